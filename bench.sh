@@ -0,0 +1,15 @@
+#!/bin/bash
+
+# stop at the first command that fails
+set -e
+
+# the bench binary is built with the same flags as everything else, since it
+# has to measure the same code that the encoder and decoder run
+FLAGS="-O2 -g -Wall -Wextra -std=c17 -pthread"
+
+./build.sh
+gcc $FLAGS src/bench.c libtransparenthuff.a -o bench
+
+# any arguments are passed on to the bench binary, for example:
+# ./bench.sh --format=json > results.json
+./bench "$@"
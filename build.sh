@@ -1,10 +1,38 @@
 #!/bin/bash
 
-# compile with debugging symbols, a lot of warnings, and the C17 standard
-gcc -g -Wall -Wextra -std=c17 \
-    src/bitbuffer.c src/huffman_tree.c src/encoder.c \
-    -o encoder
-
-gcc -g -Wall -Wextra -std=c17 \
-    src/bitbuffer.c src/huffman_tree.c src/decoder.c \
-    -o decoder
+# stop at the first command that fails
+set -e
+
+# compile with optimizations, debugging symbols, a lot of warnings, and the C17
+# standard
+FLAGS="-O2 -g -Wall -Wextra -std=c17 -pthread"
+
+# everything except for the binaries' own input/output and threads goes into
+# the library
+LIBRARY_SOURCES="src/bitbuffer.c src/huffman_tree.c src/canonical_code.c
+    src/histogram.c src/decode_table.c src/block_encoder.c src/block_decoder.c
+    src/context_model.c src/lz77.c src/adaptive_huffman.c src/dictionary.c
+    src/checksum.c src/legacy_decoder.c src/transparent_huff.c"
+
+# compile the library's sources once, as position-independent code, so that
+# the same object files can be used for both the static and shared library
+OBJECT_DIRECTORY=$(mktemp -d)
+trap 'rm -rf "$OBJECT_DIRECTORY"' EXIT
+for SOURCE in $LIBRARY_SOURCES; do
+    gcc $FLAGS -fPIC -c "$SOURCE" \
+        -o "$OBJECT_DIRECTORY/$(basename "$SOURCE" .c).o"
+done
+rm -f libtransparenthuff.a
+ar rcs libtransparenthuff.a "$OBJECT_DIRECTORY"/*.o
+gcc $FLAGS -shared "$OBJECT_DIRECTORY"/*.o -o libtransparenthuff.so
+
+# the binaries are linked with the static library, so that they work without
+# installing anything
+BINARY_SOURCES="src/file_io.c src/io_thread.c src/run_stats.c src/thread_pool.c
+    src/batch.c"
+
+gcc $FLAGS $BINARY_SOURCES src/encoder.c libtransparenthuff.a -lm -o encoder
+
+gcc $FLAGS $BINARY_SOURCES src/decoder.c libtransparenthuff.a -lm -o decoder
+
+gcc $FLAGS $BINARY_SOURCES src/huffd.c libtransparenthuff.a -lm -o huffd
@@ -0,0 +1,292 @@
+// see adaptive_huffman.h for an explanation of how the adaptive tree works
+
+#include "adaptive_huffman.h"
+#include "bitbuffer.h"
+#include "block_encoder.h"
+#include "block_format.h"
+#include <stdbool.h>
+
+// the longest possible codeword, from the root down to the deepest of 256
+// leaves
+#define MAXIMUM_ADAPTIVE_CODEWORD_LENGTH 255
+
+// start the tree that the encoder and decoder both start with, which is only
+// the NYT leaf
+void init_adaptive_huffman_tree(struct adaptive_huffman_tree *tree) {
+    tree->tree.number_of_nodes = 0;
+    tree->tree.root = add_node(&tree->tree, 0, 0);
+    tree->parents[tree->tree.root] = NO_CHILD;
+    tree->nodes_by_number[0] = tree->tree.root;
+    tree->numbers[tree->tree.root] = 0;
+    for (int i = 0; i < 256; i += 1) {
+        tree->leaves[i] = NO_CHILD;
+    }
+    tree->not_yet_transmitted = tree->tree.root;
+    tree->number_of_bytes_seen = 0;
+}
+
+// return the position of the highest-numbered node that has the same weight as
+// the node at "position". since the weights never go down from one number to
+// the next, it can be found with a binary search
+uint16_t find_leader(
+    const struct adaptive_huffman_tree *tree,
+    uint16_t position
+) {
+    uint64_t weight = tree->tree.nodes[position].weight;
+    int low = tree->numbers[position];
+    int high = tree->tree.number_of_nodes - 1;
+    while (low < high) {
+        int middle = (low + high + 1) / 2;
+        if (tree->tree.nodes[tree->nodes_by_number[middle]].weight > weight) {
+            high = middle - 1;
+        } else {
+            low = middle;
+        }
+    }
+    return tree->nodes_by_number[low];
+}
+
+// make "parent" point to "new_child" wherever it pointed to "old_child"
+void replace_child(
+    struct node *parent,
+    uint16_t old_child,
+    uint16_t new_child
+) {
+    if (parent->left_child == old_child) {
+        parent->left_child = new_child;
+    } else {
+        parent->right_child = new_child;
+    }
+}
+
+// swap the places (and numbers) of 2 nodes, along with everything below them.
+// neither of them can be the root, and neither can be above the other
+void swap_nodes(
+    struct adaptive_huffman_tree *tree,
+    uint16_t first,
+    uint16_t second
+) {
+    struct node *nodes = tree->tree.nodes;
+    uint16_t first_parent = tree->parents[first];
+    uint16_t second_parent = tree->parents[second];
+    if (first_parent == second_parent) {
+        uint16_t left_child = nodes[first_parent].left_child;
+        nodes[first_parent].left_child = nodes[first_parent].right_child;
+        nodes[first_parent].right_child = left_child;
+    } else {
+        replace_child(&nodes[first_parent], first, second);
+        replace_child(&nodes[second_parent], second, first);
+        tree->parents[first] = second_parent;
+        tree->parents[second] = first_parent;
+    }
+
+    uint16_t first_number = tree->numbers[first];
+    tree->numbers[first] = tree->numbers[second];
+    tree->numbers[second] = first_number;
+    tree->nodes_by_number[tree->numbers[first]] = first;
+    tree->nodes_by_number[tree->numbers[second]] = second;
+}
+
+// give the byte that just appeared for the first time its own leaf (with a
+// weight of 0 for now), and return the leaf's position
+uint16_t add_new_byte(
+    struct adaptive_huffman_tree *tree,
+    unsigned char byte
+) {
+    uint16_t old_not_yet_transmitted = tree->not_yet_transmitted;
+    tree->number_of_bytes_seen += 1;
+
+    // no more new bytes can come after the last one, so the NYT leaf isn't
+    // needed anymore
+    if (tree->number_of_bytes_seen == 256) {
+        tree->tree.nodes[old_not_yet_transmitted].symbol = byte;
+        tree->leaves[byte] = old_not_yet_transmitted;
+        tree->not_yet_transmitted = NO_CHILD;
+        return old_not_yet_transmitted;
+    }
+
+    uint16_t not_yet_transmitted = add_node(&tree->tree, 0, 0);
+    uint16_t leaf = add_node(&tree->tree, byte, 0);
+    tree->tree.nodes[old_not_yet_transmitted].left_child = not_yet_transmitted;
+    tree->tree.nodes[old_not_yet_transmitted].right_child = leaf;
+    tree->parents[not_yet_transmitted] = old_not_yet_transmitted;
+    tree->parents[leaf] = old_not_yet_transmitted;
+
+    // the 2 new nodes have the lowest weight, so they get the lowest numbers,
+    // and every other node's number goes up by 2
+    for (int i = tree->tree.number_of_nodes - 3; i >= 0; i -= 1) {
+        uint16_t position = tree->nodes_by_number[i];
+        tree->nodes_by_number[i + 2] = position;
+        tree->numbers[position] = i + 2;
+    }
+    tree->nodes_by_number[0] = not_yet_transmitted;
+    tree->numbers[not_yet_transmitted] = 0;
+    tree->nodes_by_number[1] = leaf;
+    tree->numbers[leaf] = 1;
+
+    tree->not_yet_transmitted = not_yet_transmitted;
+    tree->leaves[byte] = leaf;
+    return leaf;
+}
+
+// add 1 to the weight of the byte's leaf and of every node above it, moving
+// nodes around so that the tree keeps the sibling property
+void update_adaptive_huffman_tree(
+    struct adaptive_huffman_tree *tree,
+    unsigned char byte
+) {
+    uint16_t position = tree->leaves[byte];
+    if (position == NO_CHILD) {
+        position = add_new_byte(tree, byte);
+    }
+
+    while (true) {
+        uint16_t leader = find_leader(tree, position);
+        if (leader != position && leader != tree->parents[position]) {
+            swap_nodes(tree, position, leader);
+        }
+        tree->tree.nodes[position].weight += 1;
+        if (position == tree->tree.root) {
+            break;
+        }
+        position = tree->parents[position];
+    }
+}
+
+// return the length of the tree's longest codeword. a node's parent always
+// has a higher number than the node, so going from the highest number (the
+// root) to the lowest reaches every parent before its children
+int get_adaptive_tree_depth(const struct adaptive_huffman_tree *tree) {
+    unsigned char depths[MAXIMUM_NUMBER_OF_NODES];
+    int depth = 0;
+    for (int i = tree->tree.number_of_nodes - 1; i >= 0; i -= 1) {
+        uint16_t position = tree->nodes_by_number[i];
+        if (position == tree->tree.root) {
+            depths[position] = 0;
+        } else {
+            depths[position] = depths[tree->parents[position]] + 1;
+        }
+        if (depths[position] > depth) {
+            depth = depths[position];
+        }
+    }
+    return depth;
+}
+
+// write the codeword of the node at "position", which is the path to it from
+// the root. the path is found by going up from the node, so it is collected
+// from its end backward
+void write_adaptive_codeword(
+    const struct adaptive_huffman_tree *tree,
+    uint16_t position,
+    struct bit_writer *writer
+) {
+    bool path[MAXIMUM_ADAPTIVE_CODEWORD_LENGTH];
+    int path_start = MAXIMUM_ADAPTIVE_CODEWORD_LENGTH;
+    while (position != tree->tree.root) {
+        uint16_t parent = tree->parents[position];
+        path_start -= 1;
+        path[path_start] = tree->tree.nodes[parent].right_child == position;
+        position = parent;
+    }
+    bit_writer_append_bool_bits(
+        writer,
+        path + path_start,
+        MAXIMUM_ADAPTIVE_CODEWORD_LENGTH - path_start
+    );
+}
+
+// compress the block (which must have from 1 to MAXIMUM_ADAPTIVE_BLOCK_LENGTH
+// bytes) into "compressed_block", which must have room for BLOCK_HEADER_SIZE +
+// ADAPTIVE_BLOCK_BOUND(block_length) bytes, and set "compressed_block_length"
+// to the number of bytes used. the tree is updated with the block's bytes, so
+// it is ready for the next block
+void encode_adaptive_block(
+    struct adaptive_huffman_tree *tree,
+    const unsigned char *block,
+    size_t block_length,
+    unsigned char *compressed_block,
+    size_t *compressed_block_length
+) {
+    struct bit_writer writer;
+    bit_writer_init(
+        &writer,
+        compressed_block,
+        BLOCK_HEADER_SIZE + ADAPTIVE_BLOCK_BOUND(block_length)
+    );
+    bit_writer_append_bits(&writer, block_length, 32);
+    // the compressed size isn't known yet, so this is filled in at the end
+    bit_writer_append_bits(&writer, 0, 32);
+
+    for (size_t i = 0; i < block_length; i += 1) {
+        uint16_t leaf = tree->leaves[block[i]];
+        if (leaf == NO_CHILD) {
+            write_adaptive_codeword(tree, tree->not_yet_transmitted, &writer);
+            bit_writer_append_bits(&writer, block[i], 8);
+        } else {
+            write_adaptive_codeword(tree, leaf, &writer);
+        }
+        update_adaptive_huffman_tree(tree, block[i]);
+    }
+    bit_writer_flush(&writer);
+
+    *compressed_block_length = writer.position;
+    write_big_endian_32_bits(
+        &compressed_block[4],
+        writer.position - BLOCK_HEADER_SIZE
+    );
+}
+
+// decode the compressed block (parts 3 and 4 of an adaptive block, see
+// block_format.h) into "block", which must have room for "block_length" bytes.
+// the tree is updated with the block's bytes, so it is ready for the next
+// block. returns whether the decoding was successful, with the same numbers as
+// decode_block(), plus:
+// 10. a byte that had already appeared was sent as a new byte
+int decode_adaptive_block(
+    struct adaptive_huffman_tree *tree,
+    const unsigned char *compressed_block,
+    size_t compressed_block_length,
+    unsigned char *block,
+    uint32_t block_length
+) {
+    struct bit_reader reader;
+    bit_reader_init(&reader, compressed_block, compressed_block_length);
+
+    for (uint32_t i = 0; i < block_length; i += 1) {
+        // walk from the root to a leaf, 1 bit at a time
+        const struct node *nodes = tree->tree.nodes;
+        uint16_t position = tree->tree.root;
+        while (!is_leaf_node(&nodes[position])) {
+            if (reader.length == 0) {
+                bit_reader_refill(&reader);
+                if (reader.length == 0) {
+                    return 5;
+                }
+            }
+            position = bit_reader_peek_bits(&reader, 1)
+                     ? nodes[position].right_child
+                     : nodes[position].left_child;
+            bit_reader_consume_bits(&reader, 1);
+        }
+
+        if (position == tree->not_yet_transmitted) {
+            if (reader.length < 8) {
+                bit_reader_refill(&reader);
+                if (reader.length < 8) {
+                    return 5;
+                }
+            }
+            block[i] = bit_reader_peek_bits(&reader, 8);
+            bit_reader_consume_bits(&reader, 8);
+            if (tree->leaves[block[i]] != NO_CHILD) {
+                return 10;
+            }
+        } else {
+            block[i] = nodes[position].symbol;
+        }
+        update_adaptive_huffman_tree(tree, block[i]);
+    }
+
+    return 0;
+}
@@ -0,0 +1,73 @@
+// adaptive huffman coding (the FGK algorithm, after Faller, Gallager, and
+// Knuth) builds the huffman tree while the bytes are being encoded, instead of
+// counting them all first. the encoder and the decoder start with the same tree
+// and change it in the same way after every byte, so the tree never has to be
+// stored in the compressed data, and each byte can be sent as soon as it has
+// been read
+//
+// the tree starts out as a single leaf, the "not yet transmitted" (NYT) leaf,
+// which has a weight of 0 and stands for every byte that hasn't appeared yet. a
+// new byte is encoded as the NYT leaf's codeword followed by the byte's own 8
+// bits, and then the NYT leaf turns into a branch node whose children are a
+// new NYT leaf and a leaf for that byte. once the last of the 256 bytes has
+// appeared, the NYT leaf becomes that byte's leaf instead, since no more new
+// bytes can come
+//
+// after every byte, the weight of its leaf and of all of the nodes above it
+// goes up by 1. for the tree to stay a huffman tree, the nodes have to keep
+// the sibling property: they can be numbered so that the weights never go down
+// from one number to the next and each node's sibling is next to it. so the
+// nodes are kept in that order, and before a node's weight goes up, it is
+// swapped with the highest-numbered node that has the same weight (unless
+// that's its parent), which is where it needs to be for the order to still
+// hold afterward
+//
+// the tree itself is an ordinary struct huffman_tree (see huffman_tree.h), so
+// it can be printed and walked like any other tree, and the NYT leaf is the
+// leaf with a weight of 0. what the algorithm needs on top of that (each
+// node's parent, the numbering, and each byte's leaf) is kept next to it
+//
+// a codeword is the path from the root to a leaf, which isn't limited to
+// MAXIMUM_CODEWORD_LENGTH like the canonical prefix codes are. since there are
+// at most 256 leaves, it is at most 255 bits long
+
+#ifndef ADAPTIVE_HUFFMAN_H
+#define ADAPTIVE_HUFFMAN_H
+
+#include "huffman_tree.h"
+#include <stddef.h>
+#include <stdint.h>
+
+struct adaptive_huffman_tree {
+    struct huffman_tree tree;
+    // NO_CHILD for the root
+    uint16_t parents[MAXIMUM_NUMBER_OF_NODES];
+    // the positions of the nodes from the lowest number to the highest, and
+    // each node's number
+    uint16_t nodes_by_number[MAXIMUM_NUMBER_OF_NODES];
+    uint16_t numbers[MAXIMUM_NUMBER_OF_NODES];
+    // NO_CHILD for the bytes that haven't appeared yet
+    uint16_t leaves[256];
+    // NO_CHILD once all 256 bytes have appeared
+    uint16_t not_yet_transmitted;
+    int number_of_bytes_seen;
+};
+
+void init_adaptive_huffman_tree(struct adaptive_huffman_tree *tree);
+int get_adaptive_tree_depth(const struct adaptive_huffman_tree *tree);
+void encode_adaptive_block(
+    struct adaptive_huffman_tree *tree,
+    const unsigned char *block,
+    size_t block_length,
+    unsigned char *compressed_block,
+    size_t *compressed_block_length
+);
+int decode_adaptive_block(
+    struct adaptive_huffman_tree *tree,
+    const unsigned char *compressed_block,
+    size_t compressed_block_length,
+    unsigned char *block,
+    uint32_t block_length
+);
+
+#endif
@@ -0,0 +1,1162 @@
+// see batch.h for an explanation of how batch mode works
+
+// stat(), getline(), and friends are POSIX functions, not standard C ones
+#define _POSIX_C_SOURCE 200809L
+
+#include "batch.h"
+#include "adaptive_huffman.h"
+#include "block_decoder.h"
+#include "block_encoder.h"
+#include "block_format.h"
+#include "checksum.h"
+#include "context_model.h"
+#include "dictionary.h"
+#include "file_io.h"
+#include "legacy_decoder.h"
+#include "lz77.h"
+#include "run_stats.h"
+#include "thread_pool.h"
+#include "transparent_huff.h"
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// the decoder isn't told the block size, so a compressed file is small if it
+// is no bigger than the encoder's default block size
+#define SMALL_COMPRESSED_FILE_LENGTH (1024 * 1024)
+// how many small files can be waiting to be reported per thread. there are a
+// few for each worker, so that the workers still have files to go on with
+// while the main thread waits for the oldest one
+#define FILE_JOBS_PER_THREAD 4
+#define COMPRESSED_SUFFIX ".compressed"
+#define DECOMPRESSED_SUFFIX ".decompressed"
+// how many bytes of a big legacy file (see legacy_decoder.h) are decoded at
+// once before they are written
+#define LEGACY_DECODE_SIZE (512 * 1024)
+
+// the memory that belongs to each worker, which a job finds with
+// thread_pool_get_worker_number(). a worker only runs 1 job at a time, so
+// nothing else uses it at the same time
+struct batch_worker {
+    // for small files
+    struct compression_context *compression_context;
+    struct decompression_context *decompression_context;
+    unsigned char *input;
+    size_t input_capacity;
+    unsigned char *output;
+    size_t output_capacity;
+
+    // for the blocks of big files
+    struct block_encoder encoder;
+    struct block_decoder decoder;
+};
+
+// 1 small file, which is compressed or decompressed whole by 1 job
+struct file_job {
+    struct job job;
+    struct batch *batch;
+    char *path;
+    // the file's size when the main thread looked at it
+    size_t length;
+
+    // NULL if it was successful, or else what went wrong
+    const char *error_message;
+    uint64_t number_of_bytes_read;
+    uint64_t number_of_bytes_written;
+};
+
+// 1 block of a big file. the main thread finds the blocks and writes them out
+// in order, and a worker compresses or decompresses each one
+struct block_job {
+    struct job job;
+    struct batch *batch;
+    // in adaptive mode, every block of the file is compressed or decompressed
+    // with this same tree, so the blocks are done one at a time. NULL
+    // otherwise
+    struct adaptive_huffman_tree *adaptive_tree;
+    // the dictionary that every block of the file is compressed or
+    // decompressed with, or NULL for none
+    const struct dictionary *dictionary;
+
+    // the block's bytes when compressing, or parts 3 to 7 of the compressed
+    // block when decompressing, in the input file's mapping
+    const unsigned char *input;
+    size_t input_length;
+    // the number of bytes that the block decompresses to
+    uint32_t block_length;
+    // whether the file has checksums, and the block's checksum, which is
+    // added to the block when compressing, and checked when decompressing
+    bool has_checksum;
+    uint32_t checksum;
+
+    unsigned char *output;
+    size_t output_capacity;
+    size_t output_length;
+    // 0 if it was successful, or else the same numbers as the exit status of
+    // decode_block() (compressing can only run out of memory, which is 3)
+    int exit_status;
+};
+
+struct batch {
+    const struct batch_options *options;
+    // the options for compressing small files with the library
+    struct compression_options compression_options;
+    // files up to this many bytes are small
+    size_t small_file_length;
+    struct thread_pool pool;
+    struct batch_worker *workers;
+
+    // the small files that have been submitted and not reported yet, oldest
+    // first, starting at the one after the last file that was reported
+    struct file_job *file_jobs;
+    int number_of_file_jobs;
+    uint64_t number_of_files_submitted;
+    uint64_t number_of_files_reported;
+
+    struct block_job *block_jobs;
+    int number_of_block_jobs;
+
+    // the totals for the report at the end
+    uint64_t number_of_files;
+    uint64_t number_of_failed_files;
+    uint64_t number_of_bytes_read;
+    uint64_t number_of_bytes_written;
+};
+
+// where a big file is up to, while its blocks are being found
+struct big_file {
+    struct batch *batch;
+    const unsigned char *bytes;
+    size_t length;
+    size_t position;
+    // the version of the compressed file, when decompressing
+    int version;
+    // whether the file has checksums, and the checksum of the blocks so far
+    bool has_checksums;
+    uint32_t checksum;
+    struct adaptive_huffman_tree *adaptive_tree;
+    const struct dictionary *dictionary;
+    uint64_t number_of_blocks;
+    uint64_t number_of_decompressed_bytes;
+};
+
+// make sure that the memory has room for at least "length" bytes (and at least
+// 1 byte, so that it is never NULL), growing it if needed. the memory is only
+// ever grown, so that it can be reused for whatever comes next. returns
+// whether it was successful
+int reserve_memory(unsigned char **memory, size_t *capacity, size_t length) {
+    if (length == 0) {
+        length = 1;
+    }
+    if (*capacity >= length) {
+        return 0;
+    }
+    unsigned char *new_memory = realloc(*memory, length);
+    if (new_memory == NULL) {
+        return 1;
+    }
+    *memory = new_memory;
+    *capacity = length;
+    return 0;
+}
+
+// return the name of the file that the output for the file with the given
+// name goes in, which must be freed, or NULL if the memory couldn't be
+// allocated
+char *get_output_path(const char *path, bool is_compressing) {
+    size_t path_length = strlen(path);
+    size_t suffix_length = strlen(COMPRESSED_SUFFIX);
+    bool has_compressed_suffix = path_length > suffix_length
+        && strcmp(path + path_length - suffix_length, COMPRESSED_SUFFIX) == 0;
+    char *output_path = malloc(path_length + strlen(DECOMPRESSED_SUFFIX) + 1);
+    if (output_path == NULL) {
+        return NULL;
+    }
+    strcpy(output_path, path);
+    if (is_compressing) {
+        strcat(output_path, COMPRESSED_SUFFIX);
+    } else if (has_compressed_suffix) {
+        output_path[path_length - suffix_length] = '\0';
+    } else {
+        strcat(output_path, DECOMPRESSED_SUFFIX);
+    }
+    return output_path;
+}
+
+// compress the small file whole into the worker's memory. returns NULL if it
+// was successful, or else what went wrong
+const char *compress_small_file(
+    struct batch *batch,
+    struct batch_worker *worker,
+    const unsigned char *bytes,
+    size_t length,
+    size_t *output_length
+) {
+    size_t bound = get_compressed_size_bound(
+        length,
+        &batch->compression_options
+    );
+    if (reserve_memory(&worker->output, &worker->output_capacity, bound)) {
+        return "Unable to allocate memory for compressing.";
+    }
+    if (compress_buffer(
+        worker->compression_context,
+        &batch->compression_options,
+        bytes,
+        length,
+        worker->output,
+        worker->output_capacity,
+        output_length
+    )) {
+        return "Unable to allocate memory for compressing.";
+    }
+    return NULL;
+}
+
+// decompress the small file whole into the worker's memory. returns NULL if
+// it was successful, or else what went wrong
+const char *decompress_small_file(
+    struct batch_worker *worker,
+    const unsigned char *bytes,
+    size_t length,
+    size_t *output_length
+) {
+    // a block takes up at least its header and its type, however much LZ77
+    // (see lz77.h) shrinks it, so no valid file decompresses to more than that
+    // many of the biggest blocks. (get_decompressed_size() already checks the
+    // size of a legacy file, see legacy_decoder.h, which has no blocks)
+    uint64_t most_bytes = length / (BLOCK_HEADER_SIZE + 1)
+                        * (uint64_t)MAXIMUM_BLOCK_LENGTH;
+    bool is_legacy = length >= 4
+                  && get_big_endian_32_bits(bytes) != FILE_MAGIC_NUMBER;
+    uint64_t decompressed_size;
+    int decoding_exit_status = get_decompressed_size(
+        bytes,
+        length,
+        &decompressed_size
+    );
+    if (decoding_exit_status != 0) {
+        return get_decompression_error_message(decoding_exit_status);
+    } else if (!is_legacy && decompressed_size > most_bytes) {
+        return get_decompression_error_message(8);
+    }
+    if (reserve_memory(
+        &worker->output,
+        &worker->output_capacity,
+        decompressed_size
+    )) {
+        return get_decompression_error_message(3);
+    }
+    decoding_exit_status = decompress_buffer(
+        worker->decompression_context,
+        bytes,
+        length,
+        worker->output,
+        worker->output_capacity,
+        output_length
+    );
+    if (decoding_exit_status != 0) {
+        return get_decompression_error_message(decoding_exit_status);
+    }
+    return NULL;
+}
+
+// read the job's small file, compress or decompress it, and write the output
+// next to it
+void run_file_job(void *argument) {
+    struct file_job *file_job = argument;
+    struct batch *batch = file_job->batch;
+    struct batch_worker *worker = &batch->workers[
+        thread_pool_get_worker_number()
+    ];
+    file_job->error_message = NULL;
+    file_job->number_of_bytes_read = 0;
+    file_job->number_of_bytes_written = 0;
+
+    if (reserve_memory(
+        &worker->input,
+        &worker->input_capacity,
+        file_job->length
+    )) {
+        file_job->error_message = "Unable to allocate memory for the file.";
+        return;
+    }
+    // the file has to be the size that it was when the main thread looked at
+    // it, or else it might be too big to count as small
+    size_t length;
+    int reading_exit_status = read_whole_file(
+        file_job->path,
+        worker->input,
+        file_job->length,
+        &length
+    );
+    if (reading_exit_status == 1) {
+        file_job->error_message = "Could not read the file.";
+        return;
+    } else if (reading_exit_status == 2) {
+        file_job->error_message = "The file grew while it was being read.";
+        return;
+    }
+    file_job->number_of_bytes_read = length;
+
+    // a file that is only being tested is decompressed all the same, but
+    // its output is thrown away
+    size_t output_length;
+    file_job->error_message = batch->options->is_compressing
+        ? compress_small_file(
+            batch,
+            worker,
+            worker->input,
+            length,
+            &output_length
+        )
+        : decompress_small_file(worker, worker->input, length, &output_length);
+    if (file_job->error_message != NULL || batch->options->is_testing) {
+        return;
+    }
+
+    char *output_path = get_output_path(
+        file_job->path,
+        batch->options->is_compressing
+    );
+    if (output_path == NULL) {
+        file_job->error_message = "Unable to allocate memory for the file.";
+        return;
+    }
+    if (write_whole_file(output_path, worker->output, output_length)) {
+        unlink(output_path);
+        file_job->error_message = "Could not write the output file.";
+    } else {
+        file_job->number_of_bytes_written = output_length;
+    }
+    free(output_path);
+}
+
+// compress or decompress the job's block with the worker's memory
+void run_block_job(void *argument) {
+    struct block_job *block_job = argument;
+    struct batch *batch = block_job->batch;
+    struct batch_worker *worker = &batch->workers[
+        thread_pool_get_worker_number()
+    ];
+    const struct batch_options *options = batch->options;
+    block_job->exit_status = 0;
+
+    if (options->is_compressing && block_job->adaptive_tree != NULL) {
+        encode_adaptive_block(
+            block_job->adaptive_tree,
+            block_job->input,
+            block_job->input_length,
+            block_job->output,
+            &block_job->output_length
+        );
+    } else if (options->is_compressing && block_job->dictionary != NULL) {
+        encode_dictionary_block(
+            block_job->dictionary,
+            block_job->input,
+            block_job->input_length,
+            block_job->output,
+            &block_job->output_length
+        );
+    } else if (options->is_compressing) {
+        if (encode_block(
+            &worker->encoder,
+            block_job->input,
+            block_job->input_length,
+            options->codeword_length_limit,
+            options->block_type,
+            block_job->output,
+            &block_job->output_length,
+            NULL
+        )) {
+            block_job->exit_status = 3;
+        }
+    } else if (block_job->adaptive_tree != NULL) {
+        block_job->output_length = block_job->block_length;
+        block_job->exit_status = decode_adaptive_block(
+            block_job->adaptive_tree,
+            block_job->input,
+            block_job->input_length,
+            block_job->output,
+            block_job->block_length
+        );
+    } else if (block_job->dictionary != NULL) {
+        block_job->output_length = block_job->block_length;
+        block_job->exit_status = decode_dictionary_block(
+            block_job->dictionary,
+            options->use_tree_walk,
+            block_job->input,
+            block_job->input_length,
+            block_job->output,
+            block_job->block_length
+        );
+    } else {
+        block_job->output_length = block_job->block_length;
+        block_job->exit_status = decode_block(
+            &worker->decoder,
+            options->use_tree_walk,
+            block_job->input,
+            block_job->input_length,
+            block_job->output,
+            block_job->block_length
+        );
+    }
+
+    if (block_job->exit_status != 0 || !block_job->has_checksum) {
+        return;
+    }
+    if (options->is_compressing) {
+        block_job->checksum = add_block_checksum(
+            block_job->input,
+            block_job->input_length,
+            block_job->output,
+            &block_job->output_length
+        );
+    } else if (
+        update_crc32c(0, block_job->output, block_job->block_length)
+        != block_job->checksum
+    ) {
+        block_job->exit_status = 14;
+    }
+}
+
+// set up the block job for the next block of the big file, and set
+// "has_reached_end" to whether there are no blocks left. returns whether it
+// was successful, with the same numbers as the exit status of decode_block()
+int find_next_block(
+    struct big_file *file,
+    struct block_job *block_job,
+    bool *has_reached_end
+) {
+    const struct batch_options *options = file->batch->options;
+    block_job->adaptive_tree = file->adaptive_tree;
+    block_job->dictionary = file->dictionary;
+    block_job->has_checksum = file->has_checksums;
+
+    if (options->is_compressing) {
+        size_t block_size = file->batch->compression_options.block_size;
+        if (file->adaptive_tree != NULL) {
+            block_size = MAXIMUM_ADAPTIVE_BLOCK_LENGTH < block_size
+                       ? MAXIMUM_ADAPTIVE_BLOCK_LENGTH
+                       : block_size;
+        }
+        size_t block_length = file->length - file->position;
+        if (block_length > block_size) {
+            block_length = block_size;
+        }
+        *has_reached_end = block_length == 0;
+        if (*has_reached_end) {
+            return 0;
+        }
+        size_t bound = COMPRESSED_BLOCK_BOUND(block_length);
+        if (file->adaptive_tree != NULL) {
+            bound = ADAPTIVE_BLOCK_BOUND(block_length);
+        } else if (file->dictionary != NULL) {
+            bound = DICTIONARY_BLOCK_BOUND(block_length);
+        }
+        if (reserve_memory(
+            &block_job->output,
+            &block_job->output_capacity,
+            BLOCK_HEADER_SIZE + bound + BLOCK_CHECKSUM_SIZE
+        )) {
+            return 3;
+        }
+        block_job->input = file->bytes + file->position;
+        block_job->input_length = block_length;
+        block_job->block_length = block_length;
+        file->position += block_length;
+        file->number_of_decompressed_bytes += block_length;
+        return 0;
+    }
+
+    if (file->length - file->position < 4) {
+        return 1;
+    }
+    block_job->block_length = get_big_endian_32_bits(
+        file->bytes + file->position
+    );
+    file->position += 4;
+    *has_reached_end = block_job->block_length == 0;
+    if (*has_reached_end) {
+        return 0;
+    }
+    if (file->length - file->position < 4) {
+        return 1;
+    }
+    block_job->input_length = get_big_endian_32_bits(
+        file->bytes + file->position
+    );
+    file->position += 4;
+    // the block's checksum comes after the rest of it
+    size_t checksum_size = 0;
+    if (file->has_checksums) {
+        if (block_job->input_length < BLOCK_CHECKSUM_SIZE) {
+            return 1;
+        }
+        checksum_size = BLOCK_CHECKSUM_SIZE;
+        block_job->input_length -= checksum_size;
+    }
+    if (!are_block_sizes_valid_in_version(
+        file->version,
+        block_job->block_length,
+        block_job->input_length
+    )) {
+        return 1;
+    }
+    if (
+        file->length - file->position
+        < block_job->input_length + checksum_size
+    ) {
+        return 4;
+    }
+    if (reserve_memory(
+        &block_job->output,
+        &block_job->output_capacity,
+        block_job->block_length
+    )) {
+        return 3;
+    }
+    block_job->input = file->bytes + file->position;
+    file->position += block_job->input_length;
+    if (file->has_checksums) {
+        block_job->checksum = get_big_endian_32_bits(
+            file->bytes + file->position
+        );
+        file->position += BLOCK_CHECKSUM_SIZE;
+    }
+    file->number_of_decompressed_bytes += block_job->block_length;
+    return 0;
+}
+
+// hand out the blocks of the big file to the workers and write each one to
+// the output (unless it is NULL) once it is done. the blocks are submitted in
+// order, and the oldest one is always the next one to be written, so they come
+// out in order too. returns whether it was successful, with the same numbers
+// as the exit status of decode_block()
+int process_blocks(struct big_file *file, struct output_file *output) {
+    struct batch *batch = file->batch;
+    // the blocks of an adaptive file can only be done one at a time
+    int number_of_block_jobs = file->adaptive_tree != NULL
+                             ? 1
+                             : batch->number_of_block_jobs;
+    uint64_t number_of_blocks_found = 0;
+    bool has_reached_end = false;
+    int exit_status = 0;
+    while (exit_status == 0) {
+        while (
+            !has_reached_end
+            && number_of_blocks_found - file->number_of_blocks
+               < (uint64_t)number_of_block_jobs
+        ) {
+            struct block_job *block_job = &batch->block_jobs[
+                number_of_blocks_found % number_of_block_jobs
+            ];
+            exit_status = find_next_block(file, block_job, &has_reached_end);
+            if (exit_status != 0 || has_reached_end) {
+                break;
+            }
+            number_of_blocks_found += 1;
+            block_job->batch = batch;
+            block_job->job.function = &run_block_job;
+            block_job->job.argument = block_job;
+            thread_pool_submit(&batch->pool, &block_job->job);
+        }
+
+        if (file->number_of_blocks == number_of_blocks_found) {
+            break;
+        }
+        struct block_job *block_job = &batch->block_jobs[
+            file->number_of_blocks % number_of_block_jobs
+        ];
+        thread_pool_wait_for(&batch->pool, &block_job->job);
+        file->number_of_blocks += 1;
+        exit_status = block_job->exit_status;
+        if (exit_status == 0 && output != NULL) {
+            write_to_output_file(
+                output,
+                block_job->output,
+                block_job->output_length
+            );
+        }
+        if (exit_status == 0 && file->has_checksums) {
+            file->checksum = combine_crc32c(
+                file->checksum,
+                block_job->checksum,
+                block_job->block_length
+            );
+        }
+    }
+    // any blocks that are still being worked on (if there was a problem) have
+    // to be done before their memory can be used for the next file
+    while (file->number_of_blocks < number_of_blocks_found) {
+        thread_pool_wait_for(
+            &batch->pool,
+            &batch->block_jobs[
+                file->number_of_blocks % number_of_block_jobs
+            ].job
+        );
+        file->number_of_blocks += 1;
+    }
+    return exit_status;
+}
+
+// give the big file a new tree for its blocks to be compressed or decompressed
+// with in adaptive mode. returns whether the memory could be allocated
+int start_adaptive_tree(struct big_file *file) {
+    file->adaptive_tree = malloc(sizeof (*file->adaptive_tree));
+    if (file->adaptive_tree == NULL) {
+        return 1;
+    }
+    init_adaptive_huffman_tree(file->adaptive_tree);
+    return 0;
+}
+
+// compress the big file's blocks into a whole compressed file, the same as
+// the encoder does for a single file. returns whether it was successful
+int compress_big_file(struct big_file *file, struct output_file *output) {
+    const struct batch_options *options = file->batch->options;
+    if (options->is_adaptive && start_adaptive_tree(file)) {
+        return 3;
+    }
+    unsigned char file_header[FILE_HEADER_SIZE + DICTIONARY_ID_SIZE];
+    write_big_endian_32_bits(file_header, FILE_MAGIC_NUMBER);
+    file_header[4] = file->adaptive_tree != NULL
+                   ? FORMAT_VERSION_ADAPTIVE
+                   : FORMAT_VERSION;
+    size_t file_header_size = FILE_HEADER_SIZE;
+    if (options->dictionary != NULL) {
+        file_header[4] = FORMAT_VERSION_DICTIONARY;
+        write_big_endian_32_bits(
+            file_header + FILE_HEADER_SIZE,
+            options->dictionary->id
+        );
+        file_header_size += DICTIONARY_ID_SIZE;
+    }
+    file->has_checksums = options->has_checksums;
+    if (file->has_checksums) {
+        file_header[4] |= FORMAT_FLAG_CHECKSUMS;
+    }
+    write_to_output_file(output, file_header, file_header_size);
+    file->dictionary = options->dictionary;
+
+    int exit_status = process_blocks(file, output);
+    if (exit_status != 0) {
+        return exit_status;
+    }
+    unsigned char file_trailer[FILE_TRAILER_SIZE + FILE_CHECKSUM_SIZE] = {0};
+    write_big_endian_64_bits(
+        file_trailer + 4,
+        file->number_of_decompressed_bytes
+    );
+    write_big_endian_64_bits(file_trailer + 12, file->number_of_blocks);
+    write_big_endian_32_bits(file_trailer + FILE_TRAILER_SIZE, file->checksum);
+    write_to_output_file(
+        output,
+        file_trailer,
+        FILE_TRAILER_SIZE + (file->has_checksums ? FILE_CHECKSUM_SIZE : 0)
+    );
+    return 0;
+}
+
+// decompress a big legacy file (see legacy_decoder.h) on this (the main)
+// thread, since it is 1 stream instead of blocks, into the output (or nowhere,
+// if it is NULL). returns whether it was successful, with the same numbers as
+// the exit status of decode_block()
+int decompress_legacy_file(struct big_file *file, struct output_file *output) {
+    struct legacy_decoder *decoder = malloc(sizeof (*decoder));
+    unsigned char *decoded = malloc(LEGACY_DECODE_SIZE);
+    if (decoder == NULL || decoded == NULL) {
+        free(decoder);
+        free(decoded);
+        return 3;
+    }
+    init_legacy_decoder(decoder, get_big_endian_32_bits(file->bytes));
+    file->position = 4;
+    int exit_status = 0;
+    while (exit_status == 0 && get_legacy_decoding_status(decoder) != 0) {
+        size_t number_of_bytes_used;
+        size_t number_of_bytes_decoded;
+        exit_status = decode_legacy_data(
+            decoder,
+            file->bytes + file->position,
+            file->length - file->position,
+            &number_of_bytes_used,
+            decoded,
+            LEGACY_DECODE_SIZE,
+            &number_of_bytes_decoded
+        );
+        file->position += number_of_bytes_used;
+        // the file ended before all of its bytes were decoded
+        if (exit_status == 0 && number_of_bytes_decoded == 0) {
+            exit_status = get_legacy_decoding_status(decoder);
+        }
+        if (output != NULL) {
+            write_to_output_file(output, decoded, number_of_bytes_decoded);
+        }
+    }
+    free(decoder);
+    free(decoded);
+    return exit_status;
+}
+
+// decompress the big compressed file's blocks, the same as the decoder does
+// for a single file, into the output (or nowhere, if it is NULL). returns
+// whether it was successful, with the same numbers as the exit status of
+// decode_block()
+int decompress_big_file(struct big_file *file, struct output_file *output) {
+    const struct batch_options *options = file->batch->options;
+    if (file->length < 4) {
+        return 1;
+    }
+    if (get_big_endian_32_bits(file->bytes) != FILE_MAGIC_NUMBER) {
+        return decompress_legacy_file(file, output);
+    }
+    if (file->length < FILE_HEADER_SIZE) {
+        return 1;
+    }
+    file->version = file->bytes[4] & ~FORMAT_FLAGS;
+    file->has_checksums = file->bytes[4] & FORMAT_FLAG_CHECKSUMS;
+    if (!is_format_version_known(file->version)) {
+        return 7;
+    }
+    file->position = FILE_HEADER_SIZE;
+    // a file with a dictionary can only be decoded with that same dictionary
+    if (file->version == FORMAT_VERSION_DICTIONARY) {
+        if (file->length - file->position < DICTIONARY_ID_SIZE) {
+            return 1;
+        }
+        if (
+            options->dictionary == NULL
+            || options->dictionary->id
+               != get_big_endian_32_bits(file->bytes + file->position)
+        ) {
+            return 11;
+        }
+        file->position += DICTIONARY_ID_SIZE;
+        file->dictionary = options->dictionary;
+    }
+    if (
+        file->version == FORMAT_VERSION_ADAPTIVE
+        && start_adaptive_tree(file)
+    ) {
+        return 3;
+    }
+
+    int exit_status = process_blocks(file, output);
+    if (exit_status != 0) {
+        return exit_status;
+    }
+    // make sure that no blocks went missing, by checking the totals after the
+    // end marker
+    size_t checksum_size = file->has_checksums ? FILE_CHECKSUM_SIZE : 0;
+    if (file->length - file->position < FILE_TRAILER_SIZE - 4 + checksum_size) {
+        return 8;
+    }
+    const unsigned char *totals = file->bytes + file->position;
+    uint64_t total_number_of_bytes =
+        (uint64_t)get_big_endian_32_bits(totals) << 32
+        | get_big_endian_32_bits(totals + 4);
+    uint64_t total_number_of_blocks =
+        (uint64_t)get_big_endian_32_bits(totals + 8) << 32
+        | get_big_endian_32_bits(totals + 12);
+    if (
+        total_number_of_bytes != file->number_of_decompressed_bytes
+        || total_number_of_blocks != file->number_of_blocks
+    ) {
+        return 8;
+    }
+    if (
+        file->has_checksums
+        && get_big_endian_32_bits(totals + 16) != file->checksum
+    ) {
+        return 15;
+    }
+    return 0;
+}
+
+// count the file in the totals, and report it if it failed
+void report_file(
+    struct batch *batch,
+    const char *path,
+    const char *error_message,
+    uint64_t number_of_bytes_read,
+    uint64_t number_of_bytes_written
+) {
+    batch->number_of_files += 1;
+    batch->number_of_bytes_read += number_of_bytes_read;
+    batch->number_of_bytes_written += number_of_bytes_written;
+    if (error_message != NULL) {
+        batch->number_of_failed_files += 1;
+        fprintf(stderr, "Error: %s: %s\n", path, error_message);
+    }
+}
+
+// compress or decompress the big file on this (the main) thread, with the
+// workers doing its blocks. "length" is the file's size when it was looked at
+void process_big_file(struct batch *batch, const char *path, size_t length) {
+    const struct batch_options *options = batch->options;
+    struct input_file input;
+    if (open_input_file(path, &input)) {
+        report_file(batch, path, "Could not open the file.", 0, 0);
+        return;
+    }
+    // only an empty file can't be mapped into memory
+    if (input.mapped_bytes == NULL && length > 0) {
+        report_file(batch, path, "Could not map the file into memory.", 0, 0);
+        close_input_file(&input);
+        return;
+    }
+    struct big_file file = {
+        .batch = batch,
+        .bytes = input.mapped_bytes,
+        .length = input.number_of_mapped_bytes
+    };
+    // a file that is only being tested has no output file
+    if (options->is_testing) {
+        int exit_status = decompress_big_file(&file, NULL);
+        free(file.adaptive_tree);
+        report_file(
+            batch,
+            path,
+            exit_status != 0
+                ? get_decompression_error_message(exit_status)
+                : NULL,
+            input.number_of_mapped_bytes,
+            0
+        );
+        close_input_file(&input);
+        return;
+    }
+    char *output_path = get_output_path(path, options->is_compressing);
+    if (output_path == NULL) {
+        report_file(
+            batch,
+            path,
+            "Unable to allocate memory for the file.",
+            0,
+            0
+        );
+        close_input_file(&input);
+        return;
+    }
+    int file_descriptor = open(
+        output_path,
+        O_WRONLY | O_CREAT | O_TRUNC,
+        0644
+    );
+    if (file_descriptor == -1) {
+        report_file(batch, path, "Could not create the output file.", 0, 0);
+        free(output_path);
+        close_input_file(&input);
+        return;
+    }
+    struct output_file output;
+    if (open_output_file(file_descriptor, &output)) {
+        report_file(
+            batch,
+            path,
+            "Unable to allocate the output buffer.",
+            0,
+            0
+        );
+        close(file_descriptor);
+        unlink(output_path);
+        free(output_path);
+        close_input_file(&input);
+        return;
+    }
+
+    int exit_status = options->is_compressing
+                    ? compress_big_file(&file, &output)
+                    : decompress_big_file(&file, &output);
+    free(file.adaptive_tree);
+
+    bool could_write_output = !close_output_file(&output);
+    could_write_output = close(file_descriptor) == 0 && could_write_output;
+    const char *error_message = NULL;
+    if (exit_status == 3 && options->is_compressing) {
+        error_message = "Unable to allocate memory for compressing.";
+    } else if (exit_status != 0) {
+        error_message = get_decompression_error_message(exit_status);
+    } else if (!could_write_output) {
+        error_message = "Could not write the output file.";
+    }
+    if (error_message != NULL) {
+        unlink(output_path);
+    }
+    report_file(
+        batch,
+        path,
+        error_message,
+        input.number_of_mapped_bytes,
+        error_message == NULL ? output.number_of_bytes_written : 0
+    );
+    free(output_path);
+    close_input_file(&input);
+}
+
+// wait for the oldest small file that hasn't been reported yet, and report it
+void report_oldest_file_job(struct batch *batch) {
+    struct file_job *file_job = &batch->file_jobs[
+        batch->number_of_files_reported % batch->number_of_file_jobs
+    ];
+    thread_pool_wait_for(&batch->pool, &file_job->job);
+    report_file(
+        batch,
+        file_job->path,
+        file_job->error_message,
+        file_job->number_of_bytes_read,
+        file_job->number_of_bytes_written
+    );
+    free(file_job->path);
+    batch->number_of_files_reported += 1;
+}
+
+// compress or decompress the file with the given name, either as 1 job or by
+// its blocks, depending on its size
+void process_path(struct batch *batch, const char *path) {
+    struct stat status;
+    if (stat(path, &status) == -1) {
+        report_file(batch, path, "Could not open the file.", 0, 0);
+        return;
+    } else if (!S_ISREG(status.st_mode)) {
+        report_file(batch, path, "It isn't a regular file.", 0, 0);
+        return;
+    } else if ((uintmax_t)status.st_size > SIZE_MAX) {
+        report_file(batch, path, "The file is too big.", 0, 0);
+        return;
+    }
+    // the small file jobs are only needed for the output of the tree walk,
+    // which only the blocks of a big file use
+    if (
+        (size_t)status.st_size > batch->small_file_length
+        || batch->options->use_tree_walk
+    ) {
+        process_big_file(batch, path, status.st_size);
+        return;
+    }
+
+    if (
+        batch->number_of_files_submitted - batch->number_of_files_reported
+        == (uint64_t)batch->number_of_file_jobs
+    ) {
+        report_oldest_file_job(batch);
+    }
+    struct file_job *file_job = &batch->file_jobs[
+        batch->number_of_files_submitted % batch->number_of_file_jobs
+    ];
+    file_job->path = strdup(path);
+    if (file_job->path == NULL) {
+        report_file(
+            batch,
+            path,
+            "Unable to allocate memory for the file.",
+            0,
+            0
+        );
+        return;
+    }
+    file_job->batch = batch;
+    file_job->length = status.st_size;
+    file_job->job.function = &run_file_job;
+    file_job->job.argument = file_job;
+    thread_pool_submit(&batch->pool, &file_job->job);
+    batch->number_of_files_submitted += 1;
+}
+
+// allocate the memory of each worker and of the jobs. returns whether it was
+// successful
+int allocate_batch(struct batch *batch) {
+    const struct batch_options *options = batch->options;
+    int number_of_threads = options->number_of_threads;
+    batch->workers = calloc(number_of_threads, sizeof (*batch->workers));
+    batch->number_of_file_jobs = FILE_JOBS_PER_THREAD * number_of_threads;
+    batch->file_jobs = calloc(
+        batch->number_of_file_jobs,
+        sizeof (*batch->file_jobs)
+    );
+    batch->number_of_block_jobs = 2 * number_of_threads;
+    batch->block_jobs = calloc(
+        batch->number_of_block_jobs,
+        sizeof (*batch->block_jobs)
+    );
+    if (
+        batch->workers == NULL
+        || batch->file_jobs == NULL
+        || batch->block_jobs == NULL
+    ) {
+        return 1;
+    }
+
+    for (int i = 0; i < number_of_threads; i += 1) {
+        struct batch_worker *worker = &batch->workers[i];
+        init_block_decoder(&worker->decoder);
+        if (options->is_compressing) {
+            worker->compression_context = create_compression_context();
+            if (worker->compression_context == NULL) {
+                return 1;
+            }
+            // the blocks of big files are compressed with the worker's own
+            // encoder instead of the library
+            worker->encoder.sample_interval = options->sample_interval;
+        } else {
+            worker->decompression_context = create_decompression_context();
+            if (worker->decompression_context == NULL) {
+                return 1;
+            }
+            set_decompression_dictionary(
+                worker->decompression_context,
+                options->dictionary
+            );
+        }
+        if (
+            options->is_compressing
+            && options->block_type == BLOCK_TYPE_ORDER_1
+        ) {
+            worker->encoder.context_model = malloc(
+                sizeof (*worker->encoder.context_model)
+            );
+            if (worker->encoder.context_model == NULL) {
+                return 1;
+            }
+        }
+        if (
+            options->is_compressing
+            && options->block_type == BLOCK_TYPE_LZ77
+        ) {
+            worker->encoder.lz77_model = create_lz77_model(
+                options->lz77_level,
+                options->lz77_window_size
+            );
+            if (worker->encoder.lz77_model == NULL) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+void free_batch(struct batch *batch) {
+    int number_of_workers = batch->workers != NULL
+                          ? batch->options->number_of_threads
+                          : 0;
+    for (int i = 0; i < number_of_workers; i += 1) {
+        struct batch_worker *worker = &batch->workers[i];
+        free_compression_context(worker->compression_context);
+        free_decompression_context(worker->decompression_context);
+        free(worker->input);
+        free(worker->output);
+        free(worker->encoder.context_model);
+        free_lz77_model(worker->encoder.lz77_model);
+        free_block_decoder(&worker->decoder);
+    }
+    free(batch->workers);
+    free(batch->file_jobs);
+    if (batch->block_jobs != NULL) {
+        for (int i = 0; i < batch->number_of_block_jobs; i += 1) {
+            free(batch->block_jobs[i].output);
+        }
+    }
+    free(batch->block_jobs);
+}
+
+// compress or decompress every file with the given name, or if there are
+// none, every file named by a line of stdin. returns whether every file was
+// successful
+int run_batch(
+    const struct batch_options *options,
+    char **paths,
+    int number_of_paths
+) {
+    double start_time = get_time_in_seconds();
+    struct batch batch = {.options = options};
+    init_compression_options(&batch.compression_options);
+    batch.compression_options.codeword_length_limit =
+        options->codeword_length_limit;
+    batch.compression_options.block_size = options->block_size;
+    batch.compression_options.number_of_streams = get_number_of_streams(
+        options->block_type
+    );
+    batch.compression_options.is_adaptive = options->is_adaptive;
+    batch.compression_options.is_order_1 =
+        options->block_type == BLOCK_TYPE_ORDER_1;
+    batch.compression_options.lz77_level = options->lz77_level;
+    batch.compression_options.lz77_window_size = options->lz77_window_size;
+    batch.compression_options.dictionary = options->dictionary;
+    batch.compression_options.has_checksums = options->has_checksums;
+    batch.compression_options.sample_interval = options->sample_interval;
+    batch.small_file_length = options->is_compressing
+                            ? options->block_size
+                            : SMALL_COMPRESSED_FILE_LENGTH;
+
+    if (allocate_batch(&batch)) {
+        fprintf(stderr, "Error: Unable to allocate the workers' memory.\n");
+        free_batch(&batch);
+        return 1;
+    }
+    if (create_thread_pool(&batch.pool, options->number_of_threads)) {
+        fprintf(stderr, "Error: Unable to start the threads.\n");
+        free_batch(&batch);
+        return 1;
+    }
+
+    if (number_of_paths > 0) {
+        for (int i = 0; i < number_of_paths; i += 1) {
+            process_path(&batch, paths[i]);
+        }
+    } else {
+        char *line = NULL;
+        size_t line_capacity = 0;
+        ssize_t line_length;
+        while ((line_length = getline(&line, &line_capacity, stdin)) != -1) {
+            if (line_length > 0 && line[line_length - 1] == '\n') {
+                line_length -= 1;
+                line[line_length] = '\0';
+            }
+            if (line_length > 0) {
+                process_path(&batch, line);
+            }
+        }
+        free(line);
+    }
+    while (batch.number_of_files_reported < batch.number_of_files_submitted) {
+        report_oldest_file_job(&batch);
+    }
+
+    free_thread_pool(&batch.pool);
+    free_batch(&batch);
+
+    double total_seconds = get_time_in_seconds() - start_time;
+    if (options->should_print_stats) {
+        fprintf(
+            stderr,
+            "{\"program\": \"%s\", \"success\": %s, \"total_seconds\": %.6f,"
+            " \"files\": %" PRIu64 ", \"failed_files\": %" PRIu64 ","
+            " \"bytes_in\": %" PRIu64 ", \"bytes_out\": %" PRIu64 "}\n",
+            options->is_compressing ? "encoder" : "decoder",
+            batch.number_of_failed_files == 0 ? "true" : "false",
+            total_seconds,
+            batch.number_of_files,
+            batch.number_of_failed_files,
+            batch.number_of_bytes_read,
+            batch.number_of_bytes_written
+        );
+    } else {
+        fprintf(
+            stderr,
+            "%" PRIu64 " files (%" PRIu64 " failed), %" PRIu64 " bytes read,"
+            " %" PRIu64 " bytes written, %.3f seconds\n",
+            batch.number_of_files,
+            batch.number_of_failed_files,
+            batch.number_of_bytes_read,
+            batch.number_of_bytes_written,
+            total_seconds
+        );
+    }
+    return batch.number_of_failed_files > 0;
+}
@@ -0,0 +1,75 @@
+// in batch mode (--batch), the encoder or decoder works on many files in 1 run
+// instead of on 1 input that goes to stdout, so that compressing a whole
+// directory doesn't need a new process for every file. each file's output is
+// written next to it: "FILE" is compressed to "FILE.compressed", and
+// "FILE.compressed" is decompressed back to "FILE" (a file whose name doesn't
+// end in ".compressed" is decompressed to "FILE.decompressed" instead). the
+// files are either given on the command line or, if there are none, read from
+// stdin, 1 path per line, so that a list from something like find can be piped
+// in
+//
+// most files are small, so a file that fits in 1 block is 1 job for the thread
+// pool (see thread_pool.h), which compresses or decompresses the whole file in
+// 1 call to the library (see transparent_huff.h) with memory that belongs to
+// the worker that runs it. a big file would keep 1 worker busy for a long
+// time, so the main thread splits it into blocks instead, which are jobs of
+// their own, while the jobs of the small files before it keep going. since the
+// workers steal each other's jobs, none of them sit idle while there is work
+// left
+//
+// with --test, the decoder checks the files without writing any output, so
+// that a whole archive can be checked for damage without the disk space for
+// its decompressed files
+//
+// a file that can't be compressed or decompressed doesn't stop the others. each
+// one is reported on stderr with what went wrong (and its partial output is
+// removed), and the run ends with the totals for all of the files
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct dictionary;
+
+struct batch_options {
+    bool is_compressing;
+    int number_of_threads;
+    bool should_print_stats;
+
+    // for compressing
+    int codeword_length_limit;
+    // in bytes
+    size_t block_size;
+    int block_type;
+    bool is_adaptive;
+    // 0 for no LZ77 stage, and the window in bytes (see lz77.h)
+    int lz77_level;
+    size_t lz77_window_size;
+    bool has_checksums;
+    // 1 to count every byte (see histogram.h)
+    int sample_interval;
+
+    // for decompressing
+    bool use_tree_walk;
+    // with --test, each file is decompressed and checked (see checksum.h),
+    // but nothing is written
+    bool is_testing;
+
+    // the dictionary to compress every file with or to decompress files that
+    // were made with one, or NULL for none
+    const struct dictionary *dictionary;
+};
+
+int run_batch(
+    const struct batch_options *options,
+    char **paths,
+    int number_of_paths
+);
+
+// also used by huffd (see huffd.h), which names its files the same way
+int reserve_memory(unsigned char **memory, size_t *capacity, size_t length);
+char *get_output_path(const char *path, bool is_compressing);
+
+#endif
@@ -0,0 +1,574 @@
+// the bench binary measures how fast each stage of compressing and
+// decompressing a block is, so that a change to the code can be judged by its
+// numbers instead of by feel. the stages are:
+// 1. histogram: counting the bytes (see histogram.h)
+// 2. tree build: finding the code lengths with a huffman tree, or with the
+//    package-merge algorithm if the tree is too deep (see canonical_code.h)
+// 3. code assignment: making the canonical codewords from the code lengths
+// 4. encode: writing the block's header, code lengths, and codewords
+// 5. decode: turning the compressed block back into bytes, which includes
+//    reading the code lengths and creating the decode table
+//
+// the inputs are generated here instead of read from files, so that every run
+// measures exactly the same bytes. each input is compressed in blocks of the
+// same size that the encoder uses by default, and every stage is timed over
+// all of the blocks. that is repeated a few times, and the fastest time of each
+// stage is the one that is reported, since anything slower than that was
+// slowed down by something other than our code
+//
+// the speeds are given per byte of input for every stage (even the ones that
+// only work on the counts), so that the stages can be compared with each other
+// and added up. the cycles come from the processor's time-stamp counter, which
+// counts at a fixed rate, so they can be off from the actual clock cycles when
+// the processor runs faster or slower than its base frequency
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "block_decoder.h"
+#include "block_encoder.h"
+#include "block_format.h"
+#include "histogram.h"
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAS_CYCLE_COUNTER
+#endif
+
+// the input size is given in KiB
+#define DEFAULT_INPUT_SIZE (16 * 1024)
+#define MAXIMUM_INPUT_SIZE (1024 * 1024)
+#define DEFAULT_NUMBER_OF_REPETITIONS 5
+#define MAXIMUM_NUMBER_OF_REPETITIONS 1000
+// the same as the encoder's default block size
+#define BENCH_BLOCK_LENGTH (1024 * 1024)
+
+enum stage {
+    STAGE_HISTOGRAM,
+    STAGE_TREE_BUILD,
+    STAGE_CODE_ASSIGNMENT,
+    STAGE_ENCODE,
+    STAGE_DECODE,
+    NUMBER_OF_STAGES
+};
+
+const char *const stage_names[NUMBER_OF_STAGES] = {
+    "histogram",
+    "tree_build",
+    "code_assignment",
+    "encode",
+    "decode"
+};
+
+struct stage_time {
+    double seconds;
+    uint64_t cycles;
+};
+
+struct timestamp {
+    struct timespec time;
+    uint64_t cycles;
+};
+
+struct timestamp get_timestamp(void) {
+    struct timestamp timestamp;
+    clock_gettime(CLOCK_MONOTONIC, &timestamp.time);
+#ifdef HAS_CYCLE_COUNTER
+    timestamp.cycles = __rdtsc();
+#else
+    timestamp.cycles = 0;
+#endif
+    return timestamp;
+}
+
+// add the time from "start" to "end" to the stage's time
+void add_stage_time(
+    struct stage_time *stage_time,
+    const struct timestamp *start,
+    const struct timestamp *end
+) {
+    stage_time->seconds += (double)(end->time.tv_sec - start->time.tv_sec)
+                         + (end->time.tv_nsec - start->time.tv_nsec) / 1e9;
+    stage_time->cycles += end->cycles - start->cycles;
+}
+
+// return the next number of a xorshift64* generator, which is more than random
+// enough for making test data, and gives the same numbers on every machine
+uint64_t get_next_random_number(uint64_t *state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545f4914f6cdd1dULL;
+}
+
+// fill the bytes with symbols that are picked at random, where each symbol is
+// picked in proportion to its weight
+void fill_with_weighted_symbols(
+    unsigned char *bytes,
+    size_t number_of_bytes,
+    const unsigned char *symbols,
+    const uint64_t *weights,
+    int number_of_symbols,
+    uint64_t *random_state
+) {
+    uint64_t total_weight = 0;
+    for (int i = 0; i < number_of_symbols; i += 1) {
+        total_weight += weights[i];
+    }
+
+    for (size_t i = 0; i < number_of_bytes; i += 1) {
+        uint64_t point = get_next_random_number(random_state) % total_weight;
+        int symbol_index = 0;
+        while (point >= weights[symbol_index]) {
+            point -= weights[symbol_index];
+            symbol_index += 1;
+        }
+        bytes[i] = symbols[symbol_index];
+    }
+}
+
+// every byte value is equally likely, so there is almost nothing to compress
+// and every codeword is about 8 bits long
+void generate_uniform_random(
+    unsigned char *bytes,
+    size_t number_of_bytes,
+    uint64_t *random_state
+) {
+    for (size_t i = 0; i < number_of_bytes; i += 1) {
+        bytes[i] = get_next_random_number(random_state) >> 56;
+    }
+}
+
+// letters, spaces, and punctuation with about the frequencies of english text,
+// which is the kind of input that huffman coding does well on
+void generate_skewed_text(
+    unsigned char *bytes,
+    size_t number_of_bytes,
+    uint64_t *random_state
+) {
+    const unsigned char symbols[] = " etaoinshrdlcumwfgypb,.vk\njxqz";
+    const uint64_t weights[] = {
+        180, 102, 75, 65, 62, 57, 57, 53, 50, 50, 35, 33, 22, 22, 20, 19, 18,
+        16, 16, 15, 12, 10, 10, 8, 6, 5, 1, 1, 1, 1
+    };
+    fill_with_weighted_symbols(
+        bytes,
+        number_of_bytes,
+        symbols,
+        weights,
+        sizeof (weights) / sizeof (weights[0]),
+        random_state
+    );
+}
+
+// only 1 byte value, which is the smallest possible tree (see the note about
+// the extra node in README.md)
+void generate_one_unique_byte(
+    unsigned char *bytes,
+    size_t number_of_bytes,
+    uint64_t *random_state
+) {
+    (void)random_state;
+    memset(bytes, 'a', number_of_bytes);
+}
+
+// symbols whose weights are the fibonacci numbers, which makes the huffman
+// tree as deep as it can be for the number of bytes (merging the 2 lightest
+// nodes always makes a node that is merged again right away, so each symbol
+// adds a level), so the code lengths always have to be limited
+void generate_fibonacci_weighted(
+    unsigned char *bytes,
+    size_t number_of_bytes,
+    uint64_t *random_state
+) {
+    unsigned char symbols[32];
+    uint64_t weights[32];
+    for (int i = 0; i < 32; i += 1) {
+        symbols[i] = 'A' + i;
+        weights[i] = i < 2 ? 1 : weights[i - 1] + weights[i - 2];
+    }
+    fill_with_weighted_symbols(
+        bytes,
+        number_of_bytes,
+        symbols,
+        weights,
+        32,
+        random_state
+    );
+}
+
+struct bench_input {
+    const char *name;
+    void (*generate)(unsigned char *, size_t, uint64_t *);
+};
+
+const struct bench_input bench_inputs[] = {
+    {"uniform_random", generate_uniform_random},
+    {"skewed_text", generate_skewed_text},
+    {"one_unique_byte", generate_one_unique_byte},
+    {"fibonacci", generate_fibonacci_weighted}
+};
+#define NUMBER_OF_BENCH_INPUTS \
+    ((int)(sizeof (bench_inputs) / sizeof (bench_inputs[0])))
+
+struct bench_result {
+    struct stage_time stage_times[NUMBER_OF_STAGES];
+    size_t compressed_length;
+};
+
+// compress and decompress the input block by block "number_of_repetitions"
+// times, and keep the fastest time of each stage. returns 0 on success, 1 if
+// memory couldn't be allocated, and 2 if a block didn't decompress to the same
+// bytes that were compressed
+int run_bench(
+    const unsigned char *input,
+    size_t input_length,
+    int number_of_repetitions,
+    int block_type,
+    struct bench_result *result
+) {
+    unsigned char *compressed_block = malloc(
+        BLOCK_HEADER_SIZE + COMPRESSED_BLOCK_BOUND(BENCH_BLOCK_LENGTH)
+    );
+    unsigned char *decompressed_block = malloc(BENCH_BLOCK_LENGTH);
+    struct block_encoder *encoder = malloc(sizeof (*encoder));
+    struct block_decoder decoder;
+    init_block_decoder(&decoder);
+
+    int status = 0;
+    if (
+        compressed_block == NULL
+        || decompressed_block == NULL
+        || encoder == NULL
+    ) {
+        status = 1;
+    }
+
+    for (
+        int repetition = 0;
+        status == 0 && repetition < number_of_repetitions;
+        repetition += 1
+    ) {
+        struct stage_time stage_times[NUMBER_OF_STAGES] = {{0, 0}};
+        size_t compressed_length = 0;
+
+        for (
+            size_t position = 0;
+            status == 0 && position < input_length;
+            position += BENCH_BLOCK_LENGTH
+        ) {
+            const unsigned char *block = input + position;
+            size_t block_length = input_length - position;
+            if (block_length > BENCH_BLOCK_LENGTH) {
+                block_length = BENCH_BLOCK_LENGTH;
+            }
+
+            struct timestamp timestamps[NUMBER_OF_STAGES + 1];
+            timestamps[0] = get_timestamp();
+            count_byte_frequencies(
+                block,
+                block_length,
+                encoder->byte_frequencies
+            );
+            timestamps[1] = get_timestamp();
+            if (create_code_lengths(
+                encoder->byte_frequencies,
+                DEFAULT_CODEWORD_LENGTH_LIMIT,
+                encoder->code_lengths
+            )) {
+                status = 1;
+                break;
+            }
+            timestamps[2] = get_timestamp();
+            create_block_codewords(encoder);
+            timestamps[3] = get_timestamp();
+            size_t compressed_block_length;
+            write_compressed_block(
+                encoder,
+                block,
+                block_length,
+                block_type,
+                compressed_block,
+                &compressed_block_length
+            );
+            timestamps[4] = get_timestamp();
+            if (decode_block(
+                &decoder,
+                false,
+                compressed_block + BLOCK_HEADER_SIZE,
+                compressed_block_length - BLOCK_HEADER_SIZE,
+                decompressed_block,
+                block_length
+            )) {
+                status = 2;
+                break;
+            }
+            timestamps[5] = get_timestamp();
+
+            if (memcmp(block, decompressed_block, block_length) != 0) {
+                status = 2;
+                break;
+            }
+            for (int i = 0; i < NUMBER_OF_STAGES; i += 1) {
+                add_stage_time(
+                    &stage_times[i],
+                    &timestamps[i],
+                    &timestamps[i + 1]
+                );
+            }
+            compressed_length += compressed_block_length;
+        }
+
+        for (int i = 0; status == 0 && i < NUMBER_OF_STAGES; i += 1) {
+            if (
+                repetition == 0
+                || stage_times[i].seconds < result->stage_times[i].seconds
+            ) {
+                result->stage_times[i] = stage_times[i];
+            }
+        }
+        result->compressed_length = compressed_length;
+    }
+
+    free_block_decoder(&decoder);
+    free(encoder);
+    free(decompressed_block);
+    free(compressed_block);
+    return status;
+}
+
+// write the input to a file with the input's name in the directory, so that
+// the same bytes can also be run through the encoder and decoder. returns
+// whether it failed
+int write_input_file(
+    const char *directory,
+    const char *name,
+    const unsigned char *input,
+    size_t input_length
+) {
+    char path[4096];
+    if (
+        snprintf(path, sizeof (path), "%s/%s", directory, name)
+        >= (int)sizeof (path)
+    ) {
+        return 1;
+    }
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        return 1;
+    }
+    bool could_write = fwrite(input, 1, input_length, file) == input_length;
+    return fclose(file) != 0 || !could_write;
+}
+
+// print 1 row for each stage of the input's result. the cycles are left empty
+// (or null) when the processor has no cycle counter that we know how to read
+void print_bench_result(
+    bool use_json,
+    bool is_first_input,
+    const char *name,
+    size_t input_length,
+    const struct bench_result *result
+) {
+    for (int i = 0; i < NUMBER_OF_STAGES; i += 1) {
+        const struct stage_time *stage_time = &result->stage_times[i];
+        double megabytes_per_second = stage_time->seconds > 0
+                                    ? input_length / stage_time->seconds / 1e6
+                                    : 0;
+        char cycles_per_byte[32] = "";
+#ifdef HAS_CYCLE_COUNTER
+        snprintf(
+            cycles_per_byte,
+            sizeof (cycles_per_byte),
+            "%.3f",
+            input_length > 0 ? (double)stage_time->cycles / input_length : 0
+        );
+#endif
+        if (use_json) {
+            printf(
+                "%s\n    {\"input\": \"%s\", \"stage\": \"%s\","
+                " \"bytes\": %zu, \"compressed_bytes\": %zu,"
+                " \"seconds\": %.9f, \"megabytes_per_second\": %.3f,"
+                " \"cycles_per_byte\": %s}",
+                is_first_input && i == 0 ? "" : ",",
+                name,
+                stage_names[i],
+                input_length,
+                result->compressed_length,
+                stage_time->seconds,
+                megabytes_per_second,
+                cycles_per_byte[0] != '\0' ? cycles_per_byte : "null"
+            );
+        } else {
+            printf(
+                "%s,%s,%zu,%zu,%.9f,%.3f,%s\n",
+                name,
+                stage_names[i],
+                input_length,
+                result->compressed_length,
+                stage_time->seconds,
+                megabytes_per_second,
+                cycles_per_byte
+            );
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    bool use_json = false;
+    int input_size = DEFAULT_INPUT_SIZE;
+    int number_of_repetitions = DEFAULT_NUMBER_OF_REPETITIONS;
+    int block_type = BLOCK_TYPE_1_STREAM;
+    const char *corpus_directory = NULL;
+    const struct option long_options[] = {
+        {"format", required_argument, NULL, 'f'},
+        {"size", required_argument, NULL, 'n'},
+        {"repetitions", required_argument, NULL, 'r'},
+        {"streams", required_argument, NULL, 's'},
+        {"corpus-directory", required_argument, NULL, 'd'},
+        {0, 0, 0, 0}
+    };
+    int option;
+    while ((option = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+        if (option == 'f') {
+            if (strcmp(optarg, "json") == 0) {
+                use_json = true;
+            } else if (strcmp(optarg, "csv") == 0) {
+                use_json = false;
+            } else {
+                fprintf(stderr, "Error: The format must be csv or json.\n");
+                return 1;
+            }
+        } else if (option == 'n') {
+            input_size = atoi(optarg);
+            if (input_size < 1 || input_size > MAXIMUM_INPUT_SIZE) {
+                fprintf(
+                    stderr,
+                    "Error: The input size must be from 1 to %d KiB.\n",
+                    MAXIMUM_INPUT_SIZE
+                );
+                return 1;
+            }
+        } else if (option == 'r') {
+            number_of_repetitions = atoi(optarg);
+            if (
+                number_of_repetitions < 1
+                || number_of_repetitions > MAXIMUM_NUMBER_OF_REPETITIONS
+            ) {
+                fprintf(
+                    stderr,
+                    "Error: The number of repetitions must be from 1 to %d.\n",
+                    MAXIMUM_NUMBER_OF_REPETITIONS
+                );
+                return 1;
+            }
+        } else if (option == 's') {
+            block_type = get_block_type(atoi(optarg));
+            if (block_type == -1) {
+                fprintf(
+                    stderr,
+                    "Error: The number of streams must be 1, 4, or 8.\n"
+                );
+                return 1;
+            }
+        } else if (option == 'd') {
+            corpus_directory = optarg;
+        } else {
+            return 1;
+        }
+    }
+
+    if (
+        corpus_directory != NULL
+        && mkdir(corpus_directory, 0777) != 0
+        && errno != EEXIST
+    ) {
+        fprintf(stderr, "Error: Could not create the corpus directory.\n");
+        return 1;
+    }
+
+    size_t input_length = (size_t)input_size * 1024;
+    unsigned char *input = malloc(input_length);
+    if (input == NULL) {
+        fprintf(stderr, "Error: Unable to allocate the input.\n");
+        return 1;
+    }
+
+    if (use_json) {
+        printf(
+            "{\"block_size\": %d, \"repetitions\": %d,"
+            " \"streams\": %d, \"results\": [",
+            BENCH_BLOCK_LENGTH,
+            number_of_repetitions,
+            get_number_of_streams(block_type)
+        );
+    } else {
+        printf(
+            "input,stage,bytes,compressed_bytes,seconds,megabytes_per_second,"
+            "cycles_per_byte\n"
+        );
+    }
+
+    int exit_status = 0;
+    for (int i = 0; i < NUMBER_OF_BENCH_INPUTS; i += 1) {
+        // every input starts from the same seed, so it is the same on every
+        // run no matter which inputs came before it
+        uint64_t random_state = 0x9e3779b97f4a7c15ULL;
+        bench_inputs[i].generate(input, input_length, &random_state);
+
+        if (corpus_directory != NULL && write_input_file(
+            corpus_directory,
+            bench_inputs[i].name,
+            input,
+            input_length
+        )) {
+            fprintf(stderr, "Error: Could not write the corpus file.\n");
+            exit_status = 1;
+            break;
+        }
+
+        struct bench_result result;
+        int status = run_bench(
+            input,
+            input_length,
+            number_of_repetitions,
+            block_type,
+            &result
+        );
+        if (status == 1) {
+            fprintf(stderr, "Error: Unable to allocate memory.\n");
+            exit_status = 1;
+            break;
+        } else if (status == 2) {
+            fprintf(
+                stderr,
+                "Error: The %s input didn't decompress to the original"
+                " bytes.\n",
+                bench_inputs[i].name
+            );
+            exit_status = 1;
+            break;
+        }
+        print_bench_result(
+            use_json,
+            i == 0,
+            bench_inputs[i].name,
+            input_length,
+            &result
+        );
+    }
+
+    if (use_json) {
+        printf("\n]}\n");
+    }
+    free(input);
+    return exit_status;
+}
@@ -1,109 +1,212 @@
-// see bitbuffer.h for an explanation of what the bit buffer is and how it is
-// used
+// see bitbuffer.h for an explanation of what the bit writer and bit reader are
+// and how they are used
 
 #include "bitbuffer.h"
 
-// append the given bits to the end (right) of the buffer
-void buffer_append_bits(
-    struct bit_buffer *buffer,
+// start a bit writer with no bits that stores complete bytes into the given
+// memory buffer
+void bit_writer_init(
+    struct bit_writer *writer,
+    unsigned char *bytes,
+    size_t capacity
+) {
+    writer->accumulator = 0;
+    writer->length = 0;
+    writer->bytes = bytes;
+    writer->capacity = capacity;
+    writer->position = 0;
+}
+
+// append the given bits to the end (right) of the writer's bits, in pieces of
+// up to 32 bits
+void bit_writer_append_bool_bits(
+    struct bit_writer *writer,
     const bool *bits,
     int number_of_bits
 ) {
-    for (int i = 0; i < number_of_bits; i += 1) {
-        buffer->bits[i + buffer->length] = bits[i];
+    int i = 0;
+    while (i < number_of_bits) {
+        uint32_t piece = 0;
+        int piece_length = 0;
+        while (piece_length < 32 && i < number_of_bits) {
+            piece = (piece << 1) | bits[i];
+            piece_length += 1;
+            i += 1;
+        }
+        bit_writer_append_bits(writer, piece, piece_length);
     }
-    buffer->length += number_of_bits;
 }
 
-// append the given bit to the end (right) of the buffer
-void buffer_append_bit(struct bit_buffer *buffer, bool bit) {
-    bool bits[1] = {bit};
-    buffer_append_bits(buffer, bits, 1);
-}
+// the most bits that can be left in the accumulator of
+// append_codeword_groups() after storing its whole bytes
+#define MAXIMUM_LEFTOVER_BITS 7
 
-// append the given byte to the end (right) of the buffer
-void buffer_append_byte(struct bit_buffer *buffer, unsigned char byte) {
-    bool bits[8];
-    convert_byte_to_bits(byte, bits);
-    buffer_append_bits(buffer, bits, 8);
-}
+// append the codewords of "group_size" symbols at a time to "accumulator",
+// whose "length" bits are aligned to the left, and then store its whole bytes
+// with 1 store of 8 bytes, so that the writer only checks for room once per
+// group instead of once per codeword. group_size * the longest codeword length
+// + MAXIMUM_LEFTOVER_BITS must fit in 64 bits. returns the number of symbols
+// appended, which is a multiple of "group_size"
+static inline size_t append_codeword_groups(
+    struct bit_writer *writer,
+    uint64_t *accumulator,
+    int *length,
+    const unsigned char *symbols,
+    size_t number_of_symbols,
+    const uint32_t codewords[256],
+    const unsigned char code_lengths[256],
+    int group_size
+) {
+    size_t i = 0;
+    // each store writes 8 bytes, even though only the whole ones are counted.
+    // the others get written again (with their other bits) by the next store
+    while (
+        number_of_symbols - i >= (size_t)group_size
+        && writer->capacity - writer->position >= 8
+    ) {
+        for (int j = 0; j < group_size; j += 1) {
+            int code_length = code_lengths[symbols[i + j]];
+            *length += code_length;
+            *accumulator |= (uint64_t)codewords[symbols[i + j]]
+                         << (64 - *length);
+        }
+        i += group_size;
 
-// drop the given number of bits from the beginning (left) of the buffer
-void buffer_drop_left_bits(struct bit_buffer *buffer, int number_of_bits) {
-    assert(number_of_bits <= buffer->length);
-    for (int i = 0; i < buffer->length - number_of_bits; i += 1) {
-        buffer->bits[i] = buffer->bits[i + number_of_bits];
+        unsigned char *next = writer->bytes + writer->position;
+        for (int j = 0; j < 8; j += 1) {
+            next[j] = *accumulator >> (56 - 8 * j);
+        }
+        int number_of_bytes = *length >> 3;
+        writer->position += number_of_bytes;
+        // the shift is at most 56, since "length" was under 64
+        *accumulator <<= 8 * number_of_bytes;
+        *length &= 7;
     }
-    buffer->length -= number_of_bits;
+    return i;
 }
 
-// drop as many 8-bit slices as possible from the beginning (left) of the buffer
-// and write them to the file as bytes
+// append the codeword of each of the symbols to the end (right) of the
+// writer's bits. "codewords" and "code_lengths" are a packed table (each
+// codeword is in the lowest bits of its number, see
+// assign_canonical_codewords()), and no codeword can be longer than 15 bits
 //
-// afterward, the buffer will be left with 0 to 7 bits
-void buffer_write_any_complete_bytes(FILE *fout, struct bit_buffer *buffer) {
-    while (buffer->length >= 8) {
-        fputc(convert_bits_to_byte(buffer->bits, 8), fout);
-        buffer_drop_left_bits(buffer, 8);
+// this is the same as calling bit_writer_append_bits() for each symbol, but it
+// is what most of the time spent compressing goes to, so the codewords are
+// added several at a time to a 64-bit accumulator (4 at a time, or 3 if any
+// codeword is 15 bits long) and stored with 1 store each. the last few
+// symbols (and any that don't have room for a whole 8-byte store) go through
+// bit_writer_append_bits() as usual
+void bit_writer_append_codewords(
+    struct bit_writer *writer,
+    const unsigned char *symbols,
+    size_t number_of_symbols,
+    const uint32_t codewords[256],
+    const unsigned char code_lengths[256]
+) {
+    int longest_code_length = 0;
+    for (int i = 0; i < 256; i += 1) {
+        if (code_lengths[i] > longest_code_length) {
+            longest_code_length = code_lengths[i];
+        }
+    }
+
+    // move the writer's bits to the left side, where the loop below wants
+    // them, and first store enough of them that at most 7 are left
+    while (writer->length >= 8) {
+        writer->length -= 8;
+        writer->bytes[writer->position] = writer->accumulator >> writer->length;
+        writer->position += 1;
+    }
+    uint64_t accumulator = writer->length == 0
+        ? 0
+        : writer->accumulator << (64 - writer->length);
+    int length = writer->length;
+
+    size_t i;
+    if (4 * longest_code_length + MAXIMUM_LEFTOVER_BITS <= 64) {
+        i = append_codeword_groups(
+            writer,
+            &accumulator,
+            &length,
+            symbols,
+            number_of_symbols,
+            codewords,
+            code_lengths,
+            4
+        );
+    } else {
+        i = append_codeword_groups(
+            writer,
+            &accumulator,
+            &length,
+            symbols,
+            number_of_symbols,
+            codewords,
+            code_lengths,
+            3
+        );
+    }
+
+    // back to the right side for bit_writer_append_bits()
+    writer->accumulator = length == 0 ? 0 : accumulator >> (64 - length);
+    writer->length = length;
+    for (; i < number_of_symbols; i += 1) {
+        bit_writer_append_bits(
+            writer,
+            codewords[symbols[i]],
+            code_lengths[symbols[i]]
+        );
     }
 }
 
-// assume buffer_write_any_complete_bytes() has already been called so that the
-// buffer has 0 to 7 bits in it
+// store all of the writer's remaining bits into its memory buffer. if the last
+// byte is incomplete, it is padded on the right with bits of value 0
 //
-// if there is at least 1 bit in the buffer, drop the remaining 1 to 7 bits from
-// the buffer and write them to the file as 1 byte that is constructed by
-// convert_bits_to_byte()
+// for example, if the 2 bits {0, 1} are left, then 0b01000000 would be the
+// last byte stored
 //
-// afterward, the buffer will empty
-void buffer_write_any_leftover_bits_as_byte(
-    FILE *fout,
-    struct bit_buffer *buffer
-) {
-    assert(buffer->length < 8);
-    if (buffer->length > 0) {
-        fputc(convert_bits_to_byte(buffer->bits, buffer->length), fout);
-        buffer->length = 0;
+// afterward, the writer will have no bits, so anything appended after this
+// starts at a byte boundary
+void bit_writer_flush(struct bit_writer *writer) {
+    while (writer->length >= 8) {
+        writer->length -= 8;
+        writer->bytes[writer->position] = writer->accumulator >> writer->length;
+        writer->position += 1;
+    }
+    if (writer->length > 0) {
+        writer->bytes[writer->position] = writer->accumulator
+                                       << (8 - writer->length);
+        writer->position += 1;
     }
+    writer->accumulator = 0;
+    writer->length = 0;
 }
 
-// return the given 1 to 8 bits as 1 byte that is padded on the right with one
-// or more bits of value zero
-//
-// for example, if given the 2 bits {false, true}, then 0b01000000 would be the
-// byte returned
-unsigned char convert_bits_to_byte(const bool *bits, int number_of_bits) {
-    assert(number_of_bits >= 1 && number_of_bits <= 8);
+// start a bit reader with no loaded bits that loads bytes from the given memory
+// buffer
+void bit_reader_init(
+    struct bit_reader *reader,
+    const unsigned char *bytes,
+    size_t number_of_bytes
+) {
+    reader->accumulator = 0;
+    reader->length = 0;
+    reader->bytes = bytes;
+    reader->number_of_bytes = number_of_bytes;
+    reader->position = 0;
+}
 
-    unsigned char result = 0b00000000;
-    for (int i = 0; i < number_of_bits; i += 1) {
-        if (bits[i]) {
-            // change the i'th bit in the byte from 0 to 1
-            // example if "result" is currently 0b10000000 and "i" is 3:
-            //     result:       0b10000000 (0)
-            //     bit at i = 3: 0b00010000 (1 shifted 4 left) = (1 << (7 - i))
-            //     -------------------- ADD
-            //     result:       0b10010000
-            result += 1 << (7 - i);
-        }
-    }
-    return result;
+// consume the 0 to 7 bits that are left of the byte that the next bit is in,
+// so that the next bit is the first bit of a byte
+void bit_reader_align_to_byte(struct bit_reader *reader) {
+    // bytes are always loaded whole, so the number of loaded bits that are left
+    // tells us how far we are into the current byte
+    bit_reader_consume_bits(reader, reader->length % 8);
 }
 
-// set each bit in the bit array of size 8 to what the bit is at the
-// corresponding place in the byte
-//
-// for example, if given 0b11110001, then the bit array would become:
-// {true, true, true, true, false, false, false, true}
-void convert_byte_to_bits(unsigned char byte, bool *bits) {
-    for (int i = 0; i < 8; i += 1) {
-        // shift current bit all the way right to remove any bits to its right.
-        // since the bit is now in the 2^0 (1) place, we can check if it is 1 by
-        // seeing if the number is odd (not divisible by 2)
-        // for example, if "i" = 3 and "byte" is 0b01110010
-        //                                            ^
-        // right shift by 4 or (7 - i)           0b00000111
-        //                                                ^
-        bits[i] = ((byte >> (7 - i)) % 2 == 1);
-    }
+// return the position in the reader's memory buffer of the byte that the next
+// bit is the first bit of. bit_reader_align_to_byte() must have been called
+// first
+size_t bit_reader_get_byte_position(const struct bit_reader *reader) {
+    return reader->position - reader->length / 8;
 }
@@ -1,45 +1,163 @@
 // we are working with bits, but the smallest amount of data that can be written
-// to a file is a byte, so we need to have a bit buffer to keep adding bits to
-// until the buffer length >= 8 and we can write at least 1 byte.
+// to or read from a file is a byte, so we need a way of packing bits into bytes
+// (when writing) and unpacking bits from bytes (when reading)
 //
-// in general, bits get appended to the end of the buffer and removed from the
-// beginning of the buffer in increments of 8 when written to a file. if there
-// are any leftover (less than 8) bits, they can be "flushed" by padding the
-// right side with bits of 0 and writing the resulting byte to a file.
+// in both directions, the bits are collected in a 64-bit number called the
+// accumulator, so that adding or removing any number of bits only takes a
+// shift and an OR instead of handling each bit separately. the first bit of a
+// byte is its highest (leftmost) bit, like how we would write it out by hand
 //
-// also, the buffer is not meant to accumulate bits and then dump them when it
-// is full -- instead, callers add only as many bits as they need to the buffer
-// and then removed those bits as soon they don't need them anymore
+// the bit writer appends bits to the right of its accumulator. once the
+// accumulator has 32 or more bits in it, the leftmost 32 are stored as 4 bytes
+// into a memory buffer that the caller supplies, which must have room for all
+// of the bits that will be appended
+//
+// the bit reader works the other way around. it loads bytes from a memory
+// buffer that the caller supplies into the left side of its accumulator (up to
+// 8 bytes at a time), and the caller can then peek at and consume bits from the
+// left side. if the caller consumes more bits than were loaded, the missing
+// bits are treated as 0, and bit_reader_bits_left() becomes negative so that
+// the caller can tell
+
+#ifndef BITBUFFER_H
+#define BITBUFFER_H
 
-#include <assert.h>
 #include <stdbool.h>
-#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct bit_writer {
+    // the bits that have not been stored yet, aligned to the right
+    uint64_t accumulator;
+    // the number of bits in the accumulator, which is always under 32 between
+    // calls to bit_writer_append_bits()
+    int length;
+
+    // the caller's memory buffer that complete bytes are stored into
+    unsigned char *bytes;
+    size_t capacity;
+    size_t position;
+};
 
-struct bit_buffer {
+struct bit_reader {
+    // the bits that have been loaded but not consumed yet, aligned to the left
+    uint64_t accumulator;
+    // the number of loaded bits in the accumulator
     int length;
-    // i haven't done real analysis on what the maximum possible amount of bits
-    // in the buffer could be during any possible execution of the program, but
-    // i think 512 is safe because it is about double what i think the maximum
-    // possible number of bits is, which is 255 and happens during
-    // decode_data_and_write() in decoder.c
-    bool bits[512];
+
+    // the caller's memory buffer that bytes are loaded from
+    const unsigned char *bytes;
+    size_t number_of_bytes;
+    size_t position;
 };
 
-void buffer_append_bits(
-    struct bit_buffer *buffer,
+// the writer stores at most this many bytes per call to
+// bit_writer_append_bits() and bit_writer_flush(), so this is how much room the
+// caller must leave
+#define BIT_WRITER_MAXIMUM_BYTES_PER_CALL 8
+
+void bit_writer_init(
+    struct bit_writer *writer,
+    unsigned char *bytes,
+    size_t capacity
+);
+void bit_writer_append_bool_bits(
+    struct bit_writer *writer,
     const bool *bits,
     int number_of_bits
 );
-void buffer_append_bit(struct bit_buffer *buffer, bool bit);
-void buffer_append_byte(struct bit_buffer *buffer, unsigned char byte);
-
-void buffer_drop_left_bits(struct bit_buffer *buffer, int number_of_bits);
+void bit_writer_append_codewords(
+    struct bit_writer *writer,
+    const unsigned char *symbols,
+    size_t number_of_symbols,
+    const uint32_t codewords[256],
+    const unsigned char code_lengths[256]
+);
+void bit_writer_flush(struct bit_writer *writer);
 
-void buffer_write_any_complete_bytes(FILE *fout, struct bit_buffer *buffer);
-void buffer_write_any_leftover_bits_as_byte(
-    FILE *fout,
-    struct bit_buffer *buffer
+void bit_reader_init(
+    struct bit_reader *reader,
+    const unsigned char *bytes,
+    size_t number_of_bytes
 );
+void bit_reader_align_to_byte(struct bit_reader *reader);
+size_t bit_reader_get_byte_position(const struct bit_reader *reader);
+
+// the functions below are called for every codeword, so they are defined here
+// (instead of in bitbuffer.c) to let the compiler inline them
+
+// append the lowest "number_of_bits" (0 to 32) bits of "value" to the end
+// (right) of the writer's bits. "value" must not have any bits set above those
+static inline void bit_writer_append_bits(
+    struct bit_writer *writer,
+    uint32_t value,
+    int number_of_bits
+) {
+    writer->accumulator = (writer->accumulator << number_of_bits) | value;
+    writer->length += number_of_bits;
+    if (writer->length >= 32) {
+        writer->length -= 32;
+        uint32_t word = (uint32_t)(writer->accumulator >> writer->length);
+        writer->bytes[writer->position]     = word >> 24;
+        writer->bytes[writer->position + 1] = word >> 16;
+        writer->bytes[writer->position + 2] = word >> 8;
+        writer->bytes[writer->position + 3] = word;
+        writer->position += 4;
+    }
+}
+
+// load as many whole bytes as fit into the accumulator, so that it has at least
+// 56 bits (unless the reader's bytes run out)
+static inline void bit_reader_refill(struct bit_reader *reader) {
+    if (reader->number_of_bytes - reader->position >= 8) {
+        // load 8 bytes at once, even though only the ones that fully fit get
+        // counted. the bits of the byte that only partly fits are the same bits
+        // that the next refill will load into the same place, so they don't
+        // hurt anything
+        const unsigned char *next = reader->bytes + reader->position;
+        uint64_t eight_bytes = 0;
+        for (int i = 0; i < 8; i += 1) {
+            eight_bytes = (eight_bytes << 8) | next[i];
+        }
+        reader->accumulator |= eight_bytes >> reader->length;
+        reader->position += (63 - reader->length) >> 3;
+        reader->length |= 56;
+    } else {
+        while (
+            reader->length <= 56
+            && reader->position < reader->number_of_bytes
+        ) {
+            reader->accumulator |= (uint64_t)reader->bytes[reader->position]
+                                << (56 - reader->length);
+            reader->position += 1;
+            reader->length += 8;
+        }
+    }
+}
+
+// return the next "number_of_bits" (1 to 32) bits as one number, without
+// consuming them. the first bit ends up as the highest bit of the number
+static inline uint32_t bit_reader_peek_bits(
+    const struct bit_reader *reader,
+    int number_of_bits
+) {
+    return (uint32_t)(reader->accumulator >> (64 - number_of_bits));
+}
+
+// consume the next "number_of_bits" (0 to 56) bits
+static inline void bit_reader_consume_bits(
+    struct bit_reader *reader,
+    int number_of_bits
+) {
+    reader->accumulator <<= number_of_bits;
+    reader->length -= number_of_bits;
+}
+
+// return the number of bits that have not been consumed yet, including the ones
+// that have not been loaded into the accumulator yet
+static inline int64_t bit_reader_bits_left(const struct bit_reader *reader) {
+    return reader->length
+         + 8 * (int64_t)(reader->number_of_bytes - reader->position);
+}
 
-unsigned char convert_bits_to_byte(const bool *bits, int number_of_bits);
-void convert_byte_to_bits(unsigned char byte, bool *bits);
+#endif
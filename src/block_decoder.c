@@ -0,0 +1,900 @@
+// see block_decoder.h for an outline of how a block is decompressed
+
+#include "block_decoder.h"
+#include "bitbuffer.h"
+#include "block_format.h"
+#include "canonical_code.h"
+#include <stdlib.h>
+#include <string.h>
+
+// if the node is a leaf, get its symbol; else, consume the next bit and use it
+// to determine which child node to follow. returns whether the decoding was
+// successful
+int decode_codeword_recursive(
+    struct bit_reader *reader,
+    const struct huffman_tree *tree,
+    const struct node *node,
+    unsigned char *symbol
+) {
+    if (is_leaf_node(node)) {
+        *symbol = node->symbol;
+        return 0;
+    }
+
+    // we are on a branch node, but are out of bits, so we don't know which
+    // direction to go. this means that the compressed file is invalid
+    if (bit_reader_bits_left(reader) <= 0) {
+        return 1;
+    }
+
+    if (reader->length < 1) {
+        bit_reader_refill(reader);
+    }
+    const struct node *child_to_follow;
+    if (bit_reader_peek_bits(reader, 1) == 0) {
+        child_to_follow = get_left_child(tree, node);
+    } else {
+        child_to_follow = get_right_child(tree, node);
+    }
+    bit_reader_consume_bits(reader, 1);
+    return decode_codeword_recursive(reader, tree, child_to_follow, symbol);
+}
+
+// decode 1 codeword's worth of bits from the reader into its symbol by using
+// the bits as a path in the huffman tree. return whether the decoding was
+// successful
+int decode_codeword(
+    struct bit_reader *reader,
+    const struct huffman_tree *tree,
+    unsigned char *symbol
+) {
+    return decode_codeword_recursive(
+        reader,
+        tree,
+        get_root_node(tree),
+        symbol
+    );
+}
+
+// decode the bits that 1 lookup in the decode table resolves into their
+// symbols, without decoding more than "maximum_number_of_symbols" symbols. set
+// "number_of_symbols" to how many symbols were decoded. return whether the
+// decoding was successful
+int decode_codewords_with_table(
+    struct bit_reader *reader,
+    const struct decode_table *table,
+    uint32_t maximum_number_of_symbols,
+    unsigned char symbols[DECODE_TABLE_MAX_SYMBOLS_PER_ENTRY],
+    int *number_of_symbols
+) {
+    const struct decode_table_entry *entry = &table->entries[
+        bit_reader_peek_bits(reader, DECODE_TABLE_PRIMARY_BITS)
+    ];
+
+    // the codeword is longer than the primary table is wide, so follow
+    // subtables until we get to an entry that resolves it
+    while (entry->number_of_symbols == 0) {
+        // we are on a branch node, but are out of bits, so we don't know which
+        // direction to go. this means that the compressed file is invalid
+        if (entry->number_of_bits > bit_reader_bits_left(reader)) {
+            return 1;
+        }
+        bit_reader_consume_bits(reader, entry->number_of_bits);
+        bit_reader_refill(reader);
+        entry = &table->entries[
+            entry->subtable_index
+            + bit_reader_peek_bits(reader, entry->subtable_bits)
+        ];
+    }
+
+    // near the end of the data, the entry may hold more symbols than are left
+    // to decode, so only use its first one
+    int number_of_bits = entry->number_of_bits;
+    *number_of_symbols = entry->number_of_symbols;
+    if ((uint32_t)*number_of_symbols > maximum_number_of_symbols) {
+        number_of_bits = entry->first_symbol_number_of_bits;
+        *number_of_symbols = 1;
+    }
+
+    // the lookup treats missing bits as 0, so make sure that the bits it used
+    // were actually there
+    if (number_of_bits > bit_reader_bits_left(reader)) {
+        return 1;
+    }
+    bit_reader_consume_bits(reader, number_of_bits);
+    for (int i = 0; i < *number_of_symbols; i += 1) {
+        symbols[i] = entry->symbols[i];
+    }
+    return 0;
+}
+
+// decode the encoded data from the bit reader into "output". if "decode_table"
+// is NULL, each codeword is decoded by walking the huffman tree; else, by
+// looking it up in the table. returns whether the decoding was successful
+int decode_data(
+    struct bit_reader *reader,
+    const struct huffman_tree *huffman_tree,
+    const struct decode_table *decode_table,
+    unsigned char *output,
+    uint32_t number_of_bytes_to_decode
+) {
+    uint32_t number_of_bytes_decoded = 0;
+    while (number_of_bytes_decoded < number_of_bytes_to_decode) {
+        // there is not enough encoded data to decode the specified number of
+        // bytes. this means that the compressed file is invalid
+        if (bit_reader_bits_left(reader) <= 0) {
+            return 1;
+        }
+
+        // the longest codeword length possible is MAXIMUM_CODEWORD_LENGTH (see
+        // canonical_code.h), which always fits after a refill
+        bit_reader_refill(reader);
+
+        if (decode_table == NULL) {
+            if (decode_codeword(
+                reader,
+                huffman_tree,
+                &output[number_of_bytes_decoded]
+            )) {
+                return 2;
+            }
+            number_of_bytes_decoded += 1;
+        } else {
+            int number_of_symbols;
+            if (decode_codewords_with_table(
+                reader,
+                decode_table,
+                number_of_bytes_to_decode - number_of_bytes_decoded,
+                &output[number_of_bytes_decoded],
+                &number_of_symbols
+            )) {
+                return 2;
+            }
+            number_of_bytes_decoded += number_of_symbols;
+        }
+    }
+
+    return 0;
+}
+
+// decode part 6 of a block whose bytes were split into several streams (see
+// BLOCK_TYPE_4_STREAMS in block_format.h) into "output". returns whether the
+// decoding was successful, with the same numbers as decode_data()
+int decode_streams(
+    const unsigned char *bytes,
+    size_t number_of_bytes,
+    int number_of_streams,
+    const struct huffman_tree *huffman_tree,
+    const struct decode_table *decode_table,
+    unsigned char *output,
+    uint32_t number_of_bytes_to_decode
+) {
+    struct bit_reader readers[MAXIMUM_NUMBER_OF_STREAMS];
+    unsigned char *stream_outputs[MAXIMUM_NUMBER_OF_STREAMS];
+    uint32_t numbers_of_bytes_left[MAXIMUM_NUMBER_OF_STREAMS];
+
+    // use the jump table to find where each stream starts
+    size_t stream_start = 4 * (number_of_streams - 1);
+    if (number_of_bytes < stream_start) {
+        return 1;
+    }
+    uint32_t segment_length = (
+        number_of_bytes_to_decode + number_of_streams - 1
+    ) / number_of_streams;
+    for (int i = 0; i < number_of_streams; i += 1) {
+        size_t stream_size = number_of_bytes - stream_start;
+        if (i < number_of_streams - 1) {
+            uint32_t size_in_jump_table = get_big_endian_32_bits(&bytes[4 * i]);
+            // the stream would go past the end of the block
+            if (size_in_jump_table > stream_size) {
+                return 1;
+            }
+            stream_size = size_in_jump_table;
+        }
+        bit_reader_init(&readers[i], bytes + stream_start, stream_size);
+        stream_start += stream_size;
+
+        uint32_t segment_start = i * segment_length;
+        if (segment_start > number_of_bytes_to_decode) {
+            segment_start = number_of_bytes_to_decode;
+        }
+        uint32_t segment_end = segment_start + segment_length;
+        if (segment_end > number_of_bytes_to_decode) {
+            segment_end = number_of_bytes_to_decode;
+        }
+        stream_outputs[i] = output + segment_start;
+        numbers_of_bytes_left[i] = segment_end - segment_start;
+    }
+
+    // as long as every stream has room for the most symbols that 1 lookup can
+    // decode, take 1 lookup's worth from each stream in turn. the lookups of
+    // the different streams don't depend on each other, so the processor can
+    // work on them at the same time
+    //
+    // to keep this loop short, it doesn't check whether a stream runs out of
+    // bits. a stream that does just reads 0 bits, which decode_data() notices
+    // afterward
+    if (decode_table != NULL) {
+        while (true) {
+            bool every_stream_has_room = true;
+            for (int i = 0; i < number_of_streams; i += 1) {
+                if (
+                    numbers_of_bytes_left[i]
+                    < DECODE_TABLE_MAX_SYMBOLS_PER_ENTRY
+                ) {
+                    every_stream_has_room = false;
+                }
+            }
+            if (!every_stream_has_room) {
+                break;
+            }
+
+            for (int i = 0; i < number_of_streams; i += 1) {
+                bit_reader_refill(&readers[i]);
+            }
+            for (int i = 0; i < number_of_streams; i += 1) {
+                const struct decode_table_entry *entry = &decode_table->entries[
+                    bit_reader_peek_bits(&readers[i], DECODE_TABLE_PRIMARY_BITS)
+                ];
+                int number_of_symbols = entry->number_of_symbols;
+                if (number_of_symbols == 0) {
+                    // the codeword is longer than the primary table is wide
+                    if (decode_codewords_with_table(
+                        &readers[i],
+                        decode_table,
+                        numbers_of_bytes_left[i],
+                        stream_outputs[i],
+                        &number_of_symbols
+                    )) {
+                        return 2;
+                    }
+                } else {
+                    // copying all of the entry's symbols (even unused ones) is
+                    // faster than copying exactly the right number of them
+                    memcpy(
+                        stream_outputs[i],
+                        entry->symbols,
+                        DECODE_TABLE_MAX_SYMBOLS_PER_ENTRY
+                    );
+                    bit_reader_consume_bits(&readers[i], entry->number_of_bits);
+                }
+                stream_outputs[i] += number_of_symbols;
+                numbers_of_bytes_left[i] -= number_of_symbols;
+            }
+        }
+    }
+
+    // finish each stream on its own, which also checks that none of them ran
+    // out of bits
+    for (int i = 0; i < number_of_streams; i += 1) {
+        int decoding_exit_status = decode_data(
+            &readers[i],
+            huffman_tree,
+            decode_table,
+            stream_outputs[i],
+            numbers_of_bytes_left[i]
+        );
+        if (decoding_exit_status != 0) {
+            return decoding_exit_status;
+        }
+        if (bit_reader_bits_left(&readers[i]) < 0) {
+            return 2;
+        }
+    }
+
+    return 0;
+}
+
+// decode the encoded data of an order-1 block (see context_model.h) from the
+// bit reader into "output", looking up each codeword in the decode table of the
+// byte before it, or walking that table's tree if "use_tree_walk" is true.
+// returns whether the decoding was successful, with the same numbers as
+// decode_data()
+int decode_context_modeled_data(
+    struct bit_reader *reader,
+    const struct block_decoder *decoder,
+    bool use_tree_walk,
+    unsigned char *output,
+    uint32_t number_of_bytes_to_decode
+) {
+    unsigned char previous_byte = 0;
+    if (use_tree_walk) {
+        for (uint32_t i = 0; i < number_of_bytes_to_decode; i += 1) {
+            if (bit_reader_bits_left(reader) <= 0) {
+                return 1;
+            }
+            bit_reader_refill(reader);
+            if (decode_codeword(
+                reader,
+                &decoder->context_trees[
+                    decoder->table_of_context[previous_byte]
+                ],
+                &output[i]
+            )) {
+                return 2;
+            }
+            previous_byte = output[i];
+        }
+        return 0;
+    }
+
+    // which table to look in depends on the byte that was just decoded, so
+    // only the first symbol of each entry can be used. a refill leaves at
+    // least 56 bits, which is enough for 3 of the longest codewords, so the
+    // bits are refilled and checked once for every 3 codewords. a codeword that
+    // runs past the end of the data just reads 0 bits until then
+    const struct decode_table_entry *entries_of_context[256];
+    for (int i = 0; i < 256; i += 1) {
+        entries_of_context[i] = decoder->context_decode_tables[
+            decoder->table_of_context[i]
+        ].entries;
+    }
+    uint32_t number_of_bytes_decoded = 0;
+    while (number_of_bytes_decoded < number_of_bytes_to_decode) {
+        if (bit_reader_bits_left(reader) <= 0) {
+            return 1;
+        }
+        bit_reader_refill(reader);
+
+        uint32_t group_end = number_of_bytes_to_decode;
+        if (group_end - number_of_bytes_decoded > 3) {
+            group_end = number_of_bytes_decoded + 3;
+        }
+        for (uint32_t i = number_of_bytes_decoded; i < group_end; i += 1) {
+            const struct decode_table_entry *entry = &entries_of_context[
+                previous_byte
+            ][bit_reader_peek_bits(reader, DECODE_TABLE_PRIMARY_BITS)];
+            if (entry->number_of_symbols == 0) {
+                // the codeword is longer than the primary table is wide
+                int number_of_symbols;
+                if (decode_codewords_with_table(
+                    reader,
+                    &decoder->context_decode_tables[
+                        decoder->table_of_context[previous_byte]
+                    ],
+                    1,
+                    &output[i],
+                    &number_of_symbols
+                )) {
+                    return 2;
+                }
+            } else {
+                output[i] = entry->symbols[0];
+                bit_reader_consume_bits(
+                    reader,
+                    entry->first_symbol_number_of_bits
+                );
+            }
+            previous_byte = output[i];
+        }
+        number_of_bytes_decoded = group_end;
+
+        if (bit_reader_bits_left(reader) < 0) {
+            return 2;
+        }
+    }
+
+    return 0;
+}
+
+// decode the rest of an order-1 block, after its block type, from the bit
+// reader into "block". returns whether the decoding was successful, with the
+// same numbers as decode_block()
+int decode_context_modeled_block(
+    struct block_decoder *decoder,
+    bool use_tree_walk,
+    struct bit_reader *reader,
+    unsigned char *block,
+    uint32_t block_length
+) {
+    if (read_context_tables(
+        reader,
+        &decoder->number_of_context_tables,
+        decoder->table_of_context,
+        decoder->context_code_lengths
+    )) {
+        decoder->number_of_context_tables = 0;
+        return 2;
+    }
+    bit_reader_align_to_byte(reader);
+
+    if (use_tree_walk && decoder->context_trees == NULL) {
+        decoder->context_trees = malloc(
+            MAXIMUM_NUMBER_OF_CONTEXT_TABLES * sizeof (*decoder->context_trees)
+        );
+        if (decoder->context_trees == NULL) {
+            return 3;
+        }
+    }
+    for (int i = 0; i < decoder->number_of_context_tables; i += 1) {
+        if (use_tree_walk) {
+            create_tree_from_code_lengths(
+                decoder->context_code_lengths[i],
+                NULL,
+                &decoder->context_trees[i]
+            );
+        } else if (create_decode_table(
+            decoder->context_code_lengths[i],
+            &decoder->context_decode_tables[i]
+        )) {
+            return 3;
+        }
+    }
+
+    int64_t number_of_data_bits = bit_reader_bits_left(reader);
+    int decoding_exit_status = decode_context_modeled_data(
+        reader,
+        decoder,
+        use_tree_walk,
+        block,
+        block_length
+    );
+    if (decoding_exit_status != 0) {
+        return 3 + decoding_exit_status;
+    }
+    decoder->number_of_data_bits = number_of_data_bits
+                                 - bit_reader_bits_left(reader);
+    return 0;
+}
+
+// decode 1 symbol of an LZ77 block's alphabet by looking it up in the
+// alphabet's decode table, or by walking the alphabet's tree if "tree" isn't
+// NULL. the bits must have been refilled. returns whether the decoding was
+// successful
+static inline int decode_lz77_symbol(
+    struct bit_reader *reader,
+    const struct decode_table *table,
+    const struct huffman_tree *tree,
+    unsigned char *symbol
+) {
+    if (tree != NULL) {
+        return decode_codeword(reader, tree, symbol);
+    }
+    const struct decode_table_entry *entry = &table->entries[
+        bit_reader_peek_bits(reader, DECODE_TABLE_PRIMARY_BITS)
+    ];
+    if (entry->number_of_symbols == 0) {
+        // the codeword is longer than the primary table is wide
+        unsigned char symbols[DECODE_TABLE_MAX_SYMBOLS_PER_ENTRY];
+        int number_of_symbols;
+        if (decode_codewords_with_table(
+            reader,
+            table,
+            1,
+            symbols,
+            &number_of_symbols
+        )) {
+            return 1;
+        }
+        *symbol = symbols[0];
+        return 0;
+    }
+    *symbol = entry->symbols[0];
+    bit_reader_consume_bits(reader, entry->first_symbol_number_of_bits);
+    return 0;
+}
+
+// decode 1 run length, match length, or distance of an LZ77 block (see
+// lz77.h) from the given alphabet: its symbol, and then its extra bits.
+// returns whether the decoding was successful, with the same numbers as
+// decode_block()
+static inline int decode_lz77_number(
+    struct bit_reader *reader,
+    const struct block_decoder *decoder,
+    bool use_tree_walk,
+    int alphabet,
+    uint32_t *number
+) {
+    // a symbol and its extra bits take up at most 15 + 24 bits, which always
+    // fit after a refill
+    bit_reader_refill(reader);
+    unsigned char symbol;
+    if (decode_lz77_symbol(
+        reader,
+        &decoder->lz77_decode_tables[alphabet],
+        use_tree_walk ? &decoder->lz77_trees[alphabet] : NULL,
+        &symbol
+    )) {
+        return 5;
+    }
+    // the symbol is too big to be a number. this means that the compressed
+    // file is invalid
+    if (symbol >= LZ77_NUMBER_OF_NUMBER_SYMBOLS) {
+        return 13;
+    }
+    *number = get_lz77_number_base(symbol);
+    int number_of_extra_bits = get_lz77_number_extra_bits(symbol);
+    if (number_of_extra_bits > 0) {
+        // walking the tree only refills the bits that it needs
+        if (reader->length < number_of_extra_bits) {
+            bit_reader_refill(reader);
+        }
+        *number += bit_reader_peek_bits(reader, number_of_extra_bits);
+        bit_reader_consume_bits(reader, number_of_extra_bits);
+    }
+    return 0;
+}
+
+// decode "number_of_literals" literals of an LZ77 block into "output". returns
+// whether the decoding was successful, with the same numbers as decode_block()
+static inline int decode_lz77_literals(
+    struct bit_reader *reader,
+    const struct block_decoder *decoder,
+    bool use_tree_walk,
+    unsigned char *output,
+    uint32_t number_of_literals,
+    const unsigned char *output_end
+) {
+    const struct decode_table *table =
+        &decoder->lz77_decode_tables[LZ77_ALPHABET_LITERALS];
+    if (use_tree_walk) {
+        for (uint32_t i = 0; i < number_of_literals; i += 1) {
+            if (decode_codeword(
+                reader,
+                &decoder->lz77_trees[LZ77_ALPHABET_LITERALS],
+                &output[i]
+            )) {
+                return 5;
+            }
+        }
+        return 0;
+    }
+
+    // a refill leaves at least 56 bits, which is enough for 3 lookups (each
+    // of which takes up at most 15 bits), so the bits are refilled once for
+    // every 3 lookups. a codeword that runs past the end of the data just
+    // reads 0 bits, which decode_lz77_data() notices afterward
+    uint32_t position = 0;
+    while (position < number_of_literals) {
+        bit_reader_refill(reader);
+        for (int i = 0; i < 3 && position < number_of_literals; i += 1) {
+            const struct decode_table_entry *entry = &table->entries[
+                bit_reader_peek_bits(reader, DECODE_TABLE_PRIMARY_BITS)
+            ];
+            int number_of_symbols = entry->number_of_symbols;
+            if (
+                number_of_symbols != 0
+                && (uint32_t)number_of_symbols
+                   <= number_of_literals - position
+                && output_end - (output + position)
+                   >= DECODE_TABLE_MAX_SYMBOLS_PER_ENTRY
+            ) {
+                // copying all of the entry's symbols (even unused ones) is
+                // faster than copying exactly the right number of them
+                memcpy(
+                    output + position,
+                    entry->symbols,
+                    DECODE_TABLE_MAX_SYMBOLS_PER_ENTRY
+                );
+                bit_reader_consume_bits(reader, entry->number_of_bits);
+            } else if (decode_codewords_with_table(
+                reader,
+                table,
+                number_of_literals - position,
+                output + position,
+                &number_of_symbols
+            )) {
+                return 5;
+            }
+            position += number_of_symbols;
+        }
+    }
+    return 0;
+}
+
+// decode the sequences of an LZ77 block (see lz77.h) from the bit reader into
+// "output", copying each match from the bytes before it. returns whether the
+// decoding was successful, with the same numbers as decode_block()
+int decode_lz77_data(
+    struct bit_reader *reader,
+    const struct block_decoder *decoder,
+    bool use_tree_walk,
+    unsigned char *output,
+    uint32_t number_of_bytes_to_decode
+) {
+    const unsigned char *output_end = output + number_of_bytes_to_decode;
+    uint32_t position = 0;
+    while (true) {
+        // there is not enough encoded data to decode the specified number of
+        // bytes. this means that the compressed file is invalid
+        if (bit_reader_bits_left(reader) <= 0) {
+            return 4;
+        }
+
+        uint32_t run_length;
+        int decoding_exit_status = decode_lz77_number(
+            reader,
+            decoder,
+            use_tree_walk,
+            LZ77_ALPHABET_RUN_LENGTHS,
+            &run_length
+        );
+        if (decoding_exit_status != 0) {
+            return decoding_exit_status;
+        }
+        if (run_length > number_of_bytes_to_decode - position) {
+            return 13;
+        }
+        decoding_exit_status = decode_lz77_literals(
+            reader,
+            decoder,
+            use_tree_walk,
+            output + position,
+            run_length,
+            output_end
+        );
+        if (decoding_exit_status != 0) {
+            return decoding_exit_status;
+        }
+        position += run_length;
+        if (position == number_of_bytes_to_decode) {
+            break;
+        }
+
+        uint32_t match_length;
+        uint32_t distance;
+        decoding_exit_status = decode_lz77_number(
+            reader,
+            decoder,
+            use_tree_walk,
+            LZ77_ALPHABET_MATCH_LENGTHS,
+            &match_length
+        );
+        if (decoding_exit_status == 0) {
+            decoding_exit_status = decode_lz77_number(
+                reader,
+                decoder,
+                use_tree_walk,
+                LZ77_ALPHABET_DISTANCES,
+                &distance
+            );
+        }
+        if (decoding_exit_status != 0) {
+            return decoding_exit_status;
+        }
+        match_length += LZ77_MINIMUM_MATCH_LENGTH;
+        distance += 1;
+        // the match would start before the block or go past its end
+        if (
+            distance > position
+            || match_length > number_of_bytes_to_decode - position
+        ) {
+            return 13;
+        }
+        copy_lz77_match(output + position, distance, match_length, output_end);
+        position += match_length;
+    }
+
+    if (bit_reader_bits_left(reader) < 0) {
+        return 5;
+    }
+    return 0;
+}
+
+// decode the rest of an LZ77 block, after its block type, from the bit reader
+// into "block". returns whether the decoding was successful, with the same
+// numbers as decode_block()
+int decode_lz77_block(
+    struct block_decoder *decoder,
+    bool use_tree_walk,
+    struct bit_reader *reader,
+    unsigned char *block,
+    uint32_t block_length
+) {
+    for (int i = 0; i < LZ77_NUMBER_OF_ALPHABETS; i += 1) {
+        if (read_code_lengths(reader, decoder->lz77_code_lengths[i])) {
+            return 2;
+        }
+    }
+    bit_reader_align_to_byte(reader);
+
+    if (use_tree_walk && decoder->lz77_trees == NULL) {
+        decoder->lz77_trees = malloc(
+            LZ77_NUMBER_OF_ALPHABETS * sizeof (*decoder->lz77_trees)
+        );
+        if (decoder->lz77_trees == NULL) {
+            return 3;
+        }
+    }
+    for (int i = 0; i < LZ77_NUMBER_OF_ALPHABETS; i += 1) {
+        if (use_tree_walk) {
+            create_tree_from_code_lengths(
+                decoder->lz77_code_lengths[i],
+                NULL,
+                &decoder->lz77_trees[i]
+            );
+        } else if (create_decode_table(
+            decoder->lz77_code_lengths[i],
+            &decoder->lz77_decode_tables[i]
+        )) {
+            return 3;
+        }
+    }
+
+    int64_t number_of_data_bits = bit_reader_bits_left(reader);
+    int decoding_exit_status = decode_lz77_data(
+        reader,
+        decoder,
+        use_tree_walk,
+        block,
+        block_length
+    );
+    if (decoding_exit_status != 0) {
+        return decoding_exit_status;
+    }
+    decoder->number_of_data_bits = number_of_data_bits
+                                 - bit_reader_bits_left(reader);
+    return 0;
+}
+
+void init_block_decoder(struct block_decoder *decoder) {
+    init_decode_table(&decoder->decode_table);
+    decoder->block_type = BLOCK_TYPE_1_STREAM;
+    decoder->number_of_context_tables = 0;
+    for (int i = 0; i < MAXIMUM_NUMBER_OF_CONTEXT_TABLES; i += 1) {
+        init_decode_table(&decoder->context_decode_tables[i]);
+    }
+    decoder->context_trees = NULL;
+    for (int i = 0; i < LZ77_NUMBER_OF_ALPHABETS; i += 1) {
+        init_decode_table(&decoder->lz77_decode_tables[i]);
+    }
+    decoder->lz77_trees = NULL;
+}
+
+// decode the compressed block (parts 3 to 7 of a block, see block_format.h)
+// into "block", which must have room for "block_length" bytes. if
+// "use_tree_walk" is true, each codeword is decoded by walking the huffman tree
+// instead of with the decode table. returns whether the decoding was
+// successful, where each kind of problem has its own number:
+// 2. the code lengths are not those of a proper prefix code
+// 3. the memory for the decode table couldn't be allocated
+// 4. the encoded data ran out before all of the bytes were decoded
+// 5. the encoded data ran out in the middle of a codeword
+// 6. the block type is unknown
+// 13. a run of literals or a match of an LZ77 block doesn't fit in the block
+//
+// (1 is left for problems with the block's header, which the callers mostly
+// handle. it is also returned for a stored block whose size in the header
+// isn't exactly its type and its bytes)
+int decode_block(
+    struct block_decoder *decoder,
+    bool use_tree_walk,
+    const unsigned char *compressed_block,
+    size_t compressed_block_length,
+    unsigned char *block,
+    uint32_t block_length
+) {
+    struct bit_reader reader;
+    bit_reader_init(&reader, compressed_block, compressed_block_length);
+
+    bit_reader_refill(&reader);
+    int block_type = bit_reader_peek_bits(&reader, 8);
+    int number_of_streams = get_number_of_streams(block_type);
+    bit_reader_consume_bits(&reader, 8);
+    if (number_of_streams == 0) {
+        return 6;
+    }
+    decoder->block_type = block_type;
+    decoder->number_of_context_tables = 0;
+    // a stored block is exactly its type and its bytes, so anything after
+    // them means that the file is damaged
+    if (block_type == BLOCK_TYPE_STORED) {
+        if (compressed_block_length - 1 < block_length) {
+            return 4;
+        } else if (compressed_block_length - 1 > block_length) {
+            return 1;
+        }
+        memcpy(block, compressed_block + 1, block_length);
+        return 0;
+    }
+    if (block_type == BLOCK_TYPE_ORDER_1) {
+        return decode_context_modeled_block(
+            decoder,
+            use_tree_walk,
+            &reader,
+            block,
+            block_length
+        );
+    }
+    if (block_type == BLOCK_TYPE_LZ77) {
+        return decode_lz77_block(
+            decoder,
+            use_tree_walk,
+            &reader,
+            block,
+            block_length
+        );
+    }
+
+    // the code lengths are all that is needed to know the canonical prefix code
+    // that the block was encoded with
+    unsigned char *code_lengths = decoder->code_lengths;
+    if (read_code_lengths(&reader, code_lengths)) {
+        return 2;
+    }
+    // the encoded data starts at the next byte boundary
+    bit_reader_align_to_byte(&reader);
+
+    if (use_tree_walk) {
+        create_tree_from_code_lengths(
+            code_lengths,
+            NULL,
+            &decoder->huffman_tree
+        );
+    } else if (create_decode_table(code_lengths, &decoder->decode_table)) {
+        return 3;
+    }
+    const struct decode_table *decode_table = use_tree_walk
+                                            ? NULL
+                                            : &decoder->decode_table;
+
+    int decoding_exit_status;
+    if (number_of_streams == 1) {
+        decoding_exit_status = decode_data(
+            &reader,
+            &decoder->huffman_tree,
+            decode_table,
+            block,
+            block_length
+        );
+    } else {
+        size_t streams_start = bit_reader_get_byte_position(&reader);
+        decoding_exit_status = decode_streams(
+            compressed_block + streams_start,
+            compressed_block_length - streams_start,
+            number_of_streams,
+            &decoder->huffman_tree,
+            decode_table,
+            block,
+            block_length
+        );
+    }
+
+    if (decoding_exit_status != 0) {
+        return 3 + decoding_exit_status;
+    }
+    return 0;
+}
+
+// decode the compressed block of a file with a dictionary (parts 3 and 4 of
+// such a block, see block_format.h) into "block", which must have room for
+// "block_length" bytes. the dictionary's decode table (or tree, if
+// "use_tree_walk" is true) is only read, so several threads can share the
+// dictionary. returns whether the decoding was successful, with the same
+// numbers as decode_block()
+int decode_dictionary_block(
+    const struct dictionary *dictionary,
+    bool use_tree_walk,
+    const unsigned char *compressed_block,
+    size_t compressed_block_length,
+    unsigned char *block,
+    uint32_t block_length
+) {
+    struct bit_reader reader;
+    bit_reader_init(&reader, compressed_block, compressed_block_length);
+    int decoding_exit_status = decode_data(
+        &reader,
+        &dictionary->canonical_tree,
+        use_tree_walk ? NULL : &dictionary->decode_table,
+        block,
+        block_length
+    );
+    if (decoding_exit_status != 0) {
+        return 3 + decoding_exit_status;
+    }
+    return 0;
+}
+
+void free_block_decoder(struct block_decoder *decoder) {
+    free_decode_table(&decoder->decode_table);
+    for (int i = 0; i < MAXIMUM_NUMBER_OF_CONTEXT_TABLES; i += 1) {
+        free_decode_table(&decoder->context_decode_tables[i]);
+    }
+    free(decoder->context_trees);
+    decoder->context_trees = NULL;
+    for (int i = 0; i < LZ77_NUMBER_OF_ALPHABETS; i += 1) {
+        free_decode_table(&decoder->lz77_decode_tables[i]);
+    }
+    free(decoder->lz77_trees);
+    decoder->lz77_trees = NULL;
+}
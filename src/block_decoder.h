@@ -0,0 +1,80 @@
+// decompressing 1 block (see block_format.h) is the reverse of compressing it
+// (see block_encoder.h): read the code lengths, rebuild the canonical prefix
+// code from them, and then turn the codewords back into bytes, either by
+// looking them up in a decode table (see decode_table.h) or by walking the
+// huffman tree
+//
+// a block decoder holds the memory for the decode table and the tree, so that
+// decompressing many blocks can reuse it instead of allocating it every time.
+// it also keeps the block's code lengths, so that they can be looked at after
+// the block is decompressed
+//
+// an order-1 block (see context_model.h) has several prefix codes instead of
+// 1, so it gets a decode table (or tree) for each of them, and the table that
+// each codeword is looked up in is the one for the byte before it
+//
+// an LZ77 block (see lz77.h) has a prefix code for each of its 4 alphabets, so
+// it gets a decode table (or tree) for each of them too, and each match is
+// copied from the bytes that were already decoded
+//
+// a stored block (BLOCK_TYPE_STORED) has no prefix code, so its bytes are just
+// copied
+
+#ifndef BLOCK_DECODER_H
+#define BLOCK_DECODER_H
+
+#include "context_model.h"
+#include "decode_table.h"
+#include "dictionary.h"
+#include "huffman_tree.h"
+#include "lz77.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct block_decoder {
+    // the type of the last block that was decoded (see block_format.h)
+    int block_type;
+    unsigned char code_lengths[256];
+    struct decode_table decode_table;
+    struct huffman_tree huffman_tree;
+
+    // for an order-1 block, the tables of code lengths and which table each
+    // context uses. "number_of_context_tables" is 0 for every other block
+    int number_of_context_tables;
+    unsigned char table_of_context[256];
+    unsigned char context_code_lengths[MAXIMUM_NUMBER_OF_CONTEXT_TABLES][256];
+    struct decode_table context_decode_tables[MAXIMUM_NUMBER_OF_CONTEXT_TABLES];
+    // only allocated once the tree walk is used on an order-1 block
+    struct huffman_tree *context_trees;
+
+    // for an LZ77 block, the code lengths of each alphabet
+    unsigned char lz77_code_lengths[LZ77_NUMBER_OF_ALPHABETS][256];
+    struct decode_table lz77_decode_tables[LZ77_NUMBER_OF_ALPHABETS];
+    // only allocated once the tree walk is used on an LZ77 block
+    struct huffman_tree *lz77_trees;
+
+    // how many bits part 6 of an order-1 or LZ77 block took up, for --stats
+    uint64_t number_of_data_bits;
+};
+
+void init_block_decoder(struct block_decoder *decoder);
+int decode_block(
+    struct block_decoder *decoder,
+    bool use_tree_walk,
+    const unsigned char *compressed_block,
+    size_t compressed_block_length,
+    unsigned char *block,
+    uint32_t block_length
+);
+int decode_dictionary_block(
+    const struct dictionary *dictionary,
+    bool use_tree_walk,
+    const unsigned char *compressed_block,
+    size_t compressed_block_length,
+    unsigned char *block,
+    uint32_t block_length
+);
+void free_block_decoder(struct block_decoder *decoder);
+
+#endif
@@ -0,0 +1,431 @@
+// see block_encoder.h for an outline of how a block is compressed
+
+// clock_gettime() is a POSIX function, not a standard C one
+#define _POSIX_C_SOURCE 200809L
+
+#include "block_encoder.h"
+#include "bitbuffer.h"
+#include "block_format.h"
+#include "checksum.h"
+#include "context_model.h"
+#include "histogram.h"
+#include "lz77.h"
+#include <string.h>
+#include <time.h>
+
+// if the node is a leaf, create its prefix code mapping from the node's symbol
+// and the path taken to get to the node; else, attempt that for all nodes below
+void create_mapping_from_node_recursive(
+    bool *path,
+    int path_length,
+    const struct huffman_tree *tree,
+    const struct node *node,
+    struct prefix_code_mapping mappings[256]
+) {
+    if (is_leaf_node(node)) {
+        for (int i = 0; i < path_length; i += 1) {
+            mappings[node->symbol].codeword[i] = path[i];
+        }
+        mappings[node->symbol].codeword_length = path_length;
+    } else {
+        path[path_length] = false;
+        create_mapping_from_node_recursive(
+            path,
+            path_length + 1,
+            tree,
+            get_left_child(tree, node),
+            mappings
+        );
+        path[path_length] = true;
+        create_mapping_from_node_recursive(
+            path,
+            path_length + 1,
+            tree,
+            get_right_child(tree, node),
+            mappings
+        );
+    }
+}
+
+// create the prefix code mappings from the huffman tree, which must not be
+// deeper than MAXIMUM_CODEWORD_LENGTH
+void create_prefix_code_mappings(
+    const struct huffman_tree *huffman_tree,
+    struct prefix_code_mapping mappings[256]
+) {
+    for (int i = 0; i < 256; i += 1) {
+        mappings[i].symbol = i;
+        mappings[i].codeword_length = 0;
+    }
+
+    bool path[MAXIMUM_CODEWORD_LENGTH] = {false}; // initialize with all falses
+    create_mapping_from_node_recursive(
+        path,
+        0,
+        huffman_tree,
+        get_root_node(huffman_tree),
+        mappings
+    );
+}
+
+// find the code lengths of the prefix code for the given byte frequencies, with
+// no codeword longer than "codeword_length_limit". returns whether it was
+// successful
+int create_code_lengths(
+    const uint64_t byte_frequencies[256],
+    int codeword_length_limit,
+    unsigned char code_lengths[256]
+) {
+    // create a huffman tree using the bytes as the symbols and their
+    // frequencies as the weights. all we need from it is how deep each symbol
+    // is, which is the length of its codeword
+    struct huffman_tree huffman_tree;
+    create_huffman_tree(byte_frequencies, &huffman_tree);
+    get_code_lengths_from_tree(&huffman_tree, code_lengths);
+
+    // the tree is too deep, so find the best code lengths that are within the
+    // limit instead
+    if (get_longest_code_length(code_lengths) > codeword_length_limit) {
+        return limit_code_lengths(
+            byte_frequencies,
+            codeword_length_limit,
+            code_lengths
+        );
+    }
+    return 0;
+}
+
+// store the number into the 4 bytes as a big-endian 32-bit number
+void write_big_endian_32_bits(unsigned char bytes[4], uint32_t number) {
+    bytes[0] = number >> 24;
+    bytes[1] = number >> 16;
+    bytes[2] = number >> 8;
+    bytes[3] = number;
+}
+
+// store the number into the 8 bytes as a big-endian 64-bit number
+void write_big_endian_64_bits(unsigned char bytes[8], uint64_t number) {
+    write_big_endian_32_bits(bytes, number >> 32);
+    write_big_endian_32_bits(bytes + 4, number);
+}
+
+// add the checksum of the block's bytes (part 8, see block_format.h) to the
+// end of the compressed block, whichever kind it is, and count it in the
+// block's header. the compressed block needs BLOCK_CHECKSUM_SIZE bytes of room
+// after it. returns the checksum, for the checksum of all of the blocks
+uint32_t add_block_checksum(
+    const unsigned char *block,
+    size_t block_length,
+    unsigned char *compressed_block,
+    size_t *compressed_block_length
+) {
+    uint32_t checksum = update_crc32c(0, block, block_length);
+    write_big_endian_32_bits(
+        compressed_block + *compressed_block_length,
+        checksum
+    );
+    *compressed_block_length += BLOCK_CHECKSUM_SIZE;
+    write_big_endian_32_bits(
+        compressed_block + 4,
+        *compressed_block_length - BLOCK_HEADER_SIZE
+    );
+    return checksum;
+}
+
+// make the canonical codewords for the encoder's code lengths, as the packed
+// table that the block is encoded with
+void create_block_codewords(struct block_encoder *encoder) {
+    assign_canonical_codewords(encoder->code_lengths, encoder->codewords);
+}
+
+// return the number of bytes that parts 3 to 7 of a block take up when part 4
+// takes "table_size" bits and part 6 (1 stream) takes "data_size" bits
+size_t get_1_stream_block_size(uint64_t table_size, uint64_t data_size) {
+    return (8 + table_size + 7) / 8 + (data_size + 7) / 8;
+}
+
+// return the number of bytes that parts 3 to 7 of a block of the given type
+// would take up with the encoder's code lengths (or context model, for
+// BLOCK_TYPE_ORDER_1, or LZ77 model, for BLOCK_TYPE_LZ77), without writing
+// it. for a block with several streams, each stream might need 1 more byte of
+// alignment, so this can be a little more than the real size
+size_t get_block_size_from_code_lengths(
+    const struct block_encoder *encoder,
+    int block_type
+) {
+    if (block_type == BLOCK_TYPE_ORDER_1) {
+        return get_1_stream_block_size(
+            get_context_tables_size(encoder->context_model),
+            encoder->context_model->number_of_codeword_bits
+        );
+    }
+    if (block_type == BLOCK_TYPE_LZ77) {
+        return get_1_stream_block_size(
+            get_lz77_tables_size(encoder->lz77_model),
+            encoder->lz77_model->number_of_codeword_bits
+        );
+    }
+    uint64_t number_of_codeword_bits = 0;
+    for (int i = 0; i < 256; i += 1) {
+        number_of_codeword_bits += encoder->byte_frequencies[i]
+                                 * encoder->code_lengths[i];
+    }
+    size_t size = get_1_stream_block_size(
+        get_code_lengths_size(encoder->code_lengths),
+        number_of_codeword_bits
+    );
+    int number_of_streams = get_number_of_streams(block_type);
+    return size + 5 * (number_of_streams - 1);
+}
+
+// return the type that a block that was asked to be BLOCK_TYPE_ORDER_1 should
+// actually be, which is BLOCK_TYPE_ORDER_1 if the encoder's context model makes
+// it smaller than the encoder's code lengths do, or BLOCK_TYPE_1_STREAM if not.
+// the context model and the code lengths must both have been made for the
+// block
+int choose_order_1_block_type(const struct block_encoder *encoder) {
+    return get_block_size_from_code_lengths(encoder, BLOCK_TYPE_ORDER_1)
+           < get_block_size_from_code_lengths(encoder, BLOCK_TYPE_1_STREAM)
+         ? BLOCK_TYPE_ORDER_1
+         : BLOCK_TYPE_1_STREAM;
+}
+
+// the same as choose_order_1_block_type(), but for a block that was asked to be
+// BLOCK_TYPE_LZ77, whose LZ77 model must have been made for the block
+int choose_lz77_block_type(const struct block_encoder *encoder) {
+    return get_block_size_from_code_lengths(encoder, BLOCK_TYPE_LZ77)
+           < get_block_size_from_code_lengths(encoder, BLOCK_TYPE_1_STREAM)
+         ? BLOCK_TYPE_LZ77
+         : BLOCK_TYPE_1_STREAM;
+}
+
+// return BLOCK_TYPE_STORED if a block of the given type would take up at least
+// as many bytes as the block's bytes do by themselves, or else the given type.
+// the encoder's code lengths (and context model, for BLOCK_TYPE_ORDER_1, or
+// LZ77 model, for BLOCK_TYPE_LZ77) must have been made for the block
+int choose_stored_block_type(
+    const struct block_encoder *encoder,
+    size_t block_length,
+    int block_type
+) {
+    return get_block_size_from_code_lengths(encoder, block_type)
+           >= 1 + block_length
+         ? BLOCK_TYPE_STORED
+         : block_type;
+}
+
+// write the block's header and type, and then the block's bytes as they are,
+// into "compressed_block"
+void write_stored_block(
+    const unsigned char *block,
+    size_t block_length,
+    unsigned char *compressed_block,
+    size_t *compressed_block_length
+) {
+    write_big_endian_32_bits(compressed_block, block_length);
+    write_big_endian_32_bits(&compressed_block[4], 1 + block_length);
+    compressed_block[BLOCK_HEADER_SIZE] = BLOCK_TYPE_STORED;
+    memcpy(&compressed_block[BLOCK_HEADER_SIZE + 1], block, block_length);
+    *compressed_block_length = BLOCK_HEADER_SIZE + 1 + block_length;
+}
+
+// write the block's header and code lengths, and then the block's bytes
+// encoded with the encoder's prefix code, into "compressed_block". see
+// encode_block() for how much room it needs. a BLOCK_TYPE_STORED block
+// doesn't use the encoder at all
+void write_compressed_block(
+    const struct block_encoder *encoder,
+    const unsigned char *block,
+    size_t block_length,
+    int block_type,
+    unsigned char *compressed_block,
+    size_t *compressed_block_length
+) {
+    if (block_type == BLOCK_TYPE_STORED) {
+        write_stored_block(
+            block,
+            block_length,
+            compressed_block,
+            compressed_block_length
+        );
+        return;
+    }
+
+    struct bit_writer writer;
+    bit_writer_init(
+        &writer,
+        compressed_block,
+        BLOCK_HEADER_SIZE + COMPRESSED_BLOCK_BOUND(block_length)
+    );
+    bit_writer_append_bits(&writer, block_length, 32);
+    // the compressed size isn't known yet, so this is filled in at the end
+    bit_writer_append_bits(&writer, 0, 32);
+    bit_writer_append_bits(&writer, block_type, 8);
+    if (block_type == BLOCK_TYPE_ORDER_1) {
+        write_context_tables(&writer, encoder->context_model);
+    } else if (block_type == BLOCK_TYPE_LZ77) {
+        write_lz77_tables(&writer, encoder->lz77_model);
+    } else {
+        write_code_lengths(&writer, encoder->code_lengths);
+    }
+    bit_writer_flush(&writer);
+
+    // the stream sizes in the jump table aren't known yet either
+    int number_of_streams = get_number_of_streams(block_type);
+    size_t jump_table_position = writer.position;
+    for (int i = 0; i < number_of_streams - 1; i += 1) {
+        bit_writer_append_bits(&writer, 0, 32);
+    }
+
+    // each stream gets 1 segment of the block's bytes
+    size_t segment_length = (block_length + number_of_streams - 1)
+                          / number_of_streams;
+    for (int i = 0; i < number_of_streams; i += 1) {
+        size_t segment_start = i * segment_length;
+        size_t segment_end = segment_start + segment_length;
+        if (segment_start > block_length) {
+            segment_start = block_length;
+        }
+        if (segment_end > block_length) {
+            segment_end = block_length;
+        }
+
+        size_t stream_start = writer.position;
+        if (block_type == BLOCK_TYPE_ORDER_1) {
+            write_context_modeled_data(
+                block + segment_start,
+                segment_end - segment_start,
+                encoder->context_model,
+                &writer
+            );
+        } else if (block_type == BLOCK_TYPE_LZ77) {
+            write_lz77_data(block, encoder->lz77_model, &writer);
+        } else {
+            bit_writer_append_codewords(
+                &writer,
+                block + segment_start,
+                segment_end - segment_start,
+                encoder->codewords,
+                encoder->code_lengths
+            );
+        }
+        bit_writer_flush(&writer);
+        if (i < number_of_streams - 1) {
+            write_big_endian_32_bits(
+                &compressed_block[jump_table_position + 4 * i],
+                writer.position - stream_start
+            );
+        }
+    }
+
+    *compressed_block_length = writer.position;
+    write_big_endian_32_bits(
+        &compressed_block[4],
+        writer.position - BLOCK_HEADER_SIZE
+    );
+}
+
+// return the time in seconds since some fixed point in the past, or 0 when the
+// steps aren't being timed, so that the library doesn't read the clock for
+// nothing
+double get_step_time(const struct block_encoding_times *times) {
+    if (times == NULL) {
+        return 0;
+    }
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec + time.tv_nsec / 1e9;
+}
+
+// compress the block (which must have from 1 to MAXIMUM_BLOCK_LENGTH bytes)
+// into "compressed_block", which must have room for BLOCK_HEADER_SIZE +
+// COMPRESSED_BLOCK_BOUND(block_length) bytes, and set "compressed_block_length"
+// to the number of bytes used. see block_format.h for an outline of the format.
+// a "block_type" of BLOCK_TYPE_ORDER_1 (which needs the encoder to have a
+// context model) or BLOCK_TYPE_LZ77 (which needs it to have an LZ77 model)
+// only gets used if it makes the block smaller (see
+// choose_order_1_block_type()), and any block that the prefix code wouldn't
+// make smaller is stored as it is (see choose_stored_block_type()). the type
+// that the block got is left in the encoder. unless "times" is NULL, it is set
+// to how long each step took. returns whether the memory for limiting the code
+// lengths (and for the LZ77 sequences) could be allocated
+int encode_block(
+    struct block_encoder *encoder,
+    const unsigned char *block,
+    size_t block_length,
+    int codeword_length_limit,
+    int block_type,
+    unsigned char *compressed_block,
+    size_t *compressed_block_length,
+    struct block_encoding_times *times
+) {
+    double start_time = get_step_time(times);
+    sample_byte_frequencies(
+        block,
+        block_length,
+        encoder->sample_interval,
+        encoder->byte_frequencies
+    );
+    if (block_type == BLOCK_TYPE_ORDER_1) {
+        count_pair_frequencies(
+            block,
+            block_length,
+            encoder->context_model->pair_frequencies
+        );
+    }
+    double histogram_end_time = get_step_time(times);
+
+    if (create_code_lengths(
+        encoder->byte_frequencies,
+        codeword_length_limit,
+        encoder->code_lengths
+    )) {
+        return 1;
+    }
+    if (block_type == BLOCK_TYPE_ORDER_1) {
+        if (create_context_tables(
+            encoder->context_model,
+            codeword_length_limit
+        )) {
+            return 1;
+        }
+        block_type = choose_order_1_block_type(encoder);
+    }
+    if (block_type == BLOCK_TYPE_LZ77) {
+        if (create_lz77_sequences(
+            encoder->lz77_model,
+            block,
+            block_length,
+            codeword_length_limit
+        )) {
+            return 1;
+        }
+        block_type = choose_lz77_block_type(encoder);
+    }
+    block_type = choose_stored_block_type(encoder, block_length, block_type);
+    encoder->block_type = block_type;
+    double tree_build_end_time = get_step_time(times);
+
+    if (block_type != BLOCK_TYPE_STORED) {
+        create_block_codewords(encoder);
+    }
+    double code_assignment_end_time = get_step_time(times);
+    write_compressed_block(
+        encoder,
+        block,
+        block_length,
+        block_type,
+        compressed_block,
+        compressed_block_length
+    );
+
+    if (times != NULL) {
+        times->histogram_seconds = histogram_end_time - start_time;
+        times->tree_build_seconds = tree_build_end_time - histogram_end_time;
+        times->code_assignment_seconds = code_assignment_end_time
+                                       - tree_build_end_time;
+        times->encode_seconds = get_step_time(times)
+                              - code_assignment_end_time;
+    }
+    return 0;
+}
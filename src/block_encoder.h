@@ -0,0 +1,142 @@
+// compressing 1 block (see block_format.h) takes these steps:
+// 1. count how many times each byte appears in the block (see histogram.h)
+// 2. find the length of each byte's codeword from those counts, with a huffman
+//    tree (see huffman_tree.h), or with the package-merge algorithm if the
+//    tree is too deep (see canonical_code.h)
+// 3. make the canonical codewords for those lengths, as a table of 256
+//    numbers with each codeword in the lowest bits of its byte's number. the
+//    tree that they are the paths of is only made when the prefix code is
+//    printed (see print_block_job_structures() in encoder.c)
+// 4. write the block's header and code lengths, and then replace each byte of
+//    the block with its codeword from the table (see
+//    bit_writer_append_codewords() in bitbuffer.c)
+//
+// for the order-1 mode, the encoder also counts the pairs of bytes and makes a
+// context model from them (see context_model.h) between steps 2 and 3, and
+// then uses whichever of the 2 makes the block smaller. the LZ77 mode does the
+// same with the block's literals and matches (see lz77.h)
+//
+// the size that the block will take up is known from the code lengths alone,
+// so before step 3, the encoder checks whether the prefix code makes the block
+// smaller at all. if it doesn't (like for data that is already compressed),
+// steps 3 and 4 are skipped, and the block's bytes are stored as they are
+// (BLOCK_TYPE_STORED)
+//
+// the data structures from those steps are kept in a block encoder, so that
+// they can be looked at (for example, printed) after the block is compressed,
+// and so that compressing many blocks doesn't need any new memory for them
+//
+// encode_block() can also time the steps, for the encoder's --stats (see
+// run_stats.h)
+
+#ifndef BLOCK_ENCODER_H
+#define BLOCK_ENCODER_H
+
+#include "canonical_code.h"
+#include "huffman_tree.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct bit_writer;
+struct context_model;
+struct lz77_model;
+
+// a codeword spelled out bit by bit, for printing the prefix code (see
+// print_prefix_code_mappings() in encoder.c). the encoding itself uses the
+// packed codewords in the block encoder instead
+struct prefix_code_mapping {
+    // in our case, each symbol will be a unique byte
+    unsigned char symbol;
+    // representing the codeword as an array of booleans (bits) is simple to
+    // print, but it would take a loop over the bits to write it
+    //
+    // the maximum length of a huffman codeword (among a space of n symbols)
+    // is n - 1 according to
+    // https://inst.eecs.berkeley.edu/~cs170/fa18/assets/dis/dis05-sol.pdf
+    //
+    // so for our n of 256, the maximum length would be 255, but we limit it to
+    // at most MAXIMUM_CODEWORD_LENGTH (see canonical_code.h)
+    bool codeword[MAXIMUM_CODEWORD_LENGTH];
+    unsigned char codeword_length;
+};
+
+struct block_encoder {
+    uint64_t byte_frequencies[256];
+    unsigned char code_lengths[256];
+    // each codeword is in the lowest bits of its number (see
+    // assign_canonical_codewords())
+    uint32_t codewords[256];
+    // only used for BLOCK_TYPE_ORDER_1, and NULL otherwise. it is big, so the
+    // encoder's owner allocates it only when it is needed
+    struct context_model *context_model;
+    // only used for BLOCK_TYPE_LZ77, and NULL otherwise. the owner makes it
+    // with create_lz77_model(), which sets its level and window
+    struct lz77_model *lz77_model;
+    // 0 or 1 to count every byte of the block, or n to only count a sample of
+    // every n-th piece of it (see sample_byte_frequencies() in histogram.h).
+    // only used for the block types that are 1 to 8 streams
+    int sample_interval;
+    // the type that the last block actually got, since a block that was asked
+    // to be BLOCK_TYPE_ORDER_1 or BLOCK_TYPE_LZ77 gets BLOCK_TYPE_1_STREAM if
+    // that is smaller, and any block gets BLOCK_TYPE_STORED if the prefix code
+    // doesn't make it smaller
+    int block_type;
+};
+
+// how long each step of compressing a block took, in seconds. steps 2 and 3
+// are the tree build and the code assignment, which include the order-1 and
+// LZ77 models' own versions of them
+struct block_encoding_times {
+    double histogram_seconds;
+    double tree_build_seconds;
+    double code_assignment_seconds;
+    double encode_seconds;
+};
+
+void create_prefix_code_mappings(
+    const struct huffman_tree *huffman_tree,
+    struct prefix_code_mapping mappings[256]
+);
+int create_code_lengths(
+    const uint64_t byte_frequencies[256],
+    int codeword_length_limit,
+    unsigned char code_lengths[256]
+);
+void create_block_codewords(struct block_encoder *encoder);
+int choose_order_1_block_type(const struct block_encoder *encoder);
+int choose_lz77_block_type(const struct block_encoder *encoder);
+int choose_stored_block_type(
+    const struct block_encoder *encoder,
+    size_t block_length,
+    int block_type
+);
+void write_compressed_block(
+    const struct block_encoder *encoder,
+    const unsigned char *block,
+    size_t block_length,
+    int block_type,
+    unsigned char *compressed_block,
+    size_t *compressed_block_length
+);
+void write_big_endian_32_bits(unsigned char bytes[4], uint32_t number);
+void write_big_endian_64_bits(unsigned char bytes[8], uint64_t number);
+uint32_t add_block_checksum(
+    const unsigned char *block,
+    size_t block_length,
+    unsigned char *compressed_block,
+    size_t *compressed_block_length
+);
+
+int encode_block(
+    struct block_encoder *encoder,
+    const unsigned char *block,
+    size_t block_length,
+    int codeword_length_limit,
+    int block_type,
+    unsigned char *compressed_block,
+    size_t *compressed_block_length,
+    struct block_encoding_times *times
+);
+
+#endif
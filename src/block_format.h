@@ -0,0 +1,351 @@
+// compressed file format (see relevant functions for more details):
+// 1. 32 bits for the magic number FILE_MAGIC_NUMBER, which marks the file as
+//      one of ours
+// 2. 8 bits for the version of the format, FORMAT_VERSION (or
+//      FORMAT_VERSION_ADAPTIVE or FORMAT_VERSION_DICTIONARY, see below), plus
+//      FORMAT_FLAG_CHECKSUMS if the file has checksums (see below), plus
+//      FORMAT_FLAG_SEEK_INDEX if the file has a seek index (see below)
+// 3. the blocks (see below)
+// 4. 32 bits of 0 (like a block that has no bytes) to mark the end of the
+//      blocks
+// 5. 64 bits for the total number of bytes in all of the blocks before they
+//      were compressed
+//      64 bit unsigned big-endian integer
+// 6. 64 bits for the number of blocks
+//      64 bit unsigned big-endian integer
+// 6b. if the file has checksums, 32 bits for the CRC32C of all of the blocks'
+//      bytes before they were compressed
+//      32 bit unsigned big-endian integer
+//
+// 7. optionally (with --seek-index), a seek index with 1 entry for each block,
+//      in order. each entry is:
+//      a. 64 bits for where the block's header starts in the compressed file
+//           64 bit unsigned big-endian integer
+//      b. 64 bits for the total number of bytes in all of the blocks before it
+//           (where its bytes start in the decompressed data)
+//           64 bit unsigned big-endian integer
+// 8. if there is a seek index, 64 bits for its number of entries
+//      64 bit unsigned big-endian integer
+// 9. if there is a seek index, 32 bits for the magic number
+//      SEEK_INDEX_MAGIC_NUMBER
+//
+// parts 5 and 6 let the decoder check that it got all of the blocks. a block
+// can't have more than MAXIMUM_BLOCK_LENGTH bytes, so 32 bits is plenty for
+// each block, but the totals need 64 bits, since a file can be far bigger than
+// 4 GiB
+//
+// parts 7 to 9 let the decoder decompress just a range of the data (with
+// --range) by going straight to the first block that the range covers, since
+// every block starts with a fresh prefix code. they come after the totals, so
+// the decoder stops before them when it decodes the whole file, and they end
+// with a magic number so that they can be found from the end of the file. the
+// magic number alone isn't enough to tell that they are there, since a file
+// with checksums and no seek index ends with a CRC32C that could be anything,
+// so FORMAT_FLAG_SEEK_INDEX in part 2 says whether the file has them.
+// without them, the decoder can still skip the blocks before the range
+// without decoding them, by hopping from one block header to the next (see
+// below)
+//
+// the input is split into blocks of up to a chosen number of bytes, and each
+// block gets its own prefix code, so the encoder only ever needs to hold a few
+// blocks in memory and only needs to read the input once. since every block can
+// be compressed and decompressed without knowing anything about the other
+// blocks, they can also be worked on by several threads at the same time
+//
+// each block is:
+// 1. 32 bits for the number of bytes that were encoded using the prefix code
+//      (we need this to know when the encoded data stops)
+//      32 bit unsigned big-endian integer
+// 2. 32 bits for the number of bytes in parts 3 to 8 of the block
+//      (we need this to find where the next block starts without decoding
+//      this one, so that blocks can be handed out to threads right away)
+//      32 bit unsigned big-endian integer
+// 3. 8 bits for the block type, which says how part 6 is laid out
+//      (see the BLOCK_TYPE_ constants below)
+// 4. the length of each symbol's codeword in the canonical prefix code
+//      (see canonical_code.h), or for BLOCK_TYPE_ORDER_1, the tables of code
+//      lengths (see context_model.h), or for BLOCK_TYPE_LZ77, the code lengths
+//      of its 4 alphabets (see lz77.h). BLOCK_TYPE_STORED has no part 4 or 5
+// 5. 0-7 empty bits to align to byte boundary
+// 6. the block's bytes encoded with the prefix code
+// 7. 0-7 empty bits to align to byte boundary
+// 8. if the file has checksums, 32 bits for the CRC32C of the block's bytes
+//      before they were compressed
+//      32 bit unsigned big-endian integer
+//
+// adding up the sizes in part 2 gives where each block starts, so those sizes
+// work as an index of the blocks' offsets that is spread out over the file
+//
+// an adaptive file (see adaptive_huffman.h) is laid out the same way, except
+// that its version is FORMAT_VERSION_ADAPTIVE and each of its blocks is only:
+// 1. 32 bits for the number of bytes that were encoded
+//      32 bit unsigned big-endian integer
+// 2. 32 bits for the number of bytes in parts 3 and 4 of the block
+//      32 bit unsigned big-endian integer
+// 3. the block's bytes encoded with the adaptive huffman tree
+// 4. 0-7 empty bits to align to byte boundary
+//
+// there is no prefix code to store, since the tree is built up while the bytes
+// are decoded. the tree carries on from each block to the next, so the blocks
+// have to be decoded in order, but a block can be as short as the bytes that
+// were available when it was read (like a single message in a stream)
+//
+// a file that was compressed with a dictionary (see dictionary.h) has the
+// version FORMAT_VERSION_DICTIONARY, and right after the version:
+// 2b. 32 bits for the ID of the dictionary
+//      32 bit unsigned big-endian integer
+//
+// and each of its blocks is only:
+// 1. 32 bits for the number of bytes that were encoded
+//      32 bit unsigned big-endian integer
+// 2. 32 bits for the number of bytes in parts 3 and 4 of the block
+//      32 bit unsigned big-endian integer
+// 3. the block's bytes encoded with the dictionary's prefix code
+// 4. 0-7 empty bits to align to byte boundary
+//
+// the prefix code is in the dictionary, so the blocks don't need to store it,
+// which is most of what a small block would otherwise take up
+//
+// a file that was compressed with --checksum has checksums (see checksum.h),
+// whatever its version: each block ends with the checksum of its bytes (part
+// 8, which an adaptive block or a block of a file with a dictionary has right
+// after its last part, and which is counted in the block's part 2), and the
+// trailer ends with the checksum of all of the bytes (part 6b). a block's
+// checksum tells which block was damaged, and can be checked on its own, like
+// when only a range is decoded. the checksum of all of the bytes also catches
+// blocks that were swapped around
+//
+// files from before this format (and before the blocks) are in the legacy
+// format instead, which the decoder can still read (see legacy_decoder.h)
+
+#ifndef BLOCK_FORMAT_H
+#define BLOCK_FORMAT_H
+
+#include "canonical_code.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// 0x89 followed by "HUF". the first byte has its highest bit set, so that the
+// magic number can't be mistaken for text, or for the number of bytes that a
+// legacy file starts with (unless it has over 2 billion of them)
+#define FILE_MAGIC_NUMBER 0x89485546
+#define FORMAT_VERSION 1
+#define FORMAT_VERSION_ADAPTIVE 2
+#define FORMAT_VERSION_DICTIONARY 3
+// added to the version in part 2 of a file with checksums. a decoder that
+// doesn't know about checksums sees a version that it doesn't know, instead of
+// reading a block's checksum as part of its data
+#define FORMAT_FLAG_CHECKSUMS 0x80
+// added to the version in part 2 of a file with a seek index
+#define FORMAT_FLAG_SEEK_INDEX 0x40
+// all of the flags that can be added to the version in part 2
+#define FORMAT_FLAGS (FORMAT_FLAG_CHECKSUMS | FORMAT_FLAG_SEEK_INDEX)
+// the number of bytes in parts 1 and 2 of the file
+#define FILE_HEADER_SIZE 5
+// the number of bytes in part 2b of a file with a dictionary
+#define DICTIONARY_ID_SIZE 4
+// the number of bytes in parts 4 to 6 of the file
+#define FILE_TRAILER_SIZE 20
+// the number of bytes in part 6b of a file with checksums
+#define FILE_CHECKSUM_SIZE 4
+// 0x89 followed by "HUI". this only checks that the end of a file that says it
+// has a seek index (with FORMAT_FLAG_SEEK_INDEX) really is one, since a file
+// without a seek index can end with these same 4 bytes too
+#define SEEK_INDEX_MAGIC_NUMBER 0x89485549
+// the number of bytes in each entry of part 7 of the file
+#define SEEK_INDEX_ENTRY_SIZE 16
+// the number of bytes in parts 8 and 9 of the file
+#define SEEK_INDEX_FOOTER_SIZE 12
+
+// part 6 is 1 stream of codewords, one for each of the block's bytes
+#define BLOCK_TYPE_1_STREAM 0
+// the block's bytes are split into 4 (or 8) segments of the same length (except
+// for the last one, which can be shorter), and each segment is encoded into its
+// own stream that starts at a byte boundary. part 6 starts with a jump table of
+// the number of bytes in each stream except the last (each a 32 bit unsigned
+// big-endian integer), followed by the streams themselves
+//
+// since the streams don't depend on each other, the decoder can work on all of
+// them in the same loop, and the processor can overlap their table lookups
+// instead of waiting on each codeword to know where the next one starts
+#define BLOCK_TYPE_4_STREAMS 1
+#define BLOCK_TYPE_8_STREAMS 2
+// part 6 is 1 stream, but each byte's codeword comes from a prefix code that
+// depends on the byte before it, and part 4 holds several sets of code lengths
+// and which one each byte uses (see context_model.h). the encoder only uses
+// this type when it makes the block smaller than BLOCK_TYPE_1_STREAM would, so
+// COMPRESSED_BLOCK_BOUND() holds for it too
+#define BLOCK_TYPE_ORDER_1 3
+// part 6 is the block's bytes as they are, with no prefix code. the encoder
+// uses this type when the prefix code wouldn't make the block any smaller,
+// which is the case for data that is already compressed (like images and
+// video), so the decoder only has to copy the bytes
+#define BLOCK_TYPE_STORED 4
+// part 6 is 1 stream of literals and matches of earlier bytes of the block,
+// each from its own prefix code, and part 4 holds the code lengths of all of
+// them (see lz77.h). the encoder only uses this type when it makes the block
+// smaller than BLOCK_TYPE_1_STREAM would, so COMPRESSED_BLOCK_BOUND() holds
+// for it too
+#define BLOCK_TYPE_LZ77 5
+
+#define MAXIMUM_NUMBER_OF_STREAMS 8
+
+// the number of bytes in parts 1 and 2 of a block
+#define BLOCK_HEADER_SIZE 8
+// the number of bytes in part 8 of a block of a file with checksums
+#define BLOCK_CHECKSUM_SIZE 4
+// the most bytes a block can have before it is compressed
+#define MAXIMUM_BLOCK_LENGTH (64 * 1024 * 1024)
+
+// the most bytes that parts 3 to 7 of a block can take up, which is when every
+// byte gets the longest possible codeword. the code lengths take up at most 384
+// bytes (see write_code_lengths()), there can be a jump table, and each stream
+// can add 1 byte of alignment
+#define COMPRESSED_BLOCK_BOUND(block_length) \
+    (1 + 384 + 4 * (MAXIMUM_NUMBER_OF_STREAMS - 1) \
+    + ((size_t)(block_length) * MAXIMUM_CODEWORD_LENGTH + 7) / 8 \
+    + MAXIMUM_NUMBER_OF_STREAMS)
+
+// the most bytes an adaptive block can have before it is compressed. they are
+// kept short, so that the most that a block can take up once compressed (see
+// below) doesn't need much memory
+#define MAXIMUM_ADAPTIVE_BLOCK_LENGTH (64 * 1024)
+
+// the most bytes that parts 3 and 4 of an adaptive block can take up. a
+// codeword of the adaptive tree is at most 255 bits long, and a byte that
+// hasn't appeared before also needs its own 8 bits
+#define ADAPTIVE_BLOCK_BOUND(block_length) \
+    (((size_t)(block_length) * (255 + 8) + 7) / 8)
+
+// the most bytes that parts 3 and 4 of a block of a file with a dictionary can
+// take up, which is when every byte gets the longest possible codeword
+#define DICTIONARY_BLOCK_BOUND(block_length) \
+    (((size_t)(block_length) * MAXIMUM_CODEWORD_LENGTH + 7) / 8)
+
+// return whether the version (the version byte without any of FORMAT_FLAGS,
+// which are the checksum and seek index flags) is one that the decoder knows
+static inline bool is_format_version_known(int version) {
+    return version == FORMAT_VERSION
+        || version == FORMAT_VERSION_ADAPTIVE
+        || version == FORMAT_VERSION_DICTIONARY;
+}
+
+// return the number of streams that part 6 of a block of the given type has, or
+// 0 if the type is unknown
+static inline int get_number_of_streams(int block_type) {
+    if (
+        block_type == BLOCK_TYPE_1_STREAM
+        || block_type == BLOCK_TYPE_ORDER_1
+        || block_type == BLOCK_TYPE_STORED
+        || block_type == BLOCK_TYPE_LZ77
+    ) {
+        return 1;
+    } else if (block_type == BLOCK_TYPE_4_STREAMS) {
+        return 4;
+    } else if (block_type == BLOCK_TYPE_8_STREAMS) {
+        return 8;
+    } else {
+        return 0;
+    }
+}
+
+// return the block type that splits part 6 into the given number of streams,
+// or -1 if there is no such type
+static inline int get_block_type(int number_of_streams) {
+    if (number_of_streams == 1) {
+        return BLOCK_TYPE_1_STREAM;
+    } else if (number_of_streams == 4) {
+        return BLOCK_TYPE_4_STREAMS;
+    } else if (number_of_streams == 8) {
+        return BLOCK_TYPE_8_STREAMS;
+    } else {
+        return -1;
+    }
+}
+
+// return whether a block header's sizes are possible. if they aren't, the
+// compressed file is invalid. checking this also keeps a bad file from making
+// the decoder allocate huge amounts of memory. a block with bytes always takes
+// up at least 1 byte once compressed
+static inline bool are_block_sizes_valid(
+    uint32_t block_length,
+    uint32_t compressed_block_length
+) {
+    return block_length <= MAXIMUM_BLOCK_LENGTH
+        && compressed_block_length > 0
+        && compressed_block_length <= COMPRESSED_BLOCK_BOUND(block_length);
+}
+
+// the same as are_block_sizes_valid(), but for the header of an adaptive block
+static inline bool are_adaptive_block_sizes_valid(
+    uint32_t block_length,
+    uint32_t compressed_block_length
+) {
+    return block_length <= MAXIMUM_ADAPTIVE_BLOCK_LENGTH
+        && compressed_block_length > 0
+        && compressed_block_length <= ADAPTIVE_BLOCK_BOUND(block_length);
+}
+
+// the same as are_block_sizes_valid(), but for the header of a block of a file
+// with the given format version
+static inline bool are_block_sizes_valid_in_version(
+    int version,
+    uint32_t block_length,
+    uint32_t compressed_block_length
+) {
+    if (version == FORMAT_VERSION_ADAPTIVE) {
+        return are_adaptive_block_sizes_valid(
+            block_length,
+            compressed_block_length
+        );
+    } else if (version == FORMAT_VERSION_DICTIONARY) {
+        return block_length <= MAXIMUM_BLOCK_LENGTH
+            && compressed_block_length > 0
+            && compressed_block_length <= DICTIONARY_BLOCK_BOUND(block_length);
+    } else {
+        return are_block_sizes_valid(block_length, compressed_block_length);
+    }
+}
+
+// return the big-endian 32-bit number that the 4 bytes hold
+static inline uint32_t get_big_endian_32_bits(const unsigned char bytes[4]) {
+    return (uint32_t)bytes[0] << 24 | (uint32_t)bytes[1] << 16
+         | (uint32_t)bytes[2] << 8 | bytes[3];
+}
+
+// return the big-endian 64-bit number that the 8 bytes hold
+static inline uint64_t get_big_endian_64_bits(const unsigned char bytes[8]) {
+    return (uint64_t)get_big_endian_32_bits(bytes) << 32
+         | get_big_endian_32_bits(bytes + 4);
+}
+
+// if the compressed file, which is all "length" of the given bytes, has
+// FORMAT_FLAG_SEEK_INDEX in its header and ends with a seek index (parts 7 to
+// 9), set "number_of_entries" to the number of entries in it and return true.
+// the entries then start SEEK_INDEX_FOOTER_SIZE + "number_of_entries" *
+// SEEK_INDEX_ENTRY_SIZE bytes before the end of the file, and the file's
+// trailer (parts 4 to 6b) ends right before them
+static inline bool find_seek_index(
+    const unsigned char *bytes,
+    size_t length,
+    uint64_t *number_of_entries
+) {
+    if (
+        length < FILE_HEADER_SIZE + FILE_TRAILER_SIZE + SEEK_INDEX_FOOTER_SIZE
+        || get_big_endian_32_bits(bytes) != FILE_MAGIC_NUMBER
+        || !(bytes[4] & FORMAT_FLAG_SEEK_INDEX)
+        || get_big_endian_32_bits(bytes + length - 4)
+           != SEEK_INDEX_MAGIC_NUMBER
+    ) {
+        return false;
+    }
+    *number_of_entries = get_big_endian_64_bits(
+        bytes + length - SEEK_INDEX_FOOTER_SIZE
+    );
+    size_t room = length - FILE_HEADER_SIZE - FILE_TRAILER_SIZE
+                - SEEK_INDEX_FOOTER_SIZE;
+    return *number_of_entries <= room / SEEK_INDEX_ENTRY_SIZE;
+}
+
+#endif
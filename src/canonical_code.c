@@ -0,0 +1,401 @@
+// see canonical_code.h for an explanation of canonical prefix codes and how
+// their code lengths are stored
+
+#include "canonical_code.h"
+#include "bitbuffer.h"
+#include "huffman_tree.h"
+#include <stdbool.h>
+#include <stdlib.h>
+
+// set each code length to the depth of its symbol's leaf in the tree, or 0 if
+// the symbol isn't in the tree
+void get_depths_recursive(
+    const struct huffman_tree *tree,
+    const struct node *node,
+    int depth,
+    unsigned char code_lengths[256]
+) {
+    if (is_leaf_node(node)) {
+        code_lengths[node->symbol] = depth;
+    } else {
+        get_depths_recursive(
+            tree,
+            get_left_child(tree, node),
+            depth + 1,
+            code_lengths
+        );
+        get_depths_recursive(
+            tree,
+            get_right_child(tree, node),
+            depth + 1,
+            code_lengths
+        );
+    }
+}
+
+// fill the "code_lengths" array with the length of each symbol's codeword in
+// the given huffman tree, which is the depth of its leaf node. unused symbols
+// get a length of 0
+//
+// note that a length can be up to 255 here, so it might still need to be
+// limited
+void get_code_lengths_from_tree(
+    const struct huffman_tree *tree,
+    unsigned char code_lengths[256]
+) {
+    for (int i = 0; i < 256; i += 1) {
+        code_lengths[i] = 0;
+    }
+    get_depths_recursive(tree, get_root_node(tree), 0, code_lengths);
+}
+
+int get_longest_code_length(const unsigned char code_lengths[256]) {
+    int longest = 0;
+    for (int i = 0; i < 256; i += 1) {
+        if (code_lengths[i] > longest) {
+            longest = code_lengths[i];
+        }
+    }
+    return longest;
+}
+
+// an item in one of the package-merge lists (see limit_code_lengths()). it is
+// either a single symbol (a leaf) or a package of 2 items from the previous
+// list
+struct package_merge_item {
+    uint64_t weight;
+    // -1 for a package
+    int symbol;
+    // the positions of the 2 packaged items in the pool of all items
+    int first_item;
+    int second_item;
+};
+
+// compare two items by their weights in a way that produces an ascending order
+// when passed to qsort(). ties are broken by symbol, so that the result is the
+// same on every platform
+int compare_items(const void *first, const void *second) {
+    const struct package_merge_item *item_one = first;
+    const struct package_merge_item *item_two = second;
+    if (item_one->weight != item_two->weight) {
+        return item_one->weight < item_two->weight ? -1 : 1;
+    }
+    return item_one->symbol - item_two->symbol;
+}
+
+// add 1 to the code length of every symbol inside of the item
+void count_item_symbols_recursive(
+    const struct package_merge_item *pool,
+    int item,
+    unsigned char code_lengths[256]
+) {
+    if (pool[item].symbol != -1) {
+        code_lengths[pool[item].symbol] += 1;
+    } else {
+        const struct package_merge_item *package = &pool[item];
+        count_item_symbols_recursive(pool, package->first_item, code_lengths);
+        count_item_symbols_recursive(pool, package->second_item, code_lengths);
+    }
+}
+
+// fill the "code_lengths" array with the lengths of an optimal prefix code in
+// which no codeword is longer than "codeword_length_limit", using the
+// package-merge algorithm. symbols with a frequency of 0 get a length of 0.
+// returns whether the memory could be allocated
+//
+// the idea is that a symbol with a codeword of length n is like n coins, one
+// for each of the levels 1 to n of the tree. we want to "buy" the cheapest set
+// of coins (weighted by frequency) that still forms a valid prefix code, which
+// turns out to be the 2 * (number of symbols - 1) cheapest items of this list:
+// 1. start with a list of the symbols (the coins for the deepest level),
+//    sorted by weight
+// 2. pair up neighboring items of the list into packages, whose weights are
+//    the sums of the items in them
+// 3. merge those packages with a fresh, sorted list of the symbols (the coins
+//    for the next level up) to make the next list
+// 4. repeat steps 2 and 3 until there is a list for each of the levels
+//
+// each symbol's code length is then how many times it shows up in those
+// cheapest items, either by itself or inside of packages
+int limit_code_lengths(
+    const uint64_t frequencies[256],
+    int codeword_length_limit,
+    unsigned char code_lengths[256]
+) {
+    struct package_merge_item leaves[256];
+    int number_of_leaves = 0;
+    for (int i = 0; i < 256; i += 1) {
+        code_lengths[i] = 0;
+        if (frequencies[i] > 0) {
+            leaves[number_of_leaves].weight = frequencies[i];
+            leaves[number_of_leaves].symbol = i;
+            number_of_leaves += 1;
+        }
+    }
+    qsort(leaves, number_of_leaves, sizeof (*leaves), &compare_items);
+
+    // every list has at most 2 * 256 - 1 items, and we keep all of the lists
+    // in one pool so that packages can refer to the items inside of them
+    struct package_merge_item *pool = malloc(
+        codeword_length_limit * 511 * sizeof (*pool)
+    );
+    if (pool == NULL) {
+        return 1;
+    }
+
+    // the first list is just the symbols
+    int list_start = 0;
+    int list_length = number_of_leaves;
+    for (int i = 0; i < number_of_leaves; i += 1) {
+        pool[i] = leaves[i];
+    }
+
+    for (int level = 1; level < codeword_length_limit; level += 1) {
+        int next_list_start = list_start + list_length;
+        int next_list_length = 0;
+
+        // merge the sorted symbols with the packages (which come out sorted,
+        // since the list they are made from is sorted)
+        int leaf = 0;
+        int package = 0;
+        int number_of_packages = list_length / 2;
+        while (leaf < number_of_leaves || package < number_of_packages) {
+            struct package_merge_item item;
+            bool should_take_leaf;
+            if (package == number_of_packages) {
+                should_take_leaf = true;
+            } else {
+                item.weight = pool[list_start + 2 * package].weight
+                            + pool[list_start + 2 * package + 1].weight;
+                item.symbol = -1;
+                item.first_item = list_start + 2 * package;
+                item.second_item = list_start + 2 * package + 1;
+                should_take_leaf = leaf < number_of_leaves
+                                && leaves[leaf].weight <= item.weight;
+            }
+
+            if (should_take_leaf) {
+                item = leaves[leaf];
+                leaf += 1;
+            } else {
+                package += 1;
+            }
+            pool[next_list_start + next_list_length] = item;
+            next_list_length += 1;
+        }
+
+        list_start = next_list_start;
+        list_length = next_list_length;
+    }
+
+    for (int i = 0; i < 2 * (number_of_leaves - 1); i += 1) {
+        count_item_symbols_recursive(pool, list_start + i, code_lengths);
+    }
+
+    free(pool);
+    return 0;
+}
+
+// check that the code lengths describe a complete prefix code, meaning that its
+// tree would be a proper binary tree where every branch node has 2 children.
+// returns whether there is a problem
+//
+// this is the case when the codewords use up exactly all of the possible bit
+// patterns, which we can check by adding up 1 / 2^length for every codeword and
+// making sure that the sum is exactly 1
+int check_code_lengths(const unsigned char code_lengths[256]) {
+    // this is the sum multiplied by 2^MAXIMUM_CODEWORD_LENGTH, so that it can
+    // be added up with integers
+    uint32_t sum = 0;
+    for (int i = 0; i < 256; i += 1) {
+        if (code_lengths[i] > MAXIMUM_CODEWORD_LENGTH) {
+            return 1;
+        }
+        if (code_lengths[i] > 0) {
+            sum += (uint32_t)1 << (MAXIMUM_CODEWORD_LENGTH - code_lengths[i]);
+        }
+    }
+    return sum != (uint32_t)1 << MAXIMUM_CODEWORD_LENGTH;
+}
+
+// fill the "codewords" array with each symbol's canonical codeword, based on
+// the code lengths. the codeword is in the lowest bits of the number, and its
+// first bit is the highest of those bits. unused symbols get a codeword of 0
+void assign_canonical_codewords(
+    const unsigned char code_lengths[256],
+    uint32_t codewords[256]
+) {
+    int number_of_codewords_with_length[MAXIMUM_CODEWORD_LENGTH + 1] = {0};
+    for (int i = 0; i < 256; i += 1) {
+        number_of_codewords_with_length[code_lengths[i]] += 1;
+    }
+    number_of_codewords_with_length[0] = 0;
+
+    // the first codeword of each length comes right after the last codeword of
+    // the length before it, with a 0 bit added to the end
+    uint32_t next_codeword_with_length[MAXIMUM_CODEWORD_LENGTH + 1];
+    uint32_t codeword = 0;
+    for (int length = 1; length <= MAXIMUM_CODEWORD_LENGTH; length += 1) {
+        codeword = (codeword + number_of_codewords_with_length[length - 1])
+                 << 1;
+        next_codeword_with_length[length] = codeword;
+    }
+
+    for (int i = 0; i < 256; i += 1) {
+        if (code_lengths[i] > 0) {
+            codewords[i] = next_codeword_with_length[code_lengths[i]];
+            next_codeword_with_length[code_lengths[i]] += 1;
+        } else {
+            codewords[i] = 0;
+        }
+    }
+}
+
+// set each branch node's weight to the sum of its children's weights, and
+// return the node's weight
+uint64_t sum_weights_recursive(struct huffman_tree *tree, uint16_t position) {
+    struct node *node = &tree->nodes[position];
+    if (!is_leaf_node(node)) {
+        node->weight = sum_weights_recursive(tree, node->left_child)
+                     + sum_weights_recursive(tree, node->right_child);
+    }
+    return node->weight;
+}
+
+// create the huffman tree in "tree" that the canonical codewords for the
+// given code lengths are the paths of. the code lengths must have been checked
+// with check_code_lengths()
+//
+// if "frequencies" is not NULL, the leaves get those frequencies as their
+// weights, and the branch nodes get the sums of their children's weights, so
+// that the tree can be printed. else, all of the weights are 0
+void create_tree_from_code_lengths(
+    const unsigned char code_lengths[256],
+    const uint64_t frequencies[256],
+    struct huffman_tree *tree
+) {
+    uint32_t codewords[256];
+    assign_canonical_codewords(code_lengths, codewords);
+
+    // a complete prefix code has 1 leaf per symbol and 1 branch node less than
+    // that, so the tree always has room for all of its nodes
+    tree->number_of_nodes = 0;
+    tree->root = add_node(tree, 0, 0);
+    for (int i = 0; i < 256; i += 1) {
+        if (code_lengths[i] == 0) {
+            continue;
+        }
+
+        // follow the codeword from the root, adding any branch nodes that
+        // aren't there yet, and put the leaf at the end of it
+        uint16_t node = tree->root;
+        for (int bit = code_lengths[i] - 1; bit >= 0; bit -= 1) {
+            bool is_right = (codewords[i] >> bit) & 1;
+            uint16_t child = is_right ? tree->nodes[node].right_child
+                                      : tree->nodes[node].left_child;
+            if (child == NO_CHILD) {
+                child = add_node(tree, 0, 0);
+                if (is_right) {
+                    tree->nodes[node].right_child = child;
+                } else {
+                    tree->nodes[node].left_child = child;
+                }
+            }
+            node = child;
+        }
+        tree->nodes[node].symbol = i;
+        if (frequencies != NULL) {
+            tree->nodes[node].weight = frequencies[i];
+        }
+    }
+
+    if (frequencies != NULL) {
+        sum_weights_recursive(tree, tree->root);
+    }
+}
+
+// write the code lengths in the format described in canonical_code.h
+//
+// there are at most 256 * 12 bits (384 bytes), so the writer's memory buffer
+// must have at least that much room
+void write_code_lengths(
+    struct bit_writer *writer,
+    const unsigned char code_lengths[256]
+) {
+    int i = 0;
+    while (i < 256) {
+        bit_writer_append_bits(writer, code_lengths[i], 4);
+        if (code_lengths[i] == 0) {
+            // count how many more unused symbols follow this one
+            int run_length = 1;
+            while (i + run_length < 256 && code_lengths[i + run_length] == 0) {
+                run_length += 1;
+            }
+            bit_writer_append_bits(writer, run_length - 1, 8);
+            i += run_length;
+        } else {
+            i += 1;
+        }
+    }
+}
+
+// return the number of bits that write_code_lengths() would write for the code
+// lengths, so that the size of a block can be worked out without writing it
+int get_code_lengths_size(const unsigned char code_lengths[256]) {
+    int size = 0;
+    int i = 0;
+    while (i < 256) {
+        size += 4;
+        if (code_lengths[i] == 0) {
+            int run_length = 1;
+            while (i + run_length < 256 && code_lengths[i + run_length] == 0) {
+                run_length += 1;
+            }
+            size += 8;
+            i += run_length;
+        } else {
+            i += 1;
+        }
+    }
+    return size;
+}
+
+// read code lengths that were written by write_code_lengths() and check that
+// they describe a proper prefix code. returns whether the reading was
+// successful
+//
+// the reader's memory buffer must have all of the bytes of the code lengths in
+// it (at most 384), unless the data ends before then
+int read_code_lengths(
+    struct bit_reader *reader,
+    unsigned char code_lengths[256]
+) {
+    int i = 0;
+    while (i < 256) {
+        bit_reader_refill(reader);
+        unsigned char length = bit_reader_peek_bits(reader, 4);
+        bit_reader_consume_bits(reader, 4);
+        if (length == 0) {
+            int run_length = bit_reader_peek_bits(reader, 8) + 1;
+            bit_reader_consume_bits(reader, 8);
+            // the run of unused symbols goes past the last symbol. this means
+            // that the compressed file is invalid
+            if (i + run_length > 256) {
+                return 1;
+            }
+            for (int j = 0; j < run_length; j += 1) {
+                code_lengths[i + j] = 0;
+            }
+            i += run_length;
+        } else {
+            code_lengths[i] = length;
+            i += 1;
+        }
+    }
+
+    // the data ended before all of the code lengths were read
+    if (bit_reader_bits_left(reader) < 0) {
+        return 1;
+    }
+    return check_code_lengths(code_lengths);
+}
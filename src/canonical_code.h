@@ -0,0 +1,79 @@
+// instead of storing the whole huffman tree in the compressed file, we only
+// store how long each symbol's codeword is. that is enough for the decoder,
+// because both sides agree on one specific way of picking the codewords from
+// their lengths, which is called a canonical prefix code:
+// 1. shorter codewords come before longer codewords
+// 2. codewords of the same length are in the order of their symbols
+// 3. each codeword is the previous codeword plus 1, shifted left by however
+//    many bits longer it is than the previous one
+//
+// for example, the lengths {e: 1, s: 2, l: 3, ' ': 4, v: 4} give:
+//     e:  0
+//     s:  10
+//     l:  110
+//     ' ': 1110
+//     v:  1111
+//
+// we also put a limit on how long a codeword can be. a plain huffman tree can
+// be up to 255 levels deep, but a limit of around 11 to 15 bits costs almost
+// nothing in compression and means that a codeword always fits in a register
+// and can be decoded with at most 2 table lookups (see decode_table.h). when
+// the huffman tree is deeper than the limit, the lengths are instead found with
+// the package-merge algorithm (see limit_code_lengths())
+//
+// in the compressed file, each length is stored as 4 bits. a length of 0 means
+// that the symbol is not used, and it is followed by 8 more bits that say how
+// many of the symbols after it are also unused, since there are usually long
+// runs of unused symbols
+
+#ifndef CANONICAL_CODE_H
+#define CANONICAL_CODE_H
+
+#include <stdint.h>
+
+struct bit_reader;
+struct bit_writer;
+struct huffman_tree;
+
+// the most that the length of a codeword can be limited to, since a length has
+// to fit in 4 bits
+#define MAXIMUM_CODEWORD_LENGTH 15
+// the least that the length of a codeword can be limited to, since there must
+// be enough codewords for all 256 possible symbols
+#define MINIMUM_CODEWORD_LENGTH_LIMIT 8
+// this matches the width of the primary decode table, so that by default every
+// codeword can be decoded with only 1 table lookup
+#define DEFAULT_CODEWORD_LENGTH_LIMIT 11
+
+void get_code_lengths_from_tree(
+    const struct huffman_tree *tree,
+    unsigned char code_lengths[256]
+);
+int get_longest_code_length(const unsigned char code_lengths[256]);
+int limit_code_lengths(
+    const uint64_t frequencies[256],
+    int codeword_length_limit,
+    unsigned char code_lengths[256]
+);
+int check_code_lengths(const unsigned char code_lengths[256]);
+void assign_canonical_codewords(
+    const unsigned char code_lengths[256],
+    uint32_t codewords[256]
+);
+void create_tree_from_code_lengths(
+    const unsigned char code_lengths[256],
+    const uint64_t frequencies[256],
+    struct huffman_tree *tree
+);
+
+void write_code_lengths(
+    struct bit_writer *writer,
+    const unsigned char code_lengths[256]
+);
+int get_code_lengths_size(const unsigned char code_lengths[256]);
+int read_code_lengths(
+    struct bit_reader *reader,
+    unsigned char code_lengths[256]
+);
+
+#endif
@@ -0,0 +1,156 @@
+// see checksum.h for an explanation of what the checksums are for
+
+#include "checksum.h"
+#include <pthread.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#define HAS_SSE42_VERSION
+#endif
+
+// the Castagnoli polynomial with its bits reversed, since the CRC works on the
+// lowest bit of each byte first
+#define CRC32C_POLYNOMIAL 0x82f63b78
+
+// byte_tables[0][b] is the CRC of the byte b, and byte_tables[i][b] is the CRC
+// of b followed by i bytes of 0, so that 8 bytes can be looked up at once
+static uint32_t byte_tables[8][256];
+// power_tables[k] is x^(2^k) modulo the polynomial, for combine_crc32c(),
+// which needs up to k = 66 for a length of up to 2^64 - 1 bytes (8 times as
+// many bits)
+#define NUMBER_OF_POWERS (64 + 3)
+static uint32_t power_tables[NUMBER_OF_POWERS];
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+// return a times b modulo the polynomial, where the highest bit of each is
+// the lowest power of x
+static uint32_t multiply_modulo(uint32_t a, uint32_t b) {
+    uint32_t product = 0;
+    for (uint32_t bit = (uint32_t)1 << 31; bit != 0; bit >>= 1) {
+        if (a & bit) {
+            product ^= b;
+        }
+        b = b & 1 ? (b >> 1) ^ CRC32C_POLYNOMIAL : b >> 1;
+    }
+    return product;
+}
+
+static void create_tables(void) {
+    for (int i = 0; i < 256; i += 1) {
+        uint32_t crc = i;
+        for (int j = 0; j < 8; j += 1) {
+            crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLYNOMIAL : crc >> 1;
+        }
+        byte_tables[0][i] = crc;
+    }
+    for (int i = 0; i < 256; i += 1) {
+        for (int j = 1; j < 8; j += 1) {
+            uint32_t crc = byte_tables[j - 1][i];
+            byte_tables[j][i] = (crc >> 8) ^ byte_tables[0][crc & 0xff];
+        }
+    }
+
+    // x^1, then each one squared
+    power_tables[0] = (uint32_t)1 << 30;
+    for (int k = 1; k < NUMBER_OF_POWERS; k += 1) {
+        power_tables[k] = multiply_modulo(
+            power_tables[k - 1],
+            power_tables[k - 1]
+        );
+    }
+}
+
+// the CRC without the bits being flipped at the start and end
+static uint32_t update_raw_crc32c_plain(
+    uint32_t crc,
+    const unsigned char *bytes,
+    size_t number_of_bytes
+) {
+    size_t i = 0;
+    for (; i + 8 <= number_of_bytes; i += 8) {
+        // the first byte is the lowest, since it is the first to be divided
+        uint32_t low_bits = crc ^ ((uint32_t)bytes[i]
+            | (uint32_t)bytes[i + 1] << 8
+            | (uint32_t)bytes[i + 2] << 16
+            | (uint32_t)bytes[i + 3] << 24);
+        uint32_t high_bits = (uint32_t)bytes[i + 4]
+            | (uint32_t)bytes[i + 5] << 8
+            | (uint32_t)bytes[i + 6] << 16
+            | (uint32_t)bytes[i + 7] << 24;
+        crc = byte_tables[7][low_bits & 0xff]
+            ^ byte_tables[6][(low_bits >> 8) & 0xff]
+            ^ byte_tables[5][(low_bits >> 16) & 0xff]
+            ^ byte_tables[4][low_bits >> 24]
+            ^ byte_tables[3][high_bits & 0xff]
+            ^ byte_tables[2][(high_bits >> 8) & 0xff]
+            ^ byte_tables[1][(high_bits >> 16) & 0xff]
+            ^ byte_tables[0][high_bits >> 24];
+    }
+    for (; i < number_of_bytes; i += 1) {
+        crc = (crc >> 8) ^ byte_tables[0][(crc ^ bytes[i]) & 0xff];
+    }
+    return crc;
+}
+
+#ifdef HAS_SSE42_VERSION
+// the same as update_raw_crc32c_plain(), but with the CRC32 instruction, which
+// does 8 bytes at a time
+__attribute__((target("sse4.2")))
+static uint32_t update_raw_crc32c_sse42(
+    uint32_t crc,
+    const unsigned char *bytes,
+    size_t number_of_bytes
+) {
+    uint64_t crc_64 = crc;
+    size_t i = 0;
+    for (; i + 8 <= number_of_bytes; i += 8) {
+        uint64_t eight_bytes;
+        memcpy(&eight_bytes, bytes + i, 8);
+        crc_64 = _mm_crc32_u64(crc_64, eight_bytes);
+    }
+    crc = crc_64;
+    for (; i < number_of_bytes; i += 1) {
+        crc = _mm_crc32_u8(crc, bytes[i]);
+    }
+    return crc;
+}
+#endif
+
+// return the CRC32C of the bytes that "crc" is the CRC32C of, followed by the
+// given bytes. the CRC32C of no bytes is 0, so that is what "crc" starts as
+uint32_t update_crc32c(
+    uint32_t crc,
+    const unsigned char *bytes,
+    size_t number_of_bytes
+) {
+#ifdef HAS_SSE42_VERSION
+    if (__builtin_cpu_supports("sse4.2")) {
+        return ~update_raw_crc32c_sse42(~crc, bytes, number_of_bytes);
+    }
+#endif
+    pthread_once(&tables_once, &create_tables);
+    return ~update_raw_crc32c_plain(~crc, bytes, number_of_bytes);
+}
+
+// return the CRC32C of 2 pieces of data, one after the other, from the CRC32C
+// of each of them and the number of bytes in the second one. the first CRC
+// gets "second_length" bytes of 0 added to it (multiplying it by
+// x^(8 * second_length)), and the second one is added on
+uint32_t combine_crc32c(
+    uint32_t first_crc,
+    uint32_t second_crc,
+    uint64_t second_length
+) {
+    pthread_once(&tables_once, &create_tables);
+    // x^(8 * second_length) is the product of x^(2^k) for each bit k of
+    // second_length, starting 3 bits up for the 8
+    uint32_t power = (uint32_t)1 << 31;
+    for (int k = 3; second_length != 0; k += 1) {
+        if (second_length & 1) {
+            power = multiply_modulo(power_tables[k], power);
+        }
+        second_length >>= 1;
+    }
+    return multiply_modulo(power, first_crc) ^ second_crc;
+}
@@ -0,0 +1,36 @@
+// the decoder notices a damaged file when its bits run out early or its prefix
+// code can't be right, but most damage to the encoded data just decodes into
+// different bytes. a file compressed with --checksum (see block_format.h)
+// stores a checksum of each block's bytes, and one of all of the bytes
+// together, which the decoder compares with the bytes that it decoded
+//
+// the checksum is CRC32C (the CRC with the Castagnoli polynomial), which every
+// x86-64 processor since 2008 has an instruction for (in SSE4.2), so it costs
+// far less than decoding the bytes. that version is picked at runtime if the
+// processor supports it, and otherwise a table-driven version that handles 8
+// bytes at a time (slicing-by-8) is used
+//
+// a CRC of 2 pieces of data, one after the other, can be worked out from the
+// CRCs of each piece and the length of the second one. so the checksum of all
+// of the bytes is made from the blocks' checksums, in order, without going
+// over the bytes again, and the blocks' checksums can be worked out on
+// different threads
+
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+uint32_t update_crc32c(
+    uint32_t crc,
+    const unsigned char *bytes,
+    size_t number_of_bytes
+);
+uint32_t combine_crc32c(
+    uint32_t first_crc,
+    uint32_t second_crc,
+    uint64_t second_length
+);
+
+#endif
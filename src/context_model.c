@@ -0,0 +1,343 @@
+// see context_model.h for an explanation of how the contexts are grouped into
+// tables and how the tables are stored
+
+#include "context_model.h"
+#include "bitbuffer.h"
+#include "block_encoder.h"
+#include "canonical_code.h"
+#include <float.h>
+#include <stdbool.h>
+#include <string.h>
+
+// about how many bits it costs to store 1 more table. a context only gets a
+// table of its own if it would save more than this
+#define ESTIMATED_TABLE_SIZE 1024
+// how many times the tables are remade and the contexts moved to the table that
+// suits them best (step 4)
+#define NUMBER_OF_REFINEMENT_PASSES 2
+
+// return log2(number) for a number of at least 1, to within about 0.09. the
+// whole part comes from the position of the highest set bit, and the
+// fractional part from a straight line between the powers of 2 around the
+// number. that is close enough for comparing contexts, and it doesn't need the
+// math library
+static inline float approximate_log2(uint64_t number) {
+    int exponent = 63 - __builtin_clzll(number);
+    uint64_t power_of_2 = (uint64_t)1 << exponent;
+    return exponent + (float)(number - power_of_2) / power_of_2;
+}
+
+// fill the "costs" array with about how many bits each byte would take with an
+// ideal code made from the given counts. each count is treated as half more
+// than it is, so that a byte that never came up still gets a cost (a high one)
+void estimate_byte_costs(const uint64_t frequencies[256], float costs[256]) {
+    uint64_t total = 0;
+    for (int i = 0; i < 256; i += 1) {
+        total += frequencies[i];
+    }
+    // the counts are doubled so that the halves are whole numbers
+    float total_cost = approximate_log2(2 * total + 256);
+    for (int i = 0; i < 256; i += 1) {
+        costs[i] = total_cost - approximate_log2(2 * frequencies[i] + 1);
+    }
+}
+
+// return about how many bits the bytes that come after the context would take
+// with the given byte costs
+float get_context_cost(
+    const struct context_model *model,
+    int context,
+    const float costs[256]
+) {
+    float cost = 0;
+    int end = model->context_starts[context + 1];
+    for (int i = model->context_starts[context]; i < end; i += 1) {
+        cost += model->following_byte_counts[i]
+              * costs[model->following_bytes[i]];
+    }
+    return cost;
+}
+
+// set the table frequencies to the sums of the pair frequencies of the contexts
+// that use each table
+void add_up_table_frequencies(struct context_model *model) {
+    memset(model->table_frequencies, 0, sizeof (model->table_frequencies));
+    for (int context = 0; context < 256; context += 1) {
+        uint64_t *frequencies = model->table_frequencies[
+            model->table_of_context[context]
+        ];
+        int end = model->context_starts[context + 1];
+        for (int i = model->context_starts[context]; i < end; i += 1) {
+            frequencies[model->following_bytes[i]] +=
+                model->following_byte_counts[i];
+        }
+    }
+}
+
+// group the contexts into tables (steps 1 to 4 in context_model.h), setting the
+// number of tables, the table of each context, and the table frequencies. the
+// pair frequencies must have been counted
+void group_contexts(struct context_model *model) {
+    // list the pairs that came up, so that the loops below don't have to go
+    // through all 65536 of them, and find how many bits each context would
+    // take with a table of its own
+    float own_costs[256];
+    uint64_t context_totals[256];
+    int number_of_pairs = 0;
+    for (int context = 0; context < 256; context += 1) {
+        model->context_starts[context] = number_of_pairs;
+        context_totals[context] = 0;
+        own_costs[context] = 0;
+        for (int byte = 0; byte < 256; byte += 1) {
+            uint32_t count = model->pair_frequencies[context][byte];
+            if (count > 0) {
+                model->following_bytes[number_of_pairs] = byte;
+                model->following_byte_counts[number_of_pairs] = count;
+                number_of_pairs += 1;
+                context_totals[context] += count;
+            }
+        }
+        if (context_totals[context] == 0) {
+            continue;
+        }
+        float total_cost = approximate_log2(context_totals[context]);
+        int start = model->context_starts[context];
+        for (int i = start; i < number_of_pairs; i += 1) {
+            uint32_t count = model->following_byte_counts[i];
+            own_costs[context] += count
+                                * (total_cost - approximate_log2(count));
+        }
+    }
+    model->context_starts[256] = number_of_pairs;
+
+    // step 1 starts with the most common context
+    int new_table_context = 0;
+    for (int context = 1; context < 256; context += 1) {
+        if (context_totals[context] > context_totals[new_table_context]) {
+            new_table_context = context;
+        }
+    }
+
+    // steps 2 and 3. the first table is made the same way as the rest, with
+    // every context moving over to it
+    float best_costs[256];
+    for (int context = 0; context < 256; context += 1) {
+        best_costs[context] = FLT_MAX;
+        model->table_of_context[context] = 0;
+    }
+    model->number_of_tables = 0;
+    while (true) {
+        int table = model->number_of_tables;
+        for (int byte = 0; byte < 256; byte += 1) {
+            model->table_frequencies[table][byte] =
+                model->pair_frequencies[new_table_context][byte];
+        }
+        float costs[256];
+        estimate_byte_costs(model->table_frequencies[table], costs);
+        for (int context = 0; context < 256; context += 1) {
+            if (context_totals[context] == 0) {
+                continue;
+            }
+            float cost = get_context_cost(model, context, costs);
+            if (cost < best_costs[context]) {
+                best_costs[context] = cost;
+                model->table_of_context[context] = table;
+            }
+        }
+        model->number_of_tables += 1;
+        if (model->number_of_tables == MAXIMUM_NUMBER_OF_CONTEXT_TABLES) {
+            break;
+        }
+
+        float most_saved = 0;
+        for (int context = 0; context < 256; context += 1) {
+            if (
+                context_totals[context] > 0
+                && best_costs[context] - own_costs[context] > most_saved
+            ) {
+                most_saved = best_costs[context] - own_costs[context];
+                new_table_context = context;
+            }
+        }
+        if (most_saved < ESTIMATED_TABLE_SIZE) {
+            break;
+        }
+    }
+
+    // step 4
+    for (int pass = 0; pass < NUMBER_OF_REFINEMENT_PASSES; pass += 1) {
+        add_up_table_frequencies(model);
+        float costs[MAXIMUM_NUMBER_OF_CONTEXT_TABLES][256];
+        for (int table = 0; table < model->number_of_tables; table += 1) {
+            estimate_byte_costs(model->table_frequencies[table], costs[table]);
+        }
+        for (int context = 0; context < 256; context += 1) {
+            if (context_totals[context] == 0) {
+                continue;
+            }
+            float best_cost = FLT_MAX;
+            for (int table = 0; table < model->number_of_tables; table += 1) {
+                float cost = get_context_cost(model, context, costs[table]);
+                if (cost < best_cost) {
+                    best_cost = cost;
+                    model->table_of_context[context] = table;
+                }
+            }
+        }
+    }
+
+    // moving contexts around can leave a table with no contexts, which would
+    // have no prefix code, so the tables that are still used are renumbered
+    // from 0. the contexts that never came up don't matter, so they use table
+    // 0
+    int new_table_numbers[MAXIMUM_NUMBER_OF_CONTEXT_TABLES];
+    for (int table = 0; table < MAXIMUM_NUMBER_OF_CONTEXT_TABLES; table += 1) {
+        new_table_numbers[table] = -1;
+    }
+    int number_of_used_tables = 0;
+    for (int context = 0; context < 256; context += 1) {
+        int table = model->table_of_context[context];
+        if (context_totals[context] == 0) {
+            model->table_of_context[context] = 0;
+            continue;
+        }
+        if (new_table_numbers[table] == -1) {
+            new_table_numbers[table] = number_of_used_tables;
+            number_of_used_tables += 1;
+        }
+        model->table_of_context[context] = new_table_numbers[table];
+    }
+    model->number_of_tables = number_of_used_tables;
+    add_up_table_frequencies(model);
+}
+
+// group the contexts of the model into tables and make each table's prefix
+// code, with no codeword longer than "codeword_length_limit". the pair
+// frequencies must have been counted from a block of at least 1 byte. returns
+// whether the memory for limiting the code lengths could be allocated
+int create_context_tables(
+    struct context_model *model,
+    int codeword_length_limit
+) {
+    group_contexts(model);
+
+    model->number_of_codeword_bits = 0;
+    for (int table = 0; table < model->number_of_tables; table += 1) {
+        if (create_code_lengths(
+            model->table_frequencies[table],
+            codeword_length_limit,
+            model->code_lengths[table]
+        )) {
+            return 1;
+        }
+        assign_canonical_codewords(
+            model->code_lengths[table],
+            model->codewords[table]
+        );
+        for (int byte = 0; byte < 256; byte += 1) {
+            model->number_of_codeword_bits +=
+                model->table_frequencies[table][byte]
+                * model->code_lengths[table][byte];
+        }
+    }
+    return 0;
+}
+
+// return the number of bits that each context's table number takes up (part 2
+// of the tables), which is enough for the highest table number
+int get_table_number_size(int number_of_tables) {
+    int size = 0;
+    while ((1 << size) < number_of_tables) {
+        size += 1;
+    }
+    return size;
+}
+
+// return the number of bits that write_context_tables() would write for the
+// model, so that the size of a block can be worked out without writing it
+int get_context_tables_size(const struct context_model *model) {
+    int size = 4 + 256 * get_table_number_size(model->number_of_tables);
+    for (int table = 0; table < model->number_of_tables; table += 1) {
+        size += get_code_lengths_size(model->code_lengths[table]);
+    }
+    return size;
+}
+
+// write the model's tables in the format described in context_model.h
+void write_context_tables(
+    struct bit_writer *writer,
+    const struct context_model *model
+) {
+    bit_writer_append_bits(writer, model->number_of_tables - 1, 4);
+    int table_number_size = get_table_number_size(model->number_of_tables);
+    for (int context = 0; context < 256; context += 1) {
+        bit_writer_append_bits(
+            writer,
+            model->table_of_context[context],
+            table_number_size
+        );
+    }
+    for (int table = 0; table < model->number_of_tables; table += 1) {
+        write_code_lengths(writer, model->code_lengths[table]);
+    }
+}
+
+// for each byte of the block, write that byte's codeword from the table of the
+// byte before it with the bit writer
+void write_context_modeled_data(
+    const unsigned char *block,
+    size_t block_length,
+    const struct context_model *model,
+    struct bit_writer *writer
+) {
+    unsigned char previous_byte = 0;
+    for (size_t i = 0; i < block_length; i += 1) {
+        int table = model->table_of_context[previous_byte];
+        bit_writer_append_bits(
+            writer,
+            model->codewords[table][block[i]],
+            model->code_lengths[table][block[i]]
+        );
+        previous_byte = block[i];
+    }
+}
+
+// read tables that were written by write_context_tables() and check that each
+// table's code lengths describe a proper prefix code. returns whether the
+// reading was successful
+int read_context_tables(
+    struct bit_reader *reader,
+    int *number_of_tables,
+    unsigned char table_of_context[256],
+    unsigned char code_lengths[MAXIMUM_NUMBER_OF_CONTEXT_TABLES][256]
+) {
+    bit_reader_refill(reader);
+    *number_of_tables = bit_reader_peek_bits(reader, 4) + 1;
+    bit_reader_consume_bits(reader, 4);
+
+    int table_number_size = get_table_number_size(*number_of_tables);
+    for (int context = 0; context < 256; context += 1) {
+        if (table_number_size == 0) {
+            table_of_context[context] = 0;
+            continue;
+        }
+        bit_reader_refill(reader);
+        table_of_context[context] = bit_reader_peek_bits(
+            reader,
+            table_number_size
+        );
+        bit_reader_consume_bits(reader, table_number_size);
+        // the table doesn't exist. this means that the compressed file is
+        // invalid
+        if (table_of_context[context] >= *number_of_tables) {
+            return 1;
+        }
+    }
+
+    for (int table = 0; table < *number_of_tables; table += 1) {
+        if (read_code_lengths(reader, code_lengths[table])) {
+            return 1;
+        }
+    }
+    return bit_reader_bits_left(reader) < 0;
+}
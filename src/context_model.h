@@ -0,0 +1,97 @@
+// a prefix code for a whole block gives each byte the same codeword wherever
+// it is, but in text and logs, the byte before a byte says a lot about what it
+// will be (a "q" is almost always followed by a "u", a space by a letter, and a
+// newline by the start of a timestamp). the order-1 mode (BLOCK_TYPE_ORDER_1,
+// see block_format.h) uses that by picking each byte's codeword from a prefix
+// code that depends on the byte before it, which is called its context
+//
+// 256 prefix codes (1 for each context) would take up a lot of room in each
+// block, and most of them would be made from so few bytes that they wouldn't
+// be worth storing. so instead, contexts whose following bytes look alike are
+// grouped together, and each group gets 1 prefix code (a table). the groups
+// are found by:
+// 1. starting with 1 table for the most common context, which every context
+//    uses for now
+// 2. giving the context that its table suits the worst (compared to a table of
+//    its own) a new table, and moving every context that that table suits
+//    better over to it
+// 3. repeating step 2 until there are MAXIMUM_NUMBER_OF_CONTEXT_TABLES tables,
+//    or until no context would save more than a table costs to store
+// 4. a couple of times over, remaking each table from the contexts that use
+//    it and moving each context to the table that suits it best
+//
+// how well a table suits a context is estimated with the number of bits that
+// the context's bytes would take with an ideal code made from the table's
+// counts, which is much quicker than making the real prefix codes
+//
+// part 4 of an order-1 block (see block_format.h) is then:
+// 1. 4 bits for the number of tables minus 1
+// 2. for each of the 256 contexts in order, the number of its table, using as
+//      few bits as can hold the highest table number (0 bits if there is only
+//      1 table)
+// 3. the code lengths of each table, each in the same format as the code
+//      lengths of a normal block (see canonical_code.h)
+//
+// the first byte of a block is encoded as if the byte before it was 0, so that
+// each block can still be decoded without knowing anything about the others
+
+#ifndef CONTEXT_MODEL_H
+#define CONTEXT_MODEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct bit_reader;
+struct bit_writer;
+
+// this fits in 4 bits, and is enough for the tables to take up much less room
+// than 256 of them would
+#define MAXIMUM_NUMBER_OF_CONTEXT_TABLES 16
+
+struct context_model {
+    // pair_frequencies[a][b] is how many times b came right after a in the
+    // block (see count_pair_frequencies())
+    uint32_t pair_frequencies[256][256];
+
+    int number_of_tables;
+    unsigned char table_of_context[256];
+    // the counts of the bytes of all of the contexts that use each table, and
+    // the table's prefix code. each codeword is in the lowest bits of its
+    // number (see assign_canonical_codewords())
+    uint64_t table_frequencies[MAXIMUM_NUMBER_OF_CONTEXT_TABLES][256];
+    unsigned char code_lengths[MAXIMUM_NUMBER_OF_CONTEXT_TABLES][256];
+    uint32_t codewords[MAXIMUM_NUMBER_OF_CONTEXT_TABLES][256];
+    // how many bits the codewords of the block's bytes take up
+    uint64_t number_of_codeword_bits;
+
+    // the bytes that come after each context and their counts, for only the
+    // pairs that actually came up, one context after another. context c's are
+    // from context_starts[c] up to context_starts[c + 1]
+    int context_starts[257];
+    unsigned char following_bytes[256 * 256];
+    uint32_t following_byte_counts[256 * 256];
+};
+
+int create_context_tables(
+    struct context_model *model,
+    int codeword_length_limit
+);
+int get_context_tables_size(const struct context_model *model);
+void write_context_tables(
+    struct bit_writer *writer,
+    const struct context_model *model
+);
+void write_context_modeled_data(
+    const unsigned char *block,
+    size_t block_length,
+    const struct context_model *model,
+    struct bit_writer *writer
+);
+int read_context_tables(
+    struct bit_reader *reader,
+    int *number_of_tables,
+    unsigned char table_of_context[256],
+    unsigned char code_lengths[MAXIMUM_NUMBER_OF_CONTEXT_TABLES][256]
+);
+
+#endif
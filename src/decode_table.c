@@ -0,0 +1,164 @@
+// see decode_table.h for an explanation of how the decode table is laid out and
+// used
+
+#include "decode_table.h"
+#include "canonical_code.h"
+#include <stdlib.h>
+
+// set "number_of_entries" entries of the table, starting at "first_entry", to
+// resolve just the given symbol, whose codeword (or the rest of it) is
+// "number_of_bits" long
+void fill_entries_with_symbol(
+    struct decode_table_entry *first_entry,
+    uint32_t number_of_entries,
+    unsigned char symbol,
+    int number_of_bits
+) {
+    for (uint32_t i = 0; i < number_of_entries; i += 1) {
+        first_entry[i].number_of_bits = number_of_bits;
+        first_entry[i].number_of_symbols = 1;
+        first_entry[i].first_symbol_number_of_bits = number_of_bits;
+        first_entry[i].subtable_bits = 0;
+        first_entry[i].symbols[0] = symbol;
+        first_entry[i].subtable_index = 0;
+    }
+}
+
+// start a decode table that has no memory yet
+void init_decode_table(struct decode_table *table) {
+    table->entries = NULL;
+    table->number_of_entries = 0;
+    table->capacity = 0;
+}
+
+// create the decode table (on the heap) for the canonical prefix code with the
+// given code lengths, which must have been checked with check_code_lengths().
+// the table's memory from before is reused if it is big enough. returns whether
+// the memory could be allocated
+int create_decode_table(
+    const unsigned char code_lengths[256],
+    struct decode_table *table
+) {
+    const int primary_bits = DECODE_TABLE_PRIMARY_BITS;
+    const uint32_t primary_size = (uint32_t)1 << primary_bits;
+
+    uint32_t codewords[256];
+    assign_canonical_codewords(code_lengths, codewords);
+
+    // for each primary entry, find the longest codeword that starts with its
+    // bits but doesn't fit in the primary table, which decides how wide its
+    // subtable needs to be
+    unsigned char longest_code_length[1 << DECODE_TABLE_PRIMARY_BITS] = {0};
+    for (int i = 0; i < 256; i += 1) {
+        if (code_lengths[i] > primary_bits) {
+            uint32_t prefix = codewords[i] >> (code_lengths[i] - primary_bits);
+            if (code_lengths[i] > longest_code_length[prefix]) {
+                longest_code_length[prefix] = code_lengths[i];
+            }
+        }
+    }
+    uint32_t number_of_entries = primary_size;
+    for (uint32_t prefix = 0; prefix < primary_size; prefix += 1) {
+        if (longest_code_length[prefix] > 0) {
+            number_of_entries += (uint32_t)1
+                              << (longest_code_length[prefix] - primary_bits);
+        }
+    }
+
+    if (number_of_entries > table->capacity) {
+        free(table->entries);
+        table->entries = malloc(number_of_entries * sizeof (*table->entries));
+        table->capacity = number_of_entries;
+        if (table->entries == NULL) {
+            table->capacity = 0;
+            return 1;
+        }
+    }
+    table->number_of_entries = number_of_entries;
+
+    // point the primary entries of long codewords to their subtables
+    uint32_t next_subtable_index = primary_size;
+    for (uint32_t prefix = 0; prefix < primary_size; prefix += 1) {
+        if (longest_code_length[prefix] > 0) {
+            struct decode_table_entry *entry = &table->entries[prefix];
+            entry->number_of_bits = primary_bits;
+            entry->number_of_symbols = 0;
+            entry->first_symbol_number_of_bits = 0;
+            entry->subtable_bits = longest_code_length[prefix] - primary_bits;
+            entry->subtable_index = next_subtable_index;
+            next_subtable_index += (uint32_t)1 << entry->subtable_bits;
+        }
+    }
+
+    // a codeword that is shorter than the table is wide is the start of all of
+    // the bit patterns that have it as their first bits, so it fills the range
+    // of entries that have any bits after it
+    for (int i = 0; i < 256; i += 1) {
+        int length = code_lengths[i];
+        if (length == 0) {
+            continue;
+        }
+
+        if (length <= primary_bits) {
+            fill_entries_with_symbol(
+                &table->entries[codewords[i] << (primary_bits - length)],
+                (uint32_t)1 << (primary_bits - length),
+                i,
+                length
+            );
+        } else {
+            const struct decode_table_entry *link = &table->entries[
+                codewords[i] >> (length - primary_bits)
+            ];
+            int rest_length = length - primary_bits;
+            uint32_t rest = codewords[i] & (((uint32_t)1 << rest_length) - 1);
+            fill_entries_with_symbol(
+                &table->entries[
+                    link->subtable_index
+                    + (rest << (link->subtable_bits - rest_length))
+                ],
+                (uint32_t)1 << (link->subtable_bits - rest_length),
+                i,
+                rest_length
+            );
+        }
+    }
+
+    // pack more symbols into the primary entries whose bits have room left over
+    // for more whole codewords. the entry for the leftover bits (followed by
+    // 0s) starts with the next codeword, and its first symbol is still the
+    // original single symbol even if it has already been packed
+    for (uint32_t i = 0; i < primary_size; i += 1) {
+        struct decode_table_entry *entry = &table->entries[i];
+        if (entry->number_of_symbols == 0) {
+            continue;
+        }
+        while (
+            entry->number_of_symbols < DECODE_TABLE_MAX_SYMBOLS_PER_ENTRY
+            && entry->number_of_bits < primary_bits
+        ) {
+            const struct decode_table_entry *next = &table->entries[
+                (i << entry->number_of_bits) & (primary_size - 1)
+            ];
+            if (
+                next->number_of_symbols == 0
+                || next->first_symbol_number_of_bits
+                   > primary_bits - entry->number_of_bits
+            ) {
+                break;
+            }
+            entry->symbols[entry->number_of_symbols] = next->symbols[0];
+            entry->number_of_symbols += 1;
+            entry->number_of_bits += next->first_symbol_number_of_bits;
+        }
+    }
+
+    return 0;
+}
+
+void free_decode_table(struct decode_table *table) {
+    free(table->entries);
+    table->entries = NULL;
+    table->number_of_entries = 0;
+    table->capacity = 0;
+}
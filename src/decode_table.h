@@ -0,0 +1,61 @@
+// walking the huffman tree one bit at a time is simple, but it means that
+// decoding a symbol costs one step per bit of its codeword. a decode table lets
+// us instead look at the next several bits all at once and jump straight to the
+// answer
+//
+// the primary table has one entry for every possible value of the next
+// DECODE_TABLE_PRIMARY_BITS bits. those bits can either:
+// 1. start with a whole codeword. the entry then holds that codeword's symbol
+//    and length. if there are bits left over that start with another whole
+//    codeword, that one gets added too, so one entry can hold up to
+//    DECODE_TABLE_MAX_SYMBOLS_PER_ENTRY short codewords in a row
+// 2. be the start of a codeword that is longer than the table is wide. the
+//    entry then points to a subtable for the rest of the bits of all of the
+//    codewords that start with those bits. the subtable is only as wide as the
+//    longest of those codewords needs, and since codewords are at most
+//    MAXIMUM_CODEWORD_LENGTH bits long (see canonical_code.h), a subtable never
+//    needs a subtable of its own
+//
+// all of the tables are stored one after another in a single array, so an
+// entry refers to its subtable by the index where the subtable starts
+
+#ifndef DECODE_TABLE_H
+#define DECODE_TABLE_H
+
+#include <stdint.h>
+
+#define DECODE_TABLE_PRIMARY_BITS 11
+#define DECODE_TABLE_MAX_SYMBOLS_PER_ENTRY 4
+
+struct decode_table_entry {
+    // if this entry resolves symbols, the total number of bits used by all of
+    // them. if it points to a subtable, the number of bits used to get to the
+    // subtable (which is the width of the table that this entry is in)
+    unsigned char number_of_bits;
+    // 0 means that this entry points to a subtable instead
+    unsigned char number_of_symbols;
+    // the number of bits used by only the first symbol, for when we can't use
+    // all of the symbols (because we are near the end of the data)
+    unsigned char first_symbol_number_of_bits;
+    // the width of the subtable that this entry points to
+    unsigned char subtable_bits;
+    unsigned char symbols[DECODE_TABLE_MAX_SYMBOLS_PER_ENTRY];
+    uint32_t subtable_index;
+};
+
+struct decode_table {
+    // the primary table starts at index 0 and is followed by the subtables
+    struct decode_table_entry *entries;
+    uint32_t number_of_entries;
+    // how many entries there is memory for, which is kept for the next table
+    uint32_t capacity;
+};
+
+void init_decode_table(struct decode_table *table);
+int create_decode_table(
+    const unsigned char code_lengths[256],
+    struct decode_table *table
+);
+void free_decode_table(struct decode_table *table);
+
+#endif
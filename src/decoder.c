@@ -1,246 +1,1020 @@
-#define _DEFAULT_SOURCE // for endian.h
-#include "bitbuffer.h"
-#include "huffman_tree.h"
-#include <endian.h>
-#include <inttypes.h>
+// see block_format.h for an outline of the compressed file format
+
+#include "adaptive_huffman.h"
+#include "batch.h"
+#include "block_decoder.h"
+#include "block_format.h"
+#include "canonical_code.h"
+#include "checksum.h"
+#include "dictionary.h"
+#include "file_io.h"
+#include "histogram.h"
+#include "legacy_decoder.h"
+#include "run_stats.h"
+#include "thread_pool.h"
+#include "transparent_huff.h"
+#include <ctype.h>
+#include <errno.h>
+#include <getopt.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
-// create node by reading the bits that should represent the node. if it's a
-// branch node, do the same with its child nodes. returns whether the reading
-// was successful
-//
-// see comment on write_huffman_tree() in encoder.c for how the tree was written
-int read_node_recursive(
-    FILE *file,
-    struct bit_buffer *buffer,
-    struct node **node,
-    int depth
-) {
-    // we have gone past the maximum possible codeword length / depth (see
-    // comment of prefix_code_mapping struct in encoder.c). this means that the
-    // compressed file is invalid
-    if (depth >= 256) {
+#define MAXIMUM_NUMBER_OF_THREADS 256
+// how many bytes of a legacy file are read at once, and how many bytes are
+// decoded from them at once. a byte of a legacy file decodes to at most 8
+// bytes (when every codeword is 1 bit long)
+#define LEGACY_READ_SIZE (64 * 1024)
+#define LEGACY_DECODE_SIZE (8 * LEGACY_READ_SIZE)
+
+// everything about 1 block: its compressed bytes, the decode table (in the
+// block decoder), and the decoded result. the decoding can happen on a worker
+// thread, but the reading and writing happens on the main thread, in block
+// order
+struct block_job {
+    struct job job;
+
+    bool use_tree_walk;
+    struct block_decoder decoder;
+    // the tree that is carried from block to block in an adaptive file, or
+    // NULL if the file isn't adaptive
+    struct adaptive_huffman_tree *adaptive_tree;
+    // the dictionary that every block of a file with a dictionary is decoded
+    // with, or NULL if the file doesn't have one
+    const struct dictionary *dictionary;
+    // parts 3 to 7 of the block (see block_format.h), either in the input
+    // file's mapping or in the job's own memory
+    const unsigned char *compressed_block;
+    uint32_t compressed_block_length;
+    unsigned char *compressed_block_buffer;
+
+    unsigned char *block;
+    uint32_t block_length;
+    // where the block's bytes start in the decompressed data
+    uint64_t offset;
+    int exit_status;
+    // whether the file has checksums, and the checksum that the block's bytes
+    // should have
+    bool has_checksum;
+    uint32_t checksum;
+
+    // the decoded bytes are only counted for --stats, since the decoder has no
+    // other use for the counts
+    bool should_count_bytes;
+    uint64_t byte_frequencies[256];
+    double decode_seconds;
+};
+
+// decode the job's compressed block into its memory for the block, and check
+// its checksum if it has one. the job's exit status is whether the decoding
+// was successful, where each kind of problem has its own number (see
+// decode_block() and decode_adaptive_block())
+void decompress_block(void *argument) {
+    struct block_job *block_job = argument;
+    double start_time = get_time_in_seconds();
+    if (block_job->adaptive_tree != NULL) {
+        block_job->exit_status = decode_adaptive_block(
+            block_job->adaptive_tree,
+            block_job->compressed_block,
+            block_job->compressed_block_length,
+            block_job->block,
+            block_job->block_length
+        );
+    } else if (block_job->dictionary != NULL) {
+        block_job->exit_status = decode_dictionary_block(
+            block_job->dictionary,
+            block_job->use_tree_walk,
+            block_job->compressed_block,
+            block_job->compressed_block_length,
+            block_job->block,
+            block_job->block_length
+        );
+    } else {
+        block_job->exit_status = decode_block(
+            &block_job->decoder,
+            block_job->use_tree_walk,
+            block_job->compressed_block,
+            block_job->compressed_block_length,
+            block_job->block,
+            block_job->block_length
+        );
+    }
+    if (
+        block_job->exit_status == 0
+        && block_job->has_checksum
+        && update_crc32c(0, block_job->block, block_job->block_length)
+           != block_job->checksum
+    ) {
+        block_job->exit_status = 14;
+    }
+    block_job->decode_seconds = get_time_in_seconds() - start_time;
+    if (block_job->exit_status == 0 && block_job->should_count_bytes) {
+        count_byte_frequencies(
+            block_job->block,
+            block_job->block_length,
+            block_job->byte_frequencies
+        );
+    }
+}
+
+// read a big-endian 32-bit number from the file. returns whether it was
+// successful
+int read_big_endian_32_bits(struct input_file *file, uint32_t *number) {
+    unsigned char buffer[4];
+    const unsigned char *bytes;
+    size_t number_of_bytes_read;
+    if (
+        read_from_input_file(file, buffer, 4, &bytes, &number_of_bytes_read)
+        || number_of_bytes_read < 4
+    ) {
+        return 1;
+    }
+    *number = get_big_endian_32_bits(bytes);
+    return 0;
+}
+
+// read a big-endian 64-bit number from the file. returns whether it was
+// successful
+int read_big_endian_64_bits(struct input_file *file, uint64_t *number) {
+    uint32_t high_bits;
+    uint32_t low_bits;
+    if (
+        read_big_endian_32_bits(file, &high_bits)
+        || read_big_endian_32_bits(file, &low_bits)
+    ) {
         return 1;
     }
+    *number = (uint64_t)high_bits << 32 | low_bits;
+    return 0;
+}
 
-    if (buffer->length < 1) {
-        buffer_append_byte(buffer, fgetc(file));
+// read the magic number and the format version at the start of the file, and
+// set "version" to the version and "has_checksums" to whether the file has
+// checksums. a legacy file (see legacy_decoder.h) has neither, so for one of
+// those, "is_legacy" is set to true, and "legacy_number_of_bytes" is set to
+// the first 4 bytes, which are really its number of bytes. a file with a
+// dictionary also has the dictionary's ID, which "dictionary_id" is set to.
+// returns whether the reading was successful, with the same numbers as the
+// exit status of decode_block()
+int read_file_header(
+    struct input_file *file,
+    int *version,
+    bool *has_checksums,
+    bool *is_legacy,
+    uint32_t *legacy_number_of_bytes,
+    uint32_t *dictionary_id
+) {
+    uint32_t magic_number;
+    if (read_big_endian_32_bits(file, &magic_number)) {
+        return 1;
+    }
+    *is_legacy = magic_number != FILE_MAGIC_NUMBER;
+    if (*is_legacy) {
+        *legacy_number_of_bytes = magic_number;
+        return 0;
     }
 
-    // 0 is a branch node; 1 is a leaf node
-    if (buffer->bits[0] == 0) {
-        buffer_drop_left_bits(buffer, 1);
-        *node = create_node(0, -1); // we don't need the weight, so -1
-        int left_exit_status = read_node_recursive(
+    unsigned char buffer[1];
+    const unsigned char *version_byte;
+    size_t number_of_bytes_read;
+    if (
+        read_from_input_file(
             file,
             buffer,
-            &((*node)->left_child),
-            depth + 1
-        );
-        if (left_exit_status) {
+            1,
+            &version_byte,
+            &number_of_bytes_read
+        )
+        || number_of_bytes_read < 1
+    ) {
+        return 1;
+    }
+    *version = *version_byte & ~FORMAT_FLAGS;
+    *has_checksums = *version_byte & FORMAT_FLAG_CHECKSUMS;
+    if (!is_format_version_known(*version)) {
+        return 7;
+    }
+    if (
+        *version == FORMAT_VERSION_DICTIONARY
+        && read_big_endian_32_bits(file, dictionary_id)
+    ) {
+        return 1;
+    }
+    return 0;
+}
+
+// read the next block's header from the file (which has the given format
+// version, and has checksums if the job says so) and then the rest of the
+// block into the job's memory, growing that memory if needed. set
+// "is_end_marker" to whether it was the block with no bytes that marks the end
+// of the compressed data. returns whether the reading was successful, where
+// each kind of problem has its own number (the same ones as the exit status of
+// decode_block())
+int read_block(
+    struct input_file *file,
+    int version,
+    struct block_job *block_job,
+    bool *is_end_marker
+) {
+    if (read_big_endian_32_bits(file, &block_job->block_length)) {
+        return 1;
+    }
+    *is_end_marker = block_job->block_length == 0;
+    if (*is_end_marker) {
+        return 0;
+    }
+    if (read_big_endian_32_bits(file, &block_job->compressed_block_length)) {
+        return 1;
+    }
+    // the block's checksum is read along with the rest of it, but it isn't
+    // counted in "compressed_block_length"
+    uint32_t checksum_size = 0;
+    if (block_job->has_checksum) {
+        if (block_job->compressed_block_length < BLOCK_CHECKSUM_SIZE) {
             return 1;
         }
-        int right_exit_status = read_node_recursive(
-            file,
-            buffer,
-            &((*node)->right_child),
-            depth + 1
+        checksum_size = BLOCK_CHECKSUM_SIZE;
+        block_job->compressed_block_length -= checksum_size;
+    }
+    if (!are_block_sizes_valid_in_version(
+        version,
+        block_job->block_length,
+        block_job->compressed_block_length
+    )) {
+        return 1;
+    }
+
+    // the memory is only ever grown, so it ends up being reused for the blocks
+    // after this one, which are usually the same size
+    unsigned char *block = realloc(block_job->block, block_job->block_length);
+    if (block == NULL) {
+        return 3;
+    }
+    block_job->block = block;
+    // the compressed blocks of a mapped input file are used right where they
+    // are, so they don't need any memory of their own
+    if (file->mapped_bytes == NULL) {
+        unsigned char *compressed_block = realloc(
+            block_job->compressed_block_buffer,
+            block_job->compressed_block_length + checksum_size
         );
-        if (right_exit_status) {
-            return 1;
-        }
-    } else {
-        buffer_drop_left_bits(buffer, 1);
-        // make sure we have enough bits in buffer to get the node's symbol
-        if (buffer->length < 8) {
-            buffer_append_byte(buffer, fgetc(file));
+        if (compressed_block == NULL) {
+            return 3;
         }
-        unsigned char symbol = convert_bits_to_byte(buffer->bits, 8);
-        *node = create_node(symbol, -1); // we don't need the weight, so -1
-        buffer_drop_left_bits(buffer, 8);
+        block_job->compressed_block_buffer = compressed_block;
+    }
+
+    size_t bytes_read;
+    if (read_from_input_file(
+        file,
+        block_job->compressed_block_buffer,
+        block_job->compressed_block_length + checksum_size,
+        &block_job->compressed_block,
+        &bytes_read
+    ) || bytes_read < block_job->compressed_block_length + checksum_size) {
+        return 4;
+    }
+    if (block_job->has_checksum) {
+        block_job->checksum = get_big_endian_32_bits(
+            block_job->compressed_block + block_job->compressed_block_length
+        );
     }
     return 0;
 }
 
-// reconstruct the huffman tree that is written in the compressed file. returns
-// whether the reading was successful
-int read_huffman_tree(FILE *file, struct node **tree) {
-    struct bit_buffer buffer;
-    buffer.length = 0;
-
-    if (read_node_recursive(file, &buffer, tree, 0)) {
-        // it would have too much depth
+// read a range given as "OFFSET:LENGTH", which are both numbers of bytes.
+// returns whether it was successful
+int parse_range(const char *text, uint64_t *offset, uint64_t *length) {
+    if (!isdigit((unsigned char)text[0])) {
         return 1;
     }
-    if (is_leaf_node(*tree)) {
-        // it is just 1 leaf node
+    errno = 0;
+    char *end;
+    *offset = strtoull(text, &end, 10);
+    if (*end != ':' || !isdigit((unsigned char)end[1])) {
         return 1;
-    } else {
-        return 0;
     }
+    *length = strtoull(end + 1, &end, 10);
+    return *end != '\0' || errno != 0;
 }
 
-// if the node is a leaf, get its symbol and drop the bits used to get here;
-// else, use the current bit to determine which child node to follow. returns
-// whether the decoding was successful
-int decode_codeword_recursive(
-    struct bit_buffer *buffer,
-    int buffer_index,
-    const struct node *node,
-    unsigned char *symbol
+// if the compressed file (which has checksums if "has_checksums" is true) is
+// mapped into memory and ends with a seek index (see block_format.h), move the
+// file's position to the block that the byte at "range_start" is in, and set
+// "offset" to where that block's bytes start in the decompressed data and
+// "block_length" to how many bytes the index says that it has. a file without
+// a seek index is left where it is. returns whether it was successful, with
+// the same numbers as the exit status of decode_block()
+int seek_to_range(
+    struct input_file *file,
+    bool has_checksums,
+    uint64_t range_start,
+    uint64_t *offset,
+    uint64_t *block_length
 ) {
-    if (is_leaf_node(node)) {
-        // remove from the buffer the number of bits we read to resolve this
-        // codeword, which we can determine from the buffer index
-        buffer_drop_left_bits(buffer, buffer_index);
-        *symbol = node->symbol;
+    uint64_t number_of_entries;
+    if (
+        file->mapped_bytes == NULL
+        || !find_seek_index(
+            file->mapped_bytes,
+            file->number_of_mapped_bytes,
+            &number_of_entries
+        )
+        || number_of_entries == 0
+    ) {
         return 0;
     }
-
-    // we are on a branch node, but are out of bits in the buffer, so we don't
-    // know which direction to go. this means that the compressed file is
-    // invalid
-    if (buffer_index == buffer->length) {
-        return 1;
+    const unsigned char *entries = file->mapped_bytes
+                                 + file->number_of_mapped_bytes
+                                 - SEEK_INDEX_FOOTER_SIZE
+                                 - number_of_entries * SEEK_INDEX_ENTRY_SIZE;
+    size_t trailer_start = entries - file->mapped_bytes - FILE_TRAILER_SIZE
+                         - (has_checksums ? FILE_CHECKSUM_SIZE : 0);
+    uint64_t total_number_of_bytes = get_big_endian_64_bits(
+        file->mapped_bytes + trailer_start + 4
+    );
+    // the file is mapped, so moving its position is all it takes to skip
+    // ahead. a range that starts after the data goes straight to the end
+    // marker
+    if (range_start >= total_number_of_bytes) {
+        if (trailer_start < file->position) {
+            return 12;
+        }
+        file->position = trailer_start;
+        *offset = total_number_of_bytes;
+        *block_length = 0;
+        return 0;
     }
 
-    struct node *child_to_follow;
-    if (buffer->bits[buffer_index] == false) {
-        child_to_follow = node->left_child;
-    } else {
-        child_to_follow = node->right_child;
+    // find the last block that starts at or before the range
+    uint64_t low = 0;
+    uint64_t high = number_of_entries;
+    while (high - low > 1) {
+        uint64_t middle = low + (high - low) / 2;
+        const unsigned char *entry = entries + middle * SEEK_INDEX_ENTRY_SIZE;
+        if (get_big_endian_64_bits(entry + 8) <= range_start) {
+            low = middle;
+        } else {
+            high = middle;
+        }
     }
-    return decode_codeword_recursive(
-        buffer,
-        buffer_index + 1,
-        child_to_follow,
-        symbol
-    );
+    const unsigned char *entry = entries + low * SEEK_INDEX_ENTRY_SIZE;
+    uint64_t compressed_offset = get_big_endian_64_bits(entry);
+    uint64_t block_offset = get_big_endian_64_bits(entry + 8);
+    uint64_t next_block_offset = total_number_of_bytes;
+    if (low + 1 < number_of_entries) {
+        next_block_offset = get_big_endian_64_bits(
+            entry + SEEK_INDEX_ENTRY_SIZE + 8
+        );
+    }
+    // the entries can't be trusted to be in order, so the block that was
+    // found has to actually hold the start of the range
+    if (
+        block_offset > range_start
+        || next_block_offset <= range_start
+        || next_block_offset - block_offset > MAXIMUM_BLOCK_LENGTH
+        || compressed_offset < file->position
+        || compressed_offset >= trailer_start
+    ) {
+        return 12;
+    }
+    file->position = compressed_offset;
+    *offset = block_offset;
+    *block_length = next_block_offset - block_offset;
+    return 0;
 }
 
-// decode 1 codeword's worth of bits from the buffer into its symbol by using
-// the bits as a path in the huffman tree. return whether the decoding was
-// successful
-int decode_codeword(
-    struct bit_buffer *buffer,
-    const struct node *tree,
-    unsigned char *symbol
+// decode the rest of a legacy file (see legacy_decoder.h), whose first 4 bytes
+// said that it has "number_of_bytes" bytes, and write the bytes from
+// "range_start" up to (but not including) "range_end" to the output (or
+// nowhere, if it is NULL). the decoding stops once the range has been
+// written. the file's bytes are counted in the stats if "should_count_bytes"
+// is true. returns whether it was successful, with the same numbers as the
+// exit status of decode_block()
+int decode_legacy_file(
+    struct input_file *file,
+    uint32_t number_of_bytes,
+    struct output_file *output,
+    uint64_t range_start,
+    uint64_t range_end,
+    bool should_count_bytes,
+    struct run_stats *stats
 ) {
-    return decode_codeword_recursive(buffer, 0, tree, symbol);
-}
+    struct legacy_decoder *decoder = malloc(sizeof (*decoder));
+    unsigned char *buffer = malloc(LEGACY_READ_SIZE);
+    unsigned char *decoded = malloc(LEGACY_DECODE_SIZE);
+    if (decoder == NULL || buffer == NULL || decoded == NULL) {
+        free(decoder);
+        free(buffer);
+        free(decoded);
+        return 3;
+    }
+    init_legacy_decoder(decoder, number_of_bytes);
 
-// decode the encoded data from the input file and write it to the output file.
-// returns whether the decoding was successful
-int decode_data_and_write(
-    FILE *file_in,
-    const struct node *huffman_tree,
-    FILE *file_out,
-    uint32_t number_of_bytes_to_decode
-) {
-    struct bit_buffer buffer;
-    buffer.length = 0;
-
-    uint32_t number_of_bytes_decoded = 0;
-    bool have_reached_end_of_file = false;
-    do {
-        // the longest codeword length possible is 255 (see prefix_code_mapping
-        // struct comment in encoder.c), so we want to get at least that many
-        // bits (unless we're at the end of the file) in order to make sure that
-        // the codeword will reach a leaf node when traversing the tree
-        while (buffer.length < 255 && !have_reached_end_of_file) {
-            int value = fgetc(file_in);
-            if (value != EOF) {
-                buffer_append_byte(&buffer, (unsigned char)value);
-            } else {
-                have_reached_end_of_file = true;
+    // the file is 1 stream instead of blocks, so it is read and decoded in
+    // pieces, and the bytes of a piece that didn't fit in the decoded bytes
+    // are given to the decoder again
+    uint64_t offset = 0;
+    const unsigned char *bytes = NULL;
+    size_t number_of_unused_bytes = 0;
+    int decoding_exit_status = 0;
+    while (
+        decoding_exit_status == 0
+        && get_legacy_decoding_status(decoder) != 0
+        && offset < range_end
+    ) {
+        if (number_of_unused_bytes == 0) {
+            double read_start_time = get_time_in_seconds();
+            if (read_available_from_input_file(
+                file,
+                buffer,
+                LEGACY_READ_SIZE,
+                &bytes,
+                &number_of_unused_bytes
+            )) {
+                decoding_exit_status = 1;
+                break;
+            }
+            add_phase_time(
+                stats,
+                RUN_PHASE_READ,
+                get_time_in_seconds() - read_start_time
+            );
+            // the file ended before all of its bytes were decoded
+            if (number_of_unused_bytes == 0) {
+                decoding_exit_status = get_legacy_decoding_status(decoder);
+                break;
             }
         }
 
-        // there is not enough encoded data to decode the specified number of
-        // bytes. this means that the compressed file is invalid
-        if (buffer.length == 0) {
-            return 1;
+        double decode_start_time = get_time_in_seconds();
+        size_t number_of_bytes_used;
+        size_t number_of_bytes_decoded;
+        decoding_exit_status = decode_legacy_data(
+            decoder,
+            bytes,
+            number_of_unused_bytes,
+            &number_of_bytes_used,
+            decoded,
+            LEGACY_DECODE_SIZE,
+            &number_of_bytes_decoded
+        );
+        bytes += number_of_bytes_used;
+        number_of_unused_bytes -= number_of_bytes_used;
+        if (should_count_bytes) {
+            uint64_t byte_frequencies[256];
+            count_byte_frequencies(
+                decoded,
+                number_of_bytes_decoded,
+                byte_frequencies
+            );
+            add_block_to_run_stats(
+                stats,
+                byte_frequencies,
+                decoder->code_lengths
+            );
         }
+        add_phase_time(
+            stats,
+            RUN_PHASE_DECODE,
+            get_time_in_seconds() - decode_start_time
+        );
 
-        unsigned char symbol;
-        if (decode_codeword(&buffer, huffman_tree, &symbol)) {
-            return 2;
+        // only the part of the decoded bytes that is in the range is written
+        uint64_t write_start = 0;
+        uint64_t write_end = number_of_bytes_decoded;
+        if (range_start > offset) {
+            write_start = range_start - offset;
         }
-        number_of_bytes_decoded += 1;
-        fputc(symbol, file_out);
-    } while (number_of_bytes_decoded < number_of_bytes_to_decode);
+        if (range_end - offset < write_end) {
+            write_end = range_end - offset;
+        }
+        if (output != NULL && write_start < write_end) {
+            double write_start_time = get_time_in_seconds();
+            write_to_output_file(
+                output,
+                decoded + write_start,
+                write_end - write_start
+            );
+            add_phase_time(
+                stats,
+                RUN_PHASE_WRITE,
+                get_time_in_seconds() - write_start_time
+            );
+        }
+        offset += number_of_bytes_decoded;
+    }
 
-    return 0;
+    free(decoder);
+    free(buffer);
+    free(decoded);
+    return decoding_exit_status;
 }
 
 int main(int argc, char **argv) {
-    if (argc < 2) {
-        fprintf(
-            stderr,
-            "Error: You must specify the name of the file you want to"
-            " decompress.\nFor example: %s slss.compressed\n",
-            argv[0]
-        );
+    struct run_stats stats;
+    init_run_stats(&stats, "decoder", false);
+
+    // by default, codewords are decoded with the decode table, but the simpler
+    // (and much slower) tree walk can still be used as a reference
+    bool use_tree_walk = false;
+    int number_of_threads = 1;
+    bool should_print_stats = false;
+    const char *dictionary_filename = NULL;
+    bool is_batch = false;
+    // with --test, the data is decoded and checked, but not written
+    bool is_testing = false;
+    // with --range, only the bytes from "range_start" up to (but not
+    // including) "range_end" are written
+    bool has_range = false;
+    uint64_t range_start = 0;
+    uint64_t range_end = UINT64_MAX;
+    const struct option long_options[] = {
+        {"tree-walk", no_argument, NULL, 'w'},
+        {"threads", required_argument, NULL, 'T'},
+        {"stats", required_argument, NULL, 'j'},
+        {"dict", required_argument, NULL, 'd'},
+        {"batch", no_argument, NULL, 'B'},
+        {"range", required_argument, NULL, 'r'},
+        {"test", no_argument, NULL, 't'},
+        {0, 0, 0, 0}
+    };
+    int option;
+    while ((option = getopt_long(argc, argv, "T:", long_options, NULL)) != -1) {
+        if (option == 'w') {
+            use_tree_walk = true;
+        } else if (option == 'T') {
+            number_of_threads = atoi(optarg);
+            if (
+                number_of_threads < 1
+                || number_of_threads > MAXIMUM_NUMBER_OF_THREADS
+            ) {
+                fprintf(
+                    stderr,
+                    "Error: The number of threads must be from 1 to %d.\n",
+                    MAXIMUM_NUMBER_OF_THREADS
+                );
+                return 1;
+            }
+        } else if (option == 'j') {
+            if (strcmp(optarg, "json") != 0) {
+                fprintf(stderr, "Error: The stats format must be json.\n");
+                return 1;
+            }
+            should_print_stats = true;
+        } else if (option == 'd') {
+            dictionary_filename = optarg;
+        } else if (option == 'B') {
+            is_batch = true;
+        } else if (option == 't') {
+            is_testing = true;
+        } else if (option == 'r') {
+            uint64_t range_length;
+            if (parse_range(optarg, &range_start, &range_length)) {
+                fprintf(
+                    stderr,
+                    "Error: The range must be OFFSET:LENGTH, in bytes.\n"
+                );
+                return 1;
+            }
+            has_range = true;
+            range_end = range_length > UINT64_MAX - range_start
+                      ? UINT64_MAX
+                      : range_start + range_length;
+        } else {
+            return 1;
+        }
+    }
+
+    // without a filename (or with a filename of "-"), the compressed data is
+    // read from stdin, so the decoder can be used in the middle of a pipeline
+    const char *filename = NULL;
+    if (optind < argc && strcmp(argv[optind], "-") != 0) {
+        filename = argv[optind];
+    }
+    if (has_range && is_batch) {
+        fprintf(stderr, "Error: --range can't be used with --batch.\n");
         return 1;
     }
-    FILE *file_in = fopen(argv[1], "r");
-    if (!file_in) {
+    // the dictionary is loaded before anything else, since there is no point
+    // in reading the input without it
+    struct dictionary dictionary;
+    if (dictionary_filename != NULL) {
+        int reading_exit_status = read_dictionary_file(
+            dictionary_filename,
+            &dictionary
+        );
+        if (reading_exit_status == 1) {
+            fprintf(stderr, "Error: Could not read the dictionary file.\n");
+            return 1;
+        } else if (reading_exit_status == 2) {
+            fprintf(stderr, "Error: The dictionary file is invalid.\n");
+            return 1;
+        } else if (reading_exit_status == 3) {
+            fprintf(stderr, "Error: Unable to allocate the decode table.\n");
+            return 1;
+        }
+    }
+    // with --batch, every file that is named (or listed on stdin) is
+    // decompressed into a file next to it instead (see batch.h)
+    if (is_batch) {
+        struct batch_options batch_options = {
+            .is_compressing = false,
+            .number_of_threads = number_of_threads,
+            .should_print_stats = should_print_stats,
+            .use_tree_walk = use_tree_walk,
+            .is_testing = is_testing,
+            .dictionary = dictionary_filename != NULL ? &dictionary : NULL
+        };
+        int batch_exit_status = run_batch(
+            &batch_options,
+            argv + optind,
+            argc - optind
+        );
+        if (dictionary_filename != NULL) {
+            free_dictionary_tables(&dictionary);
+        }
+        return batch_exit_status;
+    }
+    struct input_file file_in;
+    if (open_input_file(filename, &file_in)) {
         fprintf(stderr, "Error: Could not open input file.\n");
+        if (dictionary_filename != NULL) {
+            free_dictionary_tables(&dictionary);
+        }
         return 1;
     }
+    struct output_file file_out;
+    if (open_output_file(STDOUT_FILENO, &file_out)) {
+        fprintf(stderr, "Error: Unable to allocate memory for decoding.\n");
+        close_input_file(&file_in);
+        if (dictionary_filename != NULL) {
+            free_dictionary_tables(&dictionary);
+        }
+        return 1;
+    }
+    // the input is read and the output is written on threads of their own
+    // (see io_thread.h), while this thread (and the workers) code the blocks
+    start_reading_ahead(&file_in);
+    start_writing_in_background(&file_out);
 
-    uint32_t number_of_bytes_to_decode;
-    if (fread(&number_of_bytes_to_decode, sizeof (uint32_t), 1, file_in) < 1) {
-        fprintf(
-            stderr,
-            "Error: Unable to read the number of bytes to decode.\n"
-            "The compressed file is invalid.\n"
+    int version = 0;
+    bool has_checksums = false;
+    bool is_legacy = false;
+    uint32_t legacy_number_of_bytes;
+    uint32_t dictionary_id;
+    int decoding_exit_status = read_file_header(
+        &file_in,
+        &version,
+        &has_checksums,
+        &is_legacy,
+        &legacy_number_of_bytes,
+        &dictionary_id
+    );
+    // a legacy file is 1 stream instead of blocks, so it is decoded on this
+    // thread, and none of the block jobs below are used for it
+    if (decoding_exit_status == 0 && is_legacy) {
+        number_of_threads = 1;
+        decoding_exit_status = decode_legacy_file(
+            &file_in,
+            legacy_number_of_bytes,
+            is_testing ? NULL : &file_out,
+            range_start,
+            range_end,
+            should_print_stats,
+            &stats
         );
-        fclose(file_in);
-        return 1;
     }
-    // convert from big endian to host endianness
-    number_of_bytes_to_decode = be32toh(number_of_bytes_to_decode);
 
-    struct node *reconstructed_huffman_tree = NULL;
-    if (read_huffman_tree(file_in, &reconstructed_huffman_tree)) {
-        fclose(file_in);
-        free_node_recursive(reconstructed_huffman_tree);
-        fprintf(
-            stderr,
-            "Error: Unable to read a proper binary Huffman tree.\n"
-            "The compressed file is invalid.\n"
+    // a file with a dictionary can only be decoded with that same dictionary
+    const struct dictionary *dictionary_to_use = NULL;
+    if (decoding_exit_status == 0 && version == FORMAT_VERSION_DICTIONARY) {
+        if (dictionary_filename == NULL || dictionary.id != dictionary_id) {
+            decoding_exit_status = 11;
+        }
+        dictionary_to_use = &dictionary;
+    }
+
+    // each block of an adaptive file is decoded with the tree that the blocks
+    // before it left behind, so they can only be decoded one at a time, and
+    // each one is written as soon as it has been decoded
+    struct adaptive_huffman_tree *adaptive_tree = NULL;
+    if (decoding_exit_status == 0 && version == FORMAT_VERSION_ADAPTIVE) {
+        number_of_threads = 1;
+        adaptive_tree = malloc(sizeof (*adaptive_tree));
+        if (adaptive_tree == NULL) {
+            decoding_exit_status = 3;
+        } else {
+            init_adaptive_huffman_tree(adaptive_tree);
+        }
+    }
+
+    // with 1 thread, everything happens on the main thread. with more, the
+    // blocks are decoded by that many worker threads while the main thread
+    // reads and writes. there are twice as many block jobs as threads, so that
+    // the workers have more blocks to go on with while the main thread waits
+    // for the oldest block to be done
+    struct thread_pool pool;
+    struct thread_pool *pool_to_use = NULL;
+    if (number_of_threads > 1) {
+        if (create_thread_pool(&pool, number_of_threads)) {
+            fprintf(stderr, "Error: Unable to start the threads.\n");
+            free(adaptive_tree);
+            close_output_file(&file_out);
+            close_input_file(&file_in);
+            if (dictionary_filename != NULL) {
+                free_dictionary_tables(&dictionary);
+            }
+            return 1;
+        }
+        pool_to_use = &pool;
+    }
+    int number_of_block_jobs = number_of_threads > 1
+                             ? 2 * number_of_threads
+                             : 1;
+    struct block_job *block_jobs = calloc(
+        number_of_block_jobs,
+        sizeof (*block_jobs)
+    );
+
+    if (block_jobs == NULL && decoding_exit_status == 0) {
+        decoding_exit_status = 3;
+    }
+    for (int i = 0; block_jobs != NULL && i < number_of_block_jobs; i += 1) {
+        init_block_decoder(&block_jobs[i].decoder);
+        block_jobs[i].adaptive_tree = adaptive_tree;
+        block_jobs[i].dictionary = dictionary_to_use;
+        block_jobs[i].has_checksum = has_checksums;
+    }
+
+    // with --range, a seek index lets the decoder start at the block that the
+    // range starts in. "expected_block_length" is then how many bytes the
+    // index says that block has, which is checked once it has been read
+    uint64_t number_of_bytes_found = 0;
+    uint64_t expected_block_length = 0;
+    if (
+        has_range
+        && decoding_exit_status == 0
+        && !is_legacy
+        && adaptive_tree == NULL
+    ) {
+        decoding_exit_status = seek_to_range(
+            &file_in,
+            has_checksums,
+            range_start,
+            &number_of_bytes_found,
+            &expected_block_length
         );
-        return 1;
     }
 
-    // now the pointer in file_in is at the first byte of the encoded data
-    int decoding_exit_status = decode_data_and_write(
-        file_in,
-        reconstructed_huffman_tree,
-        stdout,
-        number_of_bytes_to_decode
+    // the blocks are read and submitted in order, and the oldest one is always
+    // the next one to be written, so they come out in order too
+    uint64_t number_of_blocks_found = 0;
+    uint64_t number_of_blocks_read = 0;
+    uint64_t number_of_blocks_written = 0;
+    uint64_t number_of_bytes_decoded = 0;
+    uint32_t checksum = 0;
+    bool have_reached_end_marker = false;
+    while (decoding_exit_status == 0 && !is_legacy) {
+        while (
+            !have_reached_end_marker
+            && number_of_blocks_read - number_of_blocks_written
+               < (uint64_t)number_of_block_jobs
+        ) {
+            // nothing after the range needs to be read
+            if (number_of_bytes_found >= range_end) {
+                have_reached_end_marker = true;
+                break;
+            }
+            struct block_job *block_job = &block_jobs[
+                number_of_blocks_read % number_of_block_jobs
+            ];
+            double read_start_time = get_time_in_seconds();
+            decoding_exit_status = read_block(
+                &file_in,
+                version,
+                block_job,
+                &have_reached_end_marker
+            );
+            add_phase_time(
+                &stats,
+                RUN_PHASE_READ,
+                get_time_in_seconds() - read_start_time
+            );
+            if (decoding_exit_status != 0 || have_reached_end_marker) {
+                break;
+            }
+            number_of_blocks_found += 1;
+            if (
+                expected_block_length != 0
+                && block_job->block_length != expected_block_length
+            ) {
+                decoding_exit_status = 12;
+                break;
+            }
+            expected_block_length = 0;
+            block_job->offset = number_of_bytes_found;
+            number_of_bytes_found += block_job->block_length;
+            // a block that ends before the range starts is skipped without
+            // being decoded, except in an adaptive file, where every block
+            // is needed for the tree that it leaves behind
+            if (number_of_bytes_found <= range_start && adaptive_tree == NULL) {
+                continue;
+            }
+            number_of_blocks_read += 1;
+            block_job->use_tree_walk = use_tree_walk;
+            block_job->should_count_bytes = should_print_stats;
+            block_job->job.function = &decompress_block;
+            block_job->job.argument = block_job;
+            thread_pool_submit(pool_to_use, &block_job->job);
+        }
+
+        // the blocks before a problem with reading still get written, like
+        // they would have been if there was only 1 thread
+        if (number_of_blocks_written == number_of_blocks_read) {
+            break;
+        }
+        struct block_job *block_job = &block_jobs[
+            number_of_blocks_written % number_of_block_jobs
+        ];
+        thread_pool_wait_for(pool_to_use, &block_job->job);
+        number_of_blocks_written += 1;
+        if (block_job->exit_status != 0) {
+            decoding_exit_status = block_job->exit_status;
+            break;
+        }
+        // only the part of the block that is in the range is written
+        uint64_t write_start = 0;
+        uint64_t write_end = block_job->block_length;
+        if (range_start > block_job->offset) {
+            write_start = range_start - block_job->offset;
+        }
+        if (range_end - block_job->offset < write_end) {
+            write_end = range_end - block_job->offset;
+        }
+        if (write_start > write_end) {
+            write_start = write_end;
+        }
+        if (!is_testing) {
+            double write_start_time = get_time_in_seconds();
+            write_to_output_file(
+                &file_out,
+                block_job->block + write_start,
+                write_end - write_start
+            );
+            if (adaptive_tree != NULL) {
+                flush_output_file(&file_out);
+            }
+            add_phase_time(
+                &stats,
+                RUN_PHASE_WRITE,
+                get_time_in_seconds() - write_start_time
+            );
+        }
+        number_of_bytes_decoded += block_job->block_length;
+        if (has_checksums) {
+            checksum = combine_crc32c(
+                checksum,
+                block_job->checksum,
+                block_job->block_length
+            );
+        }
+
+        add_phase_time(&stats, RUN_PHASE_DECODE, block_job->decode_seconds);
+        if (should_print_stats && adaptive_tree != NULL) {
+            add_block_to_run_stats(&stats, block_job->byte_frequencies, NULL);
+            stats.number_of_codeword_bits +=
+                8 * block_job->compressed_block_length;
+            int depth = get_adaptive_tree_depth(adaptive_tree);
+            if (depth > stats.longest_code_length) {
+                stats.longest_code_length = depth;
+            }
+        } else if (
+            should_print_stats
+            && dictionary_to_use == NULL
+            && block_job->decoder.block_type == BLOCK_TYPE_STORED
+        ) {
+            // every byte of a stored block takes up 8 bits
+            add_block_to_run_stats(&stats, block_job->byte_frequencies, NULL);
+            stats.number_of_codeword_bits += 8 * block_job->block_length;
+            if (stats.longest_code_length < 8) {
+                stats.longest_code_length = 8;
+            }
+        } else if (
+            should_print_stats
+            && block_job->decoder.number_of_context_tables > 0
+        ) {
+            const struct block_decoder *decoder = &block_job->decoder;
+            add_block_to_run_stats(&stats, block_job->byte_frequencies, NULL);
+            stats.number_of_codeword_bits +=
+                decoder->number_of_data_bits;
+            for (int i = 0; i < decoder->number_of_context_tables; i += 1) {
+                int length = get_longest_code_length(
+                    decoder->context_code_lengths[i]
+                );
+                if (length > stats.longest_code_length) {
+                    stats.longest_code_length = length;
+                }
+            }
+        } else if (
+            should_print_stats
+            && block_job->decoder.block_type == BLOCK_TYPE_LZ77
+        ) {
+            const struct block_decoder *decoder = &block_job->decoder;
+            add_block_to_run_stats(&stats, block_job->byte_frequencies, NULL);
+            stats.number_of_codeword_bits += decoder->number_of_data_bits;
+            for (int i = 0; i < LZ77_NUMBER_OF_ALPHABETS; i += 1) {
+                int length = get_longest_code_length(
+                    decoder->lz77_code_lengths[i]
+                );
+                if (length > stats.longest_code_length) {
+                    stats.longest_code_length = length;
+                }
+            }
+        } else if (should_print_stats && dictionary_to_use != NULL) {
+            add_block_to_run_stats(
+                &stats,
+                block_job->byte_frequencies,
+                dictionary_to_use->code_lengths
+            );
+        } else if (should_print_stats) {
+            add_block_to_run_stats(
+                &stats,
+                block_job->byte_frequencies,
+                block_job->decoder.code_lengths
+            );
+        }
+    }
+
+    // make sure that no blocks went missing, by checking the totals after the
+    // end marker (which a legacy file doesn't have), and then the checksum
+    // of all of the blocks. with --range, only some of the blocks were
+    // decoded, so there is nothing to check them with
+    if (decoding_exit_status == 0 && !is_legacy && !has_range) {
+        uint64_t total_number_of_bytes;
+        uint64_t total_number_of_blocks;
+        uint32_t total_checksum;
+        if (
+            read_big_endian_64_bits(&file_in, &total_number_of_bytes)
+            || read_big_endian_64_bits(&file_in, &total_number_of_blocks)
+            || total_number_of_bytes != number_of_bytes_decoded
+            || total_number_of_blocks != number_of_blocks_written
+        ) {
+            decoding_exit_status = 8;
+        } else if (
+            has_checksums
+            && (read_big_endian_32_bits(&file_in, &total_checksum)
+                || total_checksum != checksum)
+        ) {
+            decoding_exit_status = 15;
+        }
+    }
+    stats.number_of_bytes_read = file_in.number_of_bytes_read;
+    stats.number_of_bytes_written = file_out.number_of_bytes_written;
+    double close_start_time = get_time_in_seconds();
+    bool could_write_output = !close_output_file(&file_out);
+    add_phase_time(
+        &stats,
+        RUN_PHASE_WRITE,
+        get_time_in_seconds() - close_start_time
     );
 
-    // free/close everything
-    fclose(file_in);
-    free_node_recursive(reconstructed_huffman_tree);
+    // free/close everything. any blocks that are still being worked on (if
+    // there was an error) have to be done before their memory can be freed
+    if (pool_to_use != NULL) {
+        free_thread_pool(pool_to_use);
+    }
+    for (int i = 0; block_jobs != NULL && i < number_of_block_jobs; i += 1) {
+        free(block_jobs[i].block);
+        free(block_jobs[i].compressed_block_buffer);
+        free_block_decoder(&block_jobs[i].decoder);
+    }
+    free(block_jobs);
+    free(adaptive_tree);
+    close_input_file(&file_in);
+    if (dictionary_filename != NULL) {
+        free_dictionary_tables(&dictionary);
+    }
 
-    if (decoding_exit_status == 1) {
-        fprintf(
-            stderr,
-            "Error: There was not enough encoded data to decode the specified"
-            " number of bytes.\nThe compressed file is invalid.\n"
+    if (should_print_stats) {
+        print_run_stats_json(
+            &stats,
+            decoding_exit_status == 0 && could_write_output,
+            stderr
         );
-        return 1;
-    } else if (decoding_exit_status == 2) {
+    }
+    if (decoding_exit_status != 0) {
         fprintf(
             stderr,
-            "Error: There was not enough encoded data to decode the last"
-            " codeword.\nThe compressed file is invalid.\n"
+            "Error: %s\n",
+            get_decompression_error_message(decoding_exit_status)
         );
         return 1;
+    } else if (!could_write_output) {
+        fprintf(stderr, "Error: Could not write the output.\n");
+        return 1;
     } else {
         return 0;
     }
@@ -0,0 +1,161 @@
+// see dictionary.h for what a dictionary is and how it is stored
+
+#include "dictionary.h"
+#include "bitbuffer.h"
+#include "block_encoder.h"
+#include "block_format.h"
+#include "canonical_code.h"
+
+// return the 32-bit FNV-1a hash of the code lengths, which is the ID of the
+// dictionary that has them
+uint32_t hash_code_lengths(const unsigned char code_lengths[256]) {
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < 256; i += 1) {
+        hash ^= code_lengths[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// set the dictionary's ID, codewords, and tree from its code lengths, which
+// must have been checked with check_code_lengths()
+void finish_dictionary(struct dictionary *dictionary) {
+    dictionary->id = hash_code_lengths(dictionary->code_lengths);
+    assign_canonical_codewords(
+        dictionary->code_lengths,
+        dictionary->codewords
+    );
+    create_tree_from_code_lengths(
+        dictionary->code_lengths,
+        NULL,
+        &dictionary->canonical_tree
+    );
+}
+
+// make a dictionary from the counts of the bytes of all of the samples, with no
+// codeword longer than "codeword_length_limit". returns whether the memory for
+// limiting the code lengths could be allocated
+int create_dictionary(
+    const uint64_t sample_frequencies[256],
+    int codeword_length_limit,
+    struct dictionary *dictionary
+) {
+    init_decode_table(&dictionary->decode_table);
+    uint64_t frequencies[256];
+    for (int i = 0; i < 256; i += 1) {
+        frequencies[i] = sample_frequencies[i] + 1;
+    }
+    if (create_code_lengths(
+        frequencies,
+        codeword_length_limit,
+        dictionary->code_lengths
+    )) {
+        return 1;
+    }
+    finish_dictionary(dictionary);
+    return 0;
+}
+
+// write the dictionary in the format described in dictionary.h into "bytes",
+// and set "number_of_bytes" to the number of bytes used
+void write_dictionary(
+    const struct dictionary *dictionary,
+    unsigned char bytes[DICTIONARY_FILE_BOUND],
+    size_t *number_of_bytes
+) {
+    struct bit_writer writer;
+    bit_writer_init(&writer, bytes, DICTIONARY_FILE_BOUND);
+    bit_writer_append_bits(&writer, DICTIONARY_MAGIC_NUMBER, 32);
+    bit_writer_append_bits(&writer, DICTIONARY_VERSION, 8);
+    bit_writer_append_bits(&writer, dictionary->id, 32);
+    write_code_lengths(&writer, dictionary->code_lengths);
+    bit_writer_flush(&writer);
+    *number_of_bytes = writer.position;
+}
+
+// read a dictionary that was written by write_dictionary(), and make its decode
+// table. returns whether it was successful:
+// 1. the bytes aren't a dictionary, or the dictionary is damaged
+// 2. the memory for the decode table couldn't be allocated
+int read_dictionary(
+    const unsigned char *bytes,
+    size_t number_of_bytes,
+    struct dictionary *dictionary
+) {
+    init_decode_table(&dictionary->decode_table);
+    if (
+        number_of_bytes < 9
+        || get_big_endian_32_bits(bytes) != DICTIONARY_MAGIC_NUMBER
+        || bytes[4] != DICTIONARY_VERSION
+    ) {
+        return 1;
+    }
+
+    struct bit_reader reader;
+    bit_reader_init(&reader, bytes + 9, number_of_bytes - 9);
+    if (read_code_lengths(&reader, dictionary->code_lengths)) {
+        return 1;
+    }
+    // every byte must have a codeword, or the encoder couldn't encode it
+    for (int i = 0; i < 256; i += 1) {
+        if (dictionary->code_lengths[i] == 0) {
+            return 1;
+        }
+    }
+    finish_dictionary(dictionary);
+    // the ID is worked out again from the code lengths, so a damaged dictionary
+    // shows up as the wrong ID
+    if (dictionary->id != get_big_endian_32_bits(bytes + 5)) {
+        return 1;
+    }
+
+    if (create_decode_table(
+        dictionary->code_lengths,
+        &dictionary->decode_table
+    )) {
+        return 2;
+    }
+    return 0;
+}
+
+void free_dictionary_tables(struct dictionary *dictionary) {
+    free_decode_table(&dictionary->decode_table);
+}
+
+// compress the block (which must have from 1 to MAXIMUM_BLOCK_LENGTH bytes)
+// with the dictionary's prefix code into "compressed_block", which must have
+// room for BLOCK_HEADER_SIZE + DICTIONARY_BLOCK_BOUND(block_length) bytes, and
+// set "compressed_block_length" to the number of bytes used. see
+// block_format.h for an outline of the format
+void encode_dictionary_block(
+    const struct dictionary *dictionary,
+    const unsigned char *block,
+    size_t block_length,
+    unsigned char *compressed_block,
+    size_t *compressed_block_length
+) {
+    struct bit_writer writer;
+    bit_writer_init(
+        &writer,
+        compressed_block,
+        BLOCK_HEADER_SIZE + DICTIONARY_BLOCK_BOUND(block_length)
+    );
+    bit_writer_append_bits(&writer, block_length, 32);
+    // the compressed size isn't known yet, so this is filled in at the end
+    bit_writer_append_bits(&writer, 0, 32);
+
+    bit_writer_append_codewords(
+        &writer,
+        block,
+        block_length,
+        dictionary->codewords,
+        dictionary->code_lengths
+    );
+    bit_writer_flush(&writer);
+
+    *compressed_block_length = writer.position;
+    write_big_endian_32_bits(
+        &compressed_block[4],
+        writer.position - BLOCK_HEADER_SIZE
+    );
+}
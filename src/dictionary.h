@@ -0,0 +1,76 @@
+// a dictionary is a prefix code that is made ahead of time from samples of the
+// data that will be compressed (with "./encoder train"), instead of from each
+// block. when there are many small inputs that are alike (like messages of the
+// same kind), 1 code made from all of them is about as good as each input's
+// own code, and with it, the inputs don't have to be counted first or store
+// their code lengths. a compressed file only records the ID of the dictionary
+// that it was made with (see FORMAT_VERSION_DICTIONARY in block_format.h), and
+// the decoder has to be given the same dictionary
+//
+// an input can have bytes that none of the samples had, so every byte gets a
+// codeword, as if it had come up once more than it did in the samples
+//
+// a dictionary file is:
+// 1. 32 bits for the magic number DICTIONARY_MAGIC_NUMBER
+// 2. 8 bits for the version of the format, DICTIONARY_VERSION
+// 3. 32 bits for the ID, which is a hash of the code lengths, so that the same
+//      code always gets the same ID
+//      32 bit unsigned big-endian integer
+// 4. the length of each byte's codeword in the canonical prefix code (see
+//      canonical_code.h)
+// 5. 0-7 empty bits to align to byte boundary
+
+#ifndef DICTIONARY_H
+#define DICTIONARY_H
+
+#include "decode_table.h"
+#include "huffman_tree.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// 0x89 followed by "HUD"
+#define DICTIONARY_MAGIC_NUMBER 0x89485544
+#define DICTIONARY_VERSION 1
+// the most bytes that a dictionary file can have: parts 1 to 3, and at most 384
+// bytes of code lengths
+#define DICTIONARY_FILE_BOUND (4 + 1 + 4 + 384)
+
+struct dictionary {
+    uint32_t id;
+    unsigned char code_lengths[256];
+    // each codeword is in the lowest bits of its number (see
+    // assign_canonical_codewords())
+    uint32_t codewords[256];
+    // the tree that the codewords are the paths of, for printing and for the
+    // tree walk. its weights are all 0, since the dictionary file doesn't have
+    // the samples' counts
+    struct huffman_tree canonical_tree;
+    // only made by read_dictionary(), since only the decoder needs it
+    struct decode_table decode_table;
+};
+
+int create_dictionary(
+    const uint64_t sample_frequencies[256],
+    int codeword_length_limit,
+    struct dictionary *dictionary
+);
+void write_dictionary(
+    const struct dictionary *dictionary,
+    unsigned char bytes[DICTIONARY_FILE_BOUND],
+    size_t *number_of_bytes
+);
+int read_dictionary(
+    const unsigned char *bytes,
+    size_t number_of_bytes,
+    struct dictionary *dictionary
+);
+void free_dictionary_tables(struct dictionary *dictionary);
+void encode_dictionary_block(
+    const struct dictionary *dictionary,
+    const unsigned char *block,
+    size_t block_length,
+    unsigned char *compressed_block,
+    size_t *compressed_block_length
+);
+
+#endif
@@ -1,58 +1,33 @@
-// compressed file format (see relevant functions for more details):
-// 1. 32 bits for the number of bytes that were encoded using the prefix code
-//      (we need this to know when the encoded data stops)
-//      32 bit unsigned big-endian integer
-// 2. the tree used to create the prefix code during huffman coding
-// 3. 0-7 empty bits to align to byte boundary
-// 4. the input bytes encoded with the prefix code
-// 5. 0-7 empty bits to align to byte boundary
-
-#define _DEFAULT_SOURCE // for endian.h
-#include "bitbuffer.h"
-#include "huffman_tree.h"
+// see block_format.h for an outline of the compressed file format
+
+#include "adaptive_huffman.h"
+#include "batch.h"
+#include "block_encoder.h"
+#include "block_format.h"
+#include "checksum.h"
+#include "context_model.h"
+#include "dictionary.h"
+#include "file_io.h"
+#include "histogram.h"
+#include "lz77.h"
+#include "run_stats.h"
+#include "thread_pool.h"
 #include <ctype.h>
-#include <endian.h>
+#include <getopt.h>
 #include <inttypes.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
-struct prefix_code_mapping {
-    // in our case, each symbol will be a unique byte
-    unsigned char symbol;
-    // representing the codeword as a dynamic array of booleans (bits) is simple
-    // but probably not memory efficient
-    bool *codeword;
-    // the maximum length of a huffman codeword (among a space of n symbols)
-    // is n - 1 according to
-    // https://inst.eecs.berkeley.edu/~cs170/fa18/assets/dis/dis05-sol.pdf
-    //
-    // so for our n of 256, the maximum length is 255
-    unsigned char codeword_length;
-};
-
-
-// fill the "byte_frequencies" array with how many occurances each byte has in
-// the file, and return the total number of bytes read
-uint32_t count_byte_frequencies(
-    FILE *file,
-    int byte_frequencies[256]
-) {
-    for (int i = 0; i < 256; i += 1) {
-        byte_frequencies[i] = 0;
-    }
-    uint32_t number_of_bytes_read = 0;
-
-    int byte = fgetc(file);
-    while (byte != EOF) {
-        byte_frequencies[byte] += 1;
-        number_of_bytes_read += 1;
-
-        byte = fgetc(file);
-    }
-
-    return number_of_bytes_read;
-}
+// the block size is given in KiB
+#define DEFAULT_BLOCK_SIZE 1024
+#define MAXIMUM_BLOCK_SIZE (MAXIMUM_BLOCK_LENGTH / 1024)
+#define MAXIMUM_NUMBER_OF_THREADS 256
+// how many bytes of a sample that isn't mapped into memory are counted at a
+// time when training a dictionary
+#define SAMPLE_BUFFER_SIZE (1024 * 1024)
 
 // print the given byte as a decimal number and, if it's printable, the
 // character it represents
@@ -66,12 +41,12 @@ void print_byte_as_number_and_character(unsigned char byte) {
     }
 }
 
-void print_byte_frequencies(const int byte_frequencies[256]) {
+void print_byte_frequencies(const uint64_t byte_frequencies[256]) {
     fprintf(stderr, "Byte Frequencies:\n");
     for (int i = 0; i < 256; i += 1) {
         if (byte_frequencies[i] > 0) {
             print_byte_as_number_and_character(i);
-            fprintf(stderr, ": %d\n", byte_frequencies[i]);
+            fprintf(stderr, ": %" PRIu64 "\n", byte_frequencies[i]);
         }
     }
     fprintf(stderr, "\n");
@@ -83,6 +58,7 @@ void print_byte_frequencies(const int byte_frequencies[256]) {
 void print_node_recursive(
     bool path[255],
     int path_length,
+    const struct huffman_tree *tree,
     const struct node *node
 ) {
     for (int i = 0; i < path_length; i += 1) {
@@ -101,7 +77,7 @@ void print_node_recursive(
         }
     }
 
-    fprintf(stderr, "%d", node->weight);
+    fprintf(stderr, "%" PRIu64, node->weight);
 
     if (is_leaf_node(node)) {
         fprintf(stderr, ": ");
@@ -110,17 +86,27 @@ void print_node_recursive(
     } else {
         fprintf(stderr, "\n");
         path[path_length] = false;
-        print_node_recursive(path, path_length + 1, node->left_child);
+        print_node_recursive(
+            path,
+            path_length + 1,
+            tree,
+            get_left_child(tree, node)
+        );
         path[path_length] = true;
-        print_node_recursive(path, path_length + 1, node->right_child);
+        print_node_recursive(
+            path,
+            path_length + 1,
+            tree,
+            get_right_child(tree, node)
+        );
     }
 }
 
-void print_huffman_tree(const struct node *root) {
+void print_huffman_tree(const struct huffman_tree *tree) {
     fprintf(stderr, "Huffman Tree:\n");
     bool path[255] = {false}; // initialize with all falses
     int path_length = 0;
-    print_node_recursive(path, path_length, root);
+    print_node_recursive(path, path_length, tree, get_root_node(tree));
     fprintf(stderr, "\n");
 }
 
@@ -141,183 +127,1161 @@ void print_prefix_code_mappings(
     fprintf(stderr, "\n");
 }
 
-// if the node is a leaf, create its prefix code mapping from the node's symbol
-// and the path taken to get to the node; else, attempt that for all nodes below
-//
-// the codeword of each prefix code mapping is on the heap
-void create_mapping_from_node_recursive(
-    bool *path,
-    int path_length,
-    const struct node *node,
-    struct prefix_code_mapping mappings[256]
+// everything about 1 block: its bytes, the data structures used to compress
+// it (in the block encoder), and the compressed result. the compressing can
+// happen on a worker thread, but the printing and writing happens on the main
+// thread, in block order
+struct block_job {
+    struct job job;
+
+    int codeword_length_limit;
+    // the type that was asked for. the type that the block actually got is
+    // in its encoder (see block_encoder.h)
+    int block_type;
+    uint64_t block_number;
+    // either in the input file's mapping or in the job's own memory
+    const unsigned char *block;
+    size_t block_length;
+    unsigned char *block_buffer;
+
+    struct block_encoder encoder;
+    // with --dict, every block is compressed with this same prefix code,
+    // which is only read, so the blocks can still be compressed at the same
+    // time. NULL otherwise
+    const struct dictionary *dictionary;
+    // a block that is compressed with a dictionary doesn't need its bytes
+    // counted, so they are only counted when they will be printed or
+    // reported
+    bool should_count_bytes;
+    // with --sample and --stats, the block's bytes are also counted exactly
+    // after it is compressed (so that it doesn't count as compressing time),
+    // for the stats of how much compression the sample gave up: the exact
+    // counts, and how many bits the codewords would have taken with the
+    // prefix code made from them
+    bool should_measure_sampling;
+    uint64_t exact_byte_frequencies[256];
+    uint64_t number_of_exact_codeword_bits;
+    // in adaptive mode, every block is compressed with this same tree, which
+    // is why the blocks are then compressed one at a time. NULL otherwise
+    struct adaptive_huffman_tree *adaptive_tree;
+
+    // big enough for the largest possible compressed block
+    unsigned char *compressed_block;
+    size_t compressed_block_length;
+    int exit_status;
+    // with --checksum, the block ends with the checksum of its bytes, which
+    // is also kept here for the checksum of all of the blocks
+    bool has_checksum;
+    uint32_t checksum;
+
+    // how long each step of compressing took (see run_stats.h)
+    double phase_seconds[NUMBER_OF_RUN_PHASES];
+};
+
+// 1 entry of the seek index (see block_format.h)
+struct seek_index_entry {
+    uint64_t compressed_offset;
+    uint64_t offset;
+};
+
+// add the entry for the next block to the seek index, growing it if needed.
+// returns whether the memory could be allocated
+int add_seek_index_entry(
+    struct seek_index_entry **entries,
+    size_t *capacity,
+    size_t number_of_entries,
+    uint64_t compressed_offset,
+    uint64_t offset
 ) {
-    if (is_leaf_node(node)) {
-        mappings[node->symbol].codeword = malloc(path_length * sizeof (bool));
-        for (int i = 0; i < path_length; i += 1) {
-            mappings[node->symbol].codeword[i] = path[i];
-        }
-        mappings[node->symbol].codeword_length = path_length;
-    } else {
-        path[path_length] = false;
-        create_mapping_from_node_recursive(
-            path,
-            path_length + 1,
-            node->left_child,
-            mappings
-        );
-        path[path_length] = true;
-        create_mapping_from_node_recursive(
-            path,
-            path_length + 1,
-            node->right_child,
-            mappings
+    if (number_of_entries == *capacity) {
+        size_t new_capacity = *capacity == 0 ? 64 : 2 * *capacity;
+        struct seek_index_entry *new_entries = realloc(
+            *entries,
+            new_capacity * sizeof (**entries)
         );
+        if (new_entries == NULL) {
+            return 1;
+        }
+        *entries = new_entries;
+        *capacity = new_capacity;
     }
+    (*entries)[number_of_entries].compressed_offset = compressed_offset;
+    (*entries)[number_of_entries].offset = offset;
+    return 0;
 }
 
-// create the prefix code mappings from the huffman tree. each prefix code
-// mapping has some data on the heap
-void create_prefix_code_mappings(
-    const struct node *huffman_tree_root,
-    struct prefix_code_mapping mappings[256]
+// write parts 7 to 9 of the file (see block_format.h) to the output
+void write_seek_index(
+    struct output_file *file_out,
+    const struct seek_index_entry *entries,
+    size_t number_of_entries
 ) {
-    for (int i = 0; i < 256; i += 1) {
-        mappings[i].symbol = i;
-        mappings[i].codeword = NULL;
-        mappings[i].codeword_length = 0;
+    for (size_t i = 0; i < number_of_entries; i += 1) {
+        unsigned char entry[SEEK_INDEX_ENTRY_SIZE];
+        write_big_endian_64_bits(entry, entries[i].compressed_offset);
+        write_big_endian_64_bits(entry + 8, entries[i].offset);
+        write_to_output_file(file_out, entry, sizeof (entry));
     }
-
-    bool path[255] = {false}; // initialize with all falses
-    create_mapping_from_node_recursive(path, 0, huffman_tree_root, mappings);
+    unsigned char footer[SEEK_INDEX_FOOTER_SIZE];
+    write_big_endian_64_bits(footer, number_of_entries);
+    write_big_endian_32_bits(footer + 8, SEEK_INDEX_MAGIC_NUMBER);
+    write_to_output_file(file_out, footer, sizeof (footer));
 }
 
-void free_prefix_code_mappings(struct prefix_code_mapping mappings[256]) {
-    for (int i = 0; i < 256; i += 1) {
-        free(mappings[i].codeword);
+// compress the job's block into its memory for the compressed block, timing
+// each step. the job's exit status is whether it was successful
+void encode_block_job(struct block_job *block_job) {
+    struct block_encoder *encoder = &block_job->encoder;
+
+    // a block with its own prefix code goes through the same steps as in the
+    // library
+    if (block_job->dictionary == NULL && block_job->adaptive_tree == NULL) {
+        struct block_encoding_times times;
+        block_job->exit_status = encode_block(
+            encoder,
+            block_job->block,
+            block_job->block_length,
+            block_job->codeword_length_limit,
+            block_job->block_type,
+            block_job->compressed_block,
+            &block_job->compressed_block_length,
+            &times
+        );
+        block_job->phase_seconds[RUN_PHASE_HISTOGRAM] =
+            times.histogram_seconds;
+        block_job->phase_seconds[RUN_PHASE_TREE_BUILD] =
+            times.tree_build_seconds;
+        block_job->phase_seconds[RUN_PHASE_CODE_ASSIGNMENT] =
+            times.code_assignment_seconds;
+        block_job->phase_seconds[RUN_PHASE_ENCODE] = times.encode_seconds;
+        return;
     }
-}
 
-// writes the huffman tree to the file, in a depth-first pre-order traversal
-//
-// branch nodes are represented as a 0 bit
-// leaf nodes are represented as a 1 bit followed by their symbol/char
-void write_huffman_tree(
-    FILE *file,
-    struct bit_buffer *buffer,
-    const struct node *root
-) {
-    if (is_leaf_node(root)) {
-        buffer_append_bit(buffer, true);
-        buffer_append_byte(buffer, root->symbol);
-        buffer_write_any_complete_bytes(file, buffer);
+    // a dictionary block (or an adaptive one) has no prefix code of its own
+    // to make, so its bytes only need to be counted for printing or --stats
+    double start_time = get_time_in_seconds();
+    if (block_job->should_count_bytes) {
+        count_byte_frequencies(
+            block_job->block,
+            block_job->block_length,
+            encoder->byte_frequencies
+        );
+    }
+    double histogram_end_time = get_time_in_seconds();
+    if (block_job->dictionary != NULL) {
+        encode_dictionary_block(
+            block_job->dictionary,
+            block_job->block,
+            block_job->block_length,
+            block_job->compressed_block,
+            &block_job->compressed_block_length
+        );
     } else {
-        buffer_append_bit(buffer, false);
-        buffer_write_any_complete_bytes(file, buffer);
+        encode_adaptive_block(
+            block_job->adaptive_tree,
+            block_job->block,
+            block_job->block_length,
+            block_job->compressed_block,
+            &block_job->compressed_block_length
+        );
+    }
+    block_job->phase_seconds[RUN_PHASE_HISTOGRAM] = histogram_end_time
+                                                  - start_time;
+    block_job->phase_seconds[RUN_PHASE_ENCODE] = get_time_in_seconds()
+                                               - histogram_end_time;
+    block_job->exit_status = 0;
+}
 
-        write_huffman_tree(file, buffer, root->left_child);
-        write_huffman_tree(file, buffer, root->right_child);
+// count the job's bytes exactly, and work out how many bits the block would
+// have taken with the prefix code made from those counts, which is at most 8
+// bits per byte since it would have been stored otherwise
+void measure_sampling(struct block_job *block_job) {
+    count_byte_frequencies(
+        block_job->block,
+        block_job->block_length,
+        block_job->exact_byte_frequencies
+    );
+    block_job->number_of_exact_codeword_bits = 8 * block_job->block_length;
+    unsigned char code_lengths[256];
+    if (create_code_lengths(
+        block_job->exact_byte_frequencies,
+        block_job->codeword_length_limit,
+        code_lengths
+    )) {
+        return;
+    }
+    uint64_t number_of_codeword_bits = 0;
+    for (int i = 0; i < 256; i += 1) {
+        number_of_codeword_bits += block_job->exact_byte_frequencies[i]
+                                 * code_lengths[i];
+    }
+    if (number_of_codeword_bits < block_job->number_of_exact_codeword_bits) {
+        block_job->number_of_exact_codeword_bits = number_of_codeword_bits;
     }
 }
 
-// for each byte of the input file, write that byte's codeword (according to the
-// prefix code) to the output file
-void write_encoded_data(
-    FILE *file_in,
-    const struct prefix_code_mapping mappings[256],
-    struct bit_buffer *buffer,
-    FILE *file_out
-) {
-    fseek(file_in, 0, SEEK_SET);
+// compress the job's block (see encode_block_job()), and then add its
+// checksum if it gets one
+void compress_block(void *argument) {
+    struct block_job *block_job = argument;
+    encode_block_job(block_job);
+    if (block_job->exit_status == 0 && block_job->should_measure_sampling) {
+        measure_sampling(block_job);
+    }
+    if (block_job->exit_status == 0 && block_job->has_checksum) {
+        double checksum_start_time = get_time_in_seconds();
+        block_job->checksum = add_block_checksum(
+            block_job->block,
+            block_job->block_length,
+            block_job->compressed_block,
+            &block_job->compressed_block_length
+        );
+        block_job->phase_seconds[RUN_PHASE_ENCODE] += get_time_in_seconds()
+                                                    - checksum_start_time;
+    }
+}
 
-    while (true) {
-        int symbol = fgetc(file_in);
-        if (symbol == EOF) {
-            return;
+// print which contexts use each table of the context model, and each table's
+// prefix code in the same way as a block's prefix code
+void print_context_model(const struct context_model *model) {
+    fprintf(
+        stderr,
+        "Context Model (%d Tables, Chosen by the Previous Byte):\n\n",
+        model->number_of_tables
+    );
+    for (int table = 0; table < model->number_of_tables; table += 1) {
+        fprintf(stderr, "Table %d, Used After:\n", table + 1);
+        for (int context = 0; context < 256; context += 1) {
+            bool did_come_up = model->context_starts[context]
+                             < model->context_starts[context + 1];
+            if (did_come_up && model->table_of_context[context] == table) {
+                print_byte_as_number_and_character(context);
+                fprintf(stderr, "\n");
+            }
         }
+        fprintf(stderr, "\n");
 
-        buffer_append_bits(
-            buffer,
-            mappings[symbol].codeword,
-            mappings[symbol].codeword_length
+        struct huffman_tree tree;
+        create_tree_from_code_lengths(
+            model->code_lengths[table],
+            model->table_frequencies[table],
+            &tree
         );
-        buffer_write_any_complete_bytes(file_out, buffer);
+        print_huffman_tree(&tree);
+        struct prefix_code_mapping mappings[256];
+        create_prefix_code_mappings(&tree, mappings);
+        print_prefix_code_mappings(mappings);
     }
 }
 
-// see the top of this file for an outline of the compressed file format
-void write_compressed_file(
-    FILE *file_in,
-    FILE *file_out,
-    uint32_t number_of_bytes_to_encode,
-    const struct node *huffman_tree_root,
-    const struct prefix_code_mapping *mappings
+// print the codeword of each symbol of the LZ77 model's alphabet of numbers,
+// along with the numbers that the symbol stands for, which are the symbol's
+// base plus its extra bits (see lz77.h)
+void print_lz77_number_code(
+    const struct lz77_model *model,
+    int alphabet,
+    const char *name,
+    uint32_t offset
 ) {
-    struct bit_buffer buffer;
-    buffer.length = 0;
+    fprintf(stderr, "%s (Numbers, Extra Bits: Codeword):\n", name);
+    for (int symbol = 0; symbol < LZ77_NUMBER_OF_NUMBER_SYMBOLS; symbol += 1) {
+        if (model->frequencies[alphabet][symbol] == 0) {
+            continue;
+        }
+        int number_of_extra_bits = get_lz77_number_extra_bits(symbol);
+        uint32_t first = get_lz77_number_base(symbol) + offset;
+        uint32_t last = first + ((uint32_t)1 << number_of_extra_bits) - 1;
+        if (first == last) {
+            fprintf(stderr, "%" PRIu32, first);
+        } else {
+            fprintf(stderr, "%" PRIu32 "-%" PRIu32, first, last);
+        }
+        fprintf(stderr, ", %d: ", number_of_extra_bits);
+        uint32_t codeword = model->codewords[alphabet][symbol];
+        int length = model->code_lengths[alphabet][symbol];
+        for (int i = length - 1; i >= 0; i -= 1) {
+            fprintf(stderr, "%d", (int)(codeword >> i) & 1);
+        }
+        fprintf(stderr, "\n");
+    }
+    fprintf(stderr, "\n");
+}
 
-    // convert from host endianness to big endian
-    number_of_bytes_to_encode = htobe32(number_of_bytes_to_encode);
-    fwrite(&number_of_bytes_to_encode, sizeof (uint32_t), 1, file_out);
+// print how the LZ77 model split the block into literals and matches, the
+// prefix code of the literals in the same way as a block's prefix code, and
+// the codewords of the numbers
+void print_lz77_model(const struct lz77_model *model) {
+    uint64_t number_of_literals = 0;
+    uint64_t number_of_matched_bytes = 0;
+    for (size_t i = 0; i < model->number_of_sequences; i += 1) {
+        number_of_literals += model->sequences[i].run_length;
+        number_of_matched_bytes += model->sequences[i].match_length;
+    }
+    fprintf(
+        stderr,
+        "LZ77 (%zu Matches Covering %" PRIu64 " Bytes, %" PRIu64
+        " Literals)\n\n",
+        model->number_of_sequences - 1,
+        number_of_matched_bytes,
+        number_of_literals
+    );
 
-    write_huffman_tree(file_out, &buffer, huffman_tree_root);
-    buffer_write_any_leftover_bits_as_byte(file_out, &buffer);
+    fprintf(stderr, "Literals:\n");
+    struct huffman_tree tree;
+    create_tree_from_code_lengths(
+        model->code_lengths[LZ77_ALPHABET_LITERALS],
+        model->frequencies[LZ77_ALPHABET_LITERALS],
+        &tree
+    );
+    print_huffman_tree(&tree);
+    struct prefix_code_mapping mappings[256];
+    create_prefix_code_mappings(&tree, mappings);
+    print_prefix_code_mappings(mappings);
 
-    write_encoded_data(file_in, mappings, &buffer, file_out);
-    buffer_write_any_leftover_bits_as_byte(file_out, &buffer);
+    print_lz77_number_code(model, LZ77_ALPHABET_RUN_LENGTHS, "Run Lengths", 0);
+    print_lz77_number_code(
+        model,
+        LZ77_ALPHABET_MATCH_LENGTHS,
+        "Match Lengths",
+        LZ77_MINIMUM_MATCH_LENGTH
+    );
+    print_lz77_number_code(model, LZ77_ALPHABET_DISTANCES, "Distances", 1);
 }
 
-int main(int argc, char **argv) {
-    if (argc < 2) {
+// print the data structures that were used to compress the job's block
+void print_block_job_structures(const struct block_job *block_job) {
+    fprintf(
+        stderr,
+        "Block %" PRIu64 " (%zu bytes)\n\n",
+        block_job->block_number,
+        block_job->block_length
+    );
+    // the adaptive tree's codewords change after every byte, so there is no
+    // one prefix code to print for the block. the tree is printed as it is
+    // after the block, and its leaves' weights are the counts of every byte
+    // so far (not just the block's)
+    if (block_job->adaptive_tree != NULL) {
+        print_huffman_tree(&block_job->adaptive_tree->tree);
+        return;
+    }
+    print_byte_frequencies(block_job->encoder.byte_frequencies);
+    // the dictionary's prefix code was already printed before the first block
+    if (block_job->dictionary != NULL) {
+        return;
+    }
+    if (block_job->encoder.block_type == BLOCK_TYPE_ORDER_1) {
+        print_context_model(block_job->encoder.context_model);
+        return;
+    }
+    if (block_job->encoder.block_type == BLOCK_TYPE_LZ77) {
+        print_lz77_model(block_job->encoder.lz77_model);
+        return;
+    }
+    if (block_job->encoder.block_type == BLOCK_TYPE_STORED) {
         fprintf(
             stderr,
-            "Error: You must specify the name of the file you want to compress."
-            "\nFor example: %s sample-files/slss\n",
-            argv[0]
+            "Stored As-Is (a Prefix Code Wouldn't Make It Smaller)\n\n"
         );
+        return;
+    }
+    // compressing the block only needed the packed codewords, so the tree
+    // that they are the paths of is only made here, for printing
+    struct huffman_tree canonical_tree;
+    create_tree_from_code_lengths(
+        block_job->encoder.code_lengths,
+        block_job->encoder.byte_frequencies,
+        &canonical_tree
+    );
+    print_huffman_tree(&canonical_tree);
+    struct prefix_code_mapping mappings[256];
+    create_prefix_code_mappings(&canonical_tree, mappings);
+    print_prefix_code_mappings(mappings);
+}
+
+// count the bytes of all of the sample files together, make a dictionary from
+// them, and write it to the dictionary file. returns the exit status for
+// main()
+int train_dictionary(
+    const char *dictionary_filename,
+    char **sample_filenames,
+    int number_of_samples,
+    int codeword_length_limit
+) {
+    unsigned char *buffer = malloc(SAMPLE_BUFFER_SIZE);
+    if (buffer == NULL) {
+        fprintf(stderr, "Error: Unable to allocate the sample buffer.\n");
         return 1;
     }
-    FILE *file_in = fopen(argv[1], "r");
-    if (!file_in) {
-        fprintf(stderr, "Error: Could not open input file.\n");
+    uint64_t sample_frequencies[256] = {0};
+    for (int i = 0; i < number_of_samples; i += 1) {
+        struct input_file sample;
+        if (open_input_file(sample_filenames[i], &sample)) {
+            fprintf(
+                stderr,
+                "Error: Could not open sample file %s.\n",
+                sample_filenames[i]
+            );
+            free(buffer);
+            return 1;
+        }
+        while (true) {
+            const unsigned char *bytes;
+            size_t number_of_bytes;
+            if (read_from_input_file(
+                &sample,
+                buffer,
+                SAMPLE_BUFFER_SIZE,
+                &bytes,
+                &number_of_bytes
+            )) {
+                fprintf(
+                    stderr,
+                    "Error: Could not read sample file %s.\n",
+                    sample_filenames[i]
+                );
+                close_input_file(&sample);
+                free(buffer);
+                return 1;
+            }
+            if (number_of_bytes == 0) {
+                break;
+            }
+            uint64_t frequencies[256];
+            count_byte_frequencies(bytes, number_of_bytes, frequencies);
+            for (int j = 0; j < 256; j += 1) {
+                sample_frequencies[j] += frequencies[j];
+            }
+        }
+        close_input_file(&sample);
+    }
+    free(buffer);
+
+    struct dictionary dictionary;
+    if (create_dictionary(
+        sample_frequencies,
+        codeword_length_limit,
+        &dictionary
+    )) {
+        fprintf(stderr, "Error: Unable to limit the codeword lengths.\n");
+        return 1;
+    }
+    unsigned char dictionary_bytes[DICTIONARY_FILE_BOUND];
+    size_t number_of_dictionary_bytes;
+    write_dictionary(
+        &dictionary,
+        dictionary_bytes,
+        &number_of_dictionary_bytes
+    );
+    free_dictionary_tables(&dictionary);
+    if (write_whole_file(
+        dictionary_filename,
+        dictionary_bytes,
+        number_of_dictionary_bytes
+    )) {
+        fprintf(stderr, "Error: Could not write the dictionary file.\n");
         return 1;
     }
 
-    int byte_frequencies[256];
-    uint32_t total_bytes = count_byte_frequencies(
-        file_in,
-        byte_frequencies
+    // the dictionary's own tree has no weights, so the one that is printed
+    // gets the samples' counts
+    struct huffman_tree tree;
+    create_tree_from_code_lengths(
+        dictionary.code_lengths,
+        sample_frequencies,
+        &tree
+    );
+    print_byte_frequencies(sample_frequencies);
+    print_huffman_tree(&tree);
+    struct prefix_code_mapping mappings[256];
+    create_prefix_code_mappings(&tree, mappings);
+    print_prefix_code_mappings(mappings);
+    fprintf(
+        stderr,
+        "Dictionary %08" PRIx32 " (%zu bytes)\n",
+        dictionary.id,
+        number_of_dictionary_bytes
     );
-    // the goal of this project is not to make the most robust compressor, so
-    // instead of handling edge cases that don't produce a proper binary tree
-    // and that would require special logic, we'll just not support it
-    if (total_bytes < 2) {
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    struct run_stats stats;
+    init_run_stats(&stats, "encoder", true);
+
+    int codeword_length_limit = DEFAULT_CODEWORD_LENGTH_LIMIT;
+    int block_size = DEFAULT_BLOCK_SIZE;
+    int number_of_threads = 1;
+    int block_type = BLOCK_TYPE_1_STREAM;
+    // the data structures of every block are printed unless --quiet is given,
+    // which is what you want when compressing a lot of data
+    bool should_print_structures = true;
+    bool should_print_stats = false;
+    bool is_adaptive = false;
+    bool is_order_1 = false;
+    // 0 for no LZ77 stage
+    int lz77_level = 0;
+    int lz77_window_size = LZ77_DEFAULT_WINDOW_SIZE;
+    const char *dictionary_filename = NULL;
+    bool is_batch = false;
+    bool has_seek_index = false;
+    bool has_checksums = false;
+    // 1 to count every byte of every block (see histogram.h)
+    int sample_interval = 1;
+    const struct option long_options[] = {
+        {"max-codeword-length", required_argument, NULL, 'l'},
+        {"block-size", required_argument, NULL, 'b'},
+        {"threads", required_argument, NULL, 'T'},
+        {"streams", required_argument, NULL, 's'},
+        {"quiet", no_argument, NULL, 'q'},
+        {"stats", required_argument, NULL, 'j'},
+        {"adaptive", no_argument, NULL, 'a'},
+        {"order-1", no_argument, NULL, 'o'},
+        {"lz77", optional_argument, NULL, 'z'},
+        {"lz77-window", required_argument, NULL, 'w'},
+        {"dict", required_argument, NULL, 'd'},
+        {"batch", no_argument, NULL, 'B'},
+        {"seek-index", no_argument, NULL, 'i'},
+        {"checksum", no_argument, NULL, 'c'},
+        {"sample", required_argument, NULL, 'S'},
+        {0, 0, 0, 0}
+    };
+    int option;
+    while ((option = getopt_long(argc, argv, "T:", long_options, NULL)) != -1) {
+        if (option == 'l') {
+            codeword_length_limit = atoi(optarg);
+            if (
+                codeword_length_limit < MINIMUM_CODEWORD_LENGTH_LIMIT
+                || codeword_length_limit > MAXIMUM_CODEWORD_LENGTH
+            ) {
+                fprintf(
+                    stderr,
+                    "Error: The maximum codeword length must be from %d to"
+                    " %d.\n",
+                    MINIMUM_CODEWORD_LENGTH_LIMIT,
+                    MAXIMUM_CODEWORD_LENGTH
+                );
+                return 1;
+            }
+        } else if (option == 'b') {
+            block_size = atoi(optarg);
+            if (block_size < 1 || block_size > MAXIMUM_BLOCK_SIZE) {
+                fprintf(
+                    stderr,
+                    "Error: The block size must be from 1 to %d KiB.\n",
+                    MAXIMUM_BLOCK_SIZE
+                );
+                return 1;
+            }
+        } else if (option == 'T') {
+            number_of_threads = atoi(optarg);
+            if (
+                number_of_threads < 1
+                || number_of_threads > MAXIMUM_NUMBER_OF_THREADS
+            ) {
+                fprintf(
+                    stderr,
+                    "Error: The number of threads must be from 1 to %d.\n",
+                    MAXIMUM_NUMBER_OF_THREADS
+                );
+                return 1;
+            }
+        } else if (option == 's') {
+            block_type = get_block_type(atoi(optarg));
+            if (block_type == -1) {
+                fprintf(
+                    stderr,
+                    "Error: The number of streams must be 1, 4, or 8.\n"
+                );
+                return 1;
+            }
+        } else if (option == 'q') {
+            should_print_structures = false;
+        } else if (option == 'j') {
+            if (strcmp(optarg, "json") != 0) {
+                fprintf(stderr, "Error: The stats format must be json.\n");
+                return 1;
+            }
+            should_print_stats = true;
+        } else if (option == 'a') {
+            is_adaptive = true;
+        } else if (option == 'o') {
+            is_order_1 = true;
+        } else if (option == 'z') {
+            lz77_level = optarg != NULL ? atoi(optarg) : LZ77_DEFAULT_LEVEL;
+            if (
+                lz77_level < LZ77_MINIMUM_LEVEL
+                || lz77_level > LZ77_MAXIMUM_LEVEL
+            ) {
+                fprintf(
+                    stderr,
+                    "Error: The LZ77 level must be from %d to %d.\n",
+                    LZ77_MINIMUM_LEVEL,
+                    LZ77_MAXIMUM_LEVEL
+                );
+                return 1;
+            }
+        } else if (option == 'w') {
+            lz77_window_size = atoi(optarg);
+            if (
+                lz77_window_size < 1
+                || !is_lz77_window_size_valid((size_t)lz77_window_size * 1024)
+            ) {
+                fprintf(
+                    stderr,
+                    "Error: The LZ77 window size must be a power of 2 from %d"
+                    " to %d KiB.\n",
+                    LZ77_MINIMUM_WINDOW_SIZE,
+                    LZ77_MAXIMUM_WINDOW_SIZE
+                );
+                return 1;
+            }
+        } else if (option == 'd') {
+            dictionary_filename = optarg;
+        } else if (option == 'B') {
+            is_batch = true;
+        } else if (option == 'i') {
+            has_seek_index = true;
+        } else if (option == 'c') {
+            has_checksums = true;
+        } else if (option == 'S') {
+            sample_interval = atoi(optarg);
+            if (
+                sample_interval < 1
+                || sample_interval > MAXIMUM_SAMPLE_INTERVAL
+            ) {
+                fprintf(
+                    stderr,
+                    "Error: The sample interval must be from 1 to %d.\n",
+                    MAXIMUM_SAMPLE_INTERVAL
+                );
+                return 1;
+            }
+        } else {
+            return 1;
+        }
+    }
+    // each codeword of an order-1 block depends on the one before it, so the
+    // block can't be split into streams, and an adaptive file has no block
+    // types at all
+    if (is_order_1 && (is_adaptive || block_type != BLOCK_TYPE_1_STREAM)) {
         fprintf(
             stderr,
-            "Error: Compressing a file under 2 bytes is not supported.\n"
+            "Error: --order-1 can't be used with --adaptive or --streams.\n"
+        );
+        return 1;
+    }
+    if (is_order_1) {
+        block_type = BLOCK_TYPE_ORDER_1;
+    }
+    // an LZ77 block is 1 stream of its own kind, and it has its own prefix
+    // codes instead of the ones of an order-1 block
+    if (
+        lz77_level != 0
+        && (is_adaptive || is_order_1 || block_type != BLOCK_TYPE_1_STREAM)
+    ) {
+        fprintf(
+            stderr,
+            "Error: --lz77 can't be used with --adaptive, --order-1, or"
+            " --streams.\n"
+        );
+        return 1;
+    }
+    if (lz77_level != 0) {
+        block_type = BLOCK_TYPE_LZ77;
+    }
+    // only the prefix code of a block that is 1 to 8 streams comes from just
+    // the counts of its bytes, and an adaptive tree counts every byte as it
+    // goes
+    if (
+        sample_interval > 1
+        && (
+            is_adaptive
+            || is_order_1
+            || lz77_level != 0
+            || dictionary_filename != NULL
+        )
+    ) {
+        fprintf(
+            stderr,
+            "Error: --sample can't be used with --adaptive, --order-1, --lz77,"
+            " or --dict.\n"
+        );
+        return 1;
+    }
+    stats.sample_interval = sample_interval;
+    // decoding can't start in the middle of an adaptive file, since each
+    // block needs the tree that the blocks before it left behind. batch mode
+    // compresses small files with the library, which doesn't write an index
+    if (has_seek_index && (is_adaptive || is_batch)) {
+        fprintf(
+            stderr,
+            "Error: --seek-index can't be used with --adaptive or --batch.\n"
         );
-        fclose(file_in);
         return 1;
     }
 
-    // create a huffman tree using the bytes as the symbols and their
-    // frequencies as the weights
-    struct node *huffman_tree = create_huffman_tree(byte_frequencies);
+    // "./encoder train DICTIONARY SAMPLE..." makes a dictionary instead of
+    // compressing anything
+    if (optind < argc && strcmp(argv[optind], "train") == 0) {
+        if (argc - optind < 3) {
+            fprintf(
+                stderr,
+                "Error: train needs a dictionary file and at least 1 sample"
+                " file.\n"
+            );
+            return 1;
+        }
+        return train_dictionary(
+            argv[optind + 1],
+            argv + optind + 2,
+            argc - optind - 2,
+            codeword_length_limit
+        );
+    }
 
-    // create the prefix code mappings from the huffman tree. this will be our
-    // dictionary for the actual encoding
-    struct prefix_code_mapping mappings[256];
-    create_prefix_code_mappings(huffman_tree, mappings);
+    // a dictionary file's prefix code is used for every block instead of
+    // each block's own, which is neither adaptive nor split into streams
+    struct dictionary dictionary;
+    struct dictionary *dictionary_to_use = NULL;
+    if (dictionary_filename != NULL) {
+        if (is_adaptive || is_order_1 || block_type != BLOCK_TYPE_1_STREAM) {
+            fprintf(
+                stderr,
+                "Error: --dict can't be used with --adaptive, --order-1,"
+                " --lz77, or --streams.\n"
+            );
+            return 1;
+        }
+        int reading_exit_status = read_dictionary_file(
+            dictionary_filename,
+            &dictionary
+        );
+        if (reading_exit_status == 1) {
+            fprintf(stderr, "Error: Could not read the dictionary file.\n");
+            return 1;
+        } else if (reading_exit_status == 2) {
+            fprintf(stderr, "Error: The dictionary file is invalid.\n");
+            return 1;
+        } else if (reading_exit_status == 3) {
+            fprintf(stderr, "Error: Unable to allocate the decode table.\n");
+            return 1;
+        }
+        // only the decoder needs the decode table
+        free_dictionary_tables(&dictionary);
+        dictionary_to_use = &dictionary;
+    }
 
-    write_compressed_file(file_in, stdout, total_bytes, huffman_tree, mappings);
+    // with --batch, every file that is named (or listed on stdin) is
+    // compressed into a file next to it instead (see batch.h)
+    if (is_batch) {
+        struct batch_options batch_options = {
+            .is_compressing = true,
+            .number_of_threads = number_of_threads,
+            .should_print_stats = should_print_stats,
+            .codeword_length_limit = codeword_length_limit,
+            .block_size = (size_t)block_size * 1024,
+            .block_type = block_type,
+            .is_adaptive = is_adaptive,
+            .lz77_level = lz77_level,
+            .lz77_window_size = (size_t)lz77_window_size * 1024,
+            .dictionary = dictionary_to_use,
+            .has_checksums = has_checksums,
+            .sample_interval = sample_interval
+        };
+        return run_batch(&batch_options, argv + optind, argc - optind);
+    }
 
-    print_byte_frequencies(byte_frequencies);
-    print_huffman_tree(huffman_tree);
-    print_prefix_code_mappings(mappings);
+    // without a filename (or with a filename of "-"), the input is read from
+    // stdin, so the encoder can be used in the middle of a pipeline
+    const char *filename = NULL;
+    if (optind < argc && strcmp(argv[optind], "-") != 0) {
+        filename = argv[optind];
+    }
+    struct input_file file_in;
+    if (open_input_file(filename, &file_in)) {
+        fprintf(stderr, "Error: Could not open input file.\n");
+        return 1;
+    }
+    struct output_file file_out;
+    if (open_output_file(STDOUT_FILENO, &file_out)) {
+        fprintf(stderr, "Error: Unable to allocate the output buffer.\n");
+        close_input_file(&file_in);
+        return 1;
+    }
+    // the input is read and the output is written on threads of their own
+    // (see io_thread.h), while this thread (and the workers) code the blocks
+    start_reading_ahead(&file_in);
+    start_writing_in_background(&file_out);
 
-    // free/close everything
-    fclose(file_in);
-    free_node_recursive(huffman_tree);
-    free_prefix_code_mappings(mappings);
+    // with 1 thread, everything happens on the main thread. with more, the
+    // blocks are compressed by that many worker threads while the main thread
+    // reads and writes. there are twice as many block jobs as threads, so that
+    // the workers have more blocks to go on with while the main thread waits
+    // for the oldest block to be done
+    //
+    // in adaptive mode, each block needs the tree that the block before it
+    // left behind, so there is only ever 1 block at a time. the blocks are
+    // also kept short, and each one is written as soon as it is compressed
+    struct adaptive_huffman_tree *adaptive_tree = NULL;
+    size_t block_capacity = (size_t)block_size * 1024;
+    if (is_adaptive) {
+        number_of_threads = 1;
+        if (block_capacity > MAXIMUM_ADAPTIVE_BLOCK_LENGTH) {
+            block_capacity = MAXIMUM_ADAPTIVE_BLOCK_LENGTH;
+        }
+    }
+    struct thread_pool pool;
+    struct thread_pool *pool_to_use = NULL;
+    if (number_of_threads > 1) {
+        if (create_thread_pool(&pool, number_of_threads)) {
+            fprintf(stderr, "Error: Unable to start the threads.\n");
+            close_output_file(&file_out);
+            close_input_file(&file_in);
+            return 1;
+        }
+        pool_to_use = &pool;
+    }
+    int number_of_block_jobs = number_of_threads > 1
+                             ? 2 * number_of_threads
+                             : 1;
+    struct block_job *block_jobs = calloc(
+        number_of_block_jobs,
+        sizeof (*block_jobs)
+    );
+    bool could_allocate = block_jobs != NULL;
+    for (int i = 0; could_allocate && i < number_of_block_jobs; i += 1) {
+        block_jobs[i].encoder.sample_interval = sample_interval;
+        // the blocks of a mapped input file are used right where they are
+        if (file_in.mapped_bytes == NULL) {
+            block_jobs[i].block_buffer = malloc(block_capacity);
+            could_allocate = block_jobs[i].block_buffer != NULL;
+        }
+        size_t compressed_block_bound = COMPRESSED_BLOCK_BOUND(block_capacity);
+        if (is_adaptive) {
+            compressed_block_bound = ADAPTIVE_BLOCK_BOUND(block_capacity);
+        } else if (dictionary_to_use != NULL) {
+            compressed_block_bound = DICTIONARY_BLOCK_BOUND(block_capacity);
+        }
+        block_jobs[i].compressed_block = malloc(
+            BLOCK_HEADER_SIZE + compressed_block_bound + BLOCK_CHECKSUM_SIZE
+        );
+        could_allocate = could_allocate
+                      && block_jobs[i].compressed_block != NULL;
+        if (is_order_1) {
+            block_jobs[i].encoder.context_model = malloc(
+                sizeof (*block_jobs[i].encoder.context_model)
+            );
+            could_allocate = could_allocate
+                          && block_jobs[i].encoder.context_model != NULL;
+        }
+        if (lz77_level != 0) {
+            block_jobs[i].encoder.lz77_model = create_lz77_model(
+                lz77_level,
+                (uint32_t)lz77_window_size * 1024
+            );
+            could_allocate = could_allocate
+                          && block_jobs[i].encoder.lz77_model != NULL;
+        }
+    }
+    if (could_allocate && is_adaptive) {
+        adaptive_tree = malloc(sizeof (*adaptive_tree));
+        could_allocate = adaptive_tree != NULL;
+        if (could_allocate) {
+            init_adaptive_huffman_tree(adaptive_tree);
+            block_jobs[0].adaptive_tree = adaptive_tree;
+        }
+    }
 
-    return 0;
+    int exit_status = 0;
+    if (!could_allocate) {
+        fprintf(stderr, "Error: Unable to allocate the blocks.\n");
+        exit_status = 1;
+    }
+
+    // the blocks are read and submitted in order, and the oldest one is always
+    // the next one to be written, so they come out in order too
+    if (exit_status == 0) {
+        unsigned char file_header[FILE_HEADER_SIZE + DICTIONARY_ID_SIZE];
+        write_big_endian_32_bits(file_header, FILE_MAGIC_NUMBER);
+        file_header[4] = is_adaptive
+                       ? FORMAT_VERSION_ADAPTIVE
+                       : FORMAT_VERSION;
+        size_t file_header_size = FILE_HEADER_SIZE;
+        if (dictionary_to_use != NULL) {
+            file_header[4] = FORMAT_VERSION_DICTIONARY;
+            write_big_endian_32_bits(
+                file_header + FILE_HEADER_SIZE,
+                dictionary_to_use->id
+            );
+            file_header_size += DICTIONARY_ID_SIZE;
+        }
+        if (has_checksums) {
+            file_header[4] |= FORMAT_FLAG_CHECKSUMS;
+        }
+        if (has_seek_index) {
+            file_header[4] |= FORMAT_FLAG_SEEK_INDEX;
+        }
+        write_to_output_file(&file_out, file_header, file_header_size);
+    }
+    // the dictionary's prefix code is the same for every block, so it is only
+    // printed once, before the first block
+    if (
+        exit_status == 0
+        && dictionary_to_use != NULL
+        && should_print_structures
+    ) {
+        fprintf(stderr, "Dictionary %08" PRIx32 "\n\n", dictionary.id);
+        print_huffman_tree(&dictionary.canonical_tree);
+        struct prefix_code_mapping mappings[256];
+        create_prefix_code_mappings(&dictionary.canonical_tree, mappings);
+        print_prefix_code_mappings(mappings);
+    }
+    struct seek_index_entry *seek_index = NULL;
+    size_t seek_index_capacity = 0;
+    uint64_t number_of_blocks_read = 0;
+    uint64_t number_of_blocks_written = 0;
+    uint64_t number_of_bytes_compressed = 0;
+    uint32_t checksum = 0;
+    bool have_reached_end_of_input = false;
+    while (exit_status == 0) {
+        while (
+            !have_reached_end_of_input
+            && number_of_blocks_read - number_of_blocks_written
+               < (uint64_t)number_of_block_jobs
+        ) {
+            struct block_job *block_job = &block_jobs[
+                number_of_blocks_read % number_of_block_jobs
+            ];
+            // in adaptive mode, a block is whatever has arrived so far, so
+            // that it can be sent on right away
+            double read_start_time = get_time_in_seconds();
+            if ((is_adaptive
+                ? read_available_from_input_file
+                : read_from_input_file
+            )(
+                &file_in,
+                block_job->block_buffer,
+                block_capacity,
+                &block_job->block,
+                &block_job->block_length
+            )) {
+                fprintf(stderr, "Error: Could not read the input file.\n");
+                exit_status = 1;
+                have_reached_end_of_input = true;
+                break;
+            }
+            add_phase_time(
+                &stats,
+                RUN_PHASE_READ,
+                get_time_in_seconds() - read_start_time
+            );
+            if (block_job->block_length == 0) {
+                have_reached_end_of_input = true;
+                break;
+            }
+            number_of_blocks_read += 1;
+            block_job->block_number = number_of_blocks_read;
+            block_job->codeword_length_limit = codeword_length_limit;
+            block_job->block_type = block_type;
+            block_job->dictionary = dictionary_to_use;
+            block_job->has_checksum = has_checksums;
+            block_job->should_count_bytes = dictionary_to_use == NULL
+                                         || should_print_structures
+                                         || should_print_stats;
+            block_job->should_measure_sampling = sample_interval > 1
+                                              && should_print_stats;
+            block_job->job.function = &compress_block;
+            block_job->job.argument = block_job;
+            thread_pool_submit(pool_to_use, &block_job->job);
+        }
+        if (number_of_blocks_written == number_of_blocks_read) {
+            break;
+        }
+
+        struct block_job *block_job = &block_jobs[
+            number_of_blocks_written % number_of_block_jobs
+        ];
+        thread_pool_wait_for(pool_to_use, &block_job->job);
+        number_of_blocks_written += 1;
+        if (block_job->exit_status) {
+            fprintf(
+                stderr,
+                "Error: Unable to allocate memory for compressing a block.\n"
+            );
+            exit_status = 1;
+            break;
+        }
+        if (has_seek_index && add_seek_index_entry(
+            &seek_index,
+            &seek_index_capacity,
+            number_of_blocks_written - 1,
+            file_out.number_of_bytes_written,
+            number_of_bytes_compressed
+        )) {
+            fprintf(stderr, "Error: Unable to allocate the seek index.\n");
+            exit_status = 1;
+            break;
+        }
+        double write_start_time = get_time_in_seconds();
+        write_to_output_file(
+            &file_out,
+            block_job->compressed_block,
+            block_job->compressed_block_length
+        );
+        if (is_adaptive) {
+            flush_output_file(&file_out);
+        }
+        add_phase_time(
+            &stats,
+            RUN_PHASE_WRITE,
+            get_time_in_seconds() - write_start_time
+        );
+        number_of_bytes_compressed += block_job->block_length;
+        if (has_checksums) {
+            checksum = combine_crc32c(
+                checksum,
+                block_job->checksum,
+                block_job->block_length
+            );
+        }
+
+        for (
+            int phase = RUN_PHASE_HISTOGRAM;
+            phase <= RUN_PHASE_ENCODE;
+            phase += 1
+        ) {
+            add_phase_time(&stats, phase, block_job->phase_seconds[phase]);
+        }
+        if (is_adaptive) {
+            add_block_to_run_stats(
+                &stats,
+                block_job->encoder.byte_frequencies,
+                NULL
+            );
+            stats.number_of_codeword_bits += 8 * (
+                block_job->compressed_block_length - BLOCK_HEADER_SIZE
+                - (has_checksums ? BLOCK_CHECKSUM_SIZE : 0)
+            );
+            int depth = get_adaptive_tree_depth(adaptive_tree);
+            if (depth > stats.longest_code_length) {
+                stats.longest_code_length = depth;
+            }
+        } else if (block_job->encoder.block_type == BLOCK_TYPE_STORED) {
+            // every byte of a stored block takes up 8 bits
+            add_block_to_run_stats(
+                &stats,
+                block_job->should_measure_sampling
+                ? block_job->exact_byte_frequencies
+                : block_job->encoder.byte_frequencies,
+                NULL
+            );
+            stats.number_of_codeword_bits += 8 * block_job->block_length;
+            if (stats.longest_code_length < 8) {
+                stats.longest_code_length = 8;
+            }
+        } else if (block_job->encoder.block_type == BLOCK_TYPE_ORDER_1) {
+            const struct context_model *model =
+                block_job->encoder.context_model;
+            add_block_to_run_stats(
+                &stats,
+                block_job->encoder.byte_frequencies,
+                NULL
+            );
+            stats.number_of_codeword_bits += model->number_of_codeword_bits;
+            for (int i = 0; i < model->number_of_tables; i += 1) {
+                int length = get_longest_code_length(model->code_lengths[i]);
+                if (length > stats.longest_code_length) {
+                    stats.longest_code_length = length;
+                }
+            }
+        } else if (block_job->encoder.block_type == BLOCK_TYPE_LZ77) {
+            const struct lz77_model *model = block_job->encoder.lz77_model;
+            add_block_to_run_stats(
+                &stats,
+                block_job->encoder.byte_frequencies,
+                NULL
+            );
+            stats.number_of_codeword_bits += model->number_of_codeword_bits;
+            for (int i = 0; i < LZ77_NUMBER_OF_ALPHABETS; i += 1) {
+                int length = get_longest_code_length(model->code_lengths[i]);
+                if (length > stats.longest_code_length) {
+                    stats.longest_code_length = length;
+                }
+            }
+        } else if (dictionary_to_use != NULL) {
+            if (block_job->should_count_bytes) {
+                add_block_to_run_stats(
+                    &stats,
+                    block_job->encoder.byte_frequencies,
+                    dictionary_to_use->code_lengths
+                );
+            }
+        } else {
+            // the sampled counts are only estimates, so the bits that the
+            // codewords really took come from the exact counts
+            add_block_to_run_stats(
+                &stats,
+                block_job->should_measure_sampling
+                ? block_job->exact_byte_frequencies
+                : block_job->encoder.byte_frequencies,
+                block_job->encoder.code_lengths
+            );
+        }
+        stats.number_of_exact_codeword_bits +=
+            block_job->number_of_exact_codeword_bits;
+        if (should_print_structures) {
+            print_block_job_structures(block_job);
+        }
+    }
+    // mark the end of the blocks with a block that has no bytes, followed by
+    // the totals and the checksum of all of the blocks
+    if (exit_status == 0) {
+        unsigned char file_trailer[
+            FILE_TRAILER_SIZE + FILE_CHECKSUM_SIZE
+        ] = {0};
+        write_big_endian_64_bits(file_trailer + 4, number_of_bytes_compressed);
+        write_big_endian_64_bits(file_trailer + 12, number_of_blocks_written);
+        write_big_endian_32_bits(file_trailer + FILE_TRAILER_SIZE, checksum);
+        write_to_output_file(
+            &file_out,
+            file_trailer,
+            FILE_TRAILER_SIZE + (has_checksums ? FILE_CHECKSUM_SIZE : 0)
+        );
+        if (has_seek_index) {
+            write_seek_index(&file_out, seek_index, number_of_blocks_written);
+        }
+    }
+    stats.number_of_bytes_read = file_in.number_of_bytes_read;
+    stats.number_of_bytes_written = file_out.number_of_bytes_written;
+    double close_start_time = get_time_in_seconds();
+    if (close_output_file(&file_out) && exit_status == 0) {
+        fprintf(stderr, "Error: Could not write the output.\n");
+        exit_status = 1;
+    }
+    add_phase_time(
+        &stats,
+        RUN_PHASE_WRITE,
+        get_time_in_seconds() - close_start_time
+    );
+
+    // free/close everything. any blocks that are still being worked on (if
+    // there was an error) have to be done before their memory can be freed
+    if (pool_to_use != NULL) {
+        free_thread_pool(pool_to_use);
+    }
+    for (int i = 0; block_jobs != NULL && i < number_of_block_jobs; i += 1) {
+        free(block_jobs[i].block_buffer);
+        free(block_jobs[i].compressed_block);
+        free(block_jobs[i].encoder.context_model);
+        free_lz77_model(block_jobs[i].encoder.lz77_model);
+    }
+    free(block_jobs);
+    free(adaptive_tree);
+    free(seek_index);
+    close_input_file(&file_in);
+
+    if (should_print_stats) {
+        print_run_stats_json(&stats, exit_status == 0, stderr);
+    }
+    return exit_status;
 }
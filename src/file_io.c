@@ -0,0 +1,427 @@
+// see file_io.h for an explanation of how the input and output are handled
+
+// mmap() and friends are POSIX functions, not standard C ones
+#define _POSIX_C_SOURCE 200809L
+
+#include "file_io.h"
+#include "dictionary.h"
+#include "io_thread.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// open the file with the given name for reading, or stdin if "filename" is
+// NULL, and map it into memory if it is a regular file. returns whether the
+// file could be opened
+int open_input_file(const char *filename, struct input_file *file) {
+    file->file_descriptor = STDIN_FILENO;
+    if (filename != NULL) {
+        file->file_descriptor = open(filename, O_RDONLY);
+        if (file->file_descriptor == -1) {
+            return 1;
+        }
+    }
+    file->mapped_bytes = NULL;
+    file->number_of_mapped_bytes = 0;
+    file->position = 0;
+    file->is_reading_ahead = false;
+    file->reader = NULL;
+    file->number_of_bytes_read = 0;
+
+    // if anything about mapping the file doesn't work out, the file is just
+    // read normally instead. an empty file can't be mapped, but there is
+    // nothing to read from it anyway
+    struct stat status;
+    if (
+        fstat(file->file_descriptor, &status) == -1
+        || !S_ISREG(status.st_mode)
+        || status.st_size == 0
+        || (uintmax_t)status.st_size > SIZE_MAX
+    ) {
+        return 0;
+    }
+    void *mapping = mmap(
+        NULL,
+        status.st_size,
+        PROT_READ,
+        MAP_PRIVATE,
+        file->file_descriptor,
+        0
+    );
+    if (mapping == MAP_FAILED) {
+        return 0;
+    }
+    // the file is read from front to back, so the system can read ahead of us
+    // and drop the pages that we are done with
+    posix_madvise(mapping, status.st_size, POSIX_MADV_SEQUENTIAL);
+
+    file->mapped_bytes = mapping;
+    file->number_of_mapped_bytes = status.st_size;
+    // stdin might have already been read from (for example, by a shell
+    // script), so continue from wherever it is
+    off_t offset = lseek(file->file_descriptor, 0, SEEK_CUR);
+    if (offset > 0 && (uintmax_t)offset < file->number_of_mapped_bytes) {
+        file->position = offset;
+    } else if (offset > 0) {
+        file->position = file->number_of_mapped_bytes;
+    }
+    return 0;
+}
+
+// have the file's bytes read ahead of time from now on: by a reader thread if
+// the file isn't mapped, or else by the system (see file_io.h). this is for
+// reading big pieces of a file in order, like blocks. if the thread can't be
+// started, the file is just read when it is needed instead
+void start_reading_ahead(struct input_file *file) {
+    if (file->mapped_bytes != NULL) {
+        file->is_reading_ahead = true;
+    } else {
+        file->reader = start_reader_thread(file->file_descriptor);
+    }
+}
+
+// ask the system to start reading the "number_of_bytes" bytes of the mapping
+// that come after its position, without waiting for them
+void read_mapping_ahead(struct input_file *file, size_t number_of_bytes) {
+    size_t number_of_bytes_left = file->number_of_mapped_bytes
+                                - file->position;
+    if (number_of_bytes > number_of_bytes_left) {
+        number_of_bytes = number_of_bytes_left;
+    }
+    if (number_of_bytes == 0) {
+        return;
+    }
+    // the advice has to start at the beginning of a page
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t)(file->mapped_bytes + file->position);
+    uintptr_t page_start = start - start % page_size;
+    posix_madvise(
+        (void *)page_start,
+        number_of_bytes + (start - page_start),
+        POSIX_MADV_WILLNEED
+    );
+}
+
+// get up to the next "number_of_bytes" bytes of the file, which are fewer only
+// at the end of the file. "bytes" is set to where they are: in the file's
+// mapping if it has one, or else in "buffer" (which must have room for them).
+// returns whether the reading was successful
+int read_from_input_file(
+    struct input_file *file,
+    unsigned char *buffer,
+    size_t number_of_bytes,
+    const unsigned char **bytes,
+    size_t *number_of_bytes_read
+) {
+    if (file->mapped_bytes != NULL) {
+        size_t number_of_bytes_left = file->number_of_mapped_bytes
+                                    - file->position;
+        if (number_of_bytes > number_of_bytes_left) {
+            number_of_bytes = number_of_bytes_left;
+        }
+        *bytes = file->mapped_bytes + file->position;
+        *number_of_bytes_read = number_of_bytes;
+        file->position += number_of_bytes;
+        file->number_of_bytes_read += number_of_bytes;
+        // the next read is most likely the same size (the next block). small
+        // reads (like of a block's header) aren't worth a system call
+        if (file->is_reading_ahead && number_of_bytes >= READ_AHEAD_MINIMUM) {
+            read_mapping_ahead(file, number_of_bytes);
+        }
+        return 0;
+    }
+
+    *bytes = buffer;
+    if (file->reader != NULL) {
+        int reading_exit_status = io_thread_read(
+            file->reader,
+            buffer,
+            number_of_bytes,
+            true,
+            number_of_bytes_read
+        );
+        file->number_of_bytes_read += *number_of_bytes_read;
+        return reading_exit_status;
+    }
+
+    // a pipe can give back fewer bytes than were asked for before its end, so
+    // keep reading until there are enough
+    *number_of_bytes_read = 0;
+    while (*number_of_bytes_read < number_of_bytes) {
+        ssize_t result = read(
+            file->file_descriptor,
+            buffer + *number_of_bytes_read,
+            number_of_bytes - *number_of_bytes_read
+        );
+        if (result == 0) {
+            break;
+        }
+        if (result == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return 1;
+        }
+        *number_of_bytes_read += result;
+        file->number_of_bytes_read += result;
+    }
+    return 0;
+}
+
+// the same as read_from_input_file(), except that input that isn't mapped
+// (like a pipe) is only read from once, so this gives back whatever bytes have
+// arrived so far instead of waiting for "number_of_bytes" of them. it only
+// gives back 0 bytes at the end of the file
+int read_available_from_input_file(
+    struct input_file *file,
+    unsigned char *buffer,
+    size_t number_of_bytes,
+    const unsigned char **bytes,
+    size_t *number_of_bytes_read
+) {
+    if (file->mapped_bytes != NULL) {
+        return read_from_input_file(
+            file,
+            buffer,
+            number_of_bytes,
+            bytes,
+            number_of_bytes_read
+        );
+    }
+
+    *bytes = buffer;
+    if (file->reader != NULL) {
+        int reading_exit_status = io_thread_read(
+            file->reader,
+            buffer,
+            number_of_bytes,
+            false,
+            number_of_bytes_read
+        );
+        file->number_of_bytes_read += *number_of_bytes_read;
+        return reading_exit_status;
+    }
+    while (true) {
+        ssize_t result = read(file->file_descriptor, buffer, number_of_bytes);
+        if (result == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return 1;
+        }
+        *number_of_bytes_read = result;
+        file->number_of_bytes_read += result;
+        return 0;
+    }
+}
+
+void close_input_file(struct input_file *file) {
+    if (file->reader != NULL) {
+        stop_io_thread(file->reader);
+    }
+    if (file->mapped_bytes != NULL) {
+        munmap((void *)file->mapped_bytes, file->number_of_mapped_bytes);
+    }
+    if (file->file_descriptor != STDIN_FILENO) {
+        close(file->file_descriptor);
+    }
+}
+
+// write all of the bytes to the file descriptor. returns whether it was
+// successful
+int write_all_bytes(
+    int file_descriptor,
+    const unsigned char *bytes,
+    size_t number_of_bytes
+) {
+    while (number_of_bytes > 0) {
+        ssize_t result = write(file_descriptor, bytes, number_of_bytes);
+        if (result == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return 1;
+        }
+        bytes += result;
+        number_of_bytes -= result;
+    }
+    return 0;
+}
+
+// start collecting output for the already open file descriptor. returns
+// whether the memory for the output buffer could be allocated
+int open_output_file(int file_descriptor, struct output_file *file) {
+    file->file_descriptor = file_descriptor;
+    file->length = 0;
+    file->has_error = false;
+    file->writer = NULL;
+    file->number_of_bytes_written = 0;
+    // aligning the buffer to a page lets the system copy it more efficiently
+    file->buffer = aligned_alloc(4096, OUTPUT_BUFFER_SIZE);
+    return file->buffer == NULL;
+}
+
+// have a writer thread write the output from now on (see file_io.h). if the
+// thread can't be started, the output is just written from the buffer instead
+void start_writing_in_background(struct output_file *file) {
+    flush_output_file(file);
+    file->writer = start_writer_thread(file->file_descriptor);
+}
+
+// write the buffered bytes to the file now, if there are any, instead of
+// waiting for the buffer to get full. with a writer thread, they are handed
+// to it now instead
+void flush_output_file(struct output_file *file) {
+    if (file->writer != NULL) {
+        io_thread_flush(file->writer);
+        return;
+    }
+    if (
+        !file->has_error
+        && write_all_bytes(file->file_descriptor, file->buffer, file->length)
+    ) {
+        file->has_error = true;
+    }
+    file->length = 0;
+}
+
+// add the bytes to the output. if there was already a problem with writing to
+// the file, they are thrown away, and close_output_file() reports the problem
+void write_to_output_file(
+    struct output_file *file,
+    const unsigned char *bytes,
+    size_t number_of_bytes
+) {
+    file->number_of_bytes_written += number_of_bytes;
+    if (file->writer != NULL) {
+        io_thread_write(file->writer, bytes, number_of_bytes);
+        return;
+    }
+    if (file->length + number_of_bytes > OUTPUT_BUFFER_SIZE) {
+        flush_output_file(file);
+    }
+
+    // bytes that wouldn't fit in the buffer anyway are written directly, since
+    // copying them first would gain nothing
+    if (number_of_bytes >= OUTPUT_BUFFER_SIZE) {
+        if (
+            !file->has_error
+            && write_all_bytes(file->file_descriptor, bytes, number_of_bytes)
+        ) {
+            file->has_error = true;
+        }
+        return;
+    }
+    memcpy(file->buffer + file->length, bytes, number_of_bytes);
+    file->length += number_of_bytes;
+}
+
+// write whatever is left in the buffer and free it. the file descriptor itself
+// stays open. returns whether any of the output couldn't be written
+int close_output_file(struct output_file *file) {
+    if (file->writer != NULL && stop_io_thread(file->writer)) {
+        file->has_error = true;
+    }
+    file->writer = NULL;
+    flush_output_file(file);
+    free(file->buffer);
+    file->buffer = NULL;
+    return file->has_error;
+}
+
+// read the whole file with the given name into "buffer", which has room for
+// "capacity" bytes, and set "length" to its size. this is for small files,
+// like dictionaries, that are needed all at once. returns whether it was
+// successful:
+// 1. the file couldn't be opened or read
+// 2. the file has more than "capacity" bytes
+int read_whole_file(
+    const char *filename,
+    unsigned char *buffer,
+    size_t capacity,
+    size_t *length
+) {
+    struct input_file file;
+    if (open_input_file(filename, &file)) {
+        return 1;
+    }
+    const unsigned char *bytes;
+    // 1 more byte than there is room for is asked for, to find out if the file
+    // is too big
+    int reading_exit_status = 0;
+    unsigned char extra_byte;
+    if (read_from_input_file(&file, buffer, capacity, &bytes, length)) {
+        reading_exit_status = 1;
+    } else {
+        memmove(buffer, bytes, *length);
+        size_t number_of_extra_bytes;
+        if (read_from_input_file(
+            &file,
+            &extra_byte,
+            1,
+            &bytes,
+            &number_of_extra_bytes
+        )) {
+            reading_exit_status = 1;
+        } else if (number_of_extra_bytes > 0) {
+            reading_exit_status = 2;
+        }
+    }
+    close_input_file(&file);
+    return reading_exit_status;
+}
+
+// create (or replace) the file with the given name and write all of the bytes
+// to it. returns whether it was successful
+int write_whole_file(
+    const char *filename,
+    const unsigned char *bytes,
+    size_t number_of_bytes
+) {
+    int file_descriptor = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (file_descriptor == -1) {
+        return 1;
+    }
+    int writing_exit_status = write_all_bytes(
+        file_descriptor,
+        bytes,
+        number_of_bytes
+    );
+    if (close(file_descriptor) == -1) {
+        writing_exit_status = 1;
+    }
+    return writing_exit_status;
+}
+
+// read the dictionary file with the given name (see dictionary.h) and make the
+// dictionary's tables. returns whether it was successful:
+// 1. the file couldn't be opened or read
+// 2. the file isn't a dictionary, or the dictionary is damaged
+// 3. the memory for the decode table couldn't be allocated
+int read_dictionary_file(
+    const char *filename,
+    struct dictionary *dictionary
+) {
+    unsigned char bytes[DICTIONARY_FILE_BOUND];
+    size_t number_of_bytes;
+    int reading_exit_status = read_whole_file(
+        filename,
+        bytes,
+        sizeof (bytes),
+        &number_of_bytes
+    );
+    // a file that is too big can't be a dictionary
+    if (reading_exit_status != 0) {
+        return reading_exit_status;
+    }
+    reading_exit_status = read_dictionary(bytes, number_of_bytes, dictionary);
+    if (reading_exit_status != 0) {
+        return 1 + reading_exit_status;
+    }
+    return 0;
+}
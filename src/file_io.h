@@ -0,0 +1,112 @@
+// both binaries read their input in large pieces (blocks) and write their
+// output in large pieces, so instead of going through stdio, they use these
+// simpler functions that work directly on file descriptors
+//
+// when the input is a regular file, the whole file is mapped into memory, and
+// reading from it just gives back a pointer to where the bytes already are, so
+// they are never copied. other kinds of input (like a pipe) can't be mapped, so
+// their bytes are read into memory that the caller supplies instead
+//
+// the output is collected in one large buffer, which is written to the file
+// whenever it gets full, so that small writes don't each cost a system call
+//
+// the encoder and decoder also give their input and output threads of their
+// own (see io_thread.h), so that the reading and writing happen while the
+// blocks are being coded. input that isn't mapped is read ahead by a reader
+// thread, and the output is written by a writer thread instead of from the
+// buffer. a mapped file is already read by the system, so the system is just
+// asked to start reading each block's bytes ahead of time, while the block
+// before it is being coded. batch mode (see batch.h) works on many files that
+// are mostly small, so it doesn't use these
+//
+// small files that are needed all at once (like dictionaries, see
+// dictionary.h) are just read or written whole
+
+#ifndef FILE_IO_H
+#define FILE_IO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct dictionary;
+struct io_thread;
+
+struct input_file {
+    int file_descriptor;
+    // NULL if the file isn't mapped into memory
+    const unsigned char *mapped_bytes;
+    size_t number_of_mapped_bytes;
+    size_t position;
+    // whether the next bytes of the mapping are read ahead of time
+    bool is_reading_ahead;
+    // NULL if the file is read on the thread that calls
+    // read_from_input_file()
+    struct io_thread *reader;
+    // the total of all of the reads, for reporting
+    uint64_t number_of_bytes_read;
+};
+
+struct output_file {
+    int file_descriptor;
+    unsigned char *buffer;
+    size_t length;
+    bool has_error;
+    // NULL if the file is written on the thread that calls
+    // write_to_output_file()
+    struct io_thread *writer;
+    // the total of all of the writes, for reporting
+    uint64_t number_of_bytes_written;
+};
+
+// how many bytes the output buffer collects before they are written to the
+// file, which is a multiple of the page size
+#define OUTPUT_BUFFER_SIZE (4 * 1024 * 1024)
+// the smallest read of a mapped file that the next bytes are read ahead for
+#define READ_AHEAD_MINIMUM (64 * 1024)
+
+int open_input_file(const char *filename, struct input_file *file);
+void start_reading_ahead(struct input_file *file);
+int read_from_input_file(
+    struct input_file *file,
+    unsigned char *buffer,
+    size_t number_of_bytes,
+    const unsigned char **bytes,
+    size_t *number_of_bytes_read
+);
+int read_available_from_input_file(
+    struct input_file *file,
+    unsigned char *buffer,
+    size_t number_of_bytes,
+    const unsigned char **bytes,
+    size_t *number_of_bytes_read
+);
+void close_input_file(struct input_file *file);
+
+int open_output_file(int file_descriptor, struct output_file *file);
+void start_writing_in_background(struct output_file *file);
+void write_to_output_file(
+    struct output_file *file,
+    const unsigned char *bytes,
+    size_t number_of_bytes
+);
+void flush_output_file(struct output_file *file);
+int close_output_file(struct output_file *file);
+
+int read_whole_file(
+    const char *filename,
+    unsigned char *buffer,
+    size_t capacity,
+    size_t *length
+);
+int write_whole_file(
+    const char *filename,
+    const unsigned char *bytes,
+    size_t number_of_bytes
+);
+int read_dictionary_file(
+    const char *filename,
+    struct dictionary *dictionary
+);
+
+#endif
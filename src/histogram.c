@@ -0,0 +1,167 @@
+// see histogram.h for an explanation of why the bytes are counted this way
+
+#include "histogram.h"
+#include <string.h>
+
+#define NUMBER_OF_SUB_HISTOGRAMS 8
+
+// the sub-histograms count with 32 bits, since they are smaller (so more of
+// them fit in the cache) than 64-bit counts. to make sure that they can't
+// overflow, the bytes are counted in chunks of at most this many bytes, and
+// each chunk's counts are added to the 64-bit totals
+#define MAXIMUM_CHUNK_SIZE ((size_t)1 << 30)
+
+// add 1 to the count of each of the 8 bytes of "eight_bytes", using a
+// different sub-histogram for each of them. which byte is which doesn't matter
+// for counting, so the bytes can be in any order
+static inline void count_eight_bytes(
+    uint64_t eight_bytes,
+    uint32_t counts[NUMBER_OF_SUB_HISTOGRAMS][256]
+) {
+#pragma GCC unroll 8
+    for (int i = 0; i < 8; i += 1) {
+        counts[i][(eight_bytes >> (8 * i)) & 0xff] += 1;
+    }
+}
+
+// count the bytes in the sub-histograms, 32 at a time. if all 32 of them are
+// the same byte, which is common in long runs, they are counted with a single
+// addition instead of 32
+void count_chunk(
+    const unsigned char *bytes,
+    size_t number_of_bytes,
+    uint32_t counts[NUMBER_OF_SUB_HISTOGRAMS][256]
+) {
+    size_t i = 0;
+    for (; i + 32 <= number_of_bytes; i += 32) {
+        uint64_t eight_bytes[4];
+        memcpy(eight_bytes, bytes + i, 32);
+        // the first 8 bytes are all the same if moving each of them over by 1
+        // byte doesn't change them, and then the rest are the same as them if
+        // each 8 of them are. most of the time, the first check already fails
+        uint64_t rotated = eight_bytes[0] >> 8 | eight_bytes[0] << 56;
+        if (
+            eight_bytes[0] == rotated
+            && eight_bytes[0] == eight_bytes[1]
+            && eight_bytes[0] == eight_bytes[2]
+            && eight_bytes[0] == eight_bytes[3]
+        ) {
+            counts[0][bytes[i]] += 32;
+            continue;
+        }
+
+        count_eight_bytes(eight_bytes[0], counts);
+        count_eight_bytes(eight_bytes[1], counts);
+        count_eight_bytes(eight_bytes[2], counts);
+        count_eight_bytes(eight_bytes[3], counts);
+    }
+    for (; i < number_of_bytes; i += 1) {
+        counts[0][bytes[i]] += 1;
+    }
+}
+
+// add the counts of the sub-histograms to the 64-bit totals, and set them back
+// to 0
+static void add_sub_histograms(
+    uint32_t counts[NUMBER_OF_SUB_HISTOGRAMS][256],
+    uint64_t byte_frequencies[256]
+) {
+    for (int i = 0; i < NUMBER_OF_SUB_HISTOGRAMS; i += 1) {
+        for (int j = 0; j < 256; j += 1) {
+            byte_frequencies[j] += counts[i][j];
+            counts[i][j] = 0;
+        }
+    }
+}
+
+// fill the "byte_frequencies" array with how many occurances each byte has in
+// the given bytes
+void count_byte_frequencies(
+    const unsigned char *bytes,
+    size_t number_of_bytes,
+    uint64_t byte_frequencies[256]
+) {
+    for (int i = 0; i < 256; i += 1) {
+        byte_frequencies[i] = 0;
+    }
+
+    size_t position = 0;
+    while (position < number_of_bytes) {
+        size_t chunk_size = number_of_bytes - position;
+        if (chunk_size > MAXIMUM_CHUNK_SIZE) {
+            chunk_size = MAXIMUM_CHUNK_SIZE;
+        }
+
+        uint32_t counts[NUMBER_OF_SUB_HISTOGRAMS][256] = {{0}};
+        count_chunk(bytes + position, chunk_size, counts);
+        add_sub_histograms(counts, byte_frequencies);
+
+        position += chunk_size;
+    }
+}
+
+// fill the "byte_frequencies" array with an estimate of how many occurances
+// each byte has in the given bytes, from only the first SAMPLE_CHUNK_SIZE
+// bytes of every "sample_interval" * SAMPLE_CHUNK_SIZE bytes. the counts of
+// that sample are scaled up to the number of bytes, and then every byte gets
+// 1 more, so that the bytes that the sample missed still get a codeword. a
+// "sample_interval" of 1 counts every byte, like count_byte_frequencies(), and
+// so do bytes that are no longer than "sample_interval" * SAMPLE_CHUNK_SIZE
+// (like the last block of most files), since the sample would skip at most
+// that many bytes and the estimate would only make the prefix code worse
+void sample_byte_frequencies(
+    const unsigned char *bytes,
+    size_t number_of_bytes,
+    int sample_interval,
+    uint64_t byte_frequencies[256]
+) {
+    size_t stride = (size_t)sample_interval * SAMPLE_CHUNK_SIZE;
+    if (sample_interval <= 1 || number_of_bytes <= stride) {
+        count_byte_frequencies(bytes, number_of_bytes, byte_frequencies);
+        return;
+    }
+    for (int i = 0; i < 256; i += 1) {
+        byte_frequencies[i] = 0;
+    }
+
+    uint32_t counts[NUMBER_OF_SUB_HISTOGRAMS][256] = {{0}};
+    size_t number_of_bytes_in_counts = 0;
+    uint64_t number_of_sampled_bytes = 0;
+    for (size_t position = 0; position < number_of_bytes; position += stride) {
+        size_t chunk_size = number_of_bytes - position;
+        if (chunk_size > SAMPLE_CHUNK_SIZE) {
+            chunk_size = SAMPLE_CHUNK_SIZE;
+        }
+        if (number_of_bytes_in_counts + chunk_size > MAXIMUM_CHUNK_SIZE) {
+            add_sub_histograms(counts, byte_frequencies);
+            number_of_bytes_in_counts = 0;
+        }
+        count_chunk(bytes + position, chunk_size, counts);
+        number_of_bytes_in_counts += chunk_size;
+        number_of_sampled_bytes += chunk_size;
+    }
+    add_sub_histograms(counts, byte_frequencies);
+
+    double scale = (double)number_of_bytes / number_of_sampled_bytes;
+    for (int i = 0; i < 256; i += 1) {
+        byte_frequencies[i] = (uint64_t)(byte_frequencies[i] * scale + 0.5)
+                            + 1;
+    }
+}
+
+// fill the "pair_frequencies" array with how many times each byte comes right
+// after each other byte in the given bytes, where pair_frequencies[a][b] is the
+// count of b after a. the first byte is counted as if it came after a 0 byte.
+// there can't be more than 2^32 - 1 bytes, so that the counts can't overflow
+void count_pair_frequencies(
+    const unsigned char *bytes,
+    size_t number_of_bytes,
+    uint32_t pair_frequencies[256][256]
+) {
+    memset(pair_frequencies, 0, 256 * sizeof (*pair_frequencies));
+    unsigned char previous_byte = 0;
+    for (size_t i = 0; i < number_of_bytes; i += 1) {
+        pair_frequencies[previous_byte][bytes[i]] += 1;
+        previous_byte = bytes[i];
+    }
+}
@@ -0,0 +1,63 @@
+// before we can make a prefix code for a block, we need to know how many times
+// each byte appears in it. this is a full pass over every byte of the input,
+// so it is worth making fast
+//
+// the simple way is to add 1 to a single array of counts for every byte. but
+// when the same byte shows up several times in a row (which is common), each
+// addition has to wait for the previous one to be stored before it can load
+// the count again. so instead, the bytes are spread over several separate
+// arrays of counts (sub-histograms), which are added together at the end
+//
+// the loop also checks whether each 32 bytes are all the same byte, and counts
+// them with a single addition if they are, so long runs are counted several
+// times faster. the check is cheap next to counting the bytes, so it costs
+// about nothing when there aren't any runs. SIMD instructions don't help here,
+// since the time goes to loading and storing the counts, and getting the bytes
+// out of a vector only adds to it
+//
+// the counts are 64-bit, so they can't overflow no matter how much data is
+// counted
+//
+// for big inputs where each block's bytes are spread about the same way
+// throughout, the prefix code barely changes if only part of the block is
+// counted. so the encoder can instead count a sample of the block (every
+// n-th piece of SAMPLE_CHUNK_SIZE bytes) and scale the counts up, which gives
+// up a little bit of compression to skip most of the counting. every byte
+// value is given a count of at least 1 then, since a byte that the sample
+// missed can still be in the block
+//
+// the order-1 mode (see context_model.h) also needs to know how many times
+// each byte comes right after each other byte. those pairs are spread over
+// 65536 counts, so the same count comes up again much less often, and they are
+// counted with a plain loop
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// the pieces that a sample is made of are this long, so that the counting loop
+// still works on long runs of bytes at a time
+#define SAMPLE_CHUNK_SIZE 4096
+// the most pieces that a sample can skip for each one that it counts
+#define MAXIMUM_SAMPLE_INTERVAL 1024
+
+void count_byte_frequencies(
+    const unsigned char *bytes,
+    size_t number_of_bytes,
+    uint64_t byte_frequencies[256]
+);
+void sample_byte_frequencies(
+    const unsigned char *bytes,
+    size_t number_of_bytes,
+    int sample_interval,
+    uint64_t byte_frequencies[256]
+);
+void count_pair_frequencies(
+    const unsigned char *bytes,
+    size_t number_of_bytes,
+    uint32_t pair_frequencies[256][256]
+);
+
+#endif
@@ -0,0 +1,1057 @@
+// see huffd.h for how the daemon works and what its messages look like
+//
+// "./huffd serve SOCKET" runs the daemon, and "./huffd compress SOCKET FILE..."
+// or "./huffd decompress SOCKET FILE..." is a client that sends the files to
+// it, all at once, and writes each response next to its file the same way that
+// batch mode does (see batch.h). without any files, the client sends stdin as
+// 1 message and writes the response to stdout
+
+// sockets, signals, and friends are POSIX functions, not standard C ones
+#define _POSIX_C_SOURCE 200809L
+
+#include "huffd.h"
+#include "batch.h"
+#include "block_encoder.h"
+#include "block_format.h"
+#include "canonical_code.h"
+#include "dictionary.h"
+#include "file_io.h"
+#include "transparent_huff.h"
+#include <errno.h>
+#include <getopt.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define MAXIMUM_NUMBER_OF_WORKERS 256
+// more connections than this at once are closed right away, so that a client
+// that keeps opening them can't make the daemon start threads without end
+#define MAXIMUM_NUMBER_OF_CONNECTIONS 1024
+// the least that a connection reads at a time, and how many bytes of
+// responses it collects before it sends them even if there are more requests
+// to answer
+#define CONNECTION_BUFFER_SIZE (64 * 1024)
+// how much of stdin the client reads at a time
+#define STDIN_CHUNK_SIZE (1024 * 1024)
+
+// the memory that requests are compressed or decompressed with. a connection
+// borrows a free worker for each request, so only 1 request uses it at a time
+struct huffd_worker {
+    struct compression_context *compression_context;
+    struct decompression_context *decompression_context;
+    struct huffd_worker *next_free_worker;
+};
+
+struct huffd {
+    struct compression_options compression_options;
+    struct huffd_worker *workers;
+    int number_of_workers;
+
+    // protects everything below it
+    pthread_mutex_t mutex;
+    pthread_cond_t worker_was_freed;
+    struct huffd_worker *first_free_worker;
+    int number_of_connections;
+};
+
+// 1 client's connection to the daemon, which has a thread of its own
+struct connection {
+    struct huffd *huffd;
+    int socket;
+    // the bytes that have been read and not answered yet are from
+    // "input_start" to "input_end"
+    unsigned char *input;
+    size_t input_capacity;
+    size_t input_start;
+    size_t input_end;
+    // the responses that haven't been sent yet
+    unsigned char *output;
+    size_t output_capacity;
+    size_t output_length;
+};
+
+// the socket that the daemon is listening on, which is removed when the daemon
+// is stopped
+static const char *listening_socket_path;
+
+void stop_daemon(int signal_number) {
+    (void)signal_number;
+    unlink(listening_socket_path);
+    _exit(0);
+}
+
+// write all of the bytes to the file descriptor, which blocks until they are
+// written. returns whether it was successful
+int write_all(int file_descriptor, const unsigned char *bytes, size_t length) {
+    while (length > 0) {
+        ssize_t number_of_bytes_written = write(
+            file_descriptor,
+            bytes,
+            length
+        );
+        if (number_of_bytes_written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return 1;
+        }
+        bytes += number_of_bytes_written;
+        length -= number_of_bytes_written;
+    }
+    return 0;
+}
+
+void write_message_header(
+    unsigned char header[HUFFD_HEADER_SIZE],
+    int type,
+    uint32_t length
+) {
+    header[0] = type;
+    header[1] = 0;
+    header[2] = 0;
+    header[3] = 0;
+    write_big_endian_32_bits(header + 4, length);
+}
+
+// wait for a free worker and take it
+struct huffd_worker *borrow_worker(struct huffd *huffd) {
+    pthread_mutex_lock(&huffd->mutex);
+    while (huffd->first_free_worker == NULL) {
+        pthread_cond_wait(&huffd->worker_was_freed, &huffd->mutex);
+    }
+    struct huffd_worker *worker = huffd->first_free_worker;
+    huffd->first_free_worker = worker->next_free_worker;
+    pthread_mutex_unlock(&huffd->mutex);
+    return worker;
+}
+
+void return_worker(struct huffd *huffd, struct huffd_worker *worker) {
+    pthread_mutex_lock(&huffd->mutex);
+    worker->next_free_worker = huffd->first_free_worker;
+    huffd->first_free_worker = worker;
+    pthread_cond_signal(&huffd->worker_was_freed);
+    pthread_mutex_unlock(&huffd->mutex);
+}
+
+// send the responses that have been collected so far. returns whether it was
+// successful
+int send_responses(struct connection *connection) {
+    int writing_exit_status = write_all(
+        connection->socket,
+        connection->output,
+        connection->output_length
+    );
+    connection->output_length = 0;
+    return writing_exit_status;
+}
+
+// make sure that at least the next "length" bytes of requests have been read.
+// if they haven't all arrived yet, the responses so far are sent before
+// waiting for them, since the client might be waiting for those first.
+// returns whether it was successful:
+// 1. the connection ended first (or couldn't be read)
+// 2. the memory for the bytes couldn't be allocated
+int read_requests(struct connection *connection, size_t length) {
+    while (connection->input_end - connection->input_start < length) {
+        // the requests that have been answered are dropped from the front, so
+        // that the memory doesn't keep growing
+        if (connection->input_start > 0) {
+            memmove(
+                connection->input,
+                connection->input + connection->input_start,
+                connection->input_end - connection->input_start
+            );
+            connection->input_end -= connection->input_start;
+            connection->input_start = 0;
+        }
+        if (reserve_memory(
+            &connection->input,
+            &connection->input_capacity,
+            length > CONNECTION_BUFFER_SIZE ? length : CONNECTION_BUFFER_SIZE
+        )) {
+            return 2;
+        }
+        unsigned char *end = connection->input + connection->input_end;
+        size_t room = connection->input_capacity - connection->input_end;
+        ssize_t number_of_bytes_read = recv(
+            connection->socket,
+            end,
+            room,
+            MSG_DONTWAIT
+        );
+        if (
+            number_of_bytes_read < 0
+            && (errno == EAGAIN || errno == EWOULDBLOCK)
+        ) {
+            if (send_responses(connection)) {
+                return 1;
+            }
+            number_of_bytes_read = recv(connection->socket, end, room, 0);
+        }
+        if (number_of_bytes_read < 0 && errno == EINTR) {
+            continue;
+        }
+        if (number_of_bytes_read <= 0) {
+            return 1;
+        }
+        connection->input_end += number_of_bytes_read;
+    }
+    return 0;
+}
+
+// add the header of a response to the connection's output, with room for
+// "capacity" bytes after it. returns where those bytes go, or NULL if the
+// memory couldn't be allocated. the response's header is filled in by
+// finish_response()
+unsigned char *start_response(struct connection *connection, size_t capacity) {
+    if (reserve_memory(
+        &connection->output,
+        &connection->output_capacity,
+        connection->output_length + HUFFD_HEADER_SIZE + capacity
+    )) {
+        return NULL;
+    }
+    return connection->output + connection->output_length + HUFFD_HEADER_SIZE;
+}
+
+void finish_response(struct connection *connection, int status, size_t length) {
+    write_message_header(
+        connection->output + connection->output_length,
+        status,
+        length
+    );
+    connection->output_length += HUFFD_HEADER_SIZE + length;
+}
+
+// add a response with the error message. returns whether the memory for it
+// could be allocated
+int add_error_response(
+    struct connection *connection,
+    const char *error_message
+) {
+    size_t length = strlen(error_message);
+    unsigned char *bytes = start_response(connection, length);
+    if (bytes == NULL) {
+        return 1;
+    }
+    memcpy(bytes, error_message, length);
+    finish_response(connection, HUFFD_STATUS_ERROR, length);
+    return 0;
+}
+
+// find out how many bytes the compressed bytes of a request decompress to, so
+// that its response can have room for them. returns NULL if it was
+// successful, or else what went wrong
+const char *get_response_capacity(
+    const unsigned char *bytes,
+    size_t length,
+    size_t *capacity
+) {
+    uint64_t decompressed_size;
+    int decoding_exit_status = get_decompressed_size(
+        bytes,
+        length,
+        &decompressed_size
+    );
+    if (decoding_exit_status != 0) {
+        return get_decompression_error_message(decoding_exit_status);
+    } else if (decompressed_size > HUFFD_MAXIMUM_MESSAGE_LENGTH) {
+        return "The decompressed bytes are too big for 1 response.";
+    }
+    *capacity = decompressed_size;
+    return NULL;
+}
+
+// compress or decompress the bytes of 1 request with a free worker, and add
+// its response to the connection's output. returns whether the memory for the
+// response could be allocated
+int answer_request(
+    struct connection *connection,
+    int type,
+    const unsigned char *bytes,
+    size_t length
+) {
+    struct huffd *huffd = connection->huffd;
+    const char *error_message = NULL;
+    size_t capacity = 0;
+    if (type == HUFFD_REQUEST_COMPRESS) {
+        capacity = get_compressed_size_bound(
+            length,
+            &huffd->compression_options
+        );
+    } else {
+        error_message = get_response_capacity(bytes, length, &capacity);
+    }
+    unsigned char *output = NULL;
+    if (error_message == NULL) {
+        output = start_response(connection, capacity);
+        if (output == NULL) {
+            error_message = "Unable to allocate memory for the response.";
+        }
+    }
+
+    size_t output_length;
+    if (error_message == NULL) {
+        struct huffd_worker *worker = borrow_worker(huffd);
+        if (type == HUFFD_REQUEST_COMPRESS) {
+            if (compress_buffer(
+                worker->compression_context,
+                &huffd->compression_options,
+                bytes,
+                length,
+                output,
+                capacity,
+                &output_length
+            )) {
+                error_message = "Unable to allocate memory for compressing.";
+            }
+        } else {
+            int decoding_exit_status = decompress_buffer(
+                worker->decompression_context,
+                bytes,
+                length,
+                output,
+                capacity,
+                &output_length
+            );
+            if (decoding_exit_status != 0) {
+                error_message = get_decompression_error_message(
+                    decoding_exit_status
+                );
+            }
+        }
+        return_worker(huffd, worker);
+    }
+    if (error_message != NULL) {
+        return add_error_response(connection, error_message);
+    }
+    finish_response(connection, HUFFD_STATUS_SUCCESS, output_length);
+    return 0;
+}
+
+// answer the connection's requests until the client closes it (or sends a
+// request that isn't valid), and then close it
+void *serve_connection(void *argument) {
+    struct connection *connection = argument;
+    while (true) {
+        int reading_exit_status = read_requests(connection, HUFFD_HEADER_SIZE);
+        if (reading_exit_status == 2) {
+            add_error_response(
+                connection,
+                "Unable to allocate memory for the request."
+            );
+        }
+        if (reading_exit_status != 0) {
+            break;
+        }
+        const unsigned char *header = connection->input
+                                    + connection->input_start;
+        int type = header[0];
+        uint32_t length = get_big_endian_32_bits(header + 4);
+        if (
+            (type != HUFFD_REQUEST_COMPRESS && type != HUFFD_REQUEST_DECOMPRESS)
+            || header[1] != 0
+            || header[2] != 0
+            || header[3] != 0
+        ) {
+            add_error_response(connection, "The request is invalid.");
+            break;
+        }
+        if (length > HUFFD_MAXIMUM_MESSAGE_LENGTH) {
+            add_error_response(connection, "The request is too big.");
+            break;
+        }
+
+        reading_exit_status = read_requests(
+            connection,
+            HUFFD_HEADER_SIZE + length
+        );
+        if (reading_exit_status == 2) {
+            add_error_response(
+                connection,
+                "Unable to allocate memory for the request."
+            );
+        }
+        if (reading_exit_status != 0) {
+            break;
+        }
+        if (answer_request(
+            connection,
+            type,
+            connection->input + connection->input_start + HUFFD_HEADER_SIZE,
+            length
+        )) {
+            break;
+        }
+        connection->input_start += HUFFD_HEADER_SIZE + length;
+        if (
+            connection->output_length >= CONNECTION_BUFFER_SIZE
+            && send_responses(connection)
+        ) {
+            break;
+        }
+    }
+    // the responses that are left (like the error that ended the
+    // connection) still go out
+    send_responses(connection);
+    close(connection->socket);
+
+    struct huffd *huffd = connection->huffd;
+    free(connection->input);
+    free(connection->output);
+    free(connection);
+    pthread_mutex_lock(&huffd->mutex);
+    huffd->number_of_connections -= 1;
+    pthread_mutex_unlock(&huffd->mutex);
+    return NULL;
+}
+
+// set the address of the socket with the given path. returns whether the path
+// fits
+int get_socket_address(const char *path, struct sockaddr_un *address) {
+    *address = (struct sockaddr_un){.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof (address->sun_path)) {
+        return 1;
+    }
+    strcpy(address->sun_path, path);
+    return 0;
+}
+
+// start listening on a socket with the given path. a socket that is left over
+// from a daemon that didn't get to remove it is replaced, but one that another
+// daemon is still listening on isn't. returns the socket, or -1 if it failed
+int listen_on_socket(const char *path) {
+    struct sockaddr_un address;
+    if (get_socket_address(path, &address)) {
+        fprintf(stderr, "Error: The socket's path is too long.\n");
+        return -1;
+    }
+    int listening_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listening_socket < 0) {
+        fprintf(stderr, "Error: Could not create the socket.\n");
+        return -1;
+    }
+    int binding_exit_status = bind(
+        listening_socket,
+        (struct sockaddr *)&address,
+        sizeof (address)
+    );
+    if (binding_exit_status != 0 && errno == EADDRINUSE) {
+        int other_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+        bool is_in_use = other_socket >= 0 && connect(
+            other_socket,
+            (struct sockaddr *)&address,
+            sizeof (address)
+        ) == 0;
+        if (other_socket >= 0) {
+            close(other_socket);
+        }
+        if (!is_in_use) {
+            unlink(path);
+            binding_exit_status = bind(
+                listening_socket,
+                (struct sockaddr *)&address,
+                sizeof (address)
+            );
+        }
+    }
+    if (binding_exit_status != 0 || listen(listening_socket, SOMAXCONN) != 0) {
+        fprintf(stderr, "Error: Could not listen on %s.\n", path);
+        close(listening_socket);
+        return -1;
+    }
+    return listening_socket;
+}
+
+// allocate each worker's memory and put them all on the list of free workers.
+// returns whether it was successful
+int allocate_workers(struct huffd *huffd, const struct dictionary *dictionary) {
+    huffd->workers = calloc(huffd->number_of_workers, sizeof (*huffd->workers));
+    if (huffd->workers == NULL) {
+        return 1;
+    }
+    for (int i = 0; i < huffd->number_of_workers; i += 1) {
+        struct huffd_worker *worker = &huffd->workers[i];
+        worker->compression_context = create_compression_context();
+        worker->decompression_context = create_decompression_context();
+        if (
+            worker->compression_context == NULL
+            || worker->decompression_context == NULL
+        ) {
+            return 1;
+        }
+        set_decompression_dictionary(worker->decompression_context, dictionary);
+        worker->next_free_worker = huffd->first_free_worker;
+        huffd->first_free_worker = worker;
+    }
+    return 0;
+}
+
+void free_workers(struct huffd *huffd) {
+    if (huffd->workers == NULL) {
+        return;
+    }
+    for (int i = 0; i < huffd->number_of_workers; i += 1) {
+        free_compression_context(huffd->workers[i].compression_context);
+        free_decompression_context(huffd->workers[i].decompression_context);
+    }
+    free(huffd->workers);
+}
+
+// accept connections on the socket with the given path until the daemon is
+// stopped (with SIGINT or SIGTERM). returns 1 if it couldn't start, and
+// otherwise never returns
+int run_daemon(struct huffd *huffd, const char *socket_path) {
+    int listening_socket = listen_on_socket(socket_path);
+    if (listening_socket < 0) {
+        return 1;
+    }
+    listening_socket_path = socket_path;
+    struct sigaction action = {.sa_handler = &stop_daemon};
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    // a client that goes away before its responses are sent makes the writes
+    // fail instead of stopping the daemon
+    signal(SIGPIPE, SIG_IGN);
+
+    pthread_attr_t attributes;
+    pthread_attr_init(&attributes);
+    pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+    while (true) {
+        int connection_socket = accept(listening_socket, NULL, NULL);
+        if (connection_socket < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            fprintf(stderr, "Error: Could not accept a connection.\n");
+            // running out of file descriptors (or memory) shouldn't stop
+            // the daemon, so it waits a bit for some to be freed
+            sleep(1);
+            continue;
+        }
+        pthread_mutex_lock(&huffd->mutex);
+        bool has_room = huffd->number_of_connections
+                      < MAXIMUM_NUMBER_OF_CONNECTIONS;
+        if (has_room) {
+            huffd->number_of_connections += 1;
+        }
+        pthread_mutex_unlock(&huffd->mutex);
+        struct connection *connection = NULL;
+        if (has_room) {
+            connection = calloc(1, sizeof (*connection));
+        }
+        pthread_t thread;
+        if (connection != NULL) {
+            connection->huffd = huffd;
+            connection->socket = connection_socket;
+            if (pthread_create(
+                &thread,
+                &attributes,
+                &serve_connection,
+                connection
+            ) == 0) {
+                continue;
+            }
+            free(connection);
+        }
+        close(connection_socket);
+        if (has_room) {
+            pthread_mutex_lock(&huffd->mutex);
+            huffd->number_of_connections -= 1;
+            pthread_mutex_unlock(&huffd->mutex);
+        }
+    }
+}
+
+// the client's side of the connection. requests are sent and responses are
+// received at the same time (see huffd.h), so it keeps track of both
+struct client {
+    int socket;
+    bool is_compressing;
+    // NULL to send stdin
+    char **paths;
+    int number_of_paths;
+
+    // the request that is being sent, header and all
+    unsigned char *request;
+    size_t request_capacity;
+    size_t request_length;
+    size_t number_of_request_bytes_sent;
+    bool is_sending_request;
+    // the next path to read, and the paths that were sent, in order (a file
+    // that can't be read is reported without being sent)
+    int next_path_number;
+    int *sent_path_numbers;
+    int number_of_requests_sent;
+
+    // the response that is being received, header and all
+    unsigned char *response;
+    size_t response_capacity;
+    size_t number_of_response_bytes_received;
+    int number_of_responses_received;
+
+    int number_of_failed_files;
+};
+
+// read stdin whole into the request after its header. returns NULL if it was
+// successful, or else what went wrong
+const char *read_stdin_request(struct client *client) {
+    struct input_file input;
+    if (open_input_file(NULL, &input)) {
+        return "Could not read stdin.";
+    }
+    const char *error_message = NULL;
+    size_t length = 0;
+    while (error_message == NULL) {
+        if (reserve_memory(
+            &client->request,
+            &client->request_capacity,
+            HUFFD_HEADER_SIZE + length + STDIN_CHUNK_SIZE
+        )) {
+            error_message = "Unable to allocate memory for stdin.";
+            break;
+        }
+        unsigned char *buffer = client->request + HUFFD_HEADER_SIZE + length;
+        const unsigned char *bytes;
+        size_t number_of_bytes_read;
+        if (read_from_input_file(
+            &input,
+            buffer,
+            STDIN_CHUNK_SIZE,
+            &bytes,
+            &number_of_bytes_read
+        )) {
+            error_message = "Could not read stdin.";
+            break;
+        } else if (number_of_bytes_read == 0) {
+            break;
+        }
+        memmove(buffer, bytes, number_of_bytes_read);
+        length += number_of_bytes_read;
+        if (length > HUFFD_MAXIMUM_MESSAGE_LENGTH) {
+            error_message = "The input is too big for 1 message.";
+        }
+    }
+    close_input_file(&input);
+    client->request_length = HUFFD_HEADER_SIZE + length;
+    return error_message;
+}
+
+// read the file whole into the request after its header. returns NULL if it
+// was successful, or else what went wrong
+const char *read_file_request(struct client *client, const char *path) {
+    struct stat file_status;
+    if (stat(path, &file_status) != 0) {
+        return "Could not read the file.";
+    }
+    if (file_status.st_size > HUFFD_MAXIMUM_MESSAGE_LENGTH) {
+        return "The file is too big for 1 message.";
+    }
+    if (reserve_memory(
+        &client->request,
+        &client->request_capacity,
+        HUFFD_HEADER_SIZE + file_status.st_size
+    )) {
+        return "Unable to allocate memory for the file.";
+    }
+    size_t length;
+    int reading_exit_status = read_whole_file(
+        path,
+        client->request + HUFFD_HEADER_SIZE,
+        file_status.st_size,
+        &length
+    );
+    if (reading_exit_status == 1) {
+        return "Could not read the file.";
+    } else if (reading_exit_status == 2) {
+        return "The file grew while it was being read.";
+    }
+    client->request_length = HUFFD_HEADER_SIZE + length;
+    return NULL;
+}
+
+// get the next request ready to send, skipping (and reporting) the files that
+// can't be read. once every request has been sent, the client stops sending,
+// so that the daemon knows that it can close the connection once it has
+// answered them
+void prepare_next_request(struct client *client) {
+    int number_of_requests = client->paths != NULL
+                           ? client->number_of_paths
+                           : 1;
+    while (
+        !client->is_sending_request
+        && client->next_path_number < number_of_requests
+    ) {
+        int path_number = client->next_path_number;
+        client->next_path_number += 1;
+        const char *path = client->paths != NULL
+                         ? client->paths[path_number]
+                         : "stdin";
+        const char *error_message = client->paths != NULL
+                                  ? read_file_request(client, path)
+                                  : read_stdin_request(client);
+        if (error_message != NULL) {
+            fprintf(stderr, "Error: %s: %s\n", path, error_message);
+            client->number_of_failed_files += 1;
+            continue;
+        }
+        write_message_header(
+            client->request,
+            client->is_compressing
+            ? HUFFD_REQUEST_COMPRESS
+            : HUFFD_REQUEST_DECOMPRESS,
+            client->request_length - HUFFD_HEADER_SIZE
+        );
+        client->sent_path_numbers[client->number_of_requests_sent] =
+            path_number;
+        client->is_sending_request = true;
+        client->number_of_request_bytes_sent = 0;
+    }
+    if (
+        !client->is_sending_request
+        && client->next_path_number == number_of_requests
+    ) {
+        shutdown(client->socket, SHUT_WR);
+        // only shut down once
+        client->next_path_number += 1;
+    }
+}
+
+// write the response that was just received to where the output of its file
+// goes, or report its error
+void finish_client_response(struct client *client) {
+    int path_number = client->sent_path_numbers[
+        client->number_of_responses_received
+    ];
+    client->number_of_responses_received += 1;
+    const char *path = client->paths != NULL
+                     ? client->paths[path_number]
+                     : "stdin";
+    const unsigned char *bytes = client->response + HUFFD_HEADER_SIZE;
+    size_t length = client->number_of_response_bytes_received
+                  - HUFFD_HEADER_SIZE;
+    client->number_of_response_bytes_received = 0;
+    if (client->response[0] != HUFFD_STATUS_SUCCESS) {
+        fprintf(stderr, "Error: %s: %.*s\n", path, (int)length, bytes);
+        client->number_of_failed_files += 1;
+        return;
+    }
+
+    const char *error_message = NULL;
+    if (client->paths == NULL) {
+        if (write_all(STDOUT_FILENO, bytes, length)) {
+            error_message = "Could not write the output.";
+        }
+    } else {
+        char *output_path = get_output_path(path, client->is_compressing);
+        if (output_path == NULL) {
+            error_message = "Unable to allocate memory for the file.";
+        } else if (write_whole_file(output_path, bytes, length)) {
+            unlink(output_path);
+            error_message = "Could not write the output file.";
+        }
+        free(output_path);
+    }
+    if (error_message != NULL) {
+        fprintf(stderr, "Error: %s: %s\n", path, error_message);
+        client->number_of_failed_files += 1;
+    }
+}
+
+// send as much of the request as the socket takes right now. returns whether
+// the connection failed
+int send_request_bytes(struct client *client) {
+    ssize_t number_of_bytes_sent = send(
+        client->socket,
+        client->request + client->number_of_request_bytes_sent,
+        client->request_length - client->number_of_request_bytes_sent,
+        MSG_DONTWAIT | MSG_NOSIGNAL
+    );
+    if (number_of_bytes_sent < 0) {
+        return errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR;
+    }
+    client->number_of_request_bytes_sent += number_of_bytes_sent;
+    if (client->number_of_request_bytes_sent == client->request_length) {
+        client->is_sending_request = false;
+        client->number_of_requests_sent += 1;
+    }
+    return 0;
+}
+
+// receive as much of the response as has arrived. returns whether the
+// connection failed (or ended before every response came)
+int receive_response_bytes(struct client *client) {
+    // the header says how much of the rest there is to wait for
+    size_t length = HUFFD_HEADER_SIZE;
+    if (client->number_of_response_bytes_received >= HUFFD_HEADER_SIZE) {
+        length += get_big_endian_32_bits(client->response + 4);
+    }
+    if (reserve_memory(
+        &client->response,
+        &client->response_capacity,
+        length
+    )) {
+        return 1;
+    }
+    ssize_t number_of_bytes_received = recv(
+        client->socket,
+        client->response + client->number_of_response_bytes_received,
+        length - client->number_of_response_bytes_received,
+        MSG_DONTWAIT
+    );
+    if (number_of_bytes_received < 0) {
+        return errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR;
+    }
+    if (number_of_bytes_received == 0) {
+        return 1;
+    }
+    client->number_of_response_bytes_received += number_of_bytes_received;
+    size_t received = client->number_of_response_bytes_received;
+    if (
+        received >= HUFFD_HEADER_SIZE
+        && received == HUFFD_HEADER_SIZE
+                       + get_big_endian_32_bits(client->response + 4)
+    ) {
+        finish_client_response(client);
+    }
+    return 0;
+}
+
+// send the files (or stdin) to the daemon that is listening on the socket
+// with the given path, and write out its responses. returns whether every
+// file was successful
+int run_client(
+    const char *socket_path,
+    bool is_compressing,
+    char **paths,
+    int number_of_paths
+) {
+    struct sockaddr_un address;
+    if (get_socket_address(socket_path, &address)) {
+        fprintf(stderr, "Error: The socket's path is too long.\n");
+        return 1;
+    }
+    struct client client = {
+        .socket = socket(AF_UNIX, SOCK_STREAM, 0),
+        .is_compressing = is_compressing,
+        .paths = number_of_paths > 0 ? paths : NULL,
+        .number_of_paths = number_of_paths
+    };
+    if (client.socket < 0 || connect(
+        client.socket,
+        (struct sockaddr *)&address,
+        sizeof (address)
+    ) != 0) {
+        fprintf(stderr, "Error: Could not connect to %s.\n", socket_path);
+        if (client.socket >= 0) {
+            close(client.socket);
+        }
+        return 1;
+    }
+    client.sent_path_numbers = malloc(
+        (number_of_paths > 0 ? number_of_paths : 1)
+        * sizeof (*client.sent_path_numbers)
+    );
+    if (client.sent_path_numbers == NULL) {
+        fprintf(stderr, "Error: Unable to allocate the requests.\n");
+        close(client.socket);
+        return 1;
+    }
+
+    bool has_failed = false;
+    prepare_next_request(&client);
+    while (
+        client.is_sending_request
+        || client.number_of_responses_received < client.number_of_requests_sent
+    ) {
+        struct pollfd poll_socket = {
+            .fd = client.socket,
+            .events = client.is_sending_request ? POLLIN | POLLOUT : POLLIN
+        };
+        if (poll(&poll_socket, 1, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            has_failed = true;
+            break;
+        }
+        if (
+            client.number_of_responses_received
+            < client.number_of_requests_sent
+            && poll_socket.revents & (POLLIN | POLLHUP | POLLERR)
+        ) {
+            if (receive_response_bytes(&client)) {
+                has_failed = true;
+                break;
+            }
+        }
+        if (client.is_sending_request && poll_socket.revents & POLLOUT) {
+            if (send_request_bytes(&client)) {
+                has_failed = true;
+                break;
+            }
+            prepare_next_request(&client);
+        }
+    }
+    if (has_failed) {
+        fprintf(
+            stderr,
+            "Error: The connection to the daemon ended before every response"
+            " came.\n"
+        );
+    }
+    close(client.socket);
+    free(client.request);
+    free(client.response);
+    free(client.sent_path_numbers);
+    return has_failed || client.number_of_failed_files > 0;
+}
+
+int main(int argc, char **argv) {
+    int number_of_workers = 1;
+    int codeword_length_limit = DEFAULT_CODEWORD_LENGTH_LIMIT;
+    int number_of_streams = 1;
+    bool has_checksums = false;
+    const char *dictionary_filename = NULL;
+    const struct option long_options[] = {
+        {"threads", required_argument, NULL, 'T'},
+        {"max-codeword-length", required_argument, NULL, 'l'},
+        {"streams", required_argument, NULL, 's'},
+        {"checksum", no_argument, NULL, 'c'},
+        {"dict", required_argument, NULL, 'd'},
+        {0, 0, 0, 0}
+    };
+    int option;
+    while ((option = getopt_long(argc, argv, "T:", long_options, NULL)) != -1) {
+        if (option == 'T') {
+            number_of_workers = atoi(optarg);
+            if (
+                number_of_workers < 1
+                || number_of_workers > MAXIMUM_NUMBER_OF_WORKERS
+            ) {
+                fprintf(
+                    stderr,
+                    "Error: The number of threads must be from 1 to %d.\n",
+                    MAXIMUM_NUMBER_OF_WORKERS
+                );
+                return 1;
+            }
+        } else if (option == 'l') {
+            codeword_length_limit = atoi(optarg);
+            if (
+                codeword_length_limit < MINIMUM_CODEWORD_LENGTH_LIMIT
+                || codeword_length_limit > MAXIMUM_CODEWORD_LENGTH
+            ) {
+                fprintf(
+                    stderr,
+                    "Error: The maximum codeword length must be from %d to"
+                    " %d.\n",
+                    MINIMUM_CODEWORD_LENGTH_LIMIT,
+                    MAXIMUM_CODEWORD_LENGTH
+                );
+                return 1;
+            }
+        } else if (option == 's') {
+            number_of_streams = atoi(optarg);
+            if (get_block_type(number_of_streams) == -1) {
+                fprintf(
+                    stderr,
+                    "Error: The number of streams must be 1, 4, or 8.\n"
+                );
+                return 1;
+            }
+        } else if (option == 'c') {
+            has_checksums = true;
+        } else if (option == 'd') {
+            dictionary_filename = optarg;
+        } else {
+            return 1;
+        }
+    }
+    if (argc - optind < 2) {
+        fprintf(
+            stderr,
+            "Error: huffd needs serve, compress, or decompress, followed by"
+            " the socket's path.\n"
+        );
+        return 1;
+    }
+    const char *command = argv[optind];
+    const char *socket_path = argv[optind + 1];
+    if (
+        strcmp(command, "compress") == 0
+        || strcmp(command, "decompress") == 0
+    ) {
+        return run_client(
+            socket_path,
+            strcmp(command, "compress") == 0,
+            argv + optind + 2,
+            argc - optind - 2
+        );
+    } else if (strcmp(command, "serve") != 0) {
+        fprintf(stderr, "Error: Unknown command %s.\n", command);
+        return 1;
+    } else if (argc - optind > 2) {
+        fprintf(stderr, "Error: serve only takes the socket's path.\n");
+        return 1;
+    }
+
+    // the dictionary's prefix code and decode table are made once, and then
+    // shared by every worker
+    struct dictionary dictionary;
+    struct dictionary *dictionary_to_use = NULL;
+    if (dictionary_filename != NULL) {
+        if (number_of_streams != 1) {
+            fprintf(stderr, "Error: --dict can't be used with --streams.\n");
+            return 1;
+        }
+        int reading_exit_status = read_dictionary_file(
+            dictionary_filename,
+            &dictionary
+        );
+        if (reading_exit_status == 1) {
+            fprintf(stderr, "Error: Could not read the dictionary file.\n");
+            return 1;
+        } else if (reading_exit_status == 2) {
+            fprintf(stderr, "Error: The dictionary file is invalid.\n");
+            return 1;
+        } else if (reading_exit_status == 3) {
+            fprintf(stderr, "Error: Unable to allocate the decode table.\n");
+            return 1;
+        }
+        dictionary_to_use = &dictionary;
+    }
+
+    struct huffd huffd = {
+        .number_of_workers = number_of_workers,
+        .mutex = PTHREAD_MUTEX_INITIALIZER,
+        .worker_was_freed = PTHREAD_COND_INITIALIZER
+    };
+    init_compression_options(&huffd.compression_options);
+    huffd.compression_options.codeword_length_limit = codeword_length_limit;
+    huffd.compression_options.number_of_streams = number_of_streams;
+    huffd.compression_options.has_checksums = has_checksums;
+    huffd.compression_options.dictionary = dictionary_to_use;
+    int exit_status = 0;
+    if (allocate_workers(&huffd, dictionary_to_use)) {
+        fprintf(stderr, "Error: Unable to allocate the workers' memory.\n");
+        exit_status = 1;
+    } else {
+        exit_status = run_daemon(&huffd, socket_path);
+    }
+    free_workers(&huffd);
+    if (dictionary_to_use != NULL) {
+        free_dictionary_tables(&dictionary);
+    }
+    return exit_status;
+}
@@ -0,0 +1,51 @@
+// huffd is a daemon that compresses and decompresses messages for other
+// programs on the same machine, which send them to it over a unix domain
+// socket. a program that compresses many small messages would otherwise start
+// a new encoder for each one, and starting the process (and allocating its
+// memory, and loading its dictionary) takes far longer than compressing a
+// small message does. the daemon does all of that once, and then each message
+// only costs a round trip over the socket
+//
+// the daemon has a fixed number of workers, each with its own compression and
+// decompression contexts (see transparent_huff.h). the memory that they need
+// (and the decode table of the dictionary, if there is one) stays allocated
+// from one message to the next, so a message that is no bigger than the ones
+// before it doesn't allocate anything. each connection gets a thread of its
+// own, which borrows a free worker for each request, so that a connection
+// that is kept open and idle doesn't keep a worker to itself
+//
+// every message that goes either way is framed with a header of
+// HUFFD_HEADER_SIZE bytes:
+// 1. 8 bits for what the request is (HUFFD_REQUEST_COMPRESS or
+//      HUFFD_REQUEST_DECOMPRESS), or for a response, HUFFD_STATUS_SUCCESS or
+//      HUFFD_STATUS_ERROR
+// 2. 24 bits of 0
+// 3. 32 bits for the number of bytes that come after the header
+//      32 bit unsigned big-endian integer
+//
+// a request is followed by the bytes to compress or decompress, and its
+// response by the compressed file (in the same format as the encoder's output,
+// see block_format.h) or the decompressed bytes. a response with an error is
+// followed by the error message instead. the bytes of a request (and of a
+// decompressed response) can be at most HUFFD_MAXIMUM_MESSAGE_LENGTH
+//
+// a client can send many requests without waiting for their responses
+// (pipelining), and they are answered in the order that they were sent. the
+// daemon reads all of the requests that have arrived before it sends any of
+// their responses, so that a lot of small messages don't each cost system
+// calls of their own. so a client that pipelines has to read the responses
+// while it is still sending requests, or else both sides could end up waiting
+// for the other one to read. a request that isn't valid gets an error and
+// ends the connection, since there is no telling where the next one starts
+
+#ifndef HUFFD_H
+#define HUFFD_H
+
+#define HUFFD_HEADER_SIZE 8
+#define HUFFD_REQUEST_COMPRESS 1
+#define HUFFD_REQUEST_DECOMPRESS 2
+#define HUFFD_STATUS_SUCCESS 0
+#define HUFFD_STATUS_ERROR 1
+#define HUFFD_MAXIMUM_MESSAGE_LENGTH (64 * 1024 * 1024)
+
+#endif
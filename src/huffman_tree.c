@@ -2,86 +2,104 @@
 
 #include "huffman_tree.h"
 
-// create a huffman tree on the heap based on the given byte frequencies
-struct node *create_huffman_tree(const int frequencies[256]) {
-    // for each byte with a non-zero frequency, make a leaf node for it and put
-    // it into the array of nodes
-    struct node *nodes[256];
-    int number_of_nodes_in_array = 0;
+// compare two nodes by their weights in a way that produces an ascending order
+// when passed to qsort(). ties are broken by symbol, so that the result is the
+// same on every platform
+int compare_nodes(const void *first, const void *second) {
+    const struct node *node_one = first;
+    const struct node *node_two = second;
+    if (node_one->weight != node_two->weight) {
+        return node_one->weight < node_two->weight ? -1 : 1;
+    }
+    return node_one->symbol - node_two->symbol;
+}
+
+// create a huffman tree in "tree" based on the given byte frequencies
+void create_huffman_tree(
+    const uint64_t frequencies[256],
+    struct huffman_tree *tree
+) {
+    // for each byte with a non-zero frequency, make a leaf node for it
+    tree->number_of_nodes = 0;
     for (int i = 0; i < 256; i += 1) {
         if (frequencies[i] > 0) {
-            nodes[number_of_nodes_in_array] = create_node(i, frequencies[i]);
-            number_of_nodes_in_array += 1;
+            add_node(tree, i, frequencies[i]);
         }
     }
 
     // handle the edge case of 1 node by adding a 2nd arbitrary node, so that we
     // end up with a proper binary tree instead of just 1 node
-    if (number_of_nodes_in_array == 1) {
-        nodes[number_of_nodes_in_array] = create_node(
-            nodes[0]->symbol + 128 % 256, // use the "farthest away" symbol
-            0
-        );
-        number_of_nodes_in_array += 1;
+    if (tree->number_of_nodes == 1) {
+        // use the "farthest away" symbol
+        add_node(tree, (tree->nodes[0].symbol + 128) % 256, 0);
     }
 
     // construct a tree by replacing the 2 lowest-weight nodes with 1 new branch
     // node whose children are those 2 nodes and whose weight is the sum of
     // those 2 nodes' weights, and repeating until we are left with only 1
     // (branch) node, which is the root of the tree
-    while (number_of_nodes_in_array > 1) {
-        // sort the nodes by descending weight
-        qsort(nodes, number_of_nodes_in_array, sizeof (*nodes), &compare_nodes);
+    //
+    // once the leaves are sorted by weight, we don't need to sort again: each
+    // new branch node weighs at least as much as the one made before it, so the
+    // branch nodes come out sorted too. that means the 2 lowest-weight nodes
+    // are always at the fronts of 2 queues, the leaves that haven't been used
+    // yet and the branch nodes that haven't been used yet
+    int number_of_leaves = tree->number_of_nodes;
+    qsort(tree->nodes, number_of_leaves, sizeof (*tree->nodes), &compare_nodes);
 
-        int weight_sum = nodes[number_of_nodes_in_array - 1]->weight
-                       + nodes[number_of_nodes_in_array - 2]->weight;
-        struct node *branch_node = create_node(0, weight_sum);
-        branch_node->left_child  = nodes[number_of_nodes_in_array - 2];
-        branch_node->right_child = nodes[number_of_nodes_in_array - 1];
+    int next_leaf = 0;
+    int next_branch_node = number_of_leaves;
+    while (
+        (number_of_leaves - next_leaf)
+        + (tree->number_of_nodes - next_branch_node) > 1
+    ) {
+        // the lowest-weight node first, then the second-lowest
+        uint16_t lowest_nodes[2];
+        for (int i = 0; i < 2; i += 1) {
+            if (
+                next_branch_node == tree->number_of_nodes
+                || (
+                    next_leaf < number_of_leaves
+                    && tree->nodes[next_leaf].weight
+                       <= tree->nodes[next_branch_node].weight
+                )
+            ) {
+                lowest_nodes[i] = next_leaf;
+                next_leaf += 1;
+            } else {
+                lowest_nodes[i] = next_branch_node;
+                next_branch_node += 1;
+            }
+        }
 
-        nodes[number_of_nodes_in_array - 2] = branch_node;
-        number_of_nodes_in_array -= 1;
+        uint16_t branch_node = add_node(
+            tree,
+            0,
+            tree->nodes[lowest_nodes[0]].weight
+            + tree->nodes[lowest_nodes[1]].weight
+        );
+        tree->nodes[branch_node].left_child  = lowest_nodes[1];
+        tree->nodes[branch_node].right_child = lowest_nodes[0];
     }
 
-    return nodes[0];
+    tree->root = tree->number_of_nodes - 1;
 }
 
-// create a new node on the heap for the huffman tree
-struct node *create_node(unsigned char symbol, int weight) {
-    struct node *result = malloc(sizeof (struct node));
-    result->symbol = symbol;
-    result->weight = weight;
-    result->left_child = NULL;
-    result->right_child = NULL;
-
-    return result;
-}
+// add a new node with no children to the end of the tree's array of nodes, and
+// return its position. the tree must have room for it (see
+// MAXIMUM_NUMBER_OF_NODES)
+uint16_t add_node(
+    struct huffman_tree *tree,
+    unsigned char symbol,
+    uint64_t weight
+) {
+    uint16_t position = tree->number_of_nodes;
+    struct node *node = &tree->nodes[position];
+    node->symbol = symbol;
+    node->weight = weight;
+    node->left_child = NO_CHILD;
+    node->right_child = NO_CHILD;
+    tree->number_of_nodes += 1;
 
-bool is_leaf_node(const struct node *node) {
-    // since we know that a tree for huffman coding is a full binary tree, we
-    // know that each node has either 0 or 2 children. so we can just check for
-    // the presence of 1 child
-    return node->left_child == NULL;
-}
-
-// compare two nodes by their weights in a way that produces a descending order
-// when passed to qsort()
-int compare_nodes(const void *first, const void *second) {
-    // each argument is not a pointer to node; it is a pointer to a pointer to a
-    // node, because the node array is an array of pointers to node -- not an
-    // array of nodes
-    int freq_one = (*(struct node **)first)->weight;
-    int freq_two = (*(struct node **)second)->weight;
-
-    return freq_two - freq_one;
-}
-
-void free_node_recursive(struct node *node) {
-    if (node->left_child != NULL) {
-        free_node_recursive(node->left_child);
-    }
-    if (node->right_child != NULL) {
-        free_node_recursive(node->right_child);
-    }
-    free(node);
+    return position;
 }
@@ -10,24 +10,80 @@
 //
 // when the tree itself is written to the compressed file and read from the
 // compressed file, the weights are not included since they are not needed
+//
+// a full binary tree with 256 leaves has 255 branch nodes, so a tree never has
+// more than 511 nodes. instead of allocating each node separately, all of a
+// tree's nodes live in one array inside of the tree, and a node refers to its
+// children by their positions in that array. this way, making a tree doesn't
+// allocate any memory at all, and the tree can just be thrown away afterward
+
+#ifndef HUFFMAN_TREE_H
+#define HUFFMAN_TREE_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 
+#define MAXIMUM_NUMBER_OF_NODES 511
+// the child "position" of a leaf node, since it has no children
+#define NO_CHILD UINT16_MAX
+
 // the word "node" is used everywhere, but more specifically, this is a node
 // of the huffman tree
 struct node {
     unsigned char symbol;
-    int weight;
+    uint64_t weight;
+
+    // positions in the tree's array of nodes
+    uint16_t left_child;
+    uint16_t right_child;
+};
 
-    struct node *left_child;
-    struct node *right_child;
+struct huffman_tree {
+    struct node nodes[MAXIMUM_NUMBER_OF_NODES];
+    int number_of_nodes;
+    // the position of the root node
+    uint16_t root;
 };
 
-struct node *create_huffman_tree(const int frequencies[256]);
-struct node *create_node(unsigned char symbol, int weight);
+void create_huffman_tree(
+    const uint64_t frequencies[256],
+    struct huffman_tree *tree
+);
+uint16_t add_node(
+    struct huffman_tree *tree,
+    unsigned char symbol,
+    uint64_t weight
+);
+
+// the functions below are used for every node that is visited, so they are
+// defined here (instead of in huffman_tree.c) to let the compiler inline them
+
+static inline bool is_leaf_node(const struct node *node) {
+    // since we know that a tree for huffman coding is a full binary tree, we
+    // know that each node has either 0 or 2 children. so we can just check for
+    // the presence of 1 child
+    return node->left_child == NO_CHILD;
+}
+
+static inline const struct node *get_root_node(
+    const struct huffman_tree *tree
+) {
+    return &tree->nodes[tree->root];
+}
+
+static inline const struct node *get_left_child(
+    const struct huffman_tree *tree,
+    const struct node *node
+) {
+    return &tree->nodes[node->left_child];
+}
 
-bool is_leaf_node(const struct node *node);
-int compare_nodes(const void *first, const void *second);
+static inline const struct node *get_right_child(
+    const struct huffman_tree *tree,
+    const struct node *node
+) {
+    return &tree->nodes[node->right_child];
+}
 
-void free_node_recursive(struct node *node);
+#endif
@@ -0,0 +1,792 @@
+// see io_thread.h for an explanation of the reader and writer threads
+
+// pread(), pwrite(), and syscall() (for io_uring, which has no C library
+// functions of its own) aren't standard C functions
+#define _GNU_SOURCE
+
+#include "io_thread.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define HAS_IO_URING_VERSION
+#endif
+#endif
+
+#ifdef HAS_IO_URING_VERSION
+// the parts of an io_uring that we use: the submission queue, where requests
+// are added at the tail, and the completion queue, where their results are
+// taken from the head. both are shared with the kernel
+struct uring {
+    int file_descriptor;
+
+    unsigned *submission_tail;
+    unsigned submission_mask;
+    unsigned *submission_array;
+    struct io_uring_sqe *submissions;
+
+    unsigned *completion_head;
+    unsigned *completion_tail;
+    unsigned completion_mask;
+    struct io_uring_cqe *completions;
+
+    void *submission_ring;
+    size_t submission_ring_size;
+    // the same as "submission_ring" if the kernel maps both queues together
+    void *completion_ring;
+    size_t completion_ring_size;
+    size_t submissions_size;
+};
+#endif
+
+struct io_chunk {
+    unsigned char *bytes;
+    // for a reader, the number of bytes that were read into the chunk, where
+    // 0 means that the end of the file (or an error) was reached. for a
+    // writer, the number of bytes to write
+    size_t length;
+};
+
+struct io_thread {
+    pthread_t thread;
+    bool is_reader;
+    int file_descriptor;
+    // whether the file is a regular file that is read or written at offsets,
+    // and the offset of the next chunk
+    bool is_seekable;
+    uint64_t offset;
+#ifdef HAS_IO_URING_VERSION
+    bool has_uring;
+    struct uring uring;
+#endif
+
+    struct io_chunk chunks[IO_RING_LENGTH];
+    // the number of chunks that have been added to the ring and taken off of
+    // it. chunk i is chunks[i % IO_RING_LENGTH]
+    atomic_size_t number_of_chunks_added;
+    atomic_size_t number_of_chunks_taken;
+    // how far into its current chunk the thread that reads or writes through
+    // the I/O thread is, and (for a writer) whether it has a chunk yet
+    size_t position;
+    bool has_chunk;
+
+    // protects nothing but the sleeping
+    pthread_mutex_t mutex;
+    pthread_cond_t ring_changed;
+    atomic_int number_of_sleeping_threads;
+    atomic_bool is_stopping;
+    atomic_bool has_error;
+};
+
+#ifdef HAS_IO_URING_VERSION
+static void free_uring(struct uring *uring) {
+    if (uring->submissions != NULL) {
+        munmap(uring->submissions, uring->submissions_size);
+    }
+    if (uring->completion_ring != uring->submission_ring) {
+        munmap(uring->completion_ring, uring->completion_ring_size);
+    }
+    munmap(uring->submission_ring, uring->submission_ring_size);
+    close(uring->file_descriptor);
+}
+
+// set up an io_uring with room for "number_of_entries" requests at a time.
+// returns whether it was successful, which it isn't on kernels before 5.1 or
+// where io_uring is turned off
+static int create_uring(struct uring *uring, unsigned number_of_entries) {
+    struct io_uring_params parameters;
+    memset(&parameters, 0, sizeof (parameters));
+    uring->file_descriptor = syscall(
+        __NR_io_uring_setup,
+        number_of_entries,
+        &parameters
+    );
+    if (uring->file_descriptor == -1) {
+        return 1;
+    }
+
+    uring->submission_ring_size = parameters.sq_off.array
+                                + parameters.sq_entries * sizeof (unsigned);
+    uring->completion_ring_size = parameters.cq_off.cqes
+                                + parameters.cq_entries
+                                  * sizeof (struct io_uring_cqe);
+    bool is_mapped_together = parameters.features & IORING_FEAT_SINGLE_MMAP;
+    if (
+        is_mapped_together
+        && uring->completion_ring_size > uring->submission_ring_size
+    ) {
+        uring->submission_ring_size = uring->completion_ring_size;
+    }
+    uring->submission_ring = mmap(
+        NULL,
+        uring->submission_ring_size,
+        PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE,
+        uring->file_descriptor,
+        IORING_OFF_SQ_RING
+    );
+    if (uring->submission_ring == MAP_FAILED) {
+        close(uring->file_descriptor);
+        return 1;
+    }
+    uring->completion_ring = uring->submission_ring;
+    uring->submissions = NULL;
+    if (!is_mapped_together) {
+        uring->completion_ring = mmap(
+            NULL,
+            uring->completion_ring_size,
+            PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE,
+            uring->file_descriptor,
+            IORING_OFF_CQ_RING
+        );
+        if (uring->completion_ring == MAP_FAILED) {
+            uring->completion_ring = uring->submission_ring;
+            free_uring(uring);
+            return 1;
+        }
+    }
+    uring->submissions_size = parameters.sq_entries
+                            * sizeof (struct io_uring_sqe);
+    uring->submissions = mmap(
+        NULL,
+        uring->submissions_size,
+        PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE,
+        uring->file_descriptor,
+        IORING_OFF_SQES
+    );
+    if (uring->submissions == MAP_FAILED) {
+        uring->submissions = NULL;
+        free_uring(uring);
+        return 1;
+    }
+
+    unsigned char *submission_ring = uring->submission_ring;
+    unsigned char *completion_ring = uring->completion_ring;
+    uring->submission_tail = (unsigned *)(
+        submission_ring + parameters.sq_off.tail
+    );
+    uring->submission_mask = *(unsigned *)(
+        submission_ring + parameters.sq_off.ring_mask
+    );
+    uring->submission_array = (unsigned *)(
+        submission_ring + parameters.sq_off.array
+    );
+    uring->completion_head = (unsigned *)(
+        completion_ring + parameters.cq_off.head
+    );
+    uring->completion_tail = (unsigned *)(
+        completion_ring + parameters.cq_off.tail
+    );
+    uring->completion_mask = *(unsigned *)(
+        completion_ring + parameters.cq_off.ring_mask
+    );
+    uring->completions = (struct io_uring_cqe *)(
+        completion_ring + parameters.cq_off.cqes
+    );
+    return 0;
+}
+
+// add a request to read or write ("opcode") "length" bytes at "offset" to the
+// submission queue. it isn't sent to the kernel until submit_and_wait()
+static void add_uring_request(
+    struct uring *uring,
+    int opcode,
+    int file_descriptor,
+    unsigned char *bytes,
+    size_t length,
+    uint64_t offset,
+    uint64_t request_number
+) {
+    // only this thread adds requests, so the tail doesn't change under us,
+    // but the kernel must see the request before it sees the new tail
+    unsigned tail = *uring->submission_tail;
+    unsigned index = tail & uring->submission_mask;
+    struct io_uring_sqe *submission = &uring->submissions[index];
+    memset(submission, 0, sizeof (*submission));
+    submission->opcode = opcode;
+    submission->fd = file_descriptor;
+    submission->addr = (uintptr_t)bytes;
+    submission->len = length;
+    submission->off = offset;
+    submission->user_data = request_number;
+    uring->submission_array[index] = index;
+    __atomic_store_n(uring->submission_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+// send the "number_of_requests" requests that were added to the kernel, wait
+// for all of them to complete, and set results[i] to the result of request
+// number i (a number of bytes, or minus an errno). returns whether it was
+// successful
+static int submit_and_wait(
+    struct uring *uring,
+    unsigned number_of_requests,
+    int results[]
+) {
+    unsigned number_to_submit = number_of_requests;
+    unsigned number_completed = 0;
+    while (number_completed < number_of_requests) {
+        long number_submitted = syscall(
+            __NR_io_uring_enter,
+            uring->file_descriptor,
+            number_to_submit,
+            number_of_requests - number_completed,
+            IORING_ENTER_GETEVENTS,
+            NULL,
+            0
+        );
+        if (number_submitted == -1) {
+            if (errno == EINTR || errno == EAGAIN) {
+                continue;
+            }
+            return 1;
+        }
+        number_to_submit -= number_submitted;
+
+        unsigned head = *uring->completion_head;
+        unsigned tail = __atomic_load_n(
+            uring->completion_tail,
+            __ATOMIC_ACQUIRE
+        );
+        for (; head != tail; head += 1) {
+            struct io_uring_cqe *completion = &uring->completions[
+                head & uring->completion_mask
+            ];
+            results[completion->user_data] = completion->res;
+            number_completed += 1;
+        }
+        __atomic_store_n(uring->completion_head, head, __ATOMIC_RELEASE);
+    }
+    return 0;
+}
+#endif
+
+// wait until the number of chunks added to the ring or taken off of it is no
+// longer what the caller saw, or until the thread is told to stop
+static void wait_for_ring_change(
+    struct io_thread *io_thread,
+    size_t number_of_chunks_added,
+    size_t number_of_chunks_taken
+) {
+    pthread_mutex_lock(&io_thread->mutex);
+    // the other thread only takes the lock to wake us up if it sees that
+    // someone is sleeping, so we say so before checking the counters for the
+    // last time
+    atomic_fetch_add(&io_thread->number_of_sleeping_threads, 1);
+    while (
+        atomic_load(&io_thread->number_of_chunks_added)
+        == number_of_chunks_added
+        && atomic_load(&io_thread->number_of_chunks_taken)
+           == number_of_chunks_taken
+        && !atomic_load(&io_thread->is_stopping)
+    ) {
+        pthread_cond_wait(&io_thread->ring_changed, &io_thread->mutex);
+    }
+    atomic_fetch_sub(&io_thread->number_of_sleeping_threads, 1);
+    pthread_mutex_unlock(&io_thread->mutex);
+}
+
+// wake up the other thread if it is sleeping in wait_for_ring_change()
+static void notify_ring_change(struct io_thread *io_thread) {
+    if (atomic_load(&io_thread->number_of_sleeping_threads) > 0) {
+        pthread_mutex_lock(&io_thread->mutex);
+        pthread_cond_broadcast(&io_thread->ring_changed);
+        pthread_mutex_unlock(&io_thread->mutex);
+    }
+}
+
+// read up to "length" bytes at "offset" (or at the file's position, if it
+// isn't seekable) with 1 system call. returns the number of bytes read, or -1
+static ssize_t read_directly(
+    struct io_thread *reader,
+    unsigned char *bytes,
+    size_t length,
+    uint64_t offset
+) {
+    while (true) {
+        ssize_t result;
+        if (reader->is_seekable) {
+            result = pread(reader->file_descriptor, bytes, length, offset);
+        } else {
+            // a pipe can make us wait forever (for example, if the decoder
+            // is done but whatever is writing to the pipe isn't), so this is
+            // the only place where stop_io_thread() can cancel the thread
+            pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+            result = read(reader->file_descriptor, bytes, length);
+            pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+        }
+        if (result == -1 && errno == EINTR) {
+            continue;
+        }
+        return result;
+    }
+}
+
+// write all "length" bytes at "offset" (or at the file's position, if it
+// isn't seekable). returns whether it was successful
+static int write_directly(
+    struct io_thread *writer,
+    const unsigned char *bytes,
+    size_t length,
+    uint64_t offset
+) {
+    while (length > 0) {
+        ssize_t result = writer->is_seekable
+            ? pwrite(writer->file_descriptor, bytes, length, offset)
+            : write(writer->file_descriptor, bytes, length);
+        if (result == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return 1;
+        }
+        bytes += result;
+        length -= result;
+        offset += result;
+    }
+    return 0;
+}
+
+// fill up to "number_of_chunks" chunks, starting with chunk "first_chunk", and
+// add them to the ring. a chunk that is read short (at the end of the file, or
+// because a pipe had fewer bytes so far) is the last one added, since the ones
+// after it would have been read from the wrong offsets. returns whether the
+// end of the file was reached (or there was an error, in which case
+// "has_error" is set)
+static bool read_chunks(
+    struct io_thread *reader,
+    size_t first_chunk,
+    int number_of_chunks
+) {
+    ssize_t results[IO_RING_LENGTH];
+#ifdef HAS_IO_URING_VERSION
+    int uring_results[IO_RING_LENGTH];
+    bool did_use_uring = false;
+    if (reader->has_uring && number_of_chunks > 1) {
+        for (int i = 0; i < number_of_chunks; i += 1) {
+            add_uring_request(
+                &reader->uring,
+                IORING_OP_READ,
+                reader->file_descriptor,
+                reader->chunks[(first_chunk + i) % IO_RING_LENGTH].bytes,
+                IO_CHUNK_SIZE,
+                reader->offset + (uint64_t)i * IO_CHUNK_SIZE,
+                i
+            );
+        }
+        if (submit_and_wait(&reader->uring, number_of_chunks, uring_results)) {
+            // the chunks are read directly instead, and so is everything
+            // after them
+            free_uring(&reader->uring);
+            reader->has_uring = false;
+        } else {
+            did_use_uring = true;
+            for (int i = 0; i < number_of_chunks; i += 1) {
+                results[i] = uring_results[i];
+            }
+        }
+    }
+#endif
+
+    for (int i = 0; i < number_of_chunks; i += 1) {
+        struct io_chunk *chunk = &reader->chunks[
+            (first_chunk + i) % IO_RING_LENGTH
+        ];
+        // a request that failed in the io_uring (for example, on a kernel
+        // that doesn't know IORING_OP_READ) is tried again directly, which
+        // also gets the real error if there is one
+#ifdef HAS_IO_URING_VERSION
+        if (!did_use_uring || results[i] < 0) {
+            results[i] = read_directly(
+                reader,
+                chunk->bytes,
+                IO_CHUNK_SIZE,
+                reader->offset
+            );
+        }
+#else
+        results[i] = read_directly(
+            reader,
+            chunk->bytes,
+            IO_CHUNK_SIZE,
+            reader->offset
+        );
+#endif
+        if (results[i] == -1) {
+            atomic_store(&reader->has_error, true);
+            results[i] = 0;
+        }
+        chunk->length = results[i];
+        reader->offset += results[i];
+        atomic_fetch_add(&reader->number_of_chunks_added, 1);
+        notify_ring_change(reader);
+        if (chunk->length == 0) {
+            return true;
+        }
+        if (chunk->length < IO_CHUNK_SIZE) {
+            return false;
+        }
+    }
+    return false;
+}
+
+// write the "number_of_chunks" chunks, starting with chunk "first_chunk". if
+// any of them can't be written, "has_error" is set
+static void write_chunks(
+    struct io_thread *writer,
+    size_t first_chunk,
+    int number_of_chunks
+) {
+    int number_done = 0;
+#ifdef HAS_IO_URING_VERSION
+    int results[IO_RING_LENGTH];
+    if (writer->has_uring && number_of_chunks > 1) {
+        uint64_t offset = writer->offset;
+        for (int i = 0; i < number_of_chunks; i += 1) {
+            struct io_chunk *chunk = &writer->chunks[
+                (first_chunk + i) % IO_RING_LENGTH
+            ];
+            add_uring_request(
+                &writer->uring,
+                IORING_OP_WRITE,
+                writer->file_descriptor,
+                chunk->bytes,
+                chunk->length,
+                offset,
+                i
+            );
+            offset += chunk->length;
+        }
+        if (submit_and_wait(&writer->uring, number_of_chunks, results)) {
+            free_uring(&writer->uring);
+            writer->has_uring = false;
+        } else {
+            // whatever part of a chunk didn't get written (like after a
+            // failed request or a short write) is written directly
+            for (int i = 0; i < number_of_chunks; i += 1) {
+                struct io_chunk *chunk = &writer->chunks[
+                    (first_chunk + i) % IO_RING_LENGTH
+                ];
+                size_t length_written = results[i] > 0 ? results[i] : 0;
+                if (write_directly(
+                    writer,
+                    chunk->bytes + length_written,
+                    chunk->length - length_written,
+                    writer->offset + length_written
+                )) {
+                    atomic_store(&writer->has_error, true);
+                }
+                writer->offset += chunk->length;
+            }
+            number_done = number_of_chunks;
+        }
+    }
+#endif
+
+    for (int i = number_done; i < number_of_chunks; i += 1) {
+        struct io_chunk *chunk = &writer->chunks[
+            (first_chunk + i) % IO_RING_LENGTH
+        ];
+        if (write_directly(
+            writer,
+            chunk->bytes,
+            chunk->length,
+            writer->offset
+        )) {
+            atomic_store(&writer->has_error, true);
+        }
+        writer->offset += chunk->length;
+    }
+}
+
+// the reader thread's loop: keep every free chunk of the ring filled until the
+// end of the file
+static void *run_reader(void *argument) {
+    struct io_thread *reader = argument;
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+    while (!atomic_load(&reader->is_stopping)) {
+        size_t number_added = atomic_load(&reader->number_of_chunks_added);
+        size_t number_taken = atomic_load(&reader->number_of_chunks_taken);
+        int number_free = IO_RING_LENGTH - (number_added - number_taken);
+        if (number_free == 0) {
+            wait_for_ring_change(reader, number_added, number_taken);
+            continue;
+        }
+        // the bytes of a pipe have to be read in order
+        if (!reader->is_seekable) {
+            number_free = 1;
+        }
+        if (read_chunks(reader, number_added, number_free)) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+// the writer thread's loop: write the chunks as they are added, until the
+// thread is told to stop and there are none left
+static void *run_writer(void *argument) {
+    struct io_thread *writer = argument;
+    while (true) {
+        size_t number_added = atomic_load(&writer->number_of_chunks_added);
+        size_t number_taken = atomic_load(&writer->number_of_chunks_taken);
+        if (number_added == number_taken) {
+            if (atomic_load(&writer->is_stopping)) {
+                break;
+            }
+            wait_for_ring_change(writer, number_added, number_taken);
+            continue;
+        }
+        int number_full = number_added - number_taken;
+        write_chunks(writer, number_taken, number_full);
+        atomic_fetch_add(&writer->number_of_chunks_taken, number_full);
+        notify_ring_change(writer);
+    }
+    return NULL;
+}
+
+static void free_io_thread_memory(struct io_thread *io_thread) {
+#ifdef HAS_IO_URING_VERSION
+    if (io_thread->has_uring) {
+        free_uring(&io_thread->uring);
+    }
+#endif
+    free(io_thread->chunks[0].bytes);
+    pthread_mutex_destroy(&io_thread->mutex);
+    pthread_cond_destroy(&io_thread->ring_changed);
+    free(io_thread);
+}
+
+// start a reader or writer thread for the file descriptor. returns NULL if the
+// memory couldn't be allocated or the thread couldn't be started
+static struct io_thread *start_io_thread(
+    int file_descriptor,
+    bool is_reader
+) {
+    struct io_thread *io_thread = calloc(1, sizeof (*io_thread));
+    if (io_thread == NULL) {
+        return NULL;
+    }
+    io_thread->is_reader = is_reader;
+    io_thread->file_descriptor = file_descriptor;
+    atomic_init(&io_thread->number_of_chunks_added, 0);
+    atomic_init(&io_thread->number_of_chunks_taken, 0);
+    atomic_init(&io_thread->number_of_sleeping_threads, 0);
+    atomic_init(&io_thread->is_stopping, false);
+    atomic_init(&io_thread->has_error, false);
+    pthread_mutex_init(&io_thread->mutex, NULL);
+    pthread_cond_init(&io_thread->ring_changed, NULL);
+
+    // all of the chunks are in 1 allocation, aligned to a page so that the
+    // system can copy them efficiently
+    unsigned char *chunk_memory = aligned_alloc(
+        4096,
+        (size_t)IO_RING_LENGTH * IO_CHUNK_SIZE
+    );
+    if (chunk_memory == NULL) {
+        free_io_thread_memory(io_thread);
+        return NULL;
+    }
+    for (int i = 0; i < IO_RING_LENGTH; i += 1) {
+        io_thread->chunks[i].bytes = chunk_memory + (size_t)i * IO_CHUNK_SIZE;
+    }
+
+    // a file opened for appending is always written at its end, whatever the
+    // offset, so several writes at once could end up out of order
+    struct stat status;
+    off_t offset = lseek(file_descriptor, 0, SEEK_CUR);
+    int flags = fcntl(file_descriptor, F_GETFL);
+    io_thread->is_seekable = fstat(file_descriptor, &status) == 0
+                          && S_ISREG(status.st_mode)
+                          && offset != -1
+                          && flags != -1
+                          && !(flags & O_APPEND);
+    if (io_thread->is_seekable) {
+        io_thread->offset = offset;
+#ifdef HAS_IO_URING_VERSION
+        io_thread->has_uring = !create_uring(
+            &io_thread->uring,
+            IO_RING_LENGTH
+        );
+#endif
+    }
+
+    if (pthread_create(
+        &io_thread->thread,
+        NULL,
+        is_reader ? &run_reader : &run_writer,
+        io_thread
+    )) {
+        free_io_thread_memory(io_thread);
+        return NULL;
+    }
+    return io_thread;
+}
+
+// start a reader thread for the file descriptor, which then only the reader
+// thread reads from (see io_thread_read()). returns NULL if it couldn't be
+// started
+struct io_thread *start_reader_thread(int file_descriptor) {
+    return start_io_thread(file_descriptor, true);
+}
+
+// take up to "number_of_bytes" bytes that the reader thread has read, in
+// order, and copy them into "buffer". if "should_wait_for_all" is true, this
+// only gives back fewer bytes at the end of the file. if it is false, it
+// waits for at least 1 byte, but otherwise only gives back the bytes that have
+// been read so far (for input that has to be passed on as soon as it arrives).
+// returns whether the reading was successful
+int io_thread_read(
+    struct io_thread *reader,
+    unsigned char *buffer,
+    size_t number_of_bytes,
+    bool should_wait_for_all,
+    size_t *number_of_bytes_read
+) {
+    *number_of_bytes_read = 0;
+    while (*number_of_bytes_read < number_of_bytes) {
+        size_t number_added = atomic_load(&reader->number_of_chunks_added);
+        size_t number_taken = atomic_load(&reader->number_of_chunks_taken);
+        if (number_added == number_taken) {
+            if (*number_of_bytes_read > 0 && !should_wait_for_all) {
+                break;
+            }
+            wait_for_ring_change(reader, number_added, number_taken);
+            continue;
+        }
+
+        // the chunk that marks the end stays in the ring, so that any reads
+        // after this one also find the end
+        const struct io_chunk *chunk = &reader->chunks[
+            number_taken % IO_RING_LENGTH
+        ];
+        if (chunk->length == 0) {
+            break;
+        }
+        size_t length = chunk->length - reader->position;
+        if (length > number_of_bytes - *number_of_bytes_read) {
+            length = number_of_bytes - *number_of_bytes_read;
+        }
+        memcpy(
+            buffer + *number_of_bytes_read,
+            chunk->bytes + reader->position,
+            length
+        );
+        *number_of_bytes_read += length;
+        reader->position += length;
+        if (reader->position == chunk->length) {
+            reader->position = 0;
+            atomic_fetch_add(&reader->number_of_chunks_taken, 1);
+            notify_ring_change(reader);
+        }
+    }
+    return atomic_load(&reader->has_error);
+}
+
+// start a writer thread for the file descriptor, which then only the writer
+// thread writes to (see io_thread_write()). returns NULL if it couldn't be
+// started
+struct io_thread *start_writer_thread(int file_descriptor) {
+    return start_io_thread(file_descriptor, false);
+}
+
+// hand the chunk that is being filled to the writer thread
+static void add_current_chunk(struct io_thread *writer) {
+    writer->chunks[
+        atomic_load(&writer->number_of_chunks_added) % IO_RING_LENGTH
+    ].length = writer->position;
+    writer->position = 0;
+    writer->has_chunk = false;
+    atomic_fetch_add(&writer->number_of_chunks_added, 1);
+    notify_ring_change(writer);
+}
+
+// copy the bytes into the ring, in order, for the writer thread to write.
+// this only waits if the ring is full. a problem with writing is reported by
+// stop_io_thread()
+void io_thread_write(
+    struct io_thread *writer,
+    const unsigned char *bytes,
+    size_t number_of_bytes
+) {
+    while (number_of_bytes > 0) {
+        size_t number_added = atomic_load(&writer->number_of_chunks_added);
+        if (!writer->has_chunk) {
+            size_t number_taken = atomic_load(
+                &writer->number_of_chunks_taken
+            );
+            if (number_added - number_taken == IO_RING_LENGTH) {
+                wait_for_ring_change(writer, number_added, number_taken);
+                continue;
+            }
+            writer->has_chunk = true;
+        }
+
+        struct io_chunk *chunk = &writer->chunks[
+            number_added % IO_RING_LENGTH
+        ];
+        size_t length = IO_CHUNK_SIZE - writer->position;
+        if (length > number_of_bytes) {
+            length = number_of_bytes;
+        }
+        memcpy(chunk->bytes + writer->position, bytes, length);
+        writer->position += length;
+        bytes += length;
+        number_of_bytes -= length;
+        if (writer->position == IO_CHUNK_SIZE) {
+            add_current_chunk(writer);
+        }
+    }
+}
+
+// hand the bytes that haven't filled a chunk yet to the writer thread now,
+// instead of waiting for more
+void io_thread_flush(struct io_thread *writer) {
+    if (writer->has_chunk && writer->position > 0) {
+        add_current_chunk(writer);
+    }
+}
+
+// stop the thread and free it. a writer thread first writes everything that
+// it was given, and the file's position is moved to the end of it. a reader
+// thread is stopped right away, even if it is waiting for a pipe. returns
+// whether there was a problem with reading or writing
+int stop_io_thread(struct io_thread *io_thread) {
+    if (!io_thread->is_reader) {
+        io_thread_flush(io_thread);
+    }
+    pthread_mutex_lock(&io_thread->mutex);
+    atomic_store(&io_thread->is_stopping, true);
+    pthread_cond_broadcast(&io_thread->ring_changed);
+    pthread_mutex_unlock(&io_thread->mutex);
+    if (io_thread->is_reader) {
+        pthread_cancel(io_thread->thread);
+    }
+    pthread_join(io_thread->thread, NULL);
+
+    // pwrite() doesn't move the file's position, so anything written to the
+    // file after us (like by the next command of a shell script) would
+    // otherwise go over our bytes
+    bool has_error = atomic_load(&io_thread->has_error);
+    if (
+        !io_thread->is_reader
+        && io_thread->is_seekable
+        && lseek(io_thread->file_descriptor, io_thread->offset, SEEK_SET) == -1
+    ) {
+        has_error = true;
+    }
+    free_io_thread_memory(io_thread);
+    return has_error;
+}
@@ -0,0 +1,58 @@
+// without threads of their own for the input and output, the binaries would
+// alternate between waiting for a read, coding, and waiting for a write, so
+// the disk (or the network, for a file on a network volume) and the coding
+// would take turns instead of working at the same time. an I/O thread does the
+// reads or the writes of 1 file descriptor in the background, so that the
+// encoder or decoder becomes a pipeline of 3 stages: a reader thread, the
+// thread(s) doing the coding, and a writer thread
+//
+// each I/O thread and the thread that it works for are connected by a ring of
+// IO_RING_LENGTH chunks of IO_CHUNK_SIZE bytes. one of them only ever adds
+// chunks to the ring and the other only ever takes them off, so the ring only
+// needs 2 atomic counters (how many chunks have been added and how many have
+// been taken) and no lock. a thread only locks anything to go to sleep when
+// the ring is full or empty, and to wake the other one up
+//
+// a reader thread keeps as many chunks filled as the ring has room for, and a
+// writer thread writes the chunks as they are added. for a regular file, the
+// offset of each chunk is known ahead of time, so all of the chunks that are
+// ready are read or written at once with io_uring (on Linux), which keeps
+// several requests in flight at a time. if io_uring isn't available (or is
+// turned off, like in many containers), each chunk is read with pread() or
+// written with pwrite() instead. a pipe or a terminal can only be read or
+// written in order, 1 request at a time, so for those the thread just uses
+// read() and write()
+
+#ifndef IO_THREAD_H
+#define IO_THREAD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// the size of each chunk, which is big enough that the system calls (or
+// io_uring requests) for them cost very little, and the number of chunks in a
+// ring, which is how far a reader thread can get ahead of the thread that it
+// reads for (and a writer thread behind the thread that it writes for)
+#define IO_CHUNK_SIZE (1024 * 1024)
+#define IO_RING_LENGTH 8
+
+struct io_thread;
+
+struct io_thread *start_reader_thread(int file_descriptor);
+int io_thread_read(
+    struct io_thread *reader,
+    unsigned char *buffer,
+    size_t number_of_bytes,
+    bool should_wait_for_all,
+    size_t *number_of_bytes_read
+);
+struct io_thread *start_writer_thread(int file_descriptor);
+void io_thread_write(
+    struct io_thread *writer,
+    const unsigned char *bytes,
+    size_t number_of_bytes
+);
+void io_thread_flush(struct io_thread *writer);
+int stop_io_thread(struct io_thread *io_thread);
+
+#endif
@@ -0,0 +1,205 @@
+// see legacy_decoder.h for an outline of the legacy file format
+
+#include "legacy_decoder.h"
+#include <string.h>
+
+// start decoding a legacy file whose part 1 says that it has
+// "number_of_bytes" bytes. the rest of the file (from part 2 on) is then given
+// to decode_legacy_data()
+void init_legacy_decoder(
+    struct legacy_decoder *decoder,
+    uint32_t number_of_bytes
+) {
+    decoder->tree.number_of_nodes = 0;
+    decoder->has_read_tree = false;
+    decoder->number_of_unfinished_branches = 0;
+    decoder->number_of_symbol_bits_left = 0;
+    memset(decoder->code_lengths, 0, sizeof (decoder->code_lengths));
+    decoder->number_of_bits_used = 0;
+    decoder->number_of_bytes_left = number_of_bytes;
+}
+
+// add a node that was just read from the tree (a leaf with the given symbol,
+// or a branch node) as the next child of the branch node that is waiting for
+// one. returns whether the tree is still a proper binary tree, with 16 if not
+//
+// the tree was written in pre-order, so a branch node's right child comes
+// after everything under its left child. a branch node stays unfinished until
+// the last leaf under its right child has been read, so the unfinished branch
+// nodes are always the path from the root down to the next node
+int add_legacy_tree_node(
+    struct legacy_decoder *decoder,
+    bool is_leaf,
+    unsigned char symbol
+) {
+    struct huffman_tree *tree = &decoder->tree;
+    int depth = decoder->number_of_unfinished_branches;
+    if (
+        depth > LEGACY_MAXIMUM_CODEWORD_LENGTH
+        || tree->number_of_nodes == MAXIMUM_NUMBER_OF_NODES
+    ) {
+        return 16;
+    }
+    // the weights aren't stored, and they aren't needed for decoding
+    uint16_t position = add_node(tree, symbol, 0);
+    if (depth == 0) {
+        tree->root = position;
+    } else {
+        struct node *parent = &tree->nodes[
+            decoder->unfinished_branches[depth - 1]
+        ];
+        if (parent->left_child == NO_CHILD) {
+            parent->left_child = position;
+        } else {
+            parent->right_child = position;
+        }
+    }
+
+    if (!is_leaf) {
+        decoder->unfinished_branches[depth] = position;
+        decoder->number_of_unfinished_branches += 1;
+        return 0;
+    }
+    decoder->code_lengths[symbol] = depth;
+    // a leaf finishes every branch node above it that it is the last node of
+    while (decoder->number_of_unfinished_branches > 0) {
+        const struct node *branch = &tree->nodes[
+            decoder->unfinished_branches[
+                decoder->number_of_unfinished_branches - 1
+            ]
+        ];
+        if (branch->right_child == NO_CHILD) {
+            break;
+        }
+        decoder->number_of_unfinished_branches -= 1;
+    }
+    if (decoder->number_of_unfinished_branches == 0) {
+        // a tree of just 1 leaf would have codewords with no bits
+        if (is_leaf_node(get_root_node(tree))) {
+            return 16;
+        }
+        decoder->has_read_tree = true;
+        decoder->position = tree->root;
+    }
+    return 0;
+}
+
+// read the next bits of the tree (part 2) from the byte, which the tree starts
+// at the beginning of. returns whether it was successful, with the same
+// numbers as decode_legacy_data()
+int read_legacy_tree_bits(struct legacy_decoder *decoder, unsigned char byte) {
+    for (int bit = 7; bit >= 0 && !decoder->has_read_tree; bit -= 1) {
+        bool is_one = (byte >> bit) & 1;
+        int exit_status = 0;
+        if (decoder->number_of_symbol_bits_left > 0) {
+            decoder->symbol = decoder->symbol << 1 | is_one;
+            decoder->number_of_symbol_bits_left -= 1;
+            if (decoder->number_of_symbol_bits_left == 0) {
+                exit_status = add_legacy_tree_node(
+                    decoder,
+                    true,
+                    decoder->symbol
+                );
+            }
+        } else if (is_one) {
+            // 1 is a leaf node, whose symbol is in the next 8 bits
+            decoder->number_of_symbol_bits_left = 8;
+        } else {
+            // 0 is a branch node
+            exit_status = add_legacy_tree_node(decoder, false, 0);
+        }
+        if (exit_status != 0) {
+            return exit_status;
+        }
+    }
+    // whatever is left of the byte after the tree is part 3
+    return 0;
+}
+
+// decode the next "input_length" bytes of the legacy file (which come right
+// after the ones from the last call, starting with part 2) into the output,
+// which has room for "output_capacity" bytes. set "input_used" to how many of
+// the input bytes were used up, and "output_length" to how many bytes were
+// decoded. the decoding stops early once the output is full or every byte of
+// the file has been decoded, so the bytes that weren't used have to be given
+// again in the next call. returns whether it was successful, with 16 if the
+// tree isn't a proper binary tree
+int decode_legacy_data(
+    struct legacy_decoder *decoder,
+    const unsigned char *input,
+    size_t input_length,
+    size_t *input_used,
+    unsigned char *output,
+    size_t output_capacity,
+    size_t *output_length
+) {
+    *input_used = 0;
+    *output_length = 0;
+    while (*input_used < input_length && !decoder->has_read_tree) {
+        int exit_status = read_legacy_tree_bits(decoder, input[*input_used]);
+        if (exit_status != 0) {
+            return exit_status;
+        }
+        *input_used += 1;
+    }
+    if (!decoder->has_read_tree) {
+        return 0;
+    }
+
+    // walk from the root to a leaf, 1 bit at a time, and start over at the
+    // root for the next codeword
+    const struct node *nodes = decoder->tree.nodes;
+    uint16_t position = decoder->position;
+    while (
+        *input_used < input_length
+        && decoder->number_of_bytes_left > 0
+        && *output_length < output_capacity
+    ) {
+        unsigned char byte = input[*input_used];
+        int bit = decoder->number_of_bits_used;
+        while (bit < 8) {
+            position = (byte >> (7 - bit)) & 1
+                     ? nodes[position].right_child
+                     : nodes[position].left_child;
+            bit += 1;
+            if (!is_leaf_node(&nodes[position])) {
+                continue;
+            }
+            output[*output_length] = nodes[position].symbol;
+            *output_length += 1;
+            position = decoder->tree.root;
+            decoder->number_of_bytes_left -= 1;
+            if (decoder->number_of_bytes_left == 0) {
+                // whatever is left of the byte after the last codeword is
+                // part 5
+                bit = 8;
+            } else if (*output_length == output_capacity) {
+                break;
+            }
+        }
+        if (bit < 8) {
+            decoder->number_of_bits_used = bit;
+            break;
+        }
+        decoder->number_of_bits_used = 0;
+        *input_used += 1;
+    }
+    decoder->position = position;
+    return 0;
+}
+
+// returns 0 if every byte of the legacy file has been decoded, or else what
+// is wrong with the file if its bytes have run out, with the numbers that
+// get_decompression_error_message() explains
+int get_legacy_decoding_status(const struct legacy_decoder *decoder) {
+    if (!decoder->has_read_tree) {
+        return 16;
+    } else if (decoder->number_of_bytes_left == 0) {
+        return 0;
+    } else if (decoder->position != decoder->tree.root) {
+        // the bytes ran out in the middle of a codeword
+        return 5;
+    } else {
+        return 4;
+    }
+}
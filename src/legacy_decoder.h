@@ -0,0 +1,81 @@
+// before the input was split into blocks (see block_format.h), the encoder
+// wrote the whole file with 1 huffman tree, and the tree itself was stored in
+// the file instead of a prefix code's lengths. those legacy files are laid out
+// as:
+// 1. 32 bits for the number of bytes that were encoded using the prefix code
+//      (we need this to know when the encoded data stops)
+//      32 bit unsigned big-endian integer
+// 2. the tree used to create the prefix code during huffman coding, in a
+//      depth-first pre-order traversal, where a branch node is a 0 bit and a
+//      leaf node is a 1 bit followed by the 8 bits of its symbol
+// 3. 0-7 empty bits to align to byte boundary
+// 4. the input bytes encoded with the prefix code, where a 0 bit goes to a
+//      node's left child and a 1 bit goes to its right child
+// 5. 0-7 empty bits to align to byte boundary
+//
+// a legacy file doesn't start with FILE_MAGIC_NUMBER, which is how the decoder
+// tells it apart. the only legacy files that can't be told apart are the ones
+// of exactly FILE_MAGIC_NUMBER (over 2 billion) bytes, which are taken for
+// newer files and can't be decoded
+//
+// the tree isn't a canonical prefix code, and its codewords can be up to 255
+// bits long, so the bytes are decoded by walking the tree 1 bit at a time,
+// like in an adaptive file (see adaptive_huffman.h). the tree is read into an
+// ordinary struct huffman_tree (see huffman_tree.h)
+//
+// the whole file is 1 stream, so the decoder can be given its bytes in pieces
+// of any size, and it keeps track of where it is (in the tree that it is
+// reading, or in the codeword that it is decoding) from one piece to the next.
+// that way, a legacy file can be decoded from a pipe without holding all of it
+// in memory
+
+#ifndef LEGACY_DECODER_H
+#define LEGACY_DECODER_H
+
+#include "huffman_tree.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// the longest codeword (or the deepest leaf) that a tree of 256 leaves can have
+#define LEGACY_MAXIMUM_CODEWORD_LENGTH 255
+
+struct legacy_decoder {
+    struct huffman_tree tree;
+    bool has_read_tree;
+    // while the tree is being read, the branch nodes from the root down to the
+    // node being read that don't have both of their children yet
+    uint16_t unfinished_branches[LEGACY_MAXIMUM_CODEWORD_LENGTH + 1];
+    int number_of_unfinished_branches;
+    // the bits of a leaf's symbol that have been read so far, and how many more
+    // are still to come (0 when no leaf is being read)
+    unsigned char symbol;
+    int number_of_symbol_bits_left;
+    // each byte's codeword length, which is the depth of its leaf (0 for the
+    // bytes that aren't in the tree)
+    unsigned char code_lengths[256];
+
+    // the node that the codeword being decoded has reached so far
+    uint16_t position;
+    // how many bits of the next byte of the file were already used by the
+    // last call, which stopped in the middle of it because the output was full
+    int number_of_bits_used;
+    uint32_t number_of_bytes_left;
+};
+
+void init_legacy_decoder(
+    struct legacy_decoder *decoder,
+    uint32_t number_of_bytes
+);
+int decode_legacy_data(
+    struct legacy_decoder *decoder,
+    const unsigned char *input,
+    size_t input_length,
+    size_t *input_used,
+    unsigned char *output,
+    size_t output_capacity,
+    size_t *output_length
+);
+int get_legacy_decoding_status(const struct legacy_decoder *decoder);
+
+#endif
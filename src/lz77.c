@@ -0,0 +1,481 @@
+// see lz77.h for an explanation of how the matches are found and stored
+
+#include "lz77.h"
+#include "bitbuffer.h"
+#include "block_encoder.h"
+#include "canonical_code.h"
+#include <stdbool.h>
+#include <stdlib.h>
+
+// how the search works at each level (see lz77.h)
+struct lz77_level {
+    // how many earlier positions with the same hash are tried at most
+    int chain_length;
+    // a match that is at least this long is taken without looking for a
+    // longer one
+    uint32_t good_enough_length;
+    bool is_lazy;
+};
+
+static const struct lz77_level lz77_levels[LZ77_MAXIMUM_LEVEL + 1] = {
+    {0, 0, false},
+    {4, 16, false},
+    {8, 32, false},
+    {16, 32, false},
+    {16, 64, true},
+    {32, 128, true},
+    {64, 128, true},
+    {128, 256, true},
+    {256, 512, true},
+    {1024, 1024, true}
+};
+
+// return the hash of the LZ77_MINIMUM_MATCH_LENGTH bytes, using its highest
+// "hash_bits" bits (Knuth's multiplicative hash)
+static inline uint32_t hash_lz77_bytes(
+    const unsigned char *bytes,
+    int hash_bits
+) {
+    uint32_t word;
+    memcpy(&word, bytes, 4);
+    return (word * 2654435761u) >> (32 - hash_bits);
+}
+
+// return how many of the bytes at "a" and "b" are the same, up to "maximum"
+static inline uint32_t get_match_length(
+    const unsigned char *a,
+    const unsigned char *b,
+    uint32_t maximum
+) {
+    uint32_t length = 0;
+    while (length + 8 <= maximum) {
+        uint64_t a_word;
+        uint64_t b_word;
+        memcpy(&a_word, a + length, 8);
+        memcpy(&b_word, b + length, 8);
+        if (a_word != b_word) {
+            break;
+        }
+        length += 8;
+    }
+    while (length < maximum && a[length] == b[length]) {
+        length += 1;
+    }
+    return length;
+}
+
+// returns NULL if the memory couldn't be allocated. the window size is in
+// bytes, and must be a power of 2
+struct lz77_model *create_lz77_model(int level, uint32_t window_size) {
+    struct lz77_model *model = malloc(sizeof (*model));
+    if (model == NULL) {
+        return NULL;
+    }
+    model->level = level;
+    model->window_size = window_size;
+    model->previous_positions = malloc(
+        window_size * sizeof (*model->previous_positions)
+    );
+    model->sequences = NULL;
+    model->number_of_sequences = 0;
+    model->sequence_capacity = 0;
+    if (model->previous_positions == NULL) {
+        free(model);
+        return NULL;
+    }
+    return model;
+}
+
+// add the position to the front of the chain of its hash, which needs at least
+// LZ77_MINIMUM_MATCH_LENGTH bytes from the position to the end of the block
+static inline void insert_lz77_position(
+    struct lz77_model *model,
+    const unsigned char *block,
+    uint32_t position,
+    int hash_bits
+) {
+    uint32_t hash = hash_lz77_bytes(block + position, hash_bits);
+    model->previous_positions[position & (model->window_size - 1)] =
+        model->hash_heads[hash];
+    model->hash_heads[hash] = position + 1;
+}
+
+// add the position to its chain, and find the longest match for the bytes
+// that start there among the positions that were already on the chain. sets
+// "distance" and returns the match's length, which is less than
+// LZ77_MINIMUM_MATCH_LENGTH if there is no match
+uint32_t find_longest_match(
+    struct lz77_model *model,
+    const unsigned char *block,
+    uint32_t block_length,
+    uint32_t position,
+    int hash_bits,
+    uint32_t *distance
+) {
+    const struct lz77_level *level = &lz77_levels[model->level];
+    uint32_t window_mask = model->window_size - 1;
+    uint32_t hash = hash_lz77_bytes(block + position, hash_bits);
+    uint32_t candidate = model->hash_heads[hash];
+    model->previous_positions[position & window_mask] = candidate;
+    model->hash_heads[hash] = position + 1;
+
+    // the position a whole window back shares its slot in
+    // "previous_positions" with this one, which was just replaced, so the
+    // chain has to stop right after it
+    uint32_t oldest_position = position >= window_mask
+                             ? position - window_mask
+                             : 0;
+    uint32_t maximum_length = block_length - position;
+    uint32_t best_length = LZ77_MINIMUM_MATCH_LENGTH - 1;
+    // a match can't be longer than the rest of the block, so once one is that
+    // long, there is no point in looking further
+    for (
+        int i = 0;
+        i < level->chain_length
+        && candidate > oldest_position
+        && best_length < maximum_length;
+        i += 1
+    ) {
+        uint32_t candidate_position = candidate - 1;
+        // a match can only be longer than the best one if it also matches
+        // the byte right after the best one's end, which rules most of them
+        // out with 1 comparison
+        if (
+            block[candidate_position + best_length]
+            == block[position + best_length]
+        ) {
+            uint32_t length = get_match_length(
+                block + candidate_position,
+                block + position,
+                maximum_length
+            );
+            if (length > best_length) {
+                best_length = length;
+                *distance = position - candidate_position;
+                if (length >= level->good_enough_length) {
+                    break;
+                }
+            }
+        }
+        uint32_t next_candidate = model->previous_positions[
+            candidate_position & window_mask
+        ];
+        // the slot was reused by a newer position, so the chain is over
+        if (next_candidate >= candidate) {
+            break;
+        }
+        candidate = next_candidate;
+    }
+    return best_length;
+}
+
+// add a sequence to the end of the model's sequences. returns whether the
+// memory could be allocated
+int add_lz77_sequence(
+    struct lz77_model *model,
+    uint32_t run_length,
+    uint32_t match_length,
+    uint32_t distance
+) {
+    if (model->number_of_sequences == model->sequence_capacity) {
+        size_t new_capacity = model->sequence_capacity == 0
+                            ? 1024
+                            : 2 * model->sequence_capacity;
+        struct lz77_sequence *new_sequences = realloc(
+            model->sequences,
+            new_capacity * sizeof (*model->sequences)
+        );
+        if (new_sequences == NULL) {
+            return 1;
+        }
+        model->sequences = new_sequences;
+        model->sequence_capacity = new_capacity;
+    }
+    struct lz77_sequence *sequence =
+        &model->sequences[model->number_of_sequences];
+    sequence->run_length = run_length;
+    sequence->match_length = match_length;
+    sequence->distance = distance;
+    model->number_of_sequences += 1;
+    return 0;
+}
+
+// split the block into sequences of literals and matches (see lz77.h).
+// returns whether the memory for the sequences could be allocated
+int find_lz77_sequences(
+    struct lz77_model *model,
+    const unsigned char *block,
+    uint32_t block_length
+) {
+    // a small block only needs a small hash table, which is quicker to clear
+    int hash_bits = 8;
+    while (
+        hash_bits < LZ77_MAXIMUM_HASH_BITS
+        && ((uint32_t)1 << hash_bits) < block_length
+    ) {
+        hash_bits += 1;
+    }
+    memset(
+        model->hash_heads,
+        0,
+        ((size_t)1 << hash_bits) * sizeof (*model->hash_heads)
+    );
+    bool is_lazy = lz77_levels[model->level].is_lazy;
+    uint32_t good_enough_length = lz77_levels[model->level].good_enough_length;
+
+    model->number_of_sequences = 0;
+    uint32_t run_start = 0;
+    uint32_t position = 0;
+    // every position before this one is on its chain
+    uint32_t next_position_to_insert = 0;
+    while (position + LZ77_MINIMUM_MATCH_LENGTH <= block_length) {
+        uint32_t distance;
+        uint32_t length = find_longest_match(
+            model,
+            block,
+            block_length,
+            position,
+            hash_bits,
+            &distance
+        );
+        next_position_to_insert = position + 1;
+        if (length < LZ77_MINIMUM_MATCH_LENGTH) {
+            position += 1;
+            continue;
+        }
+
+        // if the match that starts at the next byte is longer, this byte is
+        // better off as a literal
+        while (
+            is_lazy
+            && length < good_enough_length
+            && position + 1 + LZ77_MINIMUM_MATCH_LENGTH <= block_length
+        ) {
+            uint32_t next_distance;
+            uint32_t next_length = find_longest_match(
+                model,
+                block,
+                block_length,
+                position + 1,
+                hash_bits,
+                &next_distance
+            );
+            next_position_to_insert = position + 2;
+            if (next_length <= length) {
+                break;
+            }
+            position += 1;
+            length = next_length;
+            distance = next_distance;
+        }
+
+        if (add_lz77_sequence(
+            model,
+            position - run_start,
+            length,
+            distance
+        )) {
+            return 1;
+        }
+        position += length;
+        run_start = position;
+        // the positions inside the match can be the start of later matches
+        uint32_t insert_end = position;
+        if (insert_end + LZ77_MINIMUM_MATCH_LENGTH > block_length) {
+            insert_end = block_length - LZ77_MINIMUM_MATCH_LENGTH + 1;
+        }
+        for (uint32_t i = next_position_to_insert; i < insert_end; i += 1) {
+            insert_lz77_position(model, block, i, hash_bits);
+        }
+    }
+    return add_lz77_sequence(model, block_length - run_start, 0, 0);
+}
+
+// count the symbol of the number in the alphabet, and add its extra bits to
+// the model's number of codeword bits
+static inline void count_lz77_number(
+    struct lz77_model *model,
+    int alphabet,
+    uint32_t number
+) {
+    int symbol = get_lz77_number_symbol(number);
+    model->frequencies[alphabet][symbol] += 1;
+    model->number_of_codeword_bits += get_lz77_number_extra_bits(symbol);
+}
+
+// split the block (which must have from 1 to MAXIMUM_BLOCK_LENGTH bytes) into
+// sequences (see lz77.h), and make the prefix code of each alphabet from
+// them, with no codeword longer than "codeword_length_limit". returns whether
+// the memory for the sequences and for limiting the code lengths could be
+// allocated
+int create_lz77_sequences(
+    struct lz77_model *model,
+    const unsigned char *block,
+    size_t block_length,
+    int codeword_length_limit
+) {
+    if (find_lz77_sequences(model, block, block_length)) {
+        return 1;
+    }
+
+    memset(model->frequencies, 0, sizeof (model->frequencies));
+    model->number_of_codeword_bits = 0;
+    size_t position = 0;
+    for (size_t i = 0; i < model->number_of_sequences; i += 1) {
+        const struct lz77_sequence *sequence = &model->sequences[i];
+        count_lz77_number(
+            model,
+            LZ77_ALPHABET_RUN_LENGTHS,
+            sequence->run_length
+        );
+        for (uint32_t j = 0; j < sequence->run_length; j += 1) {
+            model->frequencies[LZ77_ALPHABET_LITERALS][block[position + j]] +=
+                1;
+        }
+        position += sequence->run_length + sequence->match_length;
+        if (sequence->match_length != 0) {
+            count_lz77_number(
+                model,
+                LZ77_ALPHABET_MATCH_LENGTHS,
+                sequence->match_length - LZ77_MINIMUM_MATCH_LENGTH
+            );
+            count_lz77_number(
+                model,
+                LZ77_ALPHABET_DISTANCES,
+                sequence->distance - 1
+            );
+        }
+    }
+
+    for (int alphabet = 0; alphabet < LZ77_NUMBER_OF_ALPHABETS; alphabet += 1) {
+        uint64_t *frequencies = model->frequencies[alphabet];
+        // an alphabet that isn't used (like the distances of a block without
+        // any matches) still needs a proper prefix code to be stored, so it
+        // gets one for a symbol that never comes up
+        bool is_used = false;
+        for (int symbol = 0; symbol < 256; symbol += 1) {
+            is_used = is_used || frequencies[symbol] > 0;
+        }
+        if (!is_used) {
+            frequencies[0] = 1;
+        }
+        if (create_code_lengths(
+            frequencies,
+            codeword_length_limit,
+            model->code_lengths[alphabet]
+        )) {
+            return 1;
+        }
+        if (!is_used) {
+            frequencies[0] = 0;
+        }
+        assign_canonical_codewords(
+            model->code_lengths[alphabet],
+            model->codewords[alphabet]
+        );
+        for (int symbol = 0; symbol < 256; symbol += 1) {
+            model->number_of_codeword_bits += frequencies[symbol]
+                                            * model->code_lengths[alphabet][
+                                                  symbol
+                                              ];
+        }
+    }
+    return 0;
+}
+
+// return the number of bits that write_lz77_tables() would write for the
+// model, so that the size of a block can be worked out without writing it
+int get_lz77_tables_size(const struct lz77_model *model) {
+    int size = 0;
+    for (int alphabet = 0; alphabet < LZ77_NUMBER_OF_ALPHABETS; alphabet += 1) {
+        size += get_code_lengths_size(model->code_lengths[alphabet]);
+    }
+    return size;
+}
+
+// write the code lengths of the model's alphabets in the format described in
+// lz77.h
+void write_lz77_tables(
+    struct bit_writer *writer,
+    const struct lz77_model *model
+) {
+    for (int alphabet = 0; alphabet < LZ77_NUMBER_OF_ALPHABETS; alphabet += 1) {
+        write_code_lengths(writer, model->code_lengths[alphabet]);
+    }
+}
+
+// write the number's symbol's codeword from the alphabet, followed by its
+// extra bits
+static inline void write_lz77_number(
+    struct bit_writer *writer,
+    const struct lz77_model *model,
+    int alphabet,
+    uint32_t number
+) {
+    int symbol = get_lz77_number_symbol(number);
+    bit_writer_append_bits(
+        writer,
+        model->codewords[alphabet][symbol],
+        model->code_lengths[alphabet][symbol]
+    );
+    int number_of_extra_bits = get_lz77_number_extra_bits(symbol);
+    bit_writer_append_bits(
+        writer,
+        number - get_lz77_number_base(symbol),
+        number_of_extra_bits
+    );
+}
+
+// write each of the model's sequences for the block, in the format described
+// in lz77.h, with the bit writer
+void write_lz77_data(
+    const unsigned char *block,
+    const struct lz77_model *model,
+    struct bit_writer *writer
+) {
+    const uint32_t *literal_codewords =
+        model->codewords[LZ77_ALPHABET_LITERALS];
+    const unsigned char *literal_code_lengths =
+        model->code_lengths[LZ77_ALPHABET_LITERALS];
+    size_t position = 0;
+    for (size_t i = 0; i < model->number_of_sequences; i += 1) {
+        const struct lz77_sequence *sequence = &model->sequences[i];
+        write_lz77_number(
+            writer,
+            model,
+            LZ77_ALPHABET_RUN_LENGTHS,
+            sequence->run_length
+        );
+        for (uint32_t j = 0; j < sequence->run_length; j += 1) {
+            unsigned char byte = block[position + j];
+            bit_writer_append_bits(
+                writer,
+                literal_codewords[byte],
+                literal_code_lengths[byte]
+            );
+        }
+        position += sequence->run_length + sequence->match_length;
+        if (sequence->match_length != 0) {
+            write_lz77_number(
+                writer,
+                model,
+                LZ77_ALPHABET_MATCH_LENGTHS,
+                sequence->match_length - LZ77_MINIMUM_MATCH_LENGTH
+            );
+            write_lz77_number(
+                writer,
+                model,
+                LZ77_ALPHABET_DISTANCES,
+                sequence->distance - 1
+            );
+        }
+    }
+}
+
+void free_lz77_model(struct lz77_model *model) {
+    if (model != NULL) {
+        free(model->previous_positions);
+        free(model->sequences);
+    }
+    free(model);
+}
@@ -0,0 +1,202 @@
+// a prefix code only makes common bytes shorter, so a line that repeats
+// earlier in the block (like the same log message over and over) still costs
+// the same as it did the first time. the LZ77 mode (BLOCK_TYPE_LZ77, see
+// block_format.h) replaces each repeat with a match: how long it is, and how
+// far back (the distance) the bytes that it repeats start. the bytes that
+// aren't part of any match are kept as literals. the block becomes a list of
+// sequences, each of which is:
+// 1. a run of literals (which can be empty)
+// 2. a match, except in the last sequence, which ends the block
+//
+// a match can overlap the bytes that it makes, when its distance is shorter
+// than its length. "abcabcabca" is the literals "abc" followed by a match with
+// a distance of 3 and a length of 7, which the decoder copies 1 byte at a time
+// (or as much at a time as the distance allows)
+//
+// the matches are found with hash chains. the first LZ77_MINIMUM_MATCH_LENGTH
+// bytes at each position of the block are hashed, each hash has the last
+// position where it came up, and each position has the position before it
+// with the same hash. following that chain from the newest position to the
+// oldest gives every earlier place where a match could start, and the longest
+// match among them is used. the level sets how far down the chain to look and
+// whether to check if the next position has an even longer match before
+// taking one (lazy matching), which trades speed for size. the window limits
+// how far back a match can be, and also how much memory the chains take up.
+// matches never reach back into an earlier block, so that each block can
+// still be decoded on its own
+//
+// the literals, the lengths of the runs of literals, the lengths of the
+// matches, and the distances each get their own prefix code (alphabet), made
+// with the same machinery as a normal block (see block_encoder.h). run
+// lengths, match lengths, and distances can be far bigger than 256, so each of
+// those numbers is split into a symbol and extra bits:
+//     numbers from 0 to 15 are their own symbol, with no extra bits
+//     a bigger number, whose highest set bit is bit b (so b >= 4), has the
+//       symbol 16 + 4 * (b - 4) + (the 2 bits right below bit b), followed by
+//       its lowest b - 2 bits as extra bits
+// so short runs and matches (which are the most common) each have a symbol of
+// their own, and the extra bits of a longer one only say where it is within
+// the range of its symbol. match lengths are stored minus
+// LZ77_MINIMUM_MATCH_LENGTH, and distances minus 1
+//
+// part 4 of an LZ77 block (see block_format.h) is the code lengths of the 4
+// alphabets in the order of the LZ77_ALPHABET_ constants below, each in the
+// same format as the code lengths of a normal block (see canonical_code.h).
+// part 6 is then each sequence in turn:
+// 1. the run length's symbol's codeword and its extra bits
+// 2. each literal's codeword
+// 3. unless that was the last of the block's bytes, the match length's
+//      symbol's codeword and extra bits, then the distance's
+
+#ifndef LZ77_H
+#define LZ77_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+struct bit_writer;
+
+// matches that are any shorter than this would hardly save anything over
+// their literals, and it is how many bytes the hash is made from
+#define LZ77_MINIMUM_MATCH_LENGTH 4
+
+#define LZ77_MINIMUM_LEVEL 1
+#define LZ77_MAXIMUM_LEVEL 9
+#define LZ77_DEFAULT_LEVEL 6
+
+// in KiB. the window is a power of 2, and a match can start at most 1 byte less
+// than the window back. a window as big as the biggest block lets matches
+// reach anywhere in the block
+#define LZ77_MINIMUM_WINDOW_SIZE 1
+#define LZ77_MAXIMUM_WINDOW_SIZE (64 * 1024)
+#define LZ77_DEFAULT_WINDOW_SIZE 1024
+
+#define LZ77_ALPHABET_LITERALS 0
+#define LZ77_ALPHABET_RUN_LENGTHS 1
+#define LZ77_ALPHABET_MATCH_LENGTHS 2
+#define LZ77_ALPHABET_DISTANCES 3
+#define LZ77_NUMBER_OF_ALPHABETS 4
+
+// the symbols for numbers of up to 2^27 - 1, which is more than any run,
+// match, or distance in a block of MAXIMUM_BLOCK_LENGTH bytes. the symbols
+// above these aren't used
+#define LZ77_NUMBER_OF_NUMBER_SYMBOLS 108
+
+// how many bits a hash has at most
+#define LZ77_MAXIMUM_HASH_BITS 16
+
+struct lz77_sequence {
+    uint32_t run_length;
+    // 0 for the last sequence of the block, which has no match
+    uint32_t match_length;
+    uint32_t distance;
+};
+
+struct lz77_model {
+    int level;
+    // in bytes, a power of 2
+    uint32_t window_size;
+
+    // the hash chains (see above). each holds a position plus 1, so that 0
+    // can mean that there is none. "previous_positions" is indexed by the
+    // position modulo the window size, since older positions can't be used
+    uint32_t hash_heads[1 << LZ77_MAXIMUM_HASH_BITS];
+    uint32_t *previous_positions;
+
+    // the block's sequences. there is room for at least
+    // "sequence_capacity" of them, and more is allocated when needed
+    struct lz77_sequence *sequences;
+    size_t number_of_sequences;
+    size_t sequence_capacity;
+
+    // the counts of the symbols of each alphabet, and each alphabet's prefix
+    // code. each codeword is in the lowest bits of its number (see
+    // assign_canonical_codewords())
+    uint64_t frequencies[LZ77_NUMBER_OF_ALPHABETS][256];
+    unsigned char code_lengths[LZ77_NUMBER_OF_ALPHABETS][256];
+    uint32_t codewords[LZ77_NUMBER_OF_ALPHABETS][256];
+    // how many bits the codewords and extra bits of the block take up
+    uint64_t number_of_codeword_bits;
+};
+
+// return whether the window size (in bytes) is a power of 2 from
+// LZ77_MINIMUM_WINDOW_SIZE to LZ77_MAXIMUM_WINDOW_SIZE KiB
+static inline bool is_lz77_window_size_valid(size_t window_size) {
+    return window_size >= LZ77_MINIMUM_WINDOW_SIZE * 1024
+        && window_size <= LZ77_MAXIMUM_WINDOW_SIZE * 1024
+        && (window_size & (window_size - 1)) == 0;
+}
+
+// return the symbol of the number (see above)
+static inline int get_lz77_number_symbol(uint32_t number) {
+    if (number < 16) {
+        return number;
+    }
+    int highest_bit = 31 - __builtin_clz(number);
+    return 16 + 4 * (highest_bit - 4) + ((number >> (highest_bit - 2)) & 3);
+}
+
+// return how many extra bits come after the symbol
+static inline int get_lz77_number_extra_bits(int symbol) {
+    return symbol < 16 ? 0 : (symbol - 16) / 4 + 2;
+}
+
+// return the smallest number that has the symbol, which the extra bits are
+// added to
+static inline uint32_t get_lz77_number_base(int symbol) {
+    if (symbol < 16) {
+        return symbol;
+    }
+    return (uint32_t)(4 + (symbol - 16) % 4)
+           << get_lz77_number_extra_bits(symbol);
+}
+
+// copy the "length" bytes that start "distance" bytes before "output" to
+// "output". when the distance is shorter than the length, the bytes overlap
+// the ones being made, which repeats them. "output_end" is where the memory
+// of the output ends, since copying 8 bytes at a time can write up to 7 bytes
+// past the match (which the bytes after it then replace)
+static inline void copy_lz77_match(
+    unsigned char *output,
+    uint32_t distance,
+    uint32_t length,
+    const unsigned char *output_end
+) {
+    const unsigned char *source = output - distance;
+    if (distance >= 8 && (size_t)(output_end - output) >= length + 7) {
+        // 8 bytes that start at least 8 bytes back are all there already, so
+        // each copy only reads bytes that earlier copies made
+        for (uint32_t i = 0; i < length; i += 8) {
+            memcpy(output + i, source + i, 8);
+        }
+    } else if (distance == 1) {
+        memset(output, *source, length);
+    } else {
+        for (uint32_t i = 0; i < length; i += 1) {
+            output[i] = source[i];
+        }
+    }
+}
+
+struct lz77_model *create_lz77_model(int level, uint32_t window_size);
+int create_lz77_sequences(
+    struct lz77_model *model,
+    const unsigned char *block,
+    size_t block_length,
+    int codeword_length_limit
+);
+int get_lz77_tables_size(const struct lz77_model *model);
+void write_lz77_tables(
+    struct bit_writer *writer,
+    const struct lz77_model *model
+);
+void write_lz77_data(
+    const unsigned char *block,
+    const struct lz77_model *model,
+    struct bit_writer *writer
+);
+void free_lz77_model(struct lz77_model *model);
+
+#endif
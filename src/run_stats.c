@@ -0,0 +1,188 @@
+// see run_stats.h for what is reported
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "run_stats.h"
+#include <inttypes.h>
+#include <math.h>
+#include <sys/resource.h>
+#include <time.h>
+
+const char *const run_phase_names[NUMBER_OF_RUN_PHASES] = {
+    "read",
+    "histogram",
+    "tree_build",
+    "code_assignment",
+    "encode",
+    "decode",
+    "write"
+};
+
+// return the time in seconds since some fixed point in the past, which only
+// means something when compared with another time from this function
+double get_time_in_seconds(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec + time.tv_nsec / 1e9;
+}
+
+// start the stats of a run that is starting now
+void init_run_stats(
+    struct run_stats *stats,
+    const char *program_name,
+    bool is_compressing
+) {
+    *stats = (struct run_stats){0};
+    stats->program_name = program_name;
+    stats->is_compressing = is_compressing;
+    stats->sample_interval = 1;
+    stats->start_time = get_time_in_seconds();
+
+    // the decoder's one step of decoding takes the place of the encoder's
+    // steps from counting the bytes to encoding them
+    for (int i = 0; i < NUMBER_OF_RUN_PHASES; i += 1) {
+        stats->is_phase_used[i] = is_compressing
+                                ? i != RUN_PHASE_DECODE
+                                : i == RUN_PHASE_READ
+                                  || i == RUN_PHASE_DECODE
+                                  || i == RUN_PHASE_WRITE;
+    }
+}
+
+void add_phase_time(
+    struct run_stats *stats,
+    enum run_phase phase,
+    double seconds
+) {
+    stats->phase_seconds[phase] += seconds;
+}
+
+// add the byte counts of 1 block and the lengths of the codewords that the
+// block's bytes were encoded with. the codewords of an adaptive block change
+// after every byte, so for one of those, "code_lengths" is NULL, and the caller
+// adds the codeword bits and the longest code length itself
+void add_block_to_run_stats(
+    struct run_stats *stats,
+    const uint64_t byte_frequencies[256],
+    const unsigned char code_lengths[256]
+) {
+    for (int i = 0; i < 256; i += 1) {
+        stats->byte_frequencies[i] += byte_frequencies[i];
+        if (code_lengths == NULL) {
+            continue;
+        }
+        stats->number_of_codeword_bits += byte_frequencies[i]
+                                        * code_lengths[i];
+        if (code_lengths[i] > stats->longest_code_length) {
+            stats->longest_code_length = code_lengths[i];
+        }
+    }
+}
+
+// return the shannon entropy of the bytes with the given counts, in bits per
+// byte
+double get_entropy(
+    const uint64_t byte_frequencies[256],
+    uint64_t number_of_bytes
+) {
+    double entropy = 0;
+    for (int i = 0; i < 256; i += 1) {
+        if (byte_frequencies[i] > 0) {
+            double probability = (double)byte_frequencies[i] / number_of_bytes;
+            entropy -= probability * log2(probability);
+        }
+    }
+    return entropy;
+}
+
+// print the stats as 1 line of JSON. the total time is from when the stats
+// were started until now
+void print_run_stats_json(
+    const struct run_stats *stats,
+    bool was_successful,
+    FILE *file
+) {
+    double total_seconds = get_time_in_seconds() - stats->start_time;
+
+    uint64_t number_of_uncompressed_bytes = 0;
+    for (int i = 0; i < 256; i += 1) {
+        number_of_uncompressed_bytes += stats->byte_frequencies[i];
+    }
+    uint64_t number_of_compressed_bytes = stats->is_compressing
+                                        ? stats->number_of_bytes_written
+                                        : stats->number_of_bytes_read;
+    double bits_per_symbol = 0;
+    double codeword_bits_per_symbol = 0;
+    if (number_of_uncompressed_bytes > 0) {
+        bits_per_symbol = 8.0 * number_of_compressed_bytes
+                        / number_of_uncompressed_bytes;
+        codeword_bits_per_symbol = (double)stats->number_of_codeword_bits
+                                 / number_of_uncompressed_bytes;
+    }
+
+    // on linux, the largest resident set size is in KiB
+    struct rusage usage;
+    uint64_t peak_memory = 0;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        peak_memory = (uint64_t)usage.ru_maxrss * 1024;
+    }
+
+    fprintf(
+        file,
+        "{\"program\": \"%s\", \"success\": %s, \"total_seconds\": %.6f,"
+        " \"phase_seconds\": {",
+        stats->program_name,
+        was_successful ? "true" : "false",
+        total_seconds
+    );
+    bool is_first_phase = true;
+    for (int i = 0; i < NUMBER_OF_RUN_PHASES; i += 1) {
+        if (stats->is_phase_used[i]) {
+            fprintf(
+                file,
+                "%s\"%s\": %.6f",
+                is_first_phase ? "" : ", ",
+                run_phase_names[i],
+                stats->phase_seconds[i]
+            );
+            is_first_phase = false;
+        }
+    }
+    fprintf(
+        file,
+        "}, \"bytes_in\": %" PRIu64 ", \"bytes_out\": %" PRIu64 ","
+        " \"bits_per_symbol\": %.4f, \"codeword_bits_per_symbol\": %.4f,"
+        " \"entropy_bits_per_symbol\": %.4f, \"max_code_length\": %d,",
+        stats->number_of_bytes_read,
+        stats->number_of_bytes_written,
+        bits_per_symbol,
+        codeword_bits_per_symbol,
+        get_entropy(stats->byte_frequencies, number_of_uncompressed_bytes),
+        stats->longest_code_length
+    );
+    if (stats->sample_interval > 1) {
+        double exact_codeword_bits_per_symbol = 0;
+        double sampling_loss_percent = 0;
+        if (number_of_uncompressed_bytes > 0) {
+            exact_codeword_bits_per_symbol =
+                (double)stats->number_of_exact_codeword_bits
+                / number_of_uncompressed_bytes;
+        }
+        if (stats->number_of_exact_codeword_bits > 0) {
+            sampling_loss_percent = 100.0 * (
+                (double)stats->number_of_codeword_bits
+                / stats->number_of_exact_codeword_bits - 1
+            );
+        }
+        fprintf(
+            file,
+            " \"sample_interval\": %d,"
+            " \"exact_codeword_bits_per_symbol\": %.4f,"
+            " \"sampling_loss_percent\": %.4f,",
+            stats->sample_interval,
+            exact_codeword_bits_per_symbol,
+            sampling_loss_percent
+        );
+    }
+    fprintf(file, " \"peak_memory_bytes\": %" PRIu64 "}\n", peak_memory);
+}
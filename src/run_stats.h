@@ -0,0 +1,84 @@
+// with --stats=json, the encoder and decoder report how their run went as 1
+// line of JSON on stderr, so that a program that runs them many times can
+// collect the numbers without having to read the printed data structures:
+// - how long each phase took, in seconds
+// - how many bytes were read and written
+// - how many bits each uncompressed byte took, both for the whole compressed
+//   data and for just the codewords, next to the shannon entropy of the bytes
+//   (the fewest bits per byte that any prefix code made from the same byte
+//   counts could get close to)
+// - the longest codeword of any block
+// - with --sample, how many bits per byte the codewords would have taken with
+//   prefix codes made from every byte instead of a sample, and how much
+//   bigger the codewords came out because of the sampling
+// - the most memory that the process used at once
+//
+// the time of each phase is added up over every block. the phases that happen
+// on the worker threads (histogram to decode) can happen at the same time, so
+// with several threads, they can add up to more than the total time
+
+#ifndef RUN_STATS_H
+#define RUN_STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+enum run_phase {
+    RUN_PHASE_READ,
+    RUN_PHASE_HISTOGRAM,
+    RUN_PHASE_TREE_BUILD,
+    RUN_PHASE_CODE_ASSIGNMENT,
+    RUN_PHASE_ENCODE,
+    RUN_PHASE_DECODE,
+    RUN_PHASE_WRITE,
+    NUMBER_OF_RUN_PHASES
+};
+
+struct run_stats {
+    const char *program_name;
+    bool is_compressing;
+    double start_time;
+    double phase_seconds[NUMBER_OF_RUN_PHASES];
+    // only the phases that the program has are reported, which is decided
+    // by whether it is compressing
+    bool is_phase_used[NUMBER_OF_RUN_PHASES];
+
+    uint64_t number_of_bytes_read;
+    uint64_t number_of_bytes_written;
+    // the counts of the uncompressed bytes of every block, and how many bits
+    // their codewords took
+    uint64_t byte_frequencies[256];
+    uint64_t number_of_codeword_bits;
+    int longest_code_length;
+    // 1 unless the blocks' prefix codes were made from samples of their bytes
+    // (see histogram.h), in which case the bits that their codewords would
+    // have taken with prefix codes made from every byte are also reported
+    int sample_interval;
+    uint64_t number_of_exact_codeword_bits;
+};
+
+double get_time_in_seconds(void);
+
+void init_run_stats(
+    struct run_stats *stats,
+    const char *program_name,
+    bool is_compressing
+);
+void add_phase_time(
+    struct run_stats *stats,
+    enum run_phase phase,
+    double seconds
+);
+void add_block_to_run_stats(
+    struct run_stats *stats,
+    const uint64_t byte_frequencies[256],
+    const unsigned char code_lengths[256]
+);
+void print_run_stats_json(
+    const struct run_stats *stats,
+    bool was_successful,
+    FILE *file
+);
+
+#endif
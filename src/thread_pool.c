@@ -0,0 +1,238 @@
+// see thread_pool.h for an explanation of what the thread pool is and how it is
+// used
+
+#include "thread_pool.h"
+#include <stdlib.h>
+
+// which worker of its pool the current thread is, or -1 if it isn't a worker
+static _Thread_local int current_worker_number = -1;
+
+// the pool that the current thread is a worker of, or NULL
+static _Thread_local struct thread_pool *current_pool = NULL;
+
+struct worker_argument {
+    struct thread_pool *pool;
+    int worker_number;
+};
+
+// add the job to the back of the queue
+void push_job(struct worker_queue *queue, struct job *job) {
+    pthread_mutex_lock(&queue->mutex);
+    job->next_in_queue = NULL;
+    job->previous_in_queue = queue->last_job;
+    if (queue->last_job == NULL) {
+        queue->first_job = job;
+    } else {
+        queue->last_job->next_in_queue = job;
+    }
+    queue->last_job = job;
+    pthread_mutex_unlock(&queue->mutex);
+}
+
+// take the job from the front of the queue (if "from_front" is true) or from
+// the back, or return NULL if the queue is empty
+struct job *pop_job(struct worker_queue *queue, bool from_front) {
+    pthread_mutex_lock(&queue->mutex);
+    struct job *job = from_front ? queue->first_job : queue->last_job;
+    if (job != NULL) {
+        if (job->previous_in_queue == NULL) {
+            queue->first_job = job->next_in_queue;
+        } else {
+            job->previous_in_queue->next_in_queue = job->next_in_queue;
+        }
+        if (job->next_in_queue == NULL) {
+            queue->last_job = job->previous_in_queue;
+        } else {
+            job->next_in_queue->previous_in_queue = job->previous_in_queue;
+        }
+    }
+    pthread_mutex_unlock(&queue->mutex);
+    return job;
+}
+
+// take the next job for the worker: the oldest one in its own queue, or else
+// the newest one in another worker's queue. returns NULL if every queue is
+// empty
+struct job *take_job(struct thread_pool *pool, int worker_number) {
+    struct job *job = pop_job(&pool->queues[worker_number], true);
+    // the other queues are tried starting with the next worker's, so that the
+    // workers don't all steal from the same one
+    for (int i = 1; job == NULL && i < pool->number_of_threads; i += 1) {
+        int victim = (worker_number + i) % pool->number_of_threads;
+        job = pop_job(&pool->queues[victim], false);
+    }
+    if (job != NULL) {
+        atomic_fetch_sub(&pool->number_of_queued_jobs, 1);
+    }
+    return job;
+}
+
+// what each worker thread runs: take the next job and run it, over and over,
+// until the pool is shutting down and every queue is empty
+void *run_worker(void *argument) {
+    struct worker_argument *worker_argument = argument;
+    struct thread_pool *pool = worker_argument->pool;
+    int worker_number = worker_argument->worker_number;
+    free(worker_argument);
+    current_pool = pool;
+    current_worker_number = worker_number;
+
+    while (true) {
+        struct job *job = take_job(pool, worker_number);
+        if (job != NULL) {
+            job->function(job->argument);
+
+            pthread_mutex_lock(&pool->mutex);
+            job->is_done = true;
+            pthread_cond_broadcast(&pool->job_was_done);
+            pthread_mutex_unlock(&pool->mutex);
+            continue;
+        }
+
+        // sleep until a job is queued. a job that was queued since the queues
+        // were looked at is still counted, so it isn't missed
+        pthread_mutex_lock(&pool->mutex);
+        atomic_fetch_add(&pool->number_of_sleeping_workers, 1);
+        while (
+            atomic_load(&pool->number_of_queued_jobs) == 0
+            && !pool->is_shutting_down
+        ) {
+            pthread_cond_wait(&pool->job_was_queued, &pool->mutex);
+        }
+        atomic_fetch_sub(&pool->number_of_sleeping_workers, 1);
+        bool should_stop = pool->is_shutting_down
+                        && atomic_load(&pool->number_of_queued_jobs) == 0;
+        pthread_mutex_unlock(&pool->mutex);
+        if (should_stop) {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+// let the workers finish every job that is still queued, then stop the first
+// "number_of_started_threads" of them (which are the only ones that exist if
+// starting the others failed) and free everything
+void stop_thread_pool(struct thread_pool *pool, int number_of_started_threads) {
+    pthread_mutex_lock(&pool->mutex);
+    pool->is_shutting_down = true;
+    pthread_cond_broadcast(&pool->job_was_queued);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (int i = 0; i < number_of_started_threads; i += 1) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    free(pool->threads);
+    for (int i = 0; i < pool->number_of_threads; i += 1) {
+        pthread_mutex_destroy(&pool->queues[i].mutex);
+    }
+    free(pool->queues);
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->job_was_queued);
+    pthread_cond_destroy(&pool->job_was_done);
+}
+
+// start the given number of worker threads. returns whether it was successful
+int create_thread_pool(struct thread_pool *pool, int number_of_threads) {
+    pool->threads = malloc(number_of_threads * sizeof (*pool->threads));
+    pool->queues = malloc(number_of_threads * sizeof (*pool->queues));
+    if (pool->threads == NULL || pool->queues == NULL) {
+        free(pool->threads);
+        free(pool->queues);
+        return 1;
+    }
+    for (int i = 0; i < number_of_threads; i += 1) {
+        pthread_mutex_init(&pool->queues[i].mutex, NULL);
+        pool->queues[i].first_job = NULL;
+        pool->queues[i].last_job = NULL;
+    }
+    // the workers look at every queue, so they must all exist before any of
+    // the workers start
+    pool->number_of_threads = number_of_threads;
+    atomic_init(&pool->next_queue, 0);
+    atomic_init(&pool->number_of_queued_jobs, 0);
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->job_was_queued, NULL);
+    pthread_cond_init(&pool->job_was_done, NULL);
+    atomic_init(&pool->number_of_sleeping_workers, 0);
+    pool->is_shutting_down = false;
+
+    int number_of_started_threads = 0;
+    for (int i = 0; i < number_of_threads; i += 1) {
+        struct worker_argument *worker_argument = malloc(
+            sizeof (*worker_argument)
+        );
+        if (worker_argument == NULL) {
+            break;
+        }
+        worker_argument->pool = pool;
+        worker_argument->worker_number = i;
+        if (pthread_create(
+            &pool->threads[i],
+            NULL,
+            &run_worker,
+            worker_argument
+        )) {
+            free(worker_argument);
+            break;
+        }
+        number_of_started_threads += 1;
+    }
+    if (number_of_started_threads < number_of_threads) {
+        stop_thread_pool(pool, number_of_started_threads);
+        return 1;
+    }
+    return 0;
+}
+
+// add the job to a queue, or run it right away if the pool is NULL
+void thread_pool_submit(struct thread_pool *pool, struct job *job) {
+    job->is_done = false;
+
+    if (pool == NULL) {
+        job->function(job->argument);
+        job->is_done = true;
+        return;
+    }
+
+    int queue_number = current_worker_number;
+    if (current_pool != pool) {
+        queue_number = atomic_fetch_add(&pool->next_queue, 1)
+                     % pool->number_of_threads;
+    }
+    push_job(&pool->queues[queue_number], job);
+    atomic_fetch_add(&pool->number_of_queued_jobs, 1);
+
+    // the mutex only needs to be locked if a worker might be sleeping
+    if (atomic_load(&pool->number_of_sleeping_workers) > 0) {
+        pthread_mutex_lock(&pool->mutex);
+        pthread_cond_signal(&pool->job_was_queued);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+}
+
+// wait until the submitted job has been run
+void thread_pool_wait_for(struct thread_pool *pool, struct job *job) {
+    if (pool == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    while (!job->is_done) {
+        pthread_cond_wait(&pool->job_was_done, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+// return which worker of its pool the current thread is (from 0 up to the
+// number of threads), or -1 if it isn't a worker. this lets a job use memory
+// that belongs to its worker, since a worker only runs 1 job at a time
+int thread_pool_get_worker_number(void) {
+    return current_worker_number;
+}
+
+// let the workers finish every job that is still queued, then stop them
+void free_thread_pool(struct thread_pool *pool) {
+    stop_thread_pool(pool, pool->number_of_threads);
+}
@@ -0,0 +1,70 @@
+// a thread pool is a fixed number of worker threads that take jobs off of
+// queues and run them. the caller submits jobs and later waits for them to be
+// done, so it can do other things (like reading the next input) while the
+// workers are busy
+//
+// if the pool is NULL, submitting a job just runs it right away on the calling
+// thread. this way, callers can use the same code whether or not they were
+// asked to use more than 1 thread
+//
+// each worker has a queue of its own, so that the workers don't all have to
+// take turns with 1 shared queue when there are a lot of small jobs (like in
+// batch mode, see batch.h, where each small file is 1 job). jobs that are
+// submitted from outside of the pool are dealt out to the queues in turn, and
+// a job that is submitted by a worker (while it runs another job) goes on
+// that worker's own queue. a worker takes the oldest job from its own queue,
+// and when its queue is empty, it steals the newest job from another worker's
+// queue. so a worker that got stuck with a long job (like a huge file) doesn't
+// hold up the jobs behind it, since the other workers take them instead
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+struct job {
+    void (*function)(void *argument);
+    void *argument;
+
+    // the fields below are managed by the thread pool
+    bool is_done;
+    struct job *previous_in_queue;
+    struct job *next_in_queue;
+};
+
+struct worker_queue {
+    // protects the jobs in the queue
+    pthread_mutex_t mutex;
+    // the owner takes jobs from the front, and the other workers steal them
+    // from the back
+    struct job *first_job;
+    struct job *last_job;
+};
+
+struct thread_pool {
+    pthread_t *threads;
+    int number_of_threads;
+    struct worker_queue *queues;
+    // the queue that the next job from outside of the pool goes on
+    atomic_uint next_queue;
+    // the total number of jobs in all of the queues, so that a worker knows
+    // when there is nothing to steal without locking every queue
+    atomic_int number_of_queued_jobs;
+
+    // protects everything below it (and every job's "is_done")
+    pthread_mutex_t mutex;
+    pthread_cond_t job_was_queued;
+    pthread_cond_t job_was_done;
+    atomic_int number_of_sleeping_workers;
+    bool is_shutting_down;
+};
+
+int create_thread_pool(struct thread_pool *pool, int number_of_threads);
+void thread_pool_submit(struct thread_pool *pool, struct job *job);
+void thread_pool_wait_for(struct thread_pool *pool, struct job *job);
+int thread_pool_get_worker_number(void);
+void free_thread_pool(struct thread_pool *pool);
+
+#endif
@@ -0,0 +1,701 @@
+// see transparent_huff.h for an explanation of what the library is for
+
+#include "transparent_huff.h"
+#include "adaptive_huffman.h"
+#include "block_decoder.h"
+#include "block_encoder.h"
+#include "block_format.h"
+#include "checksum.h"
+#include "context_model.h"
+#include "dictionary.h"
+#include "histogram.h"
+#include "legacy_decoder.h"
+#include "lz77.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct compression_context {
+    struct block_encoder encoder;
+    struct adaptive_huffman_tree adaptive_tree;
+    // a block is compressed here instead of straight into the output when the
+    // output might not have room for it
+    unsigned char *scratch;
+    size_t scratch_capacity;
+};
+
+struct decompression_context {
+    struct block_decoder decoder;
+    struct adaptive_huffman_tree adaptive_tree;
+    struct legacy_decoder legacy_decoder;
+    // NULL until set_decompression_dictionary() is called
+    const struct dictionary *dictionary;
+};
+
+// set the options to the ones that the encoder binary uses by default
+void init_compression_options(struct compression_options *options) {
+    options->codeword_length_limit = DEFAULT_CODEWORD_LENGTH_LIMIT;
+    options->block_size = 1024 * 1024;
+    options->number_of_streams = 1;
+    options->is_adaptive = false;
+    options->is_order_1 = false;
+    options->lz77_level = 0;
+    options->lz77_window_size = LZ77_DEFAULT_WINDOW_SIZE * 1024;
+    options->dictionary = NULL;
+    options->has_checksums = false;
+    options->sample_interval = 1;
+}
+
+// read a dictionary file's bytes (see dictionary.h) and set "dictionary" to a
+// new dictionary made from them, which must be freed with free_dictionary().
+// returns whether it was successful:
+// 1. the bytes aren't a dictionary, or the dictionary is damaged
+// 2. memory couldn't be allocated
+int load_dictionary(
+    const unsigned char *bytes,
+    size_t number_of_bytes,
+    struct dictionary **dictionary
+) {
+    *dictionary = malloc(sizeof (**dictionary));
+    if (*dictionary == NULL) {
+        return 2;
+    }
+    int reading_exit_status = read_dictionary(
+        bytes,
+        number_of_bytes,
+        *dictionary
+    );
+    if (reading_exit_status != 0) {
+        free_dictionary(*dictionary);
+        *dictionary = NULL;
+    }
+    return reading_exit_status;
+}
+
+void free_dictionary(struct dictionary *dictionary) {
+    if (dictionary != NULL) {
+        free_dictionary_tables(dictionary);
+    }
+    free(dictionary);
+}
+
+// return the number of bytes that each block (except maybe the last) gets
+size_t get_block_size(const struct compression_options *options) {
+    if (
+        options->is_adaptive
+        && options->block_size > MAXIMUM_ADAPTIVE_BLOCK_LENGTH
+    ) {
+        return MAXIMUM_ADAPTIVE_BLOCK_LENGTH;
+    }
+    return options->block_size;
+}
+
+// return the most bytes that a block of the given length can take up once it
+// is compressed with the given options, including its header and checksum
+size_t get_block_bound(
+    size_t block_length,
+    const struct compression_options *options
+) {
+    size_t bound = BLOCK_HEADER_SIZE + COMPRESSED_BLOCK_BOUND(block_length);
+    if (options->is_adaptive) {
+        bound = BLOCK_HEADER_SIZE + ADAPTIVE_BLOCK_BOUND(block_length);
+    } else if (options->dictionary != NULL) {
+        bound = BLOCK_HEADER_SIZE + DICTIONARY_BLOCK_BOUND(block_length);
+    }
+    if (options->has_checksums) {
+        bound += BLOCK_CHECKSUM_SIZE;
+    }
+    return bound;
+}
+
+// return the number of bytes in the file trailer (parts 4 to 6b, see
+// block_format.h)
+size_t get_file_trailer_size(bool has_checksums) {
+    return FILE_TRAILER_SIZE + (has_checksums ? FILE_CHECKSUM_SIZE : 0);
+}
+
+// return the number of bytes in the file header (parts 1 to 2b, see
+// block_format.h) for the given options
+size_t get_file_header_size(const struct compression_options *options) {
+    if (options->dictionary != NULL) {
+        return FILE_HEADER_SIZE + DICTIONARY_ID_SIZE;
+    }
+    return FILE_HEADER_SIZE;
+}
+
+// return the most bytes that compressing "number_of_bytes" bytes with the given
+// options can take up, so that the caller can make the output big enough
+size_t get_compressed_size_bound(
+    size_t number_of_bytes,
+    const struct compression_options *options
+) {
+    size_t block_size = get_block_size(options);
+    size_t number_of_full_blocks = number_of_bytes / block_size;
+    size_t number_of_bytes_left = number_of_bytes % block_size;
+    size_t bound = get_file_header_size(options)
+                 + get_file_trailer_size(options->has_checksums)
+                 + number_of_full_blocks * get_block_bound(block_size, options);
+    if (number_of_bytes_left > 0) {
+        bound += get_block_bound(number_of_bytes_left, options);
+    }
+    return bound;
+}
+
+// returns NULL if the memory couldn't be allocated
+struct compression_context *create_compression_context(void) {
+    struct compression_context *context = malloc(sizeof (*context));
+    if (context == NULL) {
+        return NULL;
+    }
+    context->scratch = NULL;
+    context->scratch_capacity = 0;
+    context->encoder.context_model = NULL;
+    context->encoder.lz77_model = NULL;
+    context->encoder.sample_interval = 1;
+    return context;
+}
+
+// compress the input into the output, which has room for "output_capacity"
+// bytes, and set "output_length" to the number of bytes used. returns whether
+// it was successful:
+// 1. the options are invalid
+// 2. memory couldn't be allocated
+// 3. the output doesn't have enough room (get_compressed_size_bound() is
+//    always enough)
+int compress_buffer(
+    struct compression_context *context,
+    const struct compression_options *options,
+    const unsigned char *input,
+    size_t input_length,
+    unsigned char *output,
+    size_t output_capacity,
+    size_t *output_length
+) {
+    int block_type = get_block_type(options->number_of_streams);
+    if (
+        options->block_size < 1
+        || options->block_size > MAXIMUM_BLOCK_LENGTH
+        || (!options->is_adaptive && (
+            options->codeword_length_limit < MINIMUM_CODEWORD_LENGTH_LIMIT
+            || options->codeword_length_limit > MAXIMUM_CODEWORD_LENGTH
+            || block_type == -1
+            || (options->is_order_1 && block_type != BLOCK_TYPE_1_STREAM)
+            || (options->lz77_level != 0 && (
+                options->lz77_level < LZ77_MINIMUM_LEVEL
+                || options->lz77_level > LZ77_MAXIMUM_LEVEL
+                || !is_lz77_window_size_valid(options->lz77_window_size)
+                || options->is_order_1
+                || block_type != BLOCK_TYPE_1_STREAM
+            ))
+        ))
+        || (options->dictionary != NULL && (
+            options->is_adaptive
+            || options->is_order_1
+            || options->lz77_level != 0
+            || block_type != BLOCK_TYPE_1_STREAM
+        ))
+        || options->sample_interval < 1
+        || options->sample_interval > MAXIMUM_SAMPLE_INTERVAL
+        || (options->sample_interval > 1 && (
+            options->is_adaptive
+            || options->is_order_1
+            || options->lz77_level != 0
+            || options->dictionary != NULL
+        ))
+    ) {
+        return 1;
+    }
+    context->encoder.sample_interval = options->sample_interval;
+    // the context model is only allocated the first time it is needed, and
+    // then kept with the rest of the context
+    if (options->is_order_1 && !options->is_adaptive) {
+        if (context->encoder.context_model == NULL) {
+            context->encoder.context_model = malloc(
+                sizeof (*context->encoder.context_model)
+            );
+            if (context->encoder.context_model == NULL) {
+                return 2;
+            }
+        }
+        block_type = BLOCK_TYPE_ORDER_1;
+    }
+    // so is the LZ77 model, which is made again if the level or window
+    // changed since
+    struct lz77_model *lz77_model = context->encoder.lz77_model;
+    if (options->lz77_level != 0 && !options->is_adaptive) {
+        if (
+            lz77_model == NULL
+            || lz77_model->level != options->lz77_level
+            || lz77_model->window_size != options->lz77_window_size
+        ) {
+            free_lz77_model(lz77_model);
+            context->encoder.lz77_model = create_lz77_model(
+                options->lz77_level,
+                options->lz77_window_size
+            );
+            if (context->encoder.lz77_model == NULL) {
+                return 2;
+            }
+        }
+        block_type = BLOCK_TYPE_LZ77;
+    }
+
+    size_t position = get_file_header_size(options);
+    if (output_capacity < position) {
+        return 3;
+    }
+    write_big_endian_32_bits(output, FILE_MAGIC_NUMBER);
+    output[4] = options->is_adaptive ? FORMAT_VERSION_ADAPTIVE : FORMAT_VERSION;
+    if (options->dictionary != NULL) {
+        output[4] = FORMAT_VERSION_DICTIONARY;
+        write_big_endian_32_bits(
+            output + FILE_HEADER_SIZE,
+            options->dictionary->id
+        );
+    }
+    if (options->has_checksums) {
+        output[4] |= FORMAT_FLAG_CHECKSUMS;
+    }
+    if (options->is_adaptive) {
+        init_adaptive_huffman_tree(&context->adaptive_tree);
+    }
+
+    size_t block_size = get_block_size(options);
+    uint64_t number_of_blocks = 0;
+    uint32_t checksum = 0;
+    size_t block_start = 0;
+    while (block_start < input_length) {
+        size_t block_length = input_length - block_start;
+        if (block_length > block_size) {
+            block_length = block_size;
+        }
+
+        // the compressed block might still fit even if the output doesn't
+        // have room for the biggest it could be, so try it on the side first
+        size_t bound = get_block_bound(block_length, options);
+        unsigned char *compressed_block = output + position;
+        if (output_capacity - position < bound) {
+            if (context->scratch_capacity < bound) {
+                free(context->scratch);
+                context->scratch = malloc(bound);
+                context->scratch_capacity = bound;
+                if (context->scratch == NULL) {
+                    context->scratch_capacity = 0;
+                    return 2;
+                }
+            }
+            compressed_block = context->scratch;
+        }
+
+        size_t compressed_block_length;
+        if (options->is_adaptive) {
+            encode_adaptive_block(
+                &context->adaptive_tree,
+                input + block_start,
+                block_length,
+                compressed_block,
+                &compressed_block_length
+            );
+        } else if (options->dictionary != NULL) {
+            encode_dictionary_block(
+                options->dictionary,
+                input + block_start,
+                block_length,
+                compressed_block,
+                &compressed_block_length
+            );
+        } else if (encode_block(
+            &context->encoder,
+            input + block_start,
+            block_length,
+            options->codeword_length_limit,
+            block_type,
+            compressed_block,
+            &compressed_block_length,
+            NULL
+        )) {
+            return 2;
+        }
+        if (options->has_checksums) {
+            uint32_t block_checksum = add_block_checksum(
+                input + block_start,
+                block_length,
+                compressed_block,
+                &compressed_block_length
+            );
+            checksum = combine_crc32c(checksum, block_checksum, block_length);
+        }
+        if (compressed_block == context->scratch) {
+            if (compressed_block_length > output_capacity - position) {
+                return 3;
+            }
+            memcpy(
+                output + position,
+                compressed_block,
+                compressed_block_length
+            );
+        }
+
+        position += compressed_block_length;
+        block_start += block_length;
+        number_of_blocks += 1;
+    }
+
+    size_t trailer_size = get_file_trailer_size(options->has_checksums);
+    if (output_capacity - position < trailer_size) {
+        return 3;
+    }
+    write_big_endian_32_bits(output + position, 0);
+    write_big_endian_64_bits(output + position + 4, input_length);
+    write_big_endian_64_bits(output + position + 12, number_of_blocks);
+    if (options->has_checksums) {
+        write_big_endian_32_bits(
+            output + position + FILE_TRAILER_SIZE,
+            checksum
+        );
+    }
+    *output_length = position + trailer_size;
+    return 0;
+}
+
+void free_compression_context(struct compression_context *context) {
+    if (context != NULL) {
+        free(context->scratch);
+        free(context->encoder.context_model);
+        free_lz77_model(context->encoder.lz77_model);
+    }
+    free(context);
+}
+
+// returns NULL if the memory couldn't be allocated
+struct decompression_context *create_decompression_context(void) {
+    struct decompression_context *context = malloc(sizeof (*context));
+    if (context == NULL) {
+        return NULL;
+    }
+    init_block_decoder(&context->decoder);
+    context->dictionary = NULL;
+    return context;
+}
+
+// set the dictionary that the context decompresses files that were compressed
+// with a dictionary with, or NULL for none. the dictionary must stay around
+// for as long as the context uses it
+void set_decompression_dictionary(
+    struct decompression_context *context,
+    const struct dictionary *dictionary
+) {
+    context->dictionary = dictionary;
+}
+
+// set "decompressed_size" to the number of bytes that the compressed input
+// decompresses to, which is stored at its end (before the seek index, if it has
+// one), so that the caller can make the output big enough. a legacy file (see
+// legacy_decoder.h) stores it at its start instead. returns whether it was
+// successful, with the same numbers as decompress_buffer()
+int get_decompressed_size(
+    const unsigned char *input,
+    size_t input_length,
+    uint64_t *decompressed_size
+) {
+    if (input_length < 4) {
+        return 1;
+    }
+    // every codeword of a legacy file is at least 1 bit, so a size that needs
+    // more bits than the file has can't be right
+    if (get_big_endian_32_bits(input) != FILE_MAGIC_NUMBER) {
+        *decompressed_size = get_big_endian_32_bits(input);
+        return *decompressed_size > 8 * (uint64_t)(input_length - 4) ? 4 : 0;
+    }
+    if (input_length < FILE_HEADER_SIZE + FILE_TRAILER_SIZE) {
+        return 1;
+    }
+    if (!is_format_version_known(input[4] & ~FORMAT_FLAGS)) {
+        return 7;
+    }
+    size_t trailer_size = get_file_trailer_size(
+        input[4] & FORMAT_FLAG_CHECKSUMS
+    );
+
+    // the trailer comes right before the seek index, if there is one
+    size_t trailer_end = input_length;
+    uint64_t number_of_entries;
+    if (find_seek_index(input, input_length, &number_of_entries)) {
+        trailer_end -= SEEK_INDEX_FOOTER_SIZE
+                     + number_of_entries * SEEK_INDEX_ENTRY_SIZE;
+    }
+    if (trailer_end < FILE_HEADER_SIZE + trailer_size) {
+        return 1;
+    }
+    const unsigned char *trailer = input + trailer_end - trailer_size;
+    if (get_big_endian_32_bits(trailer) != 0) {
+        return 8;
+    }
+    *decompressed_size = get_big_endian_64_bits(trailer + 4);
+    return 0;
+}
+
+// decompress_buffer() for a legacy file (see legacy_decoder.h)
+int decompress_legacy_buffer(
+    struct decompression_context *context,
+    const unsigned char *input,
+    size_t input_length,
+    unsigned char *output,
+    size_t output_capacity,
+    size_t *output_length
+) {
+    uint32_t number_of_bytes = get_big_endian_32_bits(input);
+    if (output_capacity < number_of_bytes) {
+        return 9;
+    }
+    init_legacy_decoder(&context->legacy_decoder, number_of_bytes);
+    size_t input_used;
+    int decoding_exit_status = decode_legacy_data(
+        &context->legacy_decoder,
+        input + 4,
+        input_length - 4,
+        &input_used,
+        output,
+        output_capacity,
+        output_length
+    );
+    if (decoding_exit_status != 0) {
+        return decoding_exit_status;
+    }
+    return get_legacy_decoding_status(&context->legacy_decoder);
+}
+
+// decompress the input into the output, which has room for "output_capacity"
+// bytes, and set "output_length" to the number of bytes used. returns whether
+// it was successful, with the numbers that get_decompression_error_message()
+// explains
+int decompress_buffer(
+    struct decompression_context *context,
+    const unsigned char *input,
+    size_t input_length,
+    unsigned char *output,
+    size_t output_capacity,
+    size_t *output_length
+) {
+    if (input_length < 4) {
+        return 1;
+    }
+    if (get_big_endian_32_bits(input) != FILE_MAGIC_NUMBER) {
+        return decompress_legacy_buffer(
+            context,
+            input,
+            input_length,
+            output,
+            output_capacity,
+            output_length
+        );
+    }
+    if (input_length < FILE_HEADER_SIZE) {
+        return 1;
+    }
+    int version = input[4] & ~FORMAT_FLAGS;
+    bool has_checksums = input[4] & FORMAT_FLAG_CHECKSUMS;
+    if (!is_format_version_known(version)) {
+        return 7;
+    }
+    size_t position = FILE_HEADER_SIZE;
+    bool is_adaptive = version == FORMAT_VERSION_ADAPTIVE;
+    // a file with a dictionary can only be decompressed with that same
+    // dictionary
+    bool has_dictionary = version == FORMAT_VERSION_DICTIONARY;
+    if (has_dictionary) {
+        if (input_length - position < DICTIONARY_ID_SIZE) {
+            return 1;
+        }
+        if (
+            context->dictionary == NULL
+            || context->dictionary->id
+               != get_big_endian_32_bits(input + position)
+        ) {
+            return 11;
+        }
+        position += DICTIONARY_ID_SIZE;
+    }
+    if (is_adaptive) {
+        init_adaptive_huffman_tree(&context->adaptive_tree);
+    }
+
+    uint64_t number_of_blocks = 0;
+    uint32_t checksum = 0;
+    size_t output_position = 0;
+    while (true) {
+        if (input_length - position < 4) {
+            return 1;
+        }
+        uint32_t block_length = get_big_endian_32_bits(input + position);
+        position += 4;
+        if (block_length == 0) {
+            break;
+        }
+        if (input_length - position < 4) {
+            return 1;
+        }
+        uint32_t compressed_block_length = get_big_endian_32_bits(
+            input + position
+        );
+        position += 4;
+        // the block's checksum comes after the rest of it
+        if (has_checksums) {
+            if (compressed_block_length < BLOCK_CHECKSUM_SIZE) {
+                return 1;
+            }
+            compressed_block_length -= BLOCK_CHECKSUM_SIZE;
+        }
+        if (!are_block_sizes_valid_in_version(
+            version,
+            block_length,
+            compressed_block_length
+        )) {
+            return 1;
+        }
+        if (
+            input_length - position < compressed_block_length
+            || (has_checksums
+                && input_length - position - compressed_block_length
+                   < BLOCK_CHECKSUM_SIZE)
+        ) {
+            return 4;
+        }
+        if (output_capacity - output_position < block_length) {
+            return 9;
+        }
+
+        int decoding_exit_status;
+        if (is_adaptive) {
+            decoding_exit_status = decode_adaptive_block(
+                &context->adaptive_tree,
+                input + position,
+                compressed_block_length,
+                output + output_position,
+                block_length
+            );
+        } else if (has_dictionary) {
+            decoding_exit_status = decode_dictionary_block(
+                context->dictionary,
+                false,
+                input + position,
+                compressed_block_length,
+                output + output_position,
+                block_length
+            );
+        } else {
+            decoding_exit_status = decode_block(
+                &context->decoder,
+                false,
+                input + position,
+                compressed_block_length,
+                output + output_position,
+                block_length
+            );
+        }
+        if (decoding_exit_status != 0) {
+            return decoding_exit_status;
+        }
+        position += compressed_block_length;
+        if (has_checksums) {
+            uint32_t block_checksum = update_crc32c(
+                0,
+                output + output_position,
+                block_length
+            );
+            if (block_checksum != get_big_endian_32_bits(input + position)) {
+                return 14;
+            }
+            checksum = combine_crc32c(checksum, block_checksum, block_length);
+            position += BLOCK_CHECKSUM_SIZE;
+        }
+        output_position += block_length;
+        number_of_blocks += 1;
+    }
+
+    // make sure that no blocks went missing
+    if (input_length - position < get_file_trailer_size(has_checksums) - 4) {
+        return 8;
+    }
+    const unsigned char *totals = input + position;
+    uint64_t total_number_of_bytes =
+        (uint64_t)get_big_endian_32_bits(totals) << 32
+        | get_big_endian_32_bits(totals + 4);
+    uint64_t total_number_of_blocks =
+        (uint64_t)get_big_endian_32_bits(totals + 8) << 32
+        | get_big_endian_32_bits(totals + 12);
+    if (
+        total_number_of_bytes != output_position
+        || total_number_of_blocks != number_of_blocks
+    ) {
+        return 8;
+    }
+    if (has_checksums && get_big_endian_32_bits(totals + 16) != checksum) {
+        return 15;
+    }
+
+    *output_length = output_position;
+    return 0;
+}
+
+void free_decompression_context(struct decompression_context *context) {
+    if (context != NULL) {
+        free_block_decoder(&context->decoder);
+    }
+    free(context);
+}
+
+// return a description of what went wrong for a number that
+// decompress_buffer() (or the decoder binary) returned
+const char *get_decompression_error_message(int status) {
+    if (status == 1) {
+        return "Unable to read the number of bytes to decode.\n"
+               "The compressed file is invalid.";
+    } else if (status == 2) {
+        return "Unable to read the lengths of a proper prefix code.\n"
+               "The compressed file is invalid.";
+    } else if (status == 3) {
+        return "Unable to allocate memory for decoding.";
+    } else if (status == 4) {
+        return "There was not enough encoded data to decode the specified"
+               " number of bytes.\nThe compressed file is invalid.";
+    } else if (status == 5) {
+        return "There was not enough encoded data to decode the last"
+               " codeword.\nThe compressed file is invalid.";
+    } else if (status == 6) {
+        return "A block has an unknown type.\n"
+               "The compressed file is invalid.";
+    } else if (status == 7) {
+        return "The compressed file has a format version that this decoder"
+               " doesn't know.";
+    } else if (status == 8) {
+        return "The totals at the end of the compressed file are missing or"
+               " don't match the decoded data.\n"
+               "The compressed file is invalid.";
+    } else if (status == 9) {
+        return "The output is too small for the decompressed data.";
+    } else if (status == 10) {
+        return "A byte that had already appeared was sent as a new byte.\n"
+               "The compressed file is invalid.";
+    } else if (status == 11) {
+        return "The compressed file was made with a dictionary, and it wasn't"
+               " given that dictionary.";
+    } else if (status == 12) {
+        return "The seek index at the end of the compressed file doesn't"
+               " match the blocks.\nThe compressed file is invalid.";
+    } else if (status == 13) {
+        return "A block has a run of literals or a match that doesn't fit in"
+               " the block.\nThe compressed file is invalid.";
+    } else if (status == 14) {
+        return "A block's checksum doesn't match the bytes that it decoded"
+               " to.\nThe compressed file is damaged.";
+    } else if (status == 15) {
+        return "The checksum at the end of the compressed file doesn't match"
+               " the decoded data.\nThe compressed file is damaged.";
+    } else if (status == 16) {
+        return "Unable to read a proper binary Huffman tree.\n"
+               "The compressed file is invalid.";
+    } else {
+        return "Unknown problem.";
+    }
+}
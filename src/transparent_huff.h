@@ -0,0 +1,119 @@
+// libtransparenthuff: the compressor and decompressor as a library, for
+// programs that want to compress data that is already in memory without going
+// through the encoder and decoder binaries
+//
+// the whole input goes in 1 call and the whole output comes out of it, in the
+// same file format that the binaries use (see block_format.h), so the binaries
+// can decompress what the library compresses and the other way around
+//
+// a context holds the memory that compressing or decompressing needs (like the
+// decode table), which is kept from one call to the next. compressing many
+// small buffers with the same context doesn't allocate anything after the
+// first call. a context must only be used by 1 thread at a time, but each
+// thread can have its own
+//
+// a dictionary (see dictionary.h) made by "./encoder train" can be loaded with
+// load_dictionary() and then used by any number of contexts and threads at
+// once, since it is only read. small buffers that are compressed with one
+// don't have to store their own prefix code
+//
+// every function that can fail returns 0 on success and a number that says
+// what went wrong on failure, like the rest of the code
+
+#ifndef TRANSPARENT_HUFF_H
+#define TRANSPARENT_HUFF_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct dictionary;
+
+struct compression_options {
+    // from 8 to 15 (see canonical_code.h)
+    int codeword_length_limit;
+    // from 1 byte to 64 MiB
+    size_t block_size;
+    // 1, 4, or 8 (see block_format.h)
+    int number_of_streams;
+    // whether to use adaptive huffman coding (see adaptive_huffman.h) instead
+    // of a prefix code for each block. the blocks are then at most 64 KiB,
+    // and the codeword length limit and number of streams aren't used
+    bool is_adaptive;
+    // whether to try an order-1 context model for each block (see
+    // context_model.h), which only gets used where it makes the block
+    // smaller. it needs 1 stream, and isn't used with is_adaptive
+    bool is_order_1;
+    // from 1 to 9 to try LZ77 matches for each block (see lz77.h), where a
+    // higher level looks harder for them, or 0 for none. they only get used
+    // where they make the block smaller. it needs 1 stream, can't be used with
+    // is_order_1, and isn't used with is_adaptive
+    int lz77_level;
+    // how far back an LZ77 match can reach, in bytes. a power of 2 from 1 KiB
+    // to 64 MiB
+    size_t lz77_window_size;
+    // the dictionary whose prefix code every block is compressed with, or
+    // NULL for each block to get its own. it needs 1 stream, and can't be
+    // used with is_adaptive, is_order_1, or lz77_level
+    const struct dictionary *dictionary;
+    // whether to store a checksum of each block and of all of the data (see
+    // checksum.h), which decompressing then checks
+    bool has_checksums;
+    // 1 to count every byte of each block for its prefix code, or from 2 to
+    // 1024 to only count 1 of every that many pieces of 4 KiB (see
+    // histogram.h), which is faster but makes the output a little bigger. it
+    // can't be used with is_adaptive, is_order_1, lz77_level, or dictionary,
+    // like --sample can't be used with their options in the encoder
+    int sample_interval;
+};
+
+struct compression_context;
+struct decompression_context;
+
+int load_dictionary(
+    const unsigned char *bytes,
+    size_t number_of_bytes,
+    struct dictionary **dictionary
+);
+void free_dictionary(struct dictionary *dictionary);
+
+void init_compression_options(struct compression_options *options);
+size_t get_compressed_size_bound(
+    size_t number_of_bytes,
+    const struct compression_options *options
+);
+
+struct compression_context *create_compression_context(void);
+int compress_buffer(
+    struct compression_context *context,
+    const struct compression_options *options,
+    const unsigned char *input,
+    size_t input_length,
+    unsigned char *output,
+    size_t output_capacity,
+    size_t *output_length
+);
+void free_compression_context(struct compression_context *context);
+
+struct decompression_context *create_decompression_context(void);
+void set_decompression_dictionary(
+    struct decompression_context *context,
+    const struct dictionary *dictionary
+);
+int get_decompressed_size(
+    const unsigned char *input,
+    size_t input_length,
+    uint64_t *decompressed_size
+);
+int decompress_buffer(
+    struct decompression_context *context,
+    const unsigned char *input,
+    size_t input_length,
+    unsigned char *output,
+    size_t output_capacity,
+    size_t *output_length
+);
+void free_decompression_context(struct decompression_context *context);
+const char *get_decompression_error_message(int status);
+
+#endif